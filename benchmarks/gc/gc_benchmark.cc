@@ -0,0 +1,259 @@
+#include <pocketknife/gc/gc.h>
+
+#include <benchmark/benchmark.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <mutex>
+#include <vector>
+
+static void *old_space_alloc(size_t size) {
+  return malloc(size);
+}
+
+static void old_space_free(void *ptr) {
+  free(ptr);
+}
+
+// Allocates a batch of rooted objects each iteration and runs enough cycles to promote them all.
+// With copy_on_promote set, the old space gets its own allocator, which forces every promotion to
+// copy the object (the behaviour before in-place promotion).
+static void BM_Promotion(benchmark::State &state, bool copy_on_promote) {
+  struct gc_config config = {
+      .debug = 0,
+      .alloc = malloc,
+      .free = free,
+      .young_max_cycles = 2,
+      .large_threshold = 1024 * 1024,
+  };
+  struct gc *gc = gc_create_with_config(&config);
+
+  if (copy_on_promote) {
+    struct gc_space_config old_space_config = {
+        .sweep_every = 10,
+        .max_size = 1024 * 1024 * 1024,
+        .alloc = old_space_alloc,
+        .free = old_space_free,
+    };
+    gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+  }
+
+  size_t object_size = (size_t)state.range(0);
+  std::vector<struct gc_slot *> slots(256);
+
+  size_t promoted = 0;
+  size_t copied = 0;
+  size_t cycles = 0;
+  for (auto _ : state) {
+    for (auto &slot : slots) {
+      slot = gc_alloc(gc, object_size, NULL, NULL);
+      gc_root(gc, slot);
+    }
+
+    struct gc_stats stats;
+    for (int i = 0; i < 3; ++i) {
+      gc_run(gc, &stats);
+      promoted += stats.total_promoted;
+      copied += stats.total_copied;
+      ++cycles;
+    }
+
+    for (auto slot : slots) {
+      gc_unroot(gc, slot);
+    }
+  }
+
+  state.counters["promoted_bytes_per_cycle"] = (double)promoted / (double)cycles;
+  state.counters["copied_bytes_per_cycle"] = (double)copied / (double)cycles;
+  state.SetBytesProcessed((int64_t)promoted);
+
+  gc_destroy(gc);
+}
+
+BENCHMARK_CAPTURE(BM_Promotion, in_place, false)->Range(64, 64 << 10);
+BENCHMARK_CAPTURE(BM_Promotion, copying, true)->Range(64, 64 << 10);
+
+static struct gc *shared_gc = NULL;
+static std::mutex shared_gc_mutex;
+
+static void SharedHeapSetup(const benchmark::State &state) {
+  (void)state;
+  struct gc_config config = {
+      .debug = 0,
+      .alloc = malloc,
+      .free = free,
+      .young_max_cycles = 2,
+      .large_threshold = 1024 * 1024,
+  };
+  shared_gc = gc_create_with_config(&config);
+}
+
+static void SharedHeapTeardown(const benchmark::State &state) {
+  (void)state;
+  gc_destroy(shared_gc);
+  shared_gc = NULL;
+}
+
+// Every thread allocates short-lived objects in one shared heap, in batches. Attached threads bump
+// allocate from their own buffers and are stopped at safepoints for collections; between batches
+// they sit in a safe region, so that threads waiting on the benchmark's barriers don't hold up a
+// collection. Without attaching, every allocation (and any collection it triggers) has to happen
+// under a single lock.
+static void BM_SharedHeapAlloc(benchmark::State &state, bool attached) {
+  const int batch = 1024;
+  struct gc *gc = shared_gc;
+
+  if (attached) {
+    gc_thread_attach(gc);
+    gc_enter_safe_region(gc);
+  }
+
+  for (auto _ : state) {
+    if (attached) {
+      gc_leave_safe_region(gc);
+      for (int i = 0; i < batch; ++i) {
+        benchmark::DoNotOptimize(gc_alloc(gc, 64, NULL, NULL));
+      }
+      gc_enter_safe_region(gc);
+    } else {
+      for (int i = 0; i < batch; ++i) {
+        std::lock_guard<std::mutex> guard(shared_gc_mutex);
+        benchmark::DoNotOptimize(gc_alloc(gc, 64, NULL, NULL));
+      }
+    }
+  }
+
+  if (attached) {
+    gc_leave_safe_region(gc);
+    gc_thread_detach(gc);
+  }
+
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+
+BENCHMARK_CAPTURE(BM_SharedHeapAlloc, attached, true)
+    ->Setup(SharedHeapSetup)
+    ->Teardown(SharedHeapTeardown)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_SharedHeapAlloc, locked, false)
+    ->Setup(SharedHeapSetup)
+    ->Teardown(SharedHeapTeardown)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+struct tree_node {
+  struct gc_slot *left;
+  struct gc_slot *right;
+};
+
+static void tree_node_marker(struct gc *gc, struct gc_slot *slot) {
+  struct tree_node *node = (struct tree_node *)gc_lock_slot(slot);
+  if (node->left) {
+    gc_mark(gc, node->left);
+  }
+  if (node->right) {
+    gc_mark(gc, node->right);
+  }
+  gc_unlock_slot(slot);
+}
+
+static struct gc_slot *build_tree(struct gc *gc, struct gc_type *type, int depth) {
+  struct gc_slot *slot = type ? gc_alloc_typed(gc, sizeof(struct tree_node), type, NULL)
+                              : gc_alloc(gc, sizeof(struct tree_node), tree_node_marker, NULL);
+  gc_root(gc, slot);
+
+  struct gc_slot *left = depth ? build_tree(gc, type, depth - 1) : NULL;
+  struct gc_slot *right = depth ? build_tree(gc, type, depth - 1) : NULL;
+
+  struct tree_node *node = (struct tree_node *)gc_lock_slot(slot);
+  node->left = left;
+  node->right = right;
+  gc_unlock_slot(slot);
+
+  if (left) {
+    gc_unroot(gc, left);
+    gc_unroot(gc, right);
+  }
+  return slot;
+}
+
+// Marks a rooted binary tree of 2^depth objects each iteration, traced either by a marker callback
+// or by a layout descriptor.
+static void BM_MarkTree(benchmark::State &state, bool typed) {
+  struct gc_config config = {
+      .debug = 0,
+      .alloc = malloc,
+      .free = free,
+      .young_max_cycles = 2,
+      .large_threshold = 1024 * 1024,
+      .auto_collect = 0,
+  };
+  struct gc *gc = gc_create_with_config(&config);
+
+  // Every cycle sweeps the old space, and so traces the whole tree.
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = (size_t)1 << 32,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  size_t offsets[] = {offsetof(struct tree_node, left), offsetof(struct tree_node, right)};
+  struct gc_type *type = typed ? gc_type_new(gc, offsets, 2, NULL) : NULL;
+
+  int depth = (int)state.range(0);
+  struct gc_slot *root = build_tree(gc, type, depth);
+
+  // Promote the tree, so that iterations don't include promotion.
+  for (int i = 0; i < 3; ++i) {
+    gc_run(gc, NULL);
+  }
+
+  for (auto _ : state) {
+    gc_run(gc, NULL);
+  }
+
+  state.SetItemsProcessed((int64_t)state.iterations() * ((int64_t)2 << depth));
+
+  gc_unroot(gc, root);
+  gc_destroy(gc);
+}
+
+BENCHMARK_CAPTURE(BM_MarkTree, marker, false)->DenseRange(12, 18, 3);
+BENCHMARK_CAPTURE(BM_MarkTree, typed, true)->DenseRange(12, 18, 3);
+
+// Allocates a zero-filled large object, touches its first page and collects it each iteration,
+// with the large space either mapping objects directly or serving them from malloc.
+static void BM_LargeZeroedAlloc(benchmark::State &state, bool map_pages) {
+  struct gc_config config = {
+      .debug = 0,
+      .alloc = malloc,
+      .free = free,
+      .young_max_cycles = 2,
+      .large_threshold = 64 * 1024,
+  };
+  struct gc *gc = gc_create_with_config(&config);
+
+  struct gc_space_config large_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024 * 1024,
+      .map_pages = map_pages,
+  };
+  gc_configure_space(gc, GC_SPACE_LARGE, &large_space_config);
+
+  size_t size = (size_t)state.range(0);
+  for (auto _ : state) {
+    struct gc_slot *slot = gc_alloc_zeroed(gc, size, NULL, NULL);
+    char *data = (char *)gc_lock_slot(slot);
+    data[0] = 1;
+    benchmark::DoNotOptimize(data);
+    gc_unlock_slot(slot);
+    gc_run(gc, NULL);
+  }
+
+  state.SetBytesProcessed((int64_t)state.iterations() * state.range(0));
+  gc_destroy(gc);
+}
+
+BENCHMARK_CAPTURE(BM_LargeZeroedAlloc, mapped, true)->Range(64 << 10, 16 << 20);
+BENCHMARK_CAPTURE(BM_LargeZeroedAlloc, malloc, false)->Range(64 << 10, 16 << 20);
@@ -0,0 +1,61 @@
+#include <pocketknife/hash/consistent.h>
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+static std::vector<uint64_t> consistent_benchmark_hashes() {
+  std::mt19937_64 random(1);
+  std::vector<uint64_t> hashes(4096);
+  for (uint64_t &hash : hashes) {
+    hash = random();
+  }
+  return hashes;
+}
+
+static void BM_Jump(benchmark::State &state) {
+  std::vector<uint64_t> hashes = consistent_benchmark_hashes();
+  for (auto _ : state) {
+    for (uint64_t hash : hashes) {
+      benchmark::DoNotOptimize(hash_jump(hash, (uint32_t)state.range(0)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t)hashes.size());
+}
+
+static void BM_Rendezvous(benchmark::State &state) {
+  std::vector<uint64_t> hashes = consistent_benchmark_hashes();
+  std::vector<uint64_t> nodes;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    nodes.push_back((uint64_t)i + 1000);
+  }
+  for (auto _ : state) {
+    for (uint64_t hash : hashes) {
+      benchmark::DoNotOptimize(hash_rendezvous(hash, nodes.data(), nodes.size()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t)hashes.size());
+}
+
+// range(0) nodes of 100 points each.
+static void BM_RingLookup(benchmark::State &state) {
+  std::vector<uint64_t> hashes = consistent_benchmark_hashes();
+  struct hash_ring *ring = hash_ring_new();
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    hash_ring_add(ring, (uint64_t)i + 1000, 100);
+  }
+  for (auto _ : state) {
+    for (uint64_t hash : hashes) {
+      uint64_t node;
+      hash_ring_lookup(ring, hash, &node);
+      benchmark::DoNotOptimize(node);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t)hashes.size());
+  hash_ring_destroy(ring);
+}
+
+BENCHMARK(BM_Jump)->RangeMultiplier(8)->Range(8, 1 << 15);
+BENCHMARK(BM_Rendezvous)->RangeMultiplier(4)->Range(4, 256);
+BENCHMARK(BM_RingLookup)->RangeMultiplier(8)->Range(8, 1 << 12);
@@ -0,0 +1,79 @@
+#include <pocketknife/hash/bloom.h>
+#include <pocketknife/hash/cuckoo.h>
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+// Adapters giving both filters the same interface. Keys are random 64-bit hashes, so that the
+// benchmarks measure the filters rather than hashing.
+
+struct BloomFilter {
+  struct hash_bloom *bloom;
+  BloomFilter(size_t keys, size_t bits) : bloom(hash_bloom_new(keys, bits)) {}
+  ~BloomFilter() { hash_bloom_destroy(bloom); }
+  void add(uint64_t hash) { hash_bloom_add_hash(bloom, hash); }
+  int contains(uint64_t hash) const { return hash_bloom_contains_hash(bloom, hash); }
+  size_t bytes() const { return hash_bloom_bytes(bloom); }
+};
+
+struct CuckooFilter {
+  struct hash_cuckoo *cuckoo;
+  CuckooFilter(size_t keys, size_t bits) : cuckoo(hash_cuckoo_new(keys, (unsigned)bits)) {}
+  ~CuckooFilter() { hash_cuckoo_destroy(cuckoo); }
+  void add(uint64_t hash) { hash_cuckoo_add_hash(cuckoo, hash); }
+  int contains(uint64_t hash) const { return hash_cuckoo_contains_hash(cuckoo, hash); }
+  size_t bytes() const { return hash_cuckoo_bytes(cuckoo); }
+};
+
+static std::vector<uint64_t> filter_benchmark_hashes(size_t count, uint64_t seed) {
+  std::mt19937_64 random(seed);
+  std::vector<uint64_t> hashes(count);
+  for (uint64_t &hash : hashes) {
+    hash = random();
+  }
+  return hashes;
+}
+
+// Looks up keys that were added (hits) or weren't (misses) in a filter of range(0) keys built
+// with range(1) bits per key for Bloom filters, or fingerprints of range(1) bits for cuckoo
+// filters. Reports the false positive rate and the actual size of the filter per key. Cuckoo
+// filters are filled to 95% of their power-of-two capacity.
+template <typename Filter, bool Hits>
+static void BM_FilterLookup(benchmark::State &state) {
+  size_t count = (size_t)state.range(0);
+  Filter filter(count, (size_t)state.range(1));
+  std::vector<uint64_t> added = filter_benchmark_hashes(count, 1);
+  for (uint64_t hash : added) {
+    filter.add(hash);
+  }
+  std::vector<uint64_t> queries = Hits ? added : filter_benchmark_hashes(count, 2);
+
+  size_t positives = 0;
+  for (auto _ : state) {
+    positives = 0;
+    for (uint64_t hash : queries) {
+      positives += (size_t)filter.contains(hash);
+    }
+    benchmark::DoNotOptimize(positives);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["positive_rate"] = (double)positives / (double)count;
+  state.counters["bits_per_key"] = (double)filter.bytes() * 8 / (double)count;
+}
+
+// 2^20 keys, and 2^23 whose filters are well out of cache; 996147 and 7969177 fill a cuckoo
+// filter's 2^18 and 2^21 buckets to 95%.
+BENCHMARK_TEMPLATE(BM_FilterLookup, BloomFilter, false)
+    ->Name("BM_BloomMiss")
+    ->ArgsProduct({{1 << 20, 1 << 23}, {4, 6, 8, 10, 12, 16, 20}});
+BENCHMARK_TEMPLATE(BM_FilterLookup, BloomFilter, true)
+    ->Name("BM_BloomHit")
+    ->ArgsProduct({{1 << 20, 1 << 23}, {10}});
+BENCHMARK_TEMPLATE(BM_FilterLookup, CuckooFilter, false)
+    ->Name("BM_CuckooMiss")
+    ->ArgsProduct({{996147, 7969177}, {8, 16}});
+BENCHMARK_TEMPLATE(BM_FilterLookup, CuckooFilter, true)
+    ->Name("BM_CuckooHit")
+    ->ArgsProduct({{996147, 7969177}, {8, 16}});
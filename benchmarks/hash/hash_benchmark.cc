@@ -0,0 +1,122 @@
+#include <pocketknife/hash/crc32c.h>
+#include <pocketknife/hash/fast.h>
+#include <pocketknife/hash/fnv.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+static std::vector<uint8_t> benchmark_data(size_t length) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = (uint8_t)((i * 131) + 17);
+  }
+  return data;
+}
+
+static void BM_FNV1a(benchmark::State &state) {
+  std::vector<uint8_t> data = benchmark_data((size_t)state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_fnv1a(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Fast64(benchmark::State &state, enum HashFastImpl impl) {
+  enum HashFastImpl original = hash_fast_impl();
+  if (!hash_fast_set_impl(impl)) {
+    state.SkipWithError("not supported by this CPU");
+    return;
+  }
+
+  std::vector<uint8_t> data = benchmark_data((size_t)state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_fast64(data.data(), data.size(), 0));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+
+  hash_fast_set_impl(original);
+}
+
+static void BM_Crc32c(benchmark::State &state, enum HashCrc32cImpl impl) {
+  enum HashCrc32cImpl original = hash_crc32c_impl();
+  if (!hash_crc32c_set_impl(impl)) {
+    state.SkipWithError("not supported by this CPU");
+    return;
+  }
+
+  std::vector<uint8_t> data = benchmark_data((size_t)state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_crc32c(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+
+  hash_crc32c_set_impl(original);
+}
+
+// Hashes 1 MiB fed in chunks of the given size, as when hashing data in flight.
+static void BM_Fast64Streaming(benchmark::State &state) {
+  std::vector<uint8_t> data = benchmark_data(1 << 20);
+  size_t chunk = (size_t)state.range(0);
+  for (auto _ : state) {
+    struct hash_fast_state hash;
+    hash_fast_init(&hash, 0);
+    for (size_t offset = 0; offset < data.size(); offset += chunk) {
+      hash_fast_update(&hash, data.data() + offset, chunk);
+    }
+    benchmark::DoNotOptimize(hash_fast64_final(&hash));
+  }
+  state.SetBytesProcessed(state.iterations() * (int64_t)data.size());
+}
+
+// 4096 keys of the given length, or of 8 bytes up to it, hashed one call at a time or as a batch.
+// The per_key counter is the time per key.
+struct ShortKeys {
+  std::vector<uint8_t> data = benchmark_data(4096 * 32);
+  std::vector<const uint8_t *> keys;
+  std::vector<size_t> lengths;
+  std::vector<uint64_t> hashes;
+
+  ShortKeys(size_t length, bool varied) {
+    for (size_t i = 0; i < 4096; ++i) {
+      keys.push_back(data.data() + (i * 32));
+      lengths.push_back(varied ? 8 + ((i * 2654435761u) % (length - 7)) : length);
+    }
+    hashes.resize(keys.size());
+  }
+};
+
+static void BM_FNV1aShortKeysLoop(benchmark::State &state) {
+  ShortKeys keys((size_t)state.range(0), state.range(1) != 0);
+  for (auto _ : state) {
+    for (size_t i = 0; i < keys.keys.size(); ++i) {
+      keys.hashes[i] = hash_fnv1a(keys.keys[i], keys.lengths[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["per_key"] = benchmark::Counter(
+      (double)keys.keys.size(),
+      benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+static void BM_FNV1aShortKeysBatch(benchmark::State &state) {
+  ShortKeys keys((size_t)state.range(0), state.range(1) != 0);
+  for (auto _ : state) {
+    hash_fnv1a_batch(keys.keys.data(), keys.lengths.data(), keys.keys.size(), keys.hashes.data());
+    benchmark::ClobberMemory();
+  }
+  state.counters["per_key"] = benchmark::Counter(
+      (double)keys.keys.size(),
+      benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_FNV1a)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Fast64, scalar, HASH_FAST_SCALAR)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Fast64, sse2, HASH_FAST_SSE2)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Fast64, avx2, HASH_FAST_AVX2)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Crc32c, table, HASH_CRC32C_TABLE)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Crc32c, sse42, HASH_CRC32C_SSE42)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK_CAPTURE(BM_Crc32c, pclmul, HASH_CRC32C_PCLMUL)->RangeMultiplier(8)->Range(8, 1 << 20);
+BENCHMARK(BM_FNV1aShortKeysLoop)->ArgsProduct({{8, 16, 32}, {0, 1}});
+BENCHMARK(BM_FNV1aShortKeysBatch)->ArgsProduct({{8, 16, 32}, {0, 1}});
+BENCHMARK(BM_Fast64Streaming)->RangeMultiplier(8)->Range(8, 1 << 16);
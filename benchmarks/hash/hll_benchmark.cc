@@ -0,0 +1,49 @@
+#include <pocketknife/hash/hll.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+static struct hash_hll *hll_benchmark_sketch(int precision, uint64_t seed, uint64_t count) {
+  struct hash_hll *hll = hash_hll_new(precision);
+  for (uint64_t key = 0; key < count; ++key) {
+    hash_hll_add_hash(hll, (key + seed) * 0x9e3779b97f4a7c15ULL);
+  }
+  return hll;
+}
+
+static void BM_HllAdd(benchmark::State &state) {
+  struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  uint64_t key = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_hll_add(hll, (const uint8_t *)&key, sizeof(key)));
+    ++key;
+  }
+  state.SetItemsProcessed(state.iterations());
+  hash_hll_destroy(hll);
+}
+
+// Merges two dense sketches of the given precision.
+static void BM_HllMerge(benchmark::State &state) {
+  int precision = (int)state.range(0);
+  struct hash_hll *dst = hll_benchmark_sketch(precision, 0, 1000000);
+  struct hash_hll *src = hll_benchmark_sketch(precision, 1, 1000000);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_hll_merge(dst, src));
+  }
+  state.SetBytesProcessed(state.iterations() * ((int64_t)1 << precision));
+  hash_hll_destroy(dst);
+  hash_hll_destroy(src);
+}
+
+static void BM_HllEstimate(benchmark::State &state) {
+  struct hash_hll *hll = hll_benchmark_sketch((int)state.range(0), 0, (uint64_t)state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hash_hll_estimate(hll));
+  }
+  hash_hll_destroy(hll);
+}
+
+BENCHMARK(BM_HllAdd);
+BENCHMARK(BM_HllMerge)->DenseRange(10, 18, 4);
+BENCHMARK(BM_HllEstimate)->ArgsProduct({{14}, {100, 1000000}});
@@ -0,0 +1,171 @@
+#include <pocketknife/hash/map.h>
+#include <pocketknife/trie/trie.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Adapters giving each table the same interface, so that every benchmark runs the same loop
+// against hash_map, std::unordered_map and (for strings) the trie.
+
+struct HashMapStrings {
+  struct hash_map *map = hash_map_new(HASH_MAP_STRING_KEYS);
+  ~HashMapStrings() { hash_map_destroy(map); }
+  void insert(const std::string &key, void *value) {
+    hash_map_insert(map, key.data(), key.size(), value);
+  }
+  void *lookup(const std::string &key) { return hash_map_lookup(map, key.data(), key.size()); }
+  void erase(const std::string &key) { hash_map_erase(map, key.data(), key.size()); }
+};
+
+struct StdStrings {
+  std::unordered_map<std::string, void *> map;
+  void insert(const std::string &key, void *value) { map[key] = value; }
+  void *lookup(const std::string &key) {
+    auto it = map.find(key);
+    return it == map.end() ? nullptr : it->second;
+  }
+  void erase(const std::string &key) { map.erase(key); }
+};
+
+struct TrieStrings {
+  struct trie *trie = new_trie();
+  ~TrieStrings() { destroy_trie(trie); }
+  void insert(const std::string &key, void *value) { trie_insert(trie, key.c_str(), value); }
+  void *lookup(const std::string &key) { return trie_lookup(trie, key.c_str()); }
+  void erase(const std::string &key) { trie_remove(trie, key.c_str()); }
+};
+
+struct HashMapInts {
+  struct hash_map *map = hash_map_new(HASH_MAP_INT_KEYS);
+  ~HashMapInts() { hash_map_destroy(map); }
+  void insert(uint64_t key, void *value) { hash_map_insert_int(map, key, value); }
+  void *lookup(uint64_t key) { return hash_map_lookup_int(map, key); }
+  void erase(uint64_t key) { hash_map_erase_int(map, key); }
+};
+
+struct StdInts {
+  std::unordered_map<uint64_t, void *> map;
+  void insert(uint64_t key, void *value) { map[key] = value; }
+  void *lookup(uint64_t key) {
+    auto it = map.find(key);
+    return it == map.end() ? nullptr : it->second;
+  }
+  void erase(uint64_t key) { map.erase(key); }
+};
+
+template <typename Key>
+static std::vector<Key> map_benchmark_keys(size_t count);
+
+template <>
+std::vector<std::string> map_benchmark_keys<std::string>(size_t count) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < count; ++i) {
+    keys.push_back("user:" + std::to_string(i * 2654435761u % 1000000007u));
+  }
+  return keys;
+}
+
+template <>
+std::vector<uint64_t> map_benchmark_keys<uint64_t>(size_t count) {
+  std::mt19937_64 random(1);
+  std::vector<uint64_t> keys(count);
+  for (uint64_t &key : keys) {
+    key = random();
+  }
+  return keys;
+}
+
+// Lookups and erases visit the keys in a different order than they were inserted.
+template <typename Key>
+static std::vector<Key> map_benchmark_shuffled(std::vector<Key> keys) {
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(2));
+  return keys;
+}
+
+template <typename Table, typename Key>
+static void BM_MapInsert(benchmark::State &state) {
+  std::vector<Key> keys = map_benchmark_keys<Key>((size_t)state.range(0));
+  for (auto _ : state) {
+    Table table;
+    for (const Key &key : keys) {
+      table.insert(key, &table);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Table, typename Key>
+static void BM_MapLookup(benchmark::State &state) {
+  std::vector<Key> keys = map_benchmark_keys<Key>((size_t)state.range(0));
+  Table table;
+  for (const Key &key : keys) {
+    table.insert(key, &table);
+  }
+
+  keys = map_benchmark_shuffled(keys);
+  for (auto _ : state) {
+    for (const Key &key : keys) {
+      benchmark::DoNotOptimize(table.lookup(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Table, typename Key>
+static void BM_MapLookupMiss(benchmark::State &state) {
+  std::vector<Key> keys = map_benchmark_keys<Key>((size_t)state.range(0) * 2);
+  Table table;
+  for (size_t i = 0; i < keys.size() / 2; ++i) {
+    table.insert(keys[i], &table);
+  }
+
+  std::vector<Key> misses(keys.begin() + (ptrdiff_t)(keys.size() / 2), keys.end());
+  for (auto _ : state) {
+    for (const Key &key : misses) {
+      benchmark::DoNotOptimize(table.lookup(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Table, typename Key>
+static void BM_MapErase(benchmark::State &state) {
+  std::vector<Key> keys = map_benchmark_keys<Key>((size_t)state.range(0));
+  std::vector<Key> shuffled = map_benchmark_shuffled(keys);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Table *table = new Table;
+    for (const Key &key : keys) {
+      table->insert(key, table);
+    }
+    state.ResumeTiming();
+
+    for (const Key &key : shuffled) {
+      table->erase(key);
+    }
+
+    state.PauseTiming();
+    delete table;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+#define MAP_BENCHMARKS(name, Table, Key, max)                                                 \
+  BENCHMARK_TEMPLATE(BM_MapInsert, Table, Key)->Name(#name "/insert")->Range(1 << 10, max);   \
+  BENCHMARK_TEMPLATE(BM_MapLookup, Table, Key)->Name(#name "/lookup")->Range(1 << 10, max);   \
+  BENCHMARK_TEMPLATE(BM_MapLookupMiss, Table, Key)->Name(#name "/miss")->Range(1 << 10, max); \
+  BENCHMARK_TEMPLATE(BM_MapErase, Table, Key)->Name(#name "/erase")->Range(1 << 10, max)
+
+MAP_BENCHMARKS(BM_HashMapStrings, HashMapStrings, std::string, 1 << 18);
+MAP_BENCHMARKS(BM_StdUnorderedMapStrings, StdStrings, std::string, 1 << 18);
+// The trie's nodes are over 2 KiB each, so it is kept to smaller sizes.
+MAP_BENCHMARKS(BM_TrieStrings, TrieStrings, std::string, 1 << 13);
+MAP_BENCHMARKS(BM_HashMapInts, HashMapInts, uint64_t, 1 << 18);
+MAP_BENCHMARKS(BM_StdUnorderedMapInts, StdInts, uint64_t, 1 << 18);
@@ -0,0 +1,58 @@
+#include <pocketknife/hash/mph.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// The same keys as the string map benchmarks, so that lookups can be compared with theirs.
+struct MphKeys {
+  std::vector<std::string> strings;
+  std::vector<const uint8_t *> keys;
+  std::vector<size_t> lengths;
+
+  explicit MphKeys(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      strings.push_back("user:" + std::to_string(i * 2654435761u % 1000000007u));
+    }
+    for (const std::string &s : strings) {
+      keys.push_back((const uint8_t *)s.data());
+      lengths.push_back(s.size());
+    }
+  }
+};
+
+static void BM_MphBuild(benchmark::State &state) {
+  MphKeys keys((size_t)state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size());
+    bytes = hash_mph_bytes(mph);
+    hash_mph_destroy(mph);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["bits_per_key"] = (double)bytes * 8 / (double)state.range(0);
+}
+
+static void BM_MphLookup(benchmark::State &state) {
+  MphKeys keys((size_t)state.range(0));
+  struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size());
+
+  std::vector<size_t> order(keys.keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(2));
+  for (auto _ : state) {
+    for (size_t i : order) {
+      benchmark::DoNotOptimize(hash_mph_lookup(mph, keys.keys[i], keys.lengths[i]));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  hash_mph_destroy(mph);
+}
+
+BENCHMARK(BM_MphBuild)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_MphLookup)->Range(1 << 10, 1 << 18);
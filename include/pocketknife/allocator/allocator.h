@@ -11,6 +11,10 @@ extern "C" {
 
 typedef void (*AllocatorMoveCallback)(void *old_ptr, void *new_ptr);
 
+// Called by compaction once an allocation has been copied to new_ptr. Return non-zero to accept
+// the move (old_ptr is then freed), or zero to keep the allocation at old_ptr.
+typedef int (*AllocatorRelocateCallback)(void *context, void *old_ptr, void *new_ptr);
+
 struct allocator *allocator_new(size_t size);
 
 /**
@@ -32,9 +36,32 @@ void allocator_destroy(struct allocator *allocator);
 void *allocator_alloc(struct allocator *allocator, size_t size);
 void allocator_free(struct allocator *allocator, void *ptr);
 
+/**
+ * @brief Check whether compaction would be able to release pages back to the system.
+ *
+ * @return int 1 if an arena has at least two pages' worth of free blocks, 0 otherwise.
+ */
 int allocator_should_compact(struct allocator *allocator);
+
+/**
+ * @brief Move small allocations out of sparsely used pages, releasing the pages once empty.
+ *
+ * @param callback Called after each allocation has been moved, with its old and new addresses.
+ */
 void allocator_compact(struct allocator *allocator, AllocatorMoveCallback callback);
 
+/**
+ * @brief Like \ref allocator_compact, but every move can be refused by the callback.
+ *
+ * Pages that hold an allocation that refused to move are left alone for the rest of the
+ * compaction.
+ *
+ * @param callback Called after each allocation has been copied to its new address.
+ * @param context Passed through to the callback.
+ */
+void allocator_compact_with_context(struct allocator *allocator,
+                                    AllocatorRelocateCallback callback, void *context);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
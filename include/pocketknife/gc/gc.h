@@ -2,6 +2,7 @@
 #define _POCKETKNIFE_GC_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,12 +12,28 @@ struct gc;
 
 struct gc_slot;
 
+struct gc_weak;
+
+struct gc_ephemeron_table;
+
+struct gc_type;
+
+struct gc_site;
+
+struct allocator;
+
 typedef void *(*GCAllocateFunc)(size_t size);
 typedef void (*GCFreeFunc)(void *ptr);
 
+typedef void *(*GCAllocateContextFunc)(void *context, size_t size);
+typedef void (*GCFreeContextFunc)(void *context, void *ptr);
+
 typedef void (*GCEraseFunc)(struct gc *gc, struct gc_slot *slot);
 typedef void (*GCMarkFunc)(struct gc *gc, struct gc_slot *slot);
 
+struct gc_cycle_info;
+typedef void (*GCEventFunc)(struct gc *gc, const struct gc_cycle_info *info, void *context);
+
 /**
  * @brief Spaces in the garbage collector.
  *
@@ -48,10 +65,51 @@ struct gc_config {
   // Function used to free memory allocated by the garbage collector. Defaults to free().
   GCFreeFunc free;
 
-  // Number of cycles an allocation can survive in the young space before a promotion.
+  // Number of cycles an allocation can survive in the young space before a promotion. Used unless
+  // the young space is configured with its own tenure_after.
   size_t young_max_cycles;
   // Number of bytes above which to directly allocate in the large space.
   size_t large_threshold;
+
+  // If set, allocations run collection cycles automatically once a space has accumulated enough
+  // new allocations since its last sweep. Each space's threshold adapts to the survival rate
+  // observed in its sweeps. Defaults to enabled. Exceeding a space's max_size always triggers a
+  // cycle, regardless of this setting.
+  int auto_collect;
+
+  // Fragmentation, as a percentage of the old space's live bytes, at which a cycle that sweeps the
+  // old space also compacts it. Fragmentation counts the space lost since the last compaction:
+  // holes left between compacted objects, and the bytes freed by old objects that were never
+  // compacted. Old objects that are merely uncompacted don't count, so a heap without garbage is
+  // never moved. Zero disables automatic compaction, though gc_compact can still be called
+  // directly. Defaults to 50.
+  size_t compact_fragmentation;
+
+  // Optional callback invoked at the end of every collection cycle with timings and statistics for
+  // that cycle, along with event_context. Works independently of debug mode. The callback must not
+  // allocate from or run the garbage collector.
+  GCEventFunc on_cycle;
+  void *event_context;
+
+  // If non-zero, the young and old spaces share a liballoc allocator over a region of this many
+  // bytes, and the large space gets another. Objects then come from liballoc's size-class arenas
+  // and page runs rather than the malloc heap, objects are promoted without copying, and old space
+  // compaction compacts the arenas (see gc_space_use_allocator).
+  size_t allocator_region_size;
+
+  // If set, erasers of collected objects are not run at the end of the cycle that collected them,
+  // but queued until the next call to gc_run_finalizers. Use this to keep user code out of cycles
+  // that allocations trigger. Queued objects keep their memory until their erasers have run.
+  int defer_finalizers;
+
+  // Allocation sites (see gc_site_new) judge whether to pretenure once this many of their objects
+  // have either died or survived into the old space, and judge again after every such batch. Zero
+  // disables pretenuring, though sites still keep statistics. Defaults to 256.
+  size_t pretenure_sample;
+  // Percentage of a site's judged objects that must survive for the site to allocate directly into
+  // the old space. A pretenured site goes back to the young space once fewer than half this
+  // percentage of its objects survive their first old space sweep. Defaults to 80.
+  size_t pretenure_survival;
 };
 
 struct gc_space_config {
@@ -62,7 +120,7 @@ struct gc_space_config {
   // The desired maximum size of this space in bytes. If an allocation would exceed this size,
   // an immediate garbage collection cycle will be triggered. That immediate cycle would attempt
   // to collect in this space, and if that is insufficient, it will run on the entire garbage
-  // collector.
+  // collector. If the space is still too full after that, the allocation proceeds anyway.
   size_t max_size;
 
   // Specific allocator for this space. If not set, the global GC allocator will be used.
@@ -70,6 +128,29 @@ struct gc_space_config {
 
   // Specific deallocator for this space. If not set, the global GC deallocator will be used.
   GCFreeFunc free;
+
+  // Context-carrying allocator for this space. If set, these are used instead of alloc and free,
+  // and are passed allocator_context with every call. Both must be set together.
+  GCAllocateContextFunc alloc_with_context;
+  GCFreeContextFunc free_with_context;
+  void *allocator_context;
+
+  // Number of sweeps an object must survive in this space before it is tenured into tenure_space.
+  // Zero disables tenuring out of this space, except for the young space, which falls back to
+  // gc_config.young_max_cycles. Chaining spaces (e.g. young -> custom survivor space -> old) gives
+  // objects several aging steps before they reach the old space.
+  size_t tenure_after;
+
+  // Space that objects are tenured into. For the young space, GC_SPACE_YOUNG means GC_SPACE_OLD.
+  // Objects are re-tagged in place if both spaces share an allocator, and copied otherwise.
+  enum GCSpace tenure_space;
+
+  // If set, every object in this space gets its own anonymous mapping instead of coming from the
+  // space's allocator. The object starts on a page boundary, its header is allocated separately
+  // with gc_config.alloc, and its pages are unmapped as soon as it is collected. Objects that
+  // attached threads allocate from their buffers are never mapped. Defaults to set for the large
+  // space.
+  int map_pages;
 };
 
 struct gc_stats {
@@ -78,8 +159,106 @@ struct gc_stats {
   size_t total_collected;  // Total memory collected by the GC
   size_t total_marked;     // Total memory marked by the GC
   size_t total_objects;    // Total number of objects managed by the GC
+  size_t total_promoted;   // Bytes promoted to another space by the last cycle
+  size_t total_copied;     // Bytes copied by promotions in the last cycle
+  size_t total_compacted;  // Bytes relocated by old space compaction in the last cycle
+};
+
+/**
+ * @brief Phases of a collection cycle.
+ */
+enum GCPhase {
+  GC_PHASE_MARK = 0,
+  GC_PHASE_SWEEP = 1,
+  GC_PHASE_PROMOTE = 2,
+  GC_PHASE_COMPACT = 3,
+  GC_PHASE_COUNT = 4,
+};
+
+/**
+ * @brief Telemetry for a single collection cycle, passed to gc_config.on_cycle.
+ *
+ * The survival rate of a swept space is survived_bytes / swept_bytes for that space.
+ */
+struct gc_cycle_info {
+  uint64_t cycle;                     // Sequence number of the cycle, starting from 1
+  int minor;                          // Non-zero if the cycle only traced the young space
+  unsigned swept_spaces;              // Bitmask of the spaces swept (bit N is enum GCSpace N)
+  uint64_t pause_ns;                  // Wall time of the whole cycle
+  uint64_t phase_ns[GC_PHASE_COUNT];  // Wall time of each phase, indexed by enum GCPhase
+  size_t bytes_freed;                 // Bytes of objects collected by the sweep
+  size_t bytes_promoted;              // Bytes tenured into another space
+  size_t bytes_compacted;             // Bytes relocated by old space compaction
+  size_t swept_bytes[8];              // Bytes in each swept space before the sweep
+  size_t survived_bytes[8];           // Bytes in each swept space that survived the sweep
+};
+
+/**
+ * @brief Statistics for an allocation site, as returned by \ref gc_get_site_stats.
+ *
+ * An object allocated at a site is judged once: when it is tenured out of the young space, or for
+ * pretenured objects when it survives its first old space sweep, it counts as survived; if it is
+ * collected first, it counts as died.
+ */
+struct gc_site_stats {
+  uint64_t allocated_objects;   // Objects allocated at the site
+  uint64_t allocated_bytes;     // Bytes allocated at the site
+  uint64_t pretenured_objects;  // Objects allocated directly into the old space
+  uint64_t survived_objects;    // Judged objects that survived
+  uint64_t died_objects;        // Judged objects that died
+  uint64_t decisions;           // Number of times the site started or stopped pretenuring
+  int pretenured;               // Non-zero if the site currently allocates into the old space
+};
+
+/**
+ * @brief Distribution of collection pause times.
+ *
+ * Percentiles come from a log-linear histogram and are accurate to within 12.5%.
+ */
+struct gc_pause_stats {
+  size_t cycles;      // Number of cycles recorded
+  uint64_t total_ns;  // Sum of all pauses
+  uint64_t p50_ns;    // Median pause
+  uint64_t p99_ns;    // 99th percentile pause
+  uint64_t max_ns;    // Longest pause
 };
 
+/**
+ * @brief Heap snapshot format, as written by \ref gc_heap_snapshot.
+ *
+ * A snapshot starts with the 8 byte magic GC_SNAPSHOT_MAGIC and a 32-bit GC_SNAPSHOT_VERSION,
+ * followed by a stream of records. Every record starts with a one byte GCSnapshotRecord tag, and
+ * all integers are little-endian. Objects are identified by their 32-bit slot index.
+ *
+ * - GC_SNAPSHOT_ROOT: u32 id, u8 GCSnapshotRootKind.
+ * - GC_SNAPSHOT_OBJECT: u32 id, u64 size, u8 space, u8 flags (GC_SNAPSHOT_FLAG_*).
+ * - GC_SNAPSHOT_EDGE: u32 target id. The edge starts at the most recent object record.
+ * - GC_SNAPSHOT_EPHEMERON: u32 key id, u32 value id. The value is reachable while the key is.
+ * - GC_SNAPSHOT_END: u64 object count, u64 edge count. Always the last record.
+ */
+#define GC_SNAPSHOT_MAGIC "PKGCSNAP"
+#define GC_SNAPSHOT_VERSION 1
+
+enum GCSnapshotRecord {
+  GC_SNAPSHOT_END = 0,
+  GC_SNAPSHOT_ROOT = 1,
+  GC_SNAPSHOT_OBJECT = 2,
+  GC_SNAPSHOT_EDGE = 3,
+  GC_SNAPSHOT_EPHEMERON = 4,
+};
+
+enum GCSnapshotRootKind {
+  GC_SNAPSHOT_ROOT_TABLE = 0,   // Rooted with gc_root
+  GC_SNAPSHOT_ROOT_SCOPED = 1,  // In a handle scope
+  GC_SNAPSHOT_ROOT_LOCKED = 2,  // Locked, and so kept alive by the collector
+  GC_SNAPSHOT_ROOT_STACK = 3,   // Found by scanning a registered stack
+};
+
+// The object is currently locked.
+#define GC_SNAPSHOT_FLAG_LOCKED 0x1
+// The object is in the remembered set.
+#define GC_SNAPSHOT_FLAG_REMEMBERED 0x2
+
 /**
  * @brief Create a new garbage collector instance.
  *
@@ -115,6 +294,22 @@ struct gc *gc_create_with_config(struct gc_config *config);
  */
 void gc_configure_space(struct gc *gc, enum GCSpace space, struct gc_space_config *config);
 
+/**
+ * @brief Back the given space with a liballoc allocator.
+ *
+ * Spaces that share an allocator promote objects between each other without copying them. If the
+ * old space is backed by an allocator, old space compaction compacts the allocator's arenas instead
+ * of packing objects into the collector's own regions; any object in the allocator that isn't
+ * locked may be moved. The allocator must only be used by this garbage collector, and must outlive
+ * it.
+ *
+ * @param gc The garbage collector instance to configure.
+ * @param space The space to configure. Its objects are no longer mapped (see
+ * gc_space_config.map_pages); its other settings are left as they are.
+ * @param allocator The allocator to serve the space's objects from.
+ */
+void gc_space_use_allocator(struct gc *gc, enum GCSpace space, struct allocator *allocator);
+
 /**
  * @brief Destroys the given garbage collector instance.
  *
@@ -136,12 +331,25 @@ void gc_destroy(struct gc *gc);
  * @param eraser An optional function that can be used by the garbage collector when erasing the
  * object. This must not free the object itself, but should free any non-garbage-collected resources
  * within. For example, if the GC object is a structure that includes a pointer allocated by
- * malloc(), free() it in this callback.
+ * malloc(), free() it in this callback. Erasers run in a batch once the sweep is complete, and
+ * objects with erasers are only released once the whole batch has run, so an eraser may still look
+ * at other such objects collected in the same cycle (see also gc_config.defer_finalizers).
  * @return void* A pointer to the allocated memory that is managed by the garbage collector, or NULL
  * if the allocation failed.
+ * @note Allocation may run a garbage collection cycle (see gc_config.auto_collect and
+ * gc_space_config.max_size). Objects that must survive it have to be rooted or locked first.
  */
 struct gc_slot *gc_alloc(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseFunc eraser);
 
+/**
+ * @brief Allocate a zero-filled object in the garbage collector.
+ *
+ * Works like \ref gc_alloc, except that the object's memory starts out zeroed. Objects in spaces
+ * that map pages (see gc_space_config.map_pages) get fresh pages, which are already zero, so large
+ * zeroed objects cost no more than any other.
+ */
+struct gc_slot *gc_alloc_zeroed(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseFunc eraser);
+
 /**
  * @brief Allocate memory for an object in the garbage collector with a specific space.
  *
@@ -154,6 +362,84 @@ struct gc_slot *gc_alloc(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseF
 struct gc_slot *gc_alloc_with_space(struct gc *gc, size_t size, GCMarkFunc marker,
                                     GCEraseFunc eraser, enum GCSpace space);
 
+/**
+ * @brief Describe the layout of a kind of object, so that it can be traced without a marker.
+ *
+ * The collector traces the references of objects allocated with a type in a tight loop, without
+ * locking them or calling a marker for each one. Types live until the collector is destroyed.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param offsets Byte offsets (e.g. from offsetof) of the object's `struct gc_slot *` fields. Each
+ * must be a multiple of the pointer size.
+ * @param count The number of offsets.
+ * @param marker Optional marker, called after the described references have been traced, for any
+ * references the offsets can't describe. Use NULL if there are none.
+ * @return struct gc_type* The new type, or NULL if it could not be allocated.
+ */
+struct gc_type *gc_type_new(struct gc *gc, const size_t *offsets, size_t count,
+                            GCMarkFunc marker);
+
+/**
+ * @brief Allocate an object whose references are described by a type.
+ *
+ * Works like \ref gc_alloc, except that the fields named by the type's offsets start out NULL and
+ * are traced by the collector itself. They must only ever hold NULL or a live slot. `size` must
+ * cover every field named by the type.
+ */
+struct gc_slot *gc_alloc_typed(struct gc *gc, size_t size, const struct gc_type *type,
+                               GCEraseFunc eraser);
+
+/**
+ * @brief Allocate an object whose references are described by a type, in a specific space.
+ *
+ * Works like \ref gc_alloc_typed, but with a custom space instead of defaulting to the young space.
+ */
+struct gc_slot *gc_alloc_typed_with_space(struct gc *gc, size_t size, const struct gc_type *type,
+                                          GCEraseFunc eraser, enum GCSpace space);
+
+/**
+ * @brief Create an allocation site, which tracks how long the objects allocated at it live.
+ *
+ * Objects allocated with \ref gc_alloc_at or \ref gc_alloc_typed_at start out in the young space,
+ * like any other. Once enough of a site's objects have been judged (see
+ * gc_config.pretenure_sample) and most of them survived into the old space, the site allocates
+ * straight into the old space instead, so that long-lived objects such as interned strings are
+ * neither copied on promotion nor swept over and over by minor cycles. Sites live until the
+ * collector is destroyed.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param name A name for the site, used in debug output. Must outlive the collector.
+ * @return struct gc_site* The new site, or NULL if it could not be allocated or the collector
+ * already has the maximum of 4095 sites.
+ */
+struct gc_site *gc_site_new(struct gc *gc, const char *name);
+
+/**
+ * @brief Allocate an object at an allocation site.
+ *
+ * Works like \ref gc_alloc, except that the object may be pretenured into the old space, and its
+ * lifetime is recorded against the site.
+ */
+struct gc_slot *gc_alloc_at(struct gc *gc, struct gc_site *site, size_t size, GCMarkFunc marker,
+                            GCEraseFunc eraser);
+
+/**
+ * @brief Allocate an object whose references are described by a type, at an allocation site.
+ *
+ * Works like \ref gc_alloc_typed, with pretenuring as in \ref gc_alloc_at.
+ */
+struct gc_slot *gc_alloc_typed_at(struct gc *gc, struct gc_site *site, size_t size,
+                                  const struct gc_type *type, GCEraseFunc eraser);
+
+/**
+ * @brief Get statistics for an allocation site.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param site The site to query.
+ * @param stats A pointer to a gc_site_stats structure that will be filled with statistics.
+ */
+void gc_get_site_stats(struct gc *gc, const struct gc_site *site, struct gc_site_stats *stats);
+
 /**
  * @brief Retrieve the underlying pointer from a gc_slot.
  *
@@ -161,9 +447,13 @@ struct gc_slot *gc_alloc_with_space(struct gc *gc, size_t size, GCMarkFunc marke
  * allowed to relocate the memory. Use \ref gc_unlock_slot when you are done with the pointer to
  * allow for garbage collection to continue.
  *
+ * A slot has a single lock, taken atomically, so it is safe to call from any thread while others
+ * use the heap. Locking is not counted: while one caller holds the lock, any other attempt, from
+ * the same thread or another, returns NULL without waiting, and only the holder should unlock it.
+ *
  * @param slot The gc_slot from which to retrieve the pointer.
- * @return void* The pointer to the allocated memory. This pointer is valid until you call
- * gc_unlock_slot on the slot.
+ * @return void* The pointer to the allocated memory, or NULL if the slot is already locked. This
+ * pointer is valid until you call gc_unlock_slot on the slot.
  */
 void *gc_lock_slot(struct gc_slot *slot);
 
@@ -184,6 +474,9 @@ void gc_unlock_slot(struct gc_slot *slot);
  * memory may still be moved. Use \ref gc_lock_slot if you need to guarantee that the memory itself
  * will not be moved during garbage collection.
  *
+ * Rooting is a constant-time operation. A slot may be rooted more than once, in which case it
+ * remains a root until a matching number of \ref gc_unroot calls have been made.
+ *
  * @param gc The garbage collector instance to use.
  * @param ptr The pointer to the object to mark as a root object.
  */
@@ -192,12 +485,46 @@ void gc_root(struct gc *gc, struct gc_slot *slot);
 /**
  * @brief Remove the given object as a root object in the garbage collector.
  *
+ * Unrooting is a constant-time operation.
+ *
  * @param gc The garbage collector instance to use.
  * @param ptr The pointer to the object to remove as a root object.
  * @return int 1 if the object was previously a root object, 0 if it was not.
  */
 int gc_unroot(struct gc *gc, struct gc_slot *slot);
 
+/**
+ * @brief Open a new handle scope for temporary roots.
+ *
+ * Slots passed to \ref gc_scope_root after this call remain roots until the scope is closed with
+ * \ref gc_pop_handle_scope. Scopes nest; closing a scope also closes any scopes opened within it.
+ * Each attached thread (see \ref gc_thread_attach) has its own stack of scopes.
+ *
+ * @param gc The garbage collector instance to use.
+ * @return size_t An opaque handle for the scope, to be passed to \ref gc_pop_handle_scope.
+ */
+size_t gc_push_handle_scope(struct gc *gc);
+
+/**
+ * @brief Root the given slot in the current handle scope.
+ *
+ * This is cheaper than \ref gc_root and needs no matching unroot call, which makes it a good fit
+ * for temporaries that only need to survive until the end of the current operation.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param slot The slot to root. May be NULL.
+ * @return struct gc_slot* The slot passed in, or NULL if it could not be rooted.
+ */
+struct gc_slot *gc_scope_root(struct gc *gc, struct gc_slot *slot);
+
+/**
+ * @brief Close a handle scope, releasing all roots added since it was opened.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param scope The handle returned by the matching \ref gc_push_handle_scope call.
+ */
+void gc_pop_handle_scope(struct gc *gc, size_t scope);
+
 /**
  * @brief Set the marked flag on the given object in the garbage collector.
  *
@@ -210,15 +537,219 @@ int gc_unroot(struct gc *gc, struct gc_slot *slot);
  */
 int gc_mark(struct gc *gc, struct gc_slot *slot);
 
+/**
+ * @brief Record that the given object now holds a reference to another object.
+ *
+ * Minor cycles only trace the young space, so the garbage collector needs to know about objects in
+ * other spaces that reference young objects. Call this after storing a reference to \p child
+ * anywhere inside \p parent; it is cheap when \p parent is young or \p child is not.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param parent The object that now holds the reference.
+ * @param child The object being referenced. May be NULL, in which case this does nothing.
+ */
+void gc_write_barrier(struct gc *gc, struct gc_slot *parent, struct gc_slot *child);
+
+/**
+ * @brief Create a weak reference to the given object.
+ *
+ * A weak reference does not keep its object alive. Once the object is collected the reference is
+ * cleared, before the object's eraser runs.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param slot The object to refer to.
+ * @return struct gc_weak* The weak reference, or NULL if it could not be allocated. Release it with
+ * \ref gc_weak_free; any that remain are released by \ref gc_destroy.
+ */
+struct gc_weak *gc_weak_new(struct gc *gc, struct gc_slot *slot);
+
+/**
+ * @brief Get the object a weak reference refers to.
+ *
+ * @param weak The weak reference.
+ * @return struct gc_slot* The object, or NULL if it has been collected.
+ */
+struct gc_slot *gc_weak_get(struct gc_weak *weak);
+
+/**
+ * @brief Release a weak reference.
+ *
+ * @param gc The garbage collector instance that created the reference.
+ * @param weak The weak reference to release.
+ */
+void gc_weak_free(struct gc *gc, struct gc_weak *weak);
+
+/**
+ * @brief Create an ephemeron table.
+ *
+ * An ephemeron table maps key objects to value objects. A value is kept alive for as long as its
+ * key is alive, and no longer: references from the value back to its key don't keep the key
+ * alive. Entries are removed once their key is collected. This makes it possible to attach data to
+ * objects, or build caches, without leaking either.
+ *
+ * @param gc The garbage collector instance to use.
+ * @return struct gc_ephemeron_table* The table, or NULL if it could not be allocated. Release it
+ * with \ref gc_ephemeron_table_free; any that remain are released by \ref gc_destroy.
+ */
+struct gc_ephemeron_table *gc_ephemeron_table_new(struct gc *gc);
+
+/**
+ * @brief Release an ephemeron table. Its values are no longer kept alive by their keys.
+ *
+ * @param gc The garbage collector instance that created the table.
+ * @param table The table to release.
+ */
+void gc_ephemeron_table_free(struct gc *gc, struct gc_ephemeron_table *table);
+
+/**
+ * @brief Set the value for a key in an ephemeron table, replacing any existing value.
+ *
+ * @param gc The garbage collector instance that created the table.
+ * @param table The table to update.
+ * @param key The key object.
+ * @param value The value object.
+ * @return int 1 on success, 0 if the table could not be grown.
+ */
+int gc_ephemeron_set(struct gc *gc, struct gc_ephemeron_table *table, struct gc_slot *key,
+                     struct gc_slot *value);
+
+/**
+ * @brief Look up the value for a key in an ephemeron table.
+ *
+ * @return struct gc_slot* The value, or NULL if the key has no entry.
+ */
+struct gc_slot *gc_ephemeron_get(struct gc_ephemeron_table *table, struct gc_slot *key);
+
+/**
+ * @brief Remove the entry for a key from an ephemeron table.
+ *
+ * @return int 1 if the key had an entry, 0 otherwise.
+ */
+int gc_ephemeron_remove(struct gc_ephemeron_table *table, struct gc_slot *key);
+
+/**
+ * @brief Get the number of entries in an ephemeron table.
+ */
+size_t gc_ephemeron_count(struct gc_ephemeron_table *table);
+
+/**
+ * @brief Run the erasers of collected objects, and release their memory.
+ *
+ * This only has work to do if gc_config.defer_finalizers is set; otherwise every cycle runs its
+ * own erasers.
+ *
+ * @param gc The garbage collector instance to use.
+ * @return size_t The number of objects that were finalized.
+ */
+size_t gc_run_finalizers(struct gc *gc);
+
+/**
+ * @brief Attach the calling thread to the collector, so that it can share the heap with others.
+ *
+ * Once any thread is attached, every thread that uses the collector must be attached, and the
+ * collector's allocation functions must be thread-safe. Attached threads allocate small young
+ * objects from their own buffers without taking a lock, and are stopped at safepoints while a
+ * cycle runs. Space configuration should be done before any thread is attached.
+ *
+ * @param gc The garbage collector instance to use.
+ * @return int 1 on success, 0 if the thread's state could not be allocated.
+ */
+int gc_thread_attach(struct gc *gc);
+
+/**
+ * @brief Detach the calling thread from the collector. Its handle scopes are dropped.
+ *
+ * Every thread must be detached before the collector is destroyed.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_thread_detach(struct gc *gc);
+
+/**
+ * @brief Stop here if another thread is waiting to run a cycle.
+ *
+ * A cycle can only start once every other attached thread has reached a safepoint, so threads
+ * should call this regularly (every allocation is a safepoint too). It's cheap when no cycle is
+ * pending. Objects the thread is using must be reachable from roots or handle scopes.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_safepoint(struct gc *gc);
+
+/**
+ * @brief Mark the start of a stretch in which the calling thread won't touch the heap.
+ *
+ * Cycles can run while a thread is in a safe region, so wrap blocking calls in one to keep them
+ * from holding up other threads. The thread must not use the collector or any of its objects
+ * until \ref gc_leave_safe_region.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_enter_safe_region(struct gc *gc);
+
+/**
+ * @brief Mark the end of a safe region, waiting for any cycle in progress to finish.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_leave_safe_region(struct gc *gc);
+
+/**
+ * @brief Register the calling thread's stack to be scanned conservatively for roots.
+ *
+ * Every word on a registered stack (and in the thread's registers) that holds the address of a
+ * live slot keeps that slot's object alive, so slots held in local variables need no explicit
+ * rooting. Since objects are reached through their slots, such roots never pin the object memory.
+ * Raw object pointers are not recognized; lock the slot to keep using one.
+ *
+ * The stacks of attached threads are scanned whenever they are stopped at a safepoint or are in a
+ * safe region. A thread that isn't attached only has its stack scanned by cycles it runs itself.
+ * Stacks are assumed to grow down.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param base The highest address of the stack, or NULL to look it up (only supported on glibc).
+ * Scanning covers everything from the current stack pointer up to this address.
+ * @return int 1 on success, or 0 if the stack's bounds could not be found.
+ */
+int gc_register_stack(struct gc *gc, void *base);
+
+/**
+ * @brief Stop scanning the calling thread's stack for roots.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_unregister_stack(struct gc *gc);
+
 /**
  * @brief Runs a garbage collection cycle.
  *
+ * If only the young space is due for a sweep, this is a minor cycle: marking starts from the young
+ * roots and the objects recorded by \ref gc_write_barrier, and never traces objects in other
+ * spaces. Otherwise every root is traced across the whole heap.
+ *
+ * Attached threads are stopped at their next safepoint for the duration of the cycle.
+ *
  * @param gc The garbage collector instance to use.
  * @param stats An optional pointer to a gc_stats structure that will be filled with statistics
  * about the garbage collection cycle. If NULL, no statistics will be collected.
  */
 void gc_run(struct gc *gc, struct gc_stats *stats);
 
+/**
+ * @brief Compacts the old space.
+ *
+ * Unlocked old space objects are slid together into dense regions, so that the memory held by the
+ * old space stays proportional to the live data in it. If the old space is backed by a liballoc
+ * allocator, the allocator's arenas are compacted instead, releasing pages that are emptied. Locked
+ * objects are never moved; objects that are not locked may have a new address the next time they
+ * are locked. Cycles that sweep the old space compact it automatically once it is fragmented enough
+ * (see gc_config.compact_fragmentation).
+ *
+ * @param gc The garbage collector instance to use.
+ * @return size_t The number of bytes relocated.
+ */
+size_t gc_compact(struct gc *gc);
+
 /**
  * @brief Get statistics about the garbage collector.
  *
@@ -230,6 +761,41 @@ void gc_run(struct gc *gc, struct gc_stats *stats);
  */
 void gc_get_stats(struct gc *gc, struct gc_stats *stats);
 
+/**
+ * @brief Get the distribution of collection pause times.
+ *
+ * Every cycle is recorded, whether it was run by \ref gc_run or triggered by an allocation.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param stats A pointer to a gc_pause_stats structure that will be filled with statistics.
+ */
+void gc_get_pause_stats(struct gc *gc, struct gc_pause_stats *stats);
+
+/**
+ * @brief Discard all recorded pause times.
+ *
+ * @param gc The garbage collector instance to use.
+ */
+void gc_reset_pause_stats(struct gc *gc);
+
+/**
+ * @brief Write a snapshot of the heap to a file descriptor.
+ *
+ * Every live object is written with its size, space and outgoing references, along with the roots
+ * that keep objects alive (see GC_SNAPSHOT_MAGIC for the format). References are found by running
+ * each object's marker in a recording mode, so markers must not have side effects beyond calling
+ * \ref gc_mark. Attached threads are stopped while the snapshot is written.
+ *
+ * The snapshot is streamed through a fixed size buffer, so writing it never allocates memory in
+ * proportion to the size of the heap. The gc_snapshot tool reads snapshots back, and works out
+ * dominators and retained sizes.
+ *
+ * @param gc The garbage collector instance to use.
+ * @param fd The file descriptor to write to.
+ * @return int 1 on success, or 0 if a write failed or memory could not be allocated.
+ */
+int gc_heap_snapshot(struct gc *gc, int fd);
+
 /**
  * @brief Get the current space in which a slot is located.
  *
@@ -0,0 +1,53 @@
+#ifndef _POCKETKNIFE_HASH_BLOOM_H
+#define _POCKETKNIFE_HASH_BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_bloom;
+
+/**
+ * @brief A blocked Bloom filter, for cheap negative lookups.
+ *
+ * The filter is an array of 64-byte blocks, one cache line each. A key sets (and a lookup tests)
+ * eight bits in a single block, one in each of its 64-bit words, so a lookup costs one cache
+ * miss at most; with AVX2 the eight bits are tested with two vector instructions. Everything is
+ * derived from one 64-bit hash of the key: its high bits pick the block, and the bits within it
+ * come from double hashing, h1 + i * h2 for i from 0 to 7, with h1 and h2 taken from its halves.
+ *
+ * At 10 bits per key the false positive rate is around 1.2%, and at 16 around 0.2%. There are no
+ * false negatives. Keys can't be removed; see cuckoo.h for a filter that allows it.
+ *
+ * Filters are not thread-safe.
+ */
+
+// Creates a filter sized for keys keys at bits_per_key bits each. Returns NULL if memory runs out.
+struct hash_bloom *hash_bloom_new(size_t keys, size_t bits_per_key);
+void hash_bloom_destroy(struct hash_bloom *bloom);
+
+// Adds a key, hashed with hash_fast64 with a zero seed.
+void hash_bloom_add(struct hash_bloom *bloom, const uint8_t *key, size_t length);
+
+// Returns 0 if the key was never added, or 1 if it may have been.
+int hash_bloom_contains(const struct hash_bloom *bloom, const uint8_t *key, size_t length);
+
+// The same, for keys that have already been hashed, with hash_fnv1a, hash_fast64 or any other
+// 64-bit hash. A filter must always be given the same hash of the same key.
+void hash_bloom_add_hash(struct hash_bloom *bloom, uint64_t hash);
+int hash_bloom_contains_hash(const struct hash_bloom *bloom, uint64_t hash);
+
+// Removes every key.
+void hash_bloom_clear(struct hash_bloom *bloom);
+
+// Returns the size of the filter's bit array in bytes.
+size_t hash_bloom_bytes(const struct hash_bloom *bloom);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_BLOOM_H
@@ -0,0 +1,61 @@
+#ifndef _POCKETKNIFE_HASH_CONSISTENT_H
+#define _POCKETKNIFE_HASH_CONSISTENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Consistent hashing, for spreading keys over a changing set of shards so that a change moves as
+// few keys as possible. Every function takes a key's 64-bit hash (from hash_fast64, hash_fnv1a or
+// any other hash), and none of the lookups allocate.
+
+// Jump consistent hash (Lamping and Veach): returns a shard in [0, shards) for a hash, which must
+// be at least one. Going from n to n + 1 shards moves a 1 / (n + 1) share of keys, all of them to
+// the new shard, and keys are spread evenly. Shards can only be added or removed at the end, so
+// this suits numbered shards; it takes O(log shards) time and no memory.
+uint32_t hash_jump(uint64_t hash, uint32_t shards);
+
+// Rendezvous (highest random weight) hashing: returns the index in nodes of the node that scores
+// highest for a hash, or 0 if there are none. Any node can be added or removed, which only moves
+// keys to or from it. It takes O(count) time, so suits small sets of nodes; node ids are any
+// distinct 64-bit values.
+size_t hash_rendezvous(uint64_t hash, const uint64_t *nodes, size_t count);
+
+struct hash_ring;
+
+/**
+ * @brief A consistent hash ring with virtual nodes.
+ *
+ * Each node is hashed to a number of points (virtual nodes) on a ring of 64-bit values, and a key
+ * belongs to the node of the first point at or after its hash. Adding a node only moves keys to
+ * it, and removing one only moves its keys, to the nodes after each of its points. More points
+ * per node spread keys more evenly: with 100 the busiest node gets around 1.3 times its share,
+ * with 1000 around 1.1 times. Giving nodes different numbers of points weights them. Lookups are
+ * a binary search of the points, which are kept sorted in one array.
+ *
+ * Rings are not thread-safe.
+ */
+struct hash_ring *hash_ring_new(void);
+void hash_ring_destroy(struct hash_ring *ring);
+
+// Adds a node with the given number of points. Returns 1 if it was added, 0 if it was already in
+// the ring, or -1 if memory ran out, in which case the ring is unchanged.
+int hash_ring_add(struct hash_ring *ring, uint64_t node, size_t points);
+
+// Removes a node. Returns 1 if it was in the ring.
+int hash_ring_remove(struct hash_ring *ring, uint64_t node);
+
+// Sets *node to the node a hash belongs to. Returns 0 if the ring is empty.
+int hash_ring_lookup(const struct hash_ring *ring, uint64_t hash, uint64_t *node);
+
+// Returns the number of nodes in the ring.
+size_t hash_ring_size(const struct hash_ring *ring);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_CONSISTENT_H
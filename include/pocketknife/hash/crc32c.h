@@ -0,0 +1,52 @@
+#ifndef _POCKETKNIFE_HASH_CRC32C_H
+#define _POCKETKNIFE_HASH_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ways of computing the CRC. They all give the same checksums; the fastest one the CPU supports
+// is picked on first use. The hardware ones are only built for x86-64.
+enum HashCrc32cImpl {
+  // Portable: eight table lookups for every eight bytes (slicing-by-8).
+  HASH_CRC32C_TABLE = 0,
+
+  // The SSE4.2 crc32 instruction, eight bytes at a time.
+  HASH_CRC32C_SSE42 = 1,
+
+  // For large buffers, three crc32 streams over separate thirds of each block, which keeps the
+  // instruction's pipeline full, joined with carry-less multiplies (PCLMULQDQ). Smaller buffers
+  // are as for HASH_CRC32C_SSE42.
+  HASH_CRC32C_PCLMUL = 2,
+};
+
+// CRC-32C (Castagnoli), the checksum of iSCSI, SCTP, ext4 and many storage formats. Unlike the
+// hashes, it is guaranteed to detect any burst of errors up to 32 bits long.
+uint32_t hash_crc32c(const uint8_t *data, size_t length);
+
+// Incremental checksums, for data that arrives in pieces. Any sequence of updates produces the
+// same checksum as a single call over the concatenated data. Final doesn't change the state, so
+// more data can be fed in afterwards.
+struct hash_crc32c_state {
+  uint32_t crc;
+};
+
+void hash_crc32c_init(struct hash_crc32c_state *state);
+void hash_crc32c_update(struct hash_crc32c_state *state, const uint8_t *data, size_t length);
+uint32_t hash_crc32c_final(const struct hash_crc32c_state *state);
+
+// Returns the implementation in use.
+enum HashCrc32cImpl hash_crc32c_impl(void);
+
+// Switches to the given implementation, for testing and benchmarking. Returns 0, leaving the
+// implementation as it was, if the CPU doesn't support it.
+int hash_crc32c_set_impl(enum HashCrc32cImpl impl);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_CRC32C_H
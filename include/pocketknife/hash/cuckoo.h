@@ -0,0 +1,64 @@
+#ifndef _POCKETKNIFE_HASH_CUCKOO_H
+#define _POCKETKNIFE_HASH_CUCKOO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_cuckoo;
+
+/**
+ * @brief A cuckoo filter: an approximate set, like a Bloom filter, that also supports deletion.
+ *
+ * The filter stores a short fingerprint of each key in one of two buckets of four slots. Both
+ * come from one 64-bit hash of the key: its low bits are the fingerprint, its high bits pick the
+ * first bucket, and the second is the first xor a hash of the fingerprint, so either can be found
+ * from the other without the key. When both buckets are full, a resident fingerprint is moved to
+ * its other bucket to make room, and so on. A lookup reads two buckets and compares their four
+ * slots at once, within a word.
+ *
+ * Fingerprints are 8 or 16 bits. With 8 bits the false positive rate is around 3% at about 8.5
+ * bits per key; with 16 bits it is around 0.01% at about 17 bits per key. Tables hold up to 95%
+ * of their slots.
+ *
+ * A key added n times is stored n times, and must be erased n times to go away. Only keys that
+ * were added may be erased: erasing any other key may remove the fingerprint of one that was.
+ *
+ * Filters are not thread-safe.
+ */
+
+// Creates a filter with room for at least keys keys, with fingerprints of 8 or 16 bits. Returns
+// NULL if fingerprint_bits is anything else, or if memory runs out.
+struct hash_cuckoo *hash_cuckoo_new(size_t keys, unsigned fingerprint_bits);
+void hash_cuckoo_destroy(struct hash_cuckoo *cuckoo);
+
+// Adds a key, hashed with hash_fast64 with a zero seed. Returns 0 if the filter is full, leaving
+// it as it was.
+int hash_cuckoo_add(struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length);
+
+// Returns 0 if the key isn't in the filter, or 1 if it may be.
+int hash_cuckoo_contains(const struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length);
+
+// Removes a key that was added. Returns 1 if a fingerprint for it was found and removed.
+int hash_cuckoo_erase(struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length);
+
+// The same, for keys that have already been hashed, with hash_fnv1a, hash_fast64 or any other
+// 64-bit hash. A filter must always be given the same hash of the same key.
+int hash_cuckoo_add_hash(struct hash_cuckoo *cuckoo, uint64_t hash);
+int hash_cuckoo_contains_hash(const struct hash_cuckoo *cuckoo, uint64_t hash);
+int hash_cuckoo_erase_hash(struct hash_cuckoo *cuckoo, uint64_t hash);
+
+// Returns the number of fingerprints stored.
+size_t hash_cuckoo_size(const struct hash_cuckoo *cuckoo);
+
+// Returns the size of the filter's table in bytes.
+size_t hash_cuckoo_bytes(const struct hash_cuckoo *cuckoo);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_CUCKOO_H
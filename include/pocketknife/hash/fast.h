@@ -0,0 +1,66 @@
+#ifndef _POCKETKNIFE_HASH_FAST_H
+#define _POCKETKNIFE_HASH_FAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash128 {
+  uint64_t low;
+  uint64_t high;
+};
+
+// Bulk loops that hash_fast64 and hash_fast128 can use for long inputs. They all produce the same
+// hashes; the fastest one the CPU supports is picked on first use.
+enum HashFastImpl {
+  HASH_FAST_SCALAR = 0,
+  HASH_FAST_SSE2 = 1,
+  HASH_FAST_AVX2 = 2,
+};
+
+// Word-at-a-time hashes with wide-multiply mixing. Inputs of up to 240 bytes are folded 16 bytes
+// at a time through 64x64->128-bit multiplies; longer inputs are consumed in 64 byte stripes by
+// eight independent accumulators, which the SIMD loops update in parallel. Not suitable where an
+// attacker must not be able to find collisions.
+uint64_t hash_fast64(const uint8_t *data, size_t length, uint64_t seed);
+
+// The 128-bit variant. Its low half is always equal to hash_fast64 of the same input and seed.
+struct hash128 hash_fast128(const uint8_t *data, size_t length, uint64_t seed);
+
+// Incremental hashing, for input that arrives in pieces. Any sequence of updates produces the same
+// hashes as a single call over the concatenated input with the same seed. The state holds up to
+// HASH_FAST_STATE_BUFFER bytes that haven't been consumed yet; longer updates are consumed
+// straight from the caller's buffer. Final doesn't change the state, so more data can be fed in
+// afterwards. The fields are private.
+#define HASH_FAST_STATE_BUFFER 256
+
+struct hash_fast_state {
+  uint64_t acc[8];
+  uint64_t key[24];
+  uint64_t seed;
+  uint64_t length;
+  size_t position;
+  size_t buffered;
+  uint8_t buffer[HASH_FAST_STATE_BUFFER];
+};
+
+void hash_fast_init(struct hash_fast_state *state, uint64_t seed);
+void hash_fast_update(struct hash_fast_state *state, const uint8_t *data, size_t length);
+uint64_t hash_fast64_final(const struct hash_fast_state *state);
+struct hash128 hash_fast128_final(const struct hash_fast_state *state);
+
+// Returns the bulk loop in use.
+enum HashFastImpl hash_fast_impl(void);
+
+// Switches to the given bulk loop, for testing and benchmarking. Returns 0, leaving the loop as it
+// was, if the CPU doesn't support it.
+int hash_fast_set_impl(enum HashFastImpl impl);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_FAST_H
@@ -11,6 +11,30 @@ extern "C" {
 uint64_t hash_fnv1(const uint8_t *data, size_t length);
 uint64_t hash_fnv1a(const uint8_t *data, size_t length);
 
+// Hashes count keys, writing the hash of keys[i], which is lengths[i] bytes long, to hashes[i].
+// On x86-64 CPUs with AVX2, keys are hashed sixteen at a time across SIMD lanes, which is about
+// twice as fast as a loop for short keys. Each group of sixteen takes as long as its longest key,
+// so this only pays off when the keys are of similar lengths.
+void hash_fnv1_batch(const uint8_t *const *keys, const size_t *lengths, size_t count,
+                     uint64_t *hashes);
+void hash_fnv1a_batch(const uint8_t *const *keys, const size_t *lengths, size_t count,
+                      uint64_t *hashes);
+
+// Incremental hashing, for input that arrives in pieces. Any sequence of updates produces the same
+// hash as a single call over the concatenated input. Final doesn't change the state, so more data
+// can be fed in afterwards.
+struct hash_fnv_state {
+  uint64_t hash;
+};
+
+void hash_fnv1_init(struct hash_fnv_state *state);
+void hash_fnv1_update(struct hash_fnv_state *state, const uint8_t *data, size_t length);
+uint64_t hash_fnv1_final(const struct hash_fnv_state *state);
+
+void hash_fnv1a_init(struct hash_fnv_state *state);
+void hash_fnv1a_update(struct hash_fnv_state *state, const uint8_t *data, size_t length);
+uint64_t hash_fnv1a_final(const struct hash_fnv_state *state);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -0,0 +1,60 @@
+#ifndef _POCKETKNIFE_HASH_FNV_HPP
+#define _POCKETKNIFE_HASH_FNV_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace pocketknife::hash {
+
+inline constexpr uint64_t kFNVOffsetBasis = 0xcbf29ce484222325ULL;
+inline constexpr uint64_t kFNVPrime = 0x100000001b3ULL;
+
+// Compile-time versions of hash_fnv1 and hash_fnv1a from fnv.h, which hash the same bytes to the
+// same values, so hashes computed either way can be compared. Characters are hashed as unsigned
+// bytes, as the C functions see them.
+constexpr uint64_t fnv1(std::string_view data) {
+  uint64_t hash = kFNVOffsetBasis;
+  for (char c : data) {
+    hash *= kFNVPrime;
+    hash ^= static_cast<unsigned char>(c);
+  }
+  return hash;
+}
+
+constexpr uint64_t fnv1a(std::string_view data) {
+  uint64_t hash = kFNVOffsetBasis;
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= kFNVPrime;
+  }
+  return hash;
+}
+
+namespace literals {
+
+// "name"_fnv1a is the FNV-1a hash of the literal's characters, without the terminating NUL. The
+// literals are consteval, so they never cost anything at run time, and they can be used as case
+// labels when switching on a hash computed at run time:
+//
+//   using namespace pocketknife::hash::literals;
+//   switch (hash_fnv1a(name, length)) {
+//     case "get"_fnv1a: ...
+//     case "set"_fnv1a: ...
+//   }
+//
+// A hash match doesn't imply a key match, so unless the set of possible keys is known, compare
+// the key itself as well. Two labels that collide fail to compile as duplicate cases.
+consteval uint64_t operator""_fnv1(const char *data, size_t length) {
+  return fnv1(std::string_view(data, length));
+}
+
+consteval uint64_t operator""_fnv1a(const char *data, size_t length) {
+  return fnv1a(std::string_view(data, length));
+}
+
+}  // namespace literals
+
+}  // namespace pocketknife::hash
+
+#endif  // _POCKETKNIFE_HASH_FNV_HPP
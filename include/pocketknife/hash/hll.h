@@ -0,0 +1,83 @@
+#ifndef _POCKETKNIFE_HASH_HLL_H
+#define _POCKETKNIFE_HASH_HLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_hll;
+
+/**
+ * @brief A HyperLogLog sketch, for estimating the number of distinct keys in a stream.
+ *
+ * A sketch of precision p has m = 2^p registers. Each key is hashed to 64 bits: the top p bits
+ * pick a register, and the register keeps the highest rank seen, the number of leading zeros in
+ * the remaining bits plus one. The estimate is computed from the histogram of the registers with
+ * Ertl's improved estimator, which needs no bias correction tables and is accurate from zero keys
+ * up; its standard error is about 1.04 / sqrt(m), so 0.81% at the default precision of 14.
+ *
+ * Memory is bounded by the precision, not the stream. A new sketch is sparse: a small hash table
+ * of the registers that have been set, which grows with the number of distinct keys until it
+ * would be as large as the registers themselves, when the sketch becomes dense, one byte per
+ * register. Many small sketches, such as one per tenant, so take little memory, and both
+ * representations give exactly the same estimates.
+ *
+ * Sketches of the same precision merge into the sketch of the union of their streams, so a
+ * stream can be counted in parts, by several threads or processes, and the parts merged; dense
+ * sketches merge with vector max instructions. Serialized sketches are the same on every
+ * machine.
+ *
+ * Sketches are not thread-safe: each thread should count into its own and merge them.
+ */
+
+#define HASH_HLL_MIN_PRECISION 4
+#define HASH_HLL_MAX_PRECISION 18
+#define HASH_HLL_DEFAULT_PRECISION 14
+
+// Creates an empty sketch with 2^precision registers. Returns NULL if the precision is out of
+// range or memory runs out.
+struct hash_hll *hash_hll_new(int precision);
+void hash_hll_destroy(struct hash_hll *hll);
+
+// Adds a key, hashed with hash_fast64 with a zero seed. Returns 1 if the sketch changed, 0 if not,
+// or -1 if memory ran out, in which case the sketch is unchanged.
+int hash_hll_add(struct hash_hll *hll, const uint8_t *key, size_t length);
+
+// The same, for keys that have already been hashed, with hash_fast64 or any other 64-bit hash of
+// good quality. Every sketch that is merged must be given the same hash of the same key.
+int hash_hll_add_hash(struct hash_hll *hll, uint64_t hash);
+
+// Returns the estimated number of distinct keys added.
+double hash_hll_estimate(const struct hash_hll *hll);
+
+// Merges src into dst, so that dst estimates the keys added to either. Returns 1, 0 if their
+// precisions differ, or -1 if memory ran out; in both cases dst is unchanged.
+int hash_hll_merge(struct hash_hll *dst, const struct hash_hll *src);
+
+// Removes every key, keeping the memory the sketch has.
+void hash_hll_clear(struct hash_hll *hll);
+
+// Returns the precision.
+int hash_hll_precision(const struct hash_hll *hll);
+
+// Returns the size of the sketch's registers, or of its table while sparse, in bytes.
+size_t hash_hll_bytes(const struct hash_hll *hll);
+
+// Serializes a sketch into out if it has room for it, and returns its size in bytes either way,
+// so a call with a size of 0 returns the size to allocate. A sparse sketch is at most 3 bytes per
+// register set, and a dense one 2^precision bytes, plus a 4-byte header. Sparse registers are
+// written in the order of the table, so equal sketches can serialize to different bytes.
+size_t hash_hll_serialize(const struct hash_hll *hll, uint8_t *out, size_t size);
+
+// Creates a sketch from size bytes written by hash_hll_serialize. Returns NULL if they are not a
+// valid sketch, or if memory runs out.
+struct hash_hll *hash_hll_deserialize(const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_HLL_H
@@ -0,0 +1,96 @@
+#ifndef _POCKETKNIFE_HASH_MAP_H
+#define _POCKETKNIFE_HASH_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_map;
+
+// Whether a map is keyed by byte strings (copied into the map on insert) or by 64-bit integers.
+// Each map holds one kind of key, and only the functions for that kind may be used with it.
+enum HashMapKeys {
+  HASH_MAP_STRING_KEYS = 0,
+  HASH_MAP_INT_KEYS = 1,
+};
+
+// Hashes a key. Integer keys are hashed as their eight little-endian bytes. hash_fnv1a and
+// hash_fnv1 can be used as they are.
+typedef uint64_t (*HashMapHashFunc)(const uint8_t *data, size_t length);
+
+typedef void *(*HashMapAllocateFunc)(void *context, size_t size);
+typedef void (*HashMapFreeFunc)(void *context, void *ptr);
+
+struct hash_map_config {
+  enum HashMapKeys keys;
+
+  // Hash function for keys. Defaults to hash_fast64 with a zero seed.
+  HashMapHashFunc hash;
+
+  // Allocator for the map, its table and its copies of string keys, passed allocator_context
+  // with every call. Both must be set together; they default to malloc() and free(). To keep a
+  // map in a liballoc arena, pass functions that call allocator_alloc and allocator_free.
+  HashMapAllocateFunc alloc;
+  HashMapFreeFunc free;
+  void *allocator_context;
+
+  // Number of entries the map can hold before it first grows.
+  size_t capacity;
+};
+
+// An entry, as returned by hash_map_next. For integer keys, key and length are zero.
+struct hash_map_entry {
+  const char *key;
+  size_t length;
+  uint64_t int_key;
+  void *value;
+};
+
+/**
+ * @brief An open-addressing hash map in the style of SwissTable.
+ *
+ * Slots are grouped in sixteens, with a control byte per slot holding either seven bits of the
+ * key's hash or an empty or deleted marker. A lookup compares a whole group of control bytes at
+ * once (with SSE2 where available), so it only touches the slots whose hash bits match, and
+ * stops at the first group with an empty slot. Tables are kept at most 7/8 full.
+ *
+ * Maps are not thread-safe.
+ */
+struct hash_map *hash_map_new(enum HashMapKeys keys);
+struct hash_map *hash_map_new_with_config(const struct hash_map_config *config);
+void hash_map_destroy(struct hash_map *map);
+
+size_t hash_map_size(const struct hash_map *map);
+
+// Inserts or replaces the value for a key. Returns 1 if the key was added, 0 if its value was
+// replaced, or -1 if memory ran out, in which case the map is unchanged.
+int hash_map_insert(struct hash_map *map, const char *key, size_t length, void *value);
+int hash_map_insert_int(struct hash_map *map, uint64_t key, void *value);
+
+// Returns the value for a key, or NULL if the key isn't in the map.
+void *hash_map_lookup(const struct hash_map *map, const char *key, size_t length);
+void *hash_map_lookup_int(const struct hash_map *map, uint64_t key);
+
+// Returns 1 if the key is in the map, even if its value is NULL.
+int hash_map_contains(const struct hash_map *map, const char *key, size_t length);
+int hash_map_contains_int(const struct hash_map *map, uint64_t key);
+
+// Removes a key. Returns 1 if it was in the map.
+int hash_map_erase(struct hash_map *map, const char *key, size_t length);
+int hash_map_erase_int(struct hash_map *map, uint64_t key);
+
+// Removes every entry, keeping the table's memory.
+void hash_map_clear(struct hash_map *map);
+
+// Iterates over the entries in table order. Start with *position zero; returns 0 once there are
+// no more entries. The map must not be changed during iteration.
+int hash_map_next(const struct hash_map *map, size_t *position, struct hash_map_entry *entry);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_MAP_H
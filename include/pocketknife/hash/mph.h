@@ -0,0 +1,57 @@
+#ifndef _POCKETKNIFE_HASH_MPH_H
+#define _POCKETKNIFE_HASH_MPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_mph;
+
+/**
+ * @brief A minimal perfect hash function for a fixed set of keys, in the style of PTHash.
+ *
+ * Maps each of the count keys it was built from to a distinct index in [0, count), so a static
+ * dictionary can be an array indexed by it. A key is hashed once with hash_fast128: the low half
+ * picks one of about 5 * count / log2(count) buckets, and the high half, mixed with a small
+ * displacement (pilot) stored for its bucket, picks its position. The builder searches for pilots
+ * that place every bucket's keys in free positions, largest buckets first. Positions range over
+ * about 3% more slots than keys, which keeps the pilots small; the keys placed in the extra slots
+ * are sent to the free indexes below count through a table. Lookups are O(1) in the worst case:
+ * a hash, a read of a packed pilot, and at most one read of the table. The structure takes around
+ * four bits per key.
+ *
+ * Keys that are not in the set map to arbitrary indexes in range, so a dictionary that may be
+ * asked about other keys must also store its keys and compare them.
+ *
+ * The structure is a single flat buffer, which can be written out as it is (hash_mph_bytes bytes
+ * starting at the pointer) and used again with hash_mph_view, in the byte order of the machine
+ * that built it.
+ */
+
+// Builds the function for count distinct keys, where keys[i] is lengths[i] bytes long. Returns
+// NULL if a key appears twice, if there are 2^32 keys or more, or if memory runs out.
+struct hash_mph *hash_mph_build(const uint8_t *const *keys, const size_t *lengths, size_t count);
+void hash_mph_destroy(struct hash_mph *mph);
+
+// Returns the index of a key in [0, count), which is distinct for every key in the set.
+size_t hash_mph_lookup(const struct hash_mph *mph, const uint8_t *key, size_t length);
+
+// Returns the number of keys.
+size_t hash_mph_count(const struct hash_mph *mph);
+
+// Returns the size of the structure's buffer in bytes.
+size_t hash_mph_bytes(const struct hash_mph *mph);
+
+// Checks that size bytes at data hold a structure written out from hash_mph_build, and returns
+// it without copying; data must stay valid while it is used, and not be passed to
+// hash_mph_destroy. Returns NULL if data isn't 8-byte aligned or isn't a valid structure.
+const struct hash_mph *hash_mph_view(const void *data, size_t size);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // _POCKETKNIFE_HASH_MPH_H
@@ -7,11 +7,22 @@
 #include "internal.h"
 #include <sys/mman.h>
 
+// Bytes at the start of the region used for the allocator's own structures.
+static size_t allocator_metadata_size(size_t size) {
+  size_t num_pages = size / PAGE_SIZE;
+  size_t owners = sizeof(struct allocator) + (sizeof(uint8_t) * num_pages);
+  owners = (owners + _Alignof(struct arena_page) - 1) & ~(_Alignof(struct arena_page) - 1);
+  return owners + (sizeof(struct arena_page) * num_pages);
+}
+
 static int check_allocator_size(size_t size) {
-  size_t minimum_required = sizeof(struct allocator) + (sizeof(uint8_t) * (size / 4096));
-  if (size < minimum_required) {
+  if (size == 0 || size % PAGE_SIZE != 0) {
     return 0;
-  } else if (size % 4096 != 0) {
+  }
+
+  // There needs to be at least one page left over once the metadata is in place.
+  size_t metadata_pages = (allocator_metadata_size(size) + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (metadata_pages >= size / PAGE_SIZE) {
     return 0;
   }
 
@@ -43,62 +54,47 @@ struct allocator *allocator_new_with_region(void *base, size_t size) {
 
   if (!check_allocator_size(size)) {
     return NULL;
-  } else if ((uintptr_t)base % 4096 != 0) {
+  } else if ((uintptr_t)base % PAGE_SIZE != 0) {
     return NULL;
   } else if (!base || size == 0) {
     return NULL;
   }
 
+  size_t num_pages = size / PAGE_SIZE;
+  size_t metadata_size = allocator_metadata_size(size);
+
   struct allocator *allocator = (struct allocator *)base;
-  memset(allocator, 0, sizeof(struct allocator));
+  memset(allocator, 0, metadata_size);
   allocator->region = base;
   allocator->region_size = size;
   allocator->is_fully_owned = 0;
-  allocator->free_blocks = NULL;
   allocator->page_owners = (uint8_t *)((char *)base + sizeof(struct allocator));
+  allocator->page_meta =
+      (struct arena_page *)((char *)base + metadata_size - (sizeof(struct arena_page) * num_pages));
 
-  size_t struct_sizes = sizeof(struct allocator) + (sizeof(uint8_t) * (size / 4096));
-
-  // Pin the internal pages for the allocator and owners field
-  for (size_t i = 0; i < (struct_sizes + 4095) / 4096; ++i) {
+  // Pin the internal pages for the allocator, owners and page metadata
+  allocator->first_free_page = (metadata_size + PAGE_SIZE - 1) / PAGE_SIZE;
+  for (size_t i = 0; i < allocator->first_free_page; ++i) {
     allocator->page_owners[i] = PAGE_OWNER_INTERNAL;
   }
 
+  for (size_t i = 0; i < num_pages; ++i) {
+    allocator->page_meta[i].base = (char *)base + (i * PAGE_SIZE);
+  }
+
   // Configure arenas
   for (size_t i = 0; i < 8; ++i) {
     allocator->arenas[i].which = i;
     allocator->arenas[i].parent = allocator;
     allocator->arenas[i].block_size = 1 << (i + 4);  // 16, 32, 64, ..., 2048
-    allocator->arenas[i].blocks_per_page = 4096 / allocator->arenas[i].block_size;
+    allocator->arenas[i].blocks_per_page = PAGE_SIZE / allocator->arenas[i].block_size;
     // TODO: consider pre-allocating some pages for each arena
-    allocator->arenas[i].free_list = NULL;
     allocator->arenas[i].pages = NULL;
+    allocator->arenas[i].pages_tail = NULL;
     allocator->arenas[i].free_count = 0;
     allocator->arenas[i].used_count = 0;
   }
 
-  // Set up the page structs
-  size_t num_pages = size / 4096;
-  void *struct_page_base = get_free_allocator_page(allocator, PAGE_OWNER_INTERNAL);
-  if (!struct_page_base) {
-    return NULL;
-  }
-  for (size_t i = 0; i < num_pages; ++i) {
-    struct arena_page *page =
-        (struct arena_page *)((char *)struct_page_base + ((i % 4096) * sizeof(struct arena_page)));
-    memset(page, 0, sizeof(struct arena_page));
-
-    page->next = allocator->free_arena_pages;
-    allocator->free_arena_pages = page;
-
-    if (i % 4096 == 0) {
-      struct_page_base = get_free_allocator_page(allocator, PAGE_OWNER_INTERNAL);
-      if (!struct_page_base) {
-        return NULL;
-      }
-    }
-  }
-
   return allocator;
 }
 
@@ -116,76 +112,67 @@ int is_within_allocator_region(struct allocator *allocator, void *ptr) {
           (char *)ptr < (char *)allocator->region + allocator->region_size);
 }
 
-void *get_free_allocator_page(struct allocator *allocator, int owner) {
-  for (size_t i = 0; i < allocator->region_size / 4096; ++i) {
-    if (allocator->page_owners[i] == PAGE_OWNER_FREE) {
-      allocator->page_owners[i] = owner;
-      void *page = (char *)allocator->region + (i * 4096);
-      return page;
-    }
-  }
-
-  return NULL;
+size_t allocator_page_index(struct allocator *allocator, void *ptr) {
+  return (size_t)((char *)ptr - (char *)allocator->region) / PAGE_SIZE;
 }
 
-struct block *allocator_alloc_block(struct allocator *allocator) {
-  if (allocator->free_blocks) {
-    struct block *block = allocator->free_blocks;
-    allocator->free_blocks = block->next;
-    return block;
-  }
+void *get_free_allocator_pages(struct allocator *allocator, size_t count, int owner) {
+  size_t num_pages = allocator->region_size / PAGE_SIZE;
+  size_t run = 0;
+  for (size_t i = allocator->first_free_page; i < num_pages; ++i) {
+    if (allocator->page_owners[i] != PAGE_OWNER_FREE) {
+      run = 0;
+      continue;
+    }
 
-  void *page = get_free_allocator_page(allocator, PAGE_OWNER_INTERNAL_BLOCK);
-  if (!page) {
-    return NULL;
-  }
+    if (++run < count) {
+      continue;
+    }
 
-  struct block *block = (struct block *)page;
-  block->at = page;
-  block->next = NULL;
-  size_t block_size = 4096 / sizeof(struct block);
+    size_t first = i + 1 - count;
+    allocator->page_owners[first] = owner;
+    for (size_t j = first + 1; j <= i; ++j) {
+      allocator->page_owners[j] = count > 1 ? PAGE_OWNER_LARGE_CONTINUATION : owner;
+    }
 
-  // add the rest of the blocks to our free list now
-  for (size_t i = 1; i < block_size; ++i) {
-    struct block *next_block = (struct block *)((char *)page + (i * sizeof(struct block)));
-    next_block->at = (char *)page + (i * sizeof(struct block));
-    next_block->next = allocator->free_blocks;
-    allocator->free_blocks = next_block;
-  }
+    if (first == allocator->first_free_page) {
+      allocator->first_free_page = i + 1;
+    }
 
-  return block;
-}
+    return (char *)allocator->region + (first * PAGE_SIZE);
+  }
 
-void allocator_free_block(struct allocator *allocator, struct block *block) {
-  block->next = allocator->free_blocks;
-  allocator->free_blocks = block;
+  return NULL;
 }
 
-struct arena_page *allocator_alloc_arena_page_meta(struct allocator *allocator) {
-  struct arena_page *page = allocator->free_arena_pages;
-  allocator->free_arena_pages = page->next;
-  page->next = NULL;
-  return page;
+void *get_free_allocator_page(struct allocator *allocator, int owner) {
+  return get_free_allocator_pages(allocator, 1, owner);
 }
 
-void allocator_free_arena_page_meta(struct allocator *allocator, struct arena_page *page) {
-  page->next = allocator->free_arena_pages;
-  allocator->free_arena_pages = page;
-}
+void free_allocator_pages(struct allocator *allocator, void *page, size_t count) {
+  size_t index = allocator_page_index(allocator, page);
+  for (size_t i = index; i < index + count; ++i) {
+    allocator->page_owners[i] = PAGE_OWNER_FREE;
+  }
 
-void free_allocator_page(struct allocator *allocator, void *page) {
-  ptrdiff_t index = ((char *)page - (char *)allocator->region) / 4096;
+  if (index < allocator->first_free_page) {
+    allocator->first_free_page = index;
+  }
 
-  allocator->page_owners[index] = 255;
-  madvise(page, 0, MADV_DONTNEED);
+  if (allocator->is_fully_owned) {
+    madvise(page, count * PAGE_SIZE, MADV_DONTNEED);
+  }
 }
 
 void *allocator_alloc(struct allocator *allocator, size_t size) {
-  (void)allocator;
-
   // We don't use arenas for anything >2K - doesn't make sense to have the arena overhead
   if (size > 2048) {
-    return get_free_allocator_page(allocator, PAGE_OWNER_LARGE_ALLOCATION);
+    size_t count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    void *pages = get_free_allocator_pages(allocator, count, PAGE_OWNER_LARGE_ALLOCATION);
+    if (pages) {
+      allocator->page_meta[allocator_page_index(allocator, pages)].run_pages = count;
+    }
+    return pages;
   } else if (size == 0) {
     return NULL;
   }
@@ -194,37 +181,54 @@ void *allocator_alloc(struct allocator *allocator, size_t size) {
     size = 16;  // minimum allocation size
   }
 
-  return arena_alloc(&allocator->arenas[bitwise_log2(size) - 4]);
+  // Round up to the next power of two
+  return arena_alloc(&allocator->arenas[bitwise_log2(size - 1) + 1 - 4]);
 }
 
 void allocator_free(struct allocator *allocator, void *ptr) {
   assert(is_within_allocator_region(allocator, ptr));
 
-  size_t nth_page = ((char *)ptr - (char *)allocator->region) / 4096;
-  if (allocator->page_owners[nth_page] == PAGE_OWNER_LARGE_ALLOCATION) {
-    // Large allocation - just use munmap
-    free_allocator_page(allocator, ptr);
-  } else if (allocator->page_owners[nth_page] == PAGE_OWNER_INTERNAL_BLOCK) {
-    // Free a block
-    struct block *block = (struct block *)ptr;
-    allocator_free_block(allocator, block);
+  size_t nth_page = allocator_page_index(allocator, ptr);
+  uint8_t owner = allocator->page_owners[nth_page];
+  if (owner == PAGE_OWNER_LARGE_ALLOCATION) {
+    free_allocator_pages(allocator, ptr, allocator->page_meta[nth_page].run_pages);
   } else {
     // Free an arena allocation - arenas are 1-indexed (free is zero)
-    arena_free(&allocator->arenas[allocator->page_owners[nth_page] - 1], ptr);
+    assert(owner >= 1 && owner <= 8);
+    arena_free(&allocator->arenas[owner - 1], ptr);
   }
 }
 
 int allocator_should_compact(struct allocator *allocator) {
-  (void)allocator;
+  for (size_t i = 0; i < 8; ++i) {
+    if (arena_should_compact(&allocator->arenas[i])) {
+      return 1;
+    }
+  }
 
-  // TODO: check for fragmentation, large free lists in arenas, etc
   return 0;
 }
 
+struct allocator_move_context {
+  AllocatorMoveCallback callback;
+};
+
+static int allocator_notify_move(void *context, void *old_ptr, void *new_ptr) {
+  struct allocator_move_context *move = (struct allocator_move_context *)context;
+  if (move->callback) {
+    move->callback(old_ptr, new_ptr);
+  }
+  return 1;
+}
+
 void allocator_compact(struct allocator *allocator, AllocatorMoveCallback callback) {
-  // try and see if we can free full pages from our struct block free list...
+  struct allocator_move_context context = {callback};
+  allocator_compact_with_context(allocator, allocator_notify_move, &context);
+}
 
-  for (int i = 0; i < 12; ++i) {
-    arena_compact(&allocator->arenas[i], callback);
+void allocator_compact_with_context(struct allocator *allocator,
+                                    AllocatorRelocateCallback callback, void *context) {
+  for (size_t i = 0; i < 8; ++i) {
+    arena_compact(&allocator->arenas[i], callback, context);
   }
 }
@@ -3,82 +3,224 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "internal.h"
 
-void *arena_alloc(struct arena *arena) {
-  if (!arena->free_list) {
-    void *new_block = get_free_allocator_page(arena->parent, arena->which + 1);
-    if (!new_block) {
-      return NULL;
+static void arena_unlink_page(struct arena *arena, struct arena_page *page) {
+  if (page->prev) {
+    page->prev->next = page->next;
+  } else {
+    arena->pages = page->next;
+  }
+
+  if (page->next) {
+    page->next->prev = page->prev;
+  } else {
+    arena->pages_tail = page->prev;
+  }
+
+  page->next = NULL;
+  page->prev = NULL;
+}
+
+static void arena_push_front(struct arena *arena, struct arena_page *page) {
+  page->prev = NULL;
+  page->next = arena->pages;
+  if (arena->pages) {
+    arena->pages->prev = page;
+  } else {
+    arena->pages_tail = page;
+  }
+  arena->pages = page;
+}
+
+static void arena_push_back(struct arena *arena, struct arena_page *page) {
+  page->next = NULL;
+  page->prev = arena->pages_tail;
+  if (arena->pages_tail) {
+    arena->pages_tail->next = page;
+  } else {
+    arena->pages = page;
+  }
+  arena->pages_tail = page;
+}
+
+static struct arena_page *arena_new_page(struct arena *arena) {
+  void *base = get_free_allocator_page(arena->parent, (int)arena->which + 1);
+  if (!base) {
+    return NULL;
+  }
+
+  struct arena_page *page =
+      &arena->parent->page_meta[allocator_page_index(arena->parent, base)];
+  memset(page->bitmap, 0, sizeof(page->bitmap));
+  page->used_count = 0;
+  page->pinned = 0;
+
+  arena_push_front(arena, page);
+  arena->free_count += arena->blocks_per_page;
+  return page;
+}
+
+static void arena_release_page(struct arena *arena, struct arena_page *page) {
+  assert(page->used_count == 0);
+
+  arena_unlink_page(arena, page);
+  arena->free_count -= arena->blocks_per_page;
+  free_allocator_pages(arena->parent, page->base, 1);
+}
+
+// Takes a free block from the given page, which must have one.
+static void *arena_take_block(struct arena *arena, struct arena_page *page) {
+  size_t words = (arena->blocks_per_page + 63) / 64;
+  for (size_t word = 0; word < words; ++word) {
+    uint64_t free_bits = ~page->bitmap[word];
+    if (arena->blocks_per_page < 64) {
+      free_bits &= (1ULL << arena->blocks_per_page) - 1;
     }
 
-    struct arena_page *new_page_meta = allocator_alloc_arena_page_meta(arena->parent);
-    if (!new_page_meta) {
-      return NULL;
+    if (!free_bits) {
+      continue;
     }
 
-    // generate the free list for this new block now
-    for (size_t i = 0; i < arena->blocks_per_page; ++i) {
-      struct block *new_block_struct = allocator_alloc_block(arena->parent);
-      new_block_struct->at = (char *)new_block + (i * arena->block_size);
-      new_block_struct->next = arena->free_list;
-      arena->free_list = new_block_struct;
+    size_t bit = (size_t)__builtin_ctzll(free_bits);
+    page->bitmap[word] |= 1ULL << bit;
+    page->used_count++;
+    arena->free_count--;
+    arena->used_count++;
+
+    // Full pages go to the back, behind every page that still has room.
+    if (page->used_count == arena->blocks_per_page && page != arena->pages_tail) {
+      arena_unlink_page(arena, page);
+      arena_push_back(arena, page);
     }
 
-    new_page_meta->base = new_block;
-    new_page_meta->bitmap = 0;
-    new_page_meta->used_count = 0;
-    new_page_meta->free_count = arena->blocks_per_page;
-    new_page_meta->next = arena->pages;
-    arena->pages = new_page_meta;
-    arena->free_count += arena->blocks_per_page;
+    return (char *)page->base + (((word * 64) + bit) * arena->block_size);
   }
 
-  struct block *block = arena->free_list;
-  arena->free_list = block->next;
+  assert(0 && "arena page has no free blocks");
+  return NULL;
+}
 
-  void *result = block->at;
+// Marks a block free, without releasing its page.
+static struct arena_page *arena_put_block(struct arena *arena, void *ptr) {
+  struct arena_page *page = &arena->parent->page_meta[allocator_page_index(arena->parent, ptr)];
+  size_t block = (size_t)((char *)ptr - (char *)page->base) / arena->block_size;
+  uint64_t bit = 1ULL << (block & 63);
 
-  arena->free_count--;
-  arena->used_count++;
+  assert(page->bitmap[block / 64] & bit);
 
-  allocator_free_block(arena->parent, block);
+  if (page->used_count == arena->blocks_per_page) {
+    arena_unlink_page(arena, page);
+    arena_push_front(arena, page);
+  }
 
-  // TODO: set the bitmap in struct arena_page for this block
-  return block->at;
+  page->bitmap[block / 64] &= ~bit;
+  page->used_count--;
+  arena->free_count++;
+  arena->used_count--;
+  return page;
 }
 
-void arena_free(struct arena *arena, void *ptr) {
-  (void)arena;
-  (void)ptr;
-
+void *arena_alloc(struct arena *arena) {
   struct arena_page *page = arena->pages;
-  while (page) {
-    if ((char *)ptr >= (char *)page->base && (char *)ptr < (char *)page->base + 4096) {
-      // Found the page containing the pointer
-      break;
+  if (!page || page->used_count == arena->blocks_per_page) {
+    page = arena_new_page(arena);
+    if (!page) {
+      return NULL;
     }
-    page = page->next;
   }
 
-  assert(page != NULL);
+  return arena_take_block(arena, page);
+}
+
+void arena_free(struct arena *arena, void *ptr) {
+  struct arena_page *page = arena_put_block(arena, ptr);
 
-  struct block *block = allocator_alloc_block(arena->parent);
-  if (!block) {
-    return;
+  // Release empty pages, but keep a page's worth of free blocks around so that alternating
+  // allocations and frees don't keep mapping in the same page.
+  if (page->used_count == 0 && arena->free_count >= 2 * arena->blocks_per_page) {
+    arena_release_page(arena, page);
   }
+}
 
-  block->at = ptr;
-  block->next = arena->free_list;
-  arena->free_list = block;
+int arena_should_compact(struct arena *arena) {
+  return arena->free_count >= 2 * arena->blocks_per_page;
+}
 
-  arena->free_count++;
-  arena->used_count--;
+// The least used page that compaction could empty, or NULL if there is none.
+static struct arena_page *arena_compaction_source(struct arena *arena) {
+  struct arena_page *source = NULL;
+  for (struct arena_page *page = arena->pages; page; page = page->next) {
+    if (page->used_count && !page->pinned &&
+        (!source || page->used_count < source->used_count)) {
+      source = page;
+    }
+  }
+
+  // The page can only be emptied if the other pages have room for all of its blocks.
+  if (source &&
+      arena->free_count - (arena->blocks_per_page - source->used_count) < source->used_count) {
+    return NULL;
+  }
+
+  return source;
+}
+
+// The fullest page, other than `source`, that still has room.
+static struct arena_page *arena_compaction_destination(struct arena *arena,
+                                                       struct arena_page *source) {
+  struct arena_page *destination = NULL;
+  for (struct arena_page *page = arena->pages; page; page = page->next) {
+    if (page != source && page->used_count < arena->blocks_per_page &&
+        (!destination || page->used_count > destination->used_count)) {
+      destination = page;
+    }
+  }
+
+  return destination;
 }
 
-void arena_compact(struct arena *arena, AllocatorMoveCallback callback) {
-  (void)arena;
-  (void)callback;
-  //
+void arena_compact(struct arena *arena, AllocatorRelocateCallback callback, void *context) {
+  for (struct arena_page *page = arena->pages; page; page = page->next) {
+    page->pinned = 0;
+  }
+
+  struct arena_page *source;
+  while ((source = arena_compaction_source(arena)) != NULL) {
+    for (size_t block = 0; block < arena->blocks_per_page && !source->pinned; ++block) {
+      if (!(source->bitmap[block / 64] & (1ULL << (block & 63)))) {
+        continue;
+      }
+
+      struct arena_page *destination = arena_compaction_destination(arena, source);
+      assert(destination != NULL);
+
+      void *old_ptr = (char *)source->base + (block * arena->block_size);
+      void *new_ptr = arena_take_block(arena, destination);
+      memcpy(new_ptr, old_ptr, arena->block_size);
+
+      if (callback(context, old_ptr, new_ptr)) {
+        arena_put_block(arena, old_ptr);
+      } else {
+        arena_put_block(arena, new_ptr);
+        source->pinned = 1;
+      }
+    }
+
+    if (!source->pinned) {
+      arena_release_page(arena, source);
+    }
+  }
+
+  // Pages that were already empty have nothing to move; release them too.
+  struct arena_page *page = arena->pages;
+  while (page) {
+    struct arena_page *next = page->next;
+    if (page->used_count == 0) {
+      arena_release_page(arena, page);
+    }
+    page = next;
+  }
 }
@@ -6,22 +6,33 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define PAGE_SIZE 4096
+
+#define PAGE_OWNER_LARGE_CONTINUATION 251
 #define PAGE_OWNER_INTERNAL 252
 #define PAGE_OWNER_LARGE_ALLOCATION 253
-#define PAGE_OWNER_INTERNAL_BLOCK 254
 #define PAGE_OWNER_FREE 0
 
-struct block {
-  void *at;
-  struct block *next;
-};
+// Largest number of blocks in an arena page (the 16-byte arena).
+#define ARENA_MAX_BLOCKS (PAGE_SIZE / 16)
 
+// Metadata for a single page of the allocator's region.
 struct arena_page {
   void *base;
-  uint64_t bitmap;
+
+  // Blocks in use, for pages owned by an arena.
+  uint64_t bitmap[ARENA_MAX_BLOCKS / 64];
   size_t used_count;
-  size_t free_count;
+
+  // Number of pages in the allocation, for the first page of a large allocation.
+  size_t run_pages;
+
+  // Set during compaction once a page has an allocation that refused to move.
+  int pinned;
+
+  // Links in the owning arena's page list.
   struct arena_page *next;
+  struct arena_page *prev;
 };
 
 struct arena {
@@ -32,9 +43,10 @@ struct arena {
   size_t block_size;
   size_t blocks_per_page;
 
-  struct block *free_list;
-
+  // Pages owned by this arena. Pages with free blocks are kept ahead of full pages, so allocation
+  // only ever needs to look at the head of the list.
   struct arena_page *pages;
+  struct arena_page *pages_tail;
 
   // Note: if free_count * block_size >= 4096, we know a compaction is possible.
   size_t free_count;
@@ -55,36 +67,40 @@ struct allocator {
   int is_fully_owned;
 
   // 0 = free
-  // 1-9 = arena index, 1-indexed, where 1 is the 16-byte arena, 2 is the 32-byte arena, etc.
-  // 253 = large allocation, fully allocated page (but how do we know how big so we can unmap??)
-  // 254 = internal "struct block" arena
+  // 1-8 = arena index, 1-indexed, where 1 is the 16-byte arena, 2 is the 32-byte arena, etc.
+  // 251 = continuation of a large allocation
+  // 252 = allocator-internal metadata
+  // 253 = first page of a large allocation (its length is in page_meta)
   uint8_t *page_owners;
 
+  // Metadata for each page in the region, indexed by page number.
+  struct arena_page *page_meta;
+
+  // No free page exists below this page number.
+  size_t first_free_page;
+
   // Sub-arenas, selected based on lg2 of size (<= 2K)
   // Arenas will pull individual pages from the allocator's region and manage their own free/used
   // lists.
   // We set a minimum allocation size of 16 bytes, so the index is actually log2(sz) - 4.
   struct arena arenas[8];
-
-  // This is a set of "struct block" objects available for arenas to use in their free/used lists.
-  struct block *free_blocks;
-
-  struct arena_page *free_arena_pages;
 };
 
 void *arena_alloc(struct arena *arena);
 void arena_free(struct arena *arena, void *ptr);
-void arena_compact(struct arena *arena, AllocatorMoveCallback callback);
+int arena_should_compact(struct arena *arena);
+void arena_compact(struct arena *arena, AllocatorRelocateCallback callback, void *context);
 
 int is_within_allocator_region(struct allocator *allocator, void *ptr);
 
-struct block *allocator_alloc_block(struct allocator *allocator);
-void allocator_free_block(struct allocator *allocator, struct block *block);
-
-struct arena_page *allocator_alloc_arena_page_meta(struct allocator *allocator);
-void allocator_free_arena_page_meta(struct allocator *allocator, struct arena_page *page);
+size_t allocator_page_index(struct allocator *allocator, void *ptr);
 
+// Finds `count` contiguous free pages and assigns them to the given owner. Returns the first page,
+// or NULL if no such run exists.
+void *get_free_allocator_pages(struct allocator *allocator, size_t count, int owner);
 void *get_free_allocator_page(struct allocator *allocator, int owner);
+// Returns pages to the free pool, releasing their memory to the system where possible.
+void free_allocator_pages(struct allocator *allocator, void *page, size_t count);
 
 size_t bitwise_log2(size_t sz);
 
@@ -0,0 +1,84 @@
+#include <pocketknife/allocator/allocator.h>
+
+#include <assert.h>
+
+#include "internal.h"
+
+struct gc_relocation {
+  size_t moved;
+};
+
+static void *gc_allocator_alloc(void *context, size_t size) {
+  return allocator_alloc((struct allocator *)context, size);
+}
+
+static void gc_allocator_free(void *context, void *ptr) {
+  allocator_free((struct allocator *)context, ptr);
+}
+
+// Called by liballoc once it has copied a block. Every block in a GC allocator's arenas is a node,
+// so the copy is valid as soon as its slot points at it.
+static int gc_allocator_relocate(void *context, void *old_ptr, void *new_ptr) {
+  struct gc_relocation *relocation = (struct gc_relocation *)context;
+  struct gcnode *node = (struct gcnode *)old_ptr;
+  if (gc_node_is_locked(node)) {
+    return 0;
+  }
+
+  node->slot->node = (struct gcnode *)new_ptr;
+  relocation->moved += node->size;
+  return 1;
+}
+
+void gc_space_use_allocator(struct gc *gc, enum GCSpace space, struct allocator *allocator) {
+  assert(gc != NULL);
+  assert(allocator != NULL);
+
+  struct gc_space *gc_space = &gc->spaces[space];
+  gc_space->config.alloc_with_context = gc_allocator_alloc;
+  gc_space->config.free_with_context = gc_allocator_free;
+  gc_space->config.allocator_context = allocator;
+  gc_space->config.map_pages = 0;
+}
+
+struct allocator *gc_space_allocator(struct gc_space *space) {
+  if (space->config.alloc_with_context != gc_allocator_alloc) {
+    return NULL;
+  }
+
+  return (struct allocator *)space->config.allocator_context;
+}
+
+int gc_create_allocators(struct gc *gc) {
+  // Young and old share an allocator so that promotion never copies.
+  for (int i = 0; i < 2; ++i) {
+    gc->owned_allocators[i] = allocator_new(gc->config.allocator_region_size);
+    if (!gc->owned_allocators[i]) {
+      gc_debugf(gc, "gc: failed to create an allocator of %zu bytes\n",
+                gc->config.allocator_region_size);
+      return 0;
+    }
+  }
+
+  gc_space_use_allocator(gc, GC_SPACE_YOUNG, gc->owned_allocators[0]);
+  gc_space_use_allocator(gc, GC_SPACE_OLD, gc->owned_allocators[0]);
+  gc_space_use_allocator(gc, GC_SPACE_LARGE, gc->owned_allocators[1]);
+  return 1;
+}
+
+void gc_destroy_allocators(struct gc *gc) {
+  for (int i = 0; i < 2; ++i) {
+    if (gc->owned_allocators[i]) {
+      allocator_destroy(gc->owned_allocators[i]);
+      gc->owned_allocators[i] = NULL;
+    }
+  }
+}
+
+size_t gc_compact_allocator(struct gc *gc, struct allocator *allocator) {
+  (void)gc;
+
+  struct gc_relocation relocation = {0};
+  allocator_compact_with_context(allocator, gc_allocator_relocate, &relocation);
+  return relocation.moved;
+}
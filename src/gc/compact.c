@@ -0,0 +1,372 @@
+#include <pocketknife/allocator/allocator.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define GC_REGION_WORDS (GC_REGION_GRANULES / 64)
+
+// Position of the compaction cursor: objects are slid down to the cursor, which walks through the
+// regions in address order.
+struct gc_compactor {
+  // Index of the region the cursor is in.
+  size_t region;
+  char *cursor;
+  // Payload bytes relocated so far.
+  size_t moved;
+};
+
+static size_t gc_node_footprint(struct gcnode *node) {
+  size_t size = node->size;
+  size = (size + GC_REGION_GRANULE - 1) & ~(size_t)(GC_REGION_GRANULE - 1);
+  return sizeof(struct gcnode) + size;
+}
+
+static size_t gc_region_granule(struct gc_region *region, const void *ptr) {
+  return (size_t)((const char *)ptr - region->data) / GC_REGION_GRANULE;
+}
+
+static void gc_region_add(struct gc_region *region, struct gcnode *node) {
+  size_t granule = gc_region_granule(region, node);
+  region->starts[granule / 64] |= 1ULL << (granule & 63);
+  region->live_bytes += gc_node_footprint(node);
+  region->payload_bytes += node->size;
+}
+
+static void gc_region_remove(struct gc_region *region, struct gcnode *node) {
+  size_t granule = gc_region_granule(region, node);
+  region->starts[granule / 64] &= ~(1ULL << (granule & 63));
+  region->live_bytes -= gc_node_footprint(node);
+  region->payload_bytes -= node->size;
+}
+
+// Returns the first object that starts at or after `from` in the region, or NULL if none do.
+static struct gcnode *gc_region_next_object(struct gc_region *region, const char *from) {
+  size_t granule = gc_region_granule(region, from);
+  size_t word = granule / 64;
+  if (word >= GC_REGION_WORDS) {
+    return NULL;
+  }
+
+  uint64_t bits = region->starts[word] & (~0ULL << (granule & 63));
+  while (!bits) {
+    if (++word == GC_REGION_WORDS) {
+      return NULL;
+    }
+    bits = region->starts[word];
+  }
+
+  size_t start = (word * 64) + (size_t)__builtin_ctzll(bits);
+  return (struct gcnode *)(region->data + (start * GC_REGION_GRANULE));
+}
+
+// Returns the end of the last object in the region, as an offset from the start of its data.
+static size_t gc_region_extent(struct gc_region *region) {
+  for (size_t word = GC_REGION_WORDS; word > 0; --word) {
+    uint64_t bits = region->starts[word - 1];
+    if (bits) {
+      size_t start = ((word - 1) * 64) + 63 - (size_t)__builtin_clzll(bits);
+      struct gcnode *node = (struct gcnode *)(region->data + (start * GC_REGION_GRANULE));
+      return (start * GC_REGION_GRANULE) + gc_node_footprint(node);
+    }
+  }
+
+  return 0;
+}
+
+static struct gc_region *gc_region_find(struct gc *gc, const void *ptr) {
+  size_t lo = 0;
+  size_t hi = gc->region_count;
+  while (lo < hi) {
+    size_t mid = lo + ((hi - lo) / 2);
+    struct gc_region *region = gc->regions[mid];
+    if ((const char *)ptr < region->data) {
+      hi = mid;
+    } else if ((const char *)ptr >= region->data + GC_REGION_SIZE) {
+      lo = mid + 1;
+    } else {
+      return region;
+    }
+  }
+
+  return NULL;
+}
+
+// Appends a new, empty region. The region array is sorted again once compaction completes.
+static struct gc_region *gc_region_new(struct gc *gc) {
+  struct gc_space *old = &gc->spaces[GC_SPACE_OLD];
+
+  struct gc_region **regions = gc_grow_array(gc, gc->regions, sizeof(struct gc_region *),
+                                             gc->region_count, &gc->region_capacity);
+  if (!regions) {
+    return NULL;
+  }
+  gc->regions = regions;
+
+  struct gc_region *region = gc->config.alloc(sizeof(struct gc_region));
+  if (!region) {
+    return NULL;
+  }
+
+  region->raw = gc_space_alloc(old, GC_REGION_SIZE + GC_REGION_GRANULE);
+  if (!region->raw) {
+    gc->config.free(region);
+    return NULL;
+  }
+
+  uintptr_t data = ((uintptr_t)region->raw + GC_REGION_GRANULE - 1) &
+                   ~(uintptr_t)(GC_REGION_GRANULE - 1);
+  region->data = (char *)data;
+  region->used = 0;
+  region->live_bytes = 0;
+  region->payload_bytes = 0;
+  memset(region->starts, 0, sizeof(region->starts));
+
+  gc->regions[gc->region_count++] = region;
+
+  gc_debugf(gc, "gc: created compaction region %p\n", (void *)region->data);
+  return region;
+}
+
+static void gc_region_destroy(struct gc *gc, struct gc_region *region) {
+  gc_space_free(&gc->spaces[GC_SPACE_OLD], region->raw);
+  gc->config.free(region);
+}
+
+static int gc_region_compare(const void *a, const void *b) {
+  const struct gc_region *ra = *(struct gc_region *const *)a;
+  const struct gc_region *rb = *(struct gc_region *const *)b;
+  return (ra->data > rb->data) - (ra->data < rb->data);
+}
+
+void gc_region_release(struct gc *gc, struct gcnode *node) {
+  struct gc_region *region = gc_region_find(gc, node);
+  assert(region != NULL);
+
+  // The space is left as a hole until the next compaction.
+  gc_region_remove(region, node);
+}
+
+// Finds room for an object of `footprint` bytes at or after the cursor, stepping over pinned
+// objects. `self` is the object being placed; it may overlap its own destination. Returns NULL if
+// a new region was needed but could not be allocated.
+static char *gc_compact_place(struct gc *gc, struct gc_compactor *compactor, struct gcnode *self,
+                              size_t footprint) {
+  while (1) {
+    if (compactor->region == gc->region_count) {
+      if (!gc_region_new(gc)) {
+        return NULL;
+      }
+      compactor->cursor = gc->regions[compactor->region]->data;
+    }
+
+    struct gc_region *region = gc->regions[compactor->region];
+
+    // Everything between the cursor and the next object in this region is free. That object is
+    // either `self` (objects only ever slide down) or pinned.
+    struct gcnode *next = gc_region_next_object(region, compactor->cursor);
+    char *limit = next ? (char *)next : region->data + GC_REGION_SIZE;
+    if (next == self || compactor->cursor + footprint <= limit) {
+      char *dest = compactor->cursor;
+      compactor->cursor += footprint;
+      return dest;
+    }
+
+    if (next) {
+      compactor->cursor = (char *)next + gc_node_footprint(next);
+    } else if (++compactor->region < gc->region_count) {
+      compactor->cursor = gc->regions[compactor->region]->data;
+    }
+  }
+}
+
+// Slides the object down to the cursor. `from` is the region the object is in, or NULL if it has
+// its own allocation.
+static void gc_compact_node(struct gc *gc, struct gc_compactor *compactor, struct gcnode *node,
+                            struct gc_region *from) {
+  size_t footprint = gc_node_footprint(node);
+  size_t size = node->size;
+
+  char *dest = gc_compact_place(gc, compactor, node, footprint);
+  if (!dest) {
+    // Out of memory, leave the object where it is.
+    return;
+  } else if (dest == (char *)node) {
+    return;
+  }
+
+  struct gc_region *to = gc->regions[compactor->region];
+  struct gcnode *moved = (struct gcnode *)dest;
+
+  if (from) {
+    gc_region_remove(from, node);
+    memmove(moved, node, sizeof(struct gcnode) + size);
+  } else {
+    memcpy(moved, node, sizeof(struct gcnode) + size);
+    gc_space_free(&gc->spaces[GC_SPACE_OLD], node);
+    moved->in_region = 1;
+  }
+
+  gc_region_add(to, moved);
+
+  // The slot is the only reference to the object's address that the collector hands out for
+  // unlocked objects, so it's the only thing to fix up.
+  moved->slot->node = moved;
+  compactor->moved += size;
+}
+
+static size_t gc_compact_old_space(struct gc *gc) {
+  struct gc_compactor compactor = {0, NULL, 0};
+  if (gc->region_count) {
+    compactor.cursor = gc->regions[0]->data;
+  }
+
+  // Slide objects already in regions down, in address order. Placement never needs a new region
+  // here, as every object fits at least where it already is.
+  size_t region_count = gc->region_count;
+  for (size_t i = 0; i < region_count; ++i) {
+    struct gc_region *region = gc->regions[i];
+    for (size_t word = 0; word < GC_REGION_WORDS; ++word) {
+      uint64_t bits = region->starts[word];
+      while (bits) {
+        size_t start = (word * 64) + (size_t)__builtin_ctzll(bits);
+        bits &= bits - 1;
+
+        // Pinned objects stay put; placement steps over them, using any gap in front of them.
+        // Objects awaiting finalization are about to be released, so aren't worth moving either.
+        struct gcnode *node = (struct gcnode *)(region->data + (start * GC_REGION_GRANULE));
+        if (!gc_node_is_locked(node) && !node->finalizing) {
+          gc_compact_node(gc, &compactor, node, region);
+        }
+      }
+    }
+  }
+
+  // Then pack old objects that still have their own allocations in after them.
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    struct gc_slot_page *page = gc->slot_pages[i];
+    for (size_t word = 0; word < GC_SLOT_PAGE_WORDS; ++word) {
+      uint64_t bits = page->allocated[word];
+      while (bits) {
+        size_t bit = (size_t)__builtin_ctzll(bits);
+        bits &= bits - 1;
+
+        struct gcnode *node = page->slots[(word * 64) + bit].node;
+        if (node->space == GC_SPACE_OLD && !node->in_region && !node->mapped &&
+            !gc_node_is_locked(node) && !node->finalizing &&
+            gc_node_footprint(node) <= GC_REGION_MAX_OBJECT) {
+          gc_compact_node(gc, &compactor, node, NULL);
+        }
+      }
+    }
+  }
+
+  // Trim regions down to their last object, releasing any that are now empty.
+  size_t kept = 0;
+  for (size_t i = 0; i < gc->region_count; ++i) {
+    struct gc_region *region = gc->regions[i];
+    region->used = gc_region_extent(region);
+    if (region->used) {
+      gc->regions[kept++] = region;
+    } else {
+      gc_debugf(gc, "gc: releasing empty compaction region %p\n", (void *)region->data);
+      gc_region_destroy(gc, region);
+    }
+  }
+  gc->region_count = kept;
+
+  if (gc->region_count > 1) {
+    qsort(gc->regions, gc->region_count, sizeof(struct gc_region *), gc_region_compare);
+  }
+
+  return compactor.moved;
+}
+
+// Bytes left in holes between objects in the compacted regions.
+static size_t gc_region_holes(struct gc *gc) {
+  size_t holes = 0;
+  for (size_t i = 0; i < gc->region_count; ++i) {
+    holes += gc->regions[i]->used - gc->regions[i]->live_bytes;
+  }
+
+  return holes;
+}
+
+// Compacts the old space. Attached threads must be stopped.
+static size_t gc_compact_stopped(struct gc *gc) {
+  struct allocator *allocator = gc_space_allocator(&gc->spaces[GC_SPACE_OLD]);
+  if (allocator) {
+    size_t moved = gc_compact_allocator(gc, allocator);
+    gc->spaces[GC_SPACE_OLD].stats.total_compacted += moved;
+    gc_debugf(gc, "gc: compacted old space allocator, moved %zu bytes\n", moved);
+    return moved;
+  }
+
+  size_t moved = gc_compact_old_space(gc);
+
+  // Holes that remain are pinned in place by locked objects; don't count them towards the next
+  // compaction.
+  gc->pinned_holes = gc_region_holes(gc);
+  gc->loose_freed = 0;
+  gc->spaces[GC_SPACE_OLD].stats.total_compacted += moved;
+
+  gc_debugf(gc, "gc: compacted old space, moved %zu bytes into %zu regions\n", moved,
+            gc->region_count);
+  return moved;
+}
+
+size_t gc_compact(struct gc *gc) {
+  assert(gc != NULL);
+
+  gc_stop_world(gc);
+  size_t moved = gc_compact_stopped(gc);
+  gc_resume_world(gc);
+  return moved;
+}
+
+void gc_maybe_compact(struct gc *gc) {
+  if (!gc->config.compact_fragmentation) {
+    return;
+  }
+
+  // liballoc keeps track of its own fragmentation.
+  struct allocator *allocator = gc_space_allocator(&gc->spaces[GC_SPACE_OLD]);
+  if (allocator) {
+    if (allocator_should_compact(allocator)) {
+      gc_compact_stopped(gc);
+    }
+    return;
+  }
+
+  // Fragmentation is the space lost since the last compaction: holes in the regions, and the
+  // memory freed by old objects that had their own allocations, which is left scattered between
+  // the survivors. Old objects that have simply never been compacted don't count.
+  size_t holes = gc_region_holes(gc);
+  holes = holes > gc->pinned_holes ? holes - gc->pinned_holes : 0;
+  size_t wasted = holes + gc->loose_freed;
+  size_t live = gc->spaces[GC_SPACE_OLD].stats.total_allocated;
+
+  if (wasted < GC_MIN_TRIGGER || wasted * 100 < live * gc->config.compact_fragmentation) {
+    return;
+  }
+
+  gc_debugf(gc, "gc: old space fragmented (%zu bytes lost, %zu live), compacting\n", wasted,
+            live);
+  gc_compact_stopped(gc);
+}
+
+void gc_regions_destroy(struct gc *gc) {
+  for (size_t i = 0; i < gc->region_count; ++i) {
+    gc_region_destroy(gc, gc->regions[i]);
+  }
+
+  if (gc->regions) {
+    gc->config.free(gc->regions);
+  }
+
+  gc->regions = NULL;
+  gc->region_count = 0;
+  gc->region_capacity = 0;
+}
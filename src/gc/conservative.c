@@ -0,0 +1,150 @@
+// For pthread_getattr_np
+#define _GNU_SOURCE
+
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "internal.h"
+
+// Words copied from either side of the frame that stops a thread. Depending on the architecture,
+// a frame's spilled registers sit just below or just above its frame address.
+#define GC_STACK_SPILL_HALF (GC_STACK_SPILL_WORDS / 2)
+
+// Returns an address below every frame of the caller, including the registers it spilled. Stacks
+// are assumed to grow down.
+static __attribute__((noinline)) char *gc_stack_pointer(void) {
+  return __builtin_frame_address(0);
+}
+
+static const uintptr_t *gc_align_word(const char *address) {
+  uintptr_t mask = sizeof(uintptr_t) - 1;
+  return (const uintptr_t *)(((uintptr_t)address + mask) & ~mask);
+}
+
+// Stacks hold more than the sanitizers consider in bounds, so they're read without instrumentation
+// (which inlining would bring back).
+#define GC_UNINSTRUMENTED __attribute__((noinline, no_sanitize("address")))
+
+GC_UNINSTRUMENTED static void gc_scan_range(struct gc *gc, const char *low, const char *high,
+                                            GCStackVisitor visit) {
+  for (const uintptr_t *word = gc_align_word(low); (const char *)(word + 1) <= high; ++word) {
+    struct gc_slot *slot = gc_find_slot(gc, *word);
+    if (slot) {
+      visit(gc, slot);
+    }
+  }
+}
+
+static __attribute__((noinline)) void gc_scan_current_stack(struct gc *gc, const char *base,
+                                                            GCStackVisitor visit) {
+  // Spill callee-saved registers into this frame, so that references held in them are found too.
+  __builtin_unwind_init();
+  gc_scan_range(gc, gc_stack_pointer(), base, visit);
+}
+
+GC_UNINSTRUMENTED static size_t gc_copy_range(uintptr_t *out, const char *low, const char *high) {
+  size_t count = 0;
+  for (const uintptr_t *word = gc_align_word(low); (const char *)(word + 1) <= high; ++word) {
+    out[count++] = *word;
+  }
+  return count;
+}
+
+void gc_thread_save_stack(struct gc_thread *thread, char *frame) {
+  if (!thread->stack_base) {
+    return;
+  }
+
+  // Everything between here and the frame is still on the stack, as is everything above it.
+  char *low = gc_stack_pointer();
+  if (low < frame - (GC_STACK_SPILL_HALF * sizeof(uintptr_t))) {
+    low = frame - (GC_STACK_SPILL_HALF * sizeof(uintptr_t));
+  }
+
+  char *high = frame + (GC_STACK_SPILL_HALF * sizeof(uintptr_t));
+  if (high > thread->stack_base) {
+    high = thread->stack_base;
+  }
+
+  thread->spill_words = gc_copy_range(thread->spill, low, high);
+  thread->stack_top = frame;
+}
+
+void gc_scan_stacks(struct gc *gc, GCStackVisitor visit) {
+  struct gc_thread *self = gc_find_thread(gc);
+
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    struct gc_thread *thread = gc->threads[i];
+    if (!thread->stack_base) {
+      continue;
+    }
+
+    if (thread == self) {
+      gc_scan_current_stack(gc, thread->stack_base, visit);
+    } else if (thread->state != GC_THREAD_RUNNING) {
+      const char *spill = (const char *)thread->spill;
+      gc_scan_range(gc, spill, spill + (thread->spill_words * sizeof(uintptr_t)), visit);
+      gc_scan_range(gc, thread->stack_top, thread->stack_base, visit);
+    }
+  }
+
+  if (gc->stack_base && pthread_equal(gc->stack_thread, pthread_self())) {
+    gc_scan_current_stack(gc, gc->stack_base, visit);
+  }
+}
+
+int gc_register_stack(struct gc *gc, void *base) {
+  assert(gc != NULL);
+
+  if (!base) {
+#ifdef __GLIBC__
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+      return 0;
+    }
+
+    void *addr;
+    size_t size;
+    int found = pthread_attr_getstack(&attr, &addr, &size) == 0;
+    pthread_attr_destroy(&attr);
+    if (!found) {
+      return 0;
+    }
+
+    base = (char *)addr + size;
+#else
+    return 0;
+#endif
+  }
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  if (thread) {
+    thread->stack_base = base;
+    return 1;
+  }
+
+  int locked = gc_lock(gc);
+  gc->stack_base = base;
+  gc->stack_thread = pthread_self();
+  gc_unlock(gc, locked);
+  return 1;
+}
+
+void gc_unregister_stack(struct gc *gc) {
+  assert(gc != NULL);
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  if (thread) {
+    thread->stack_base = NULL;
+    return;
+  }
+
+  int locked = gc_lock(gc);
+  if (gc->stack_base && pthread_equal(gc->stack_thread, pthread_self())) {
+    gc->stack_base = NULL;
+  }
+  gc_unlock(gc, locked);
+}
@@ -1,80 +1,12 @@
 #include <pocketknife/gc/gc.h>
+#include <pocketknife/os/os.h>
 
 #include <assert.h>
-#include <stdarg.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-struct gcroot;
-struct gcnode;
-struct gc_slot;
-struct gc_space;
-
-struct gc_space {
-  struct gc_stats stats;
-
-  size_t cycles_since_sweep;
-
-  struct gc_space_config config;
-
-  struct gcroot *roots;
-  struct gc_slot *nodes;
-};
-
-struct gc {
-  struct gc_config config;
-
-  struct gc_space spaces[8];
-};
-
-struct gcroot {
-  struct gc_slot *slot;
-  struct gcroot *next;
-};
-
-// Used as a header on the resulting allocation
-// Currently a 32-byte header - if adding fields, try to ensure at least 16-byte alignment
-struct gcnode {
-  GCMarkFunc marker;
-  GCEraseFunc eraser;
-
-  struct gc_slot *slot;
-
-  union {
-    struct {
-      // Mark bit for mark-sweep.
-      uint64_t marked : 1;
-      // If set, the object is locked and cannot be moved.
-      uint64_t locked : 1;
-      // GCSpace the object is currently in
-      uint64_t space : 3;
-      // # of cycles the object has lived in its current space (will not wrap around to zero)
-      uint64_t survived : 8;
-      // Size of the object in bytes
-      uint64_t size : 51;
-    };
-    uint64_t meta;
-  };
-} __attribute__((packed)) __attribute__((aligned(8)));
-
-struct gc_slot {
-  struct gcnode *node;
-  struct gc_slot *next;
-};
-
-static void gc_debugf(struct gc *gc, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
-static void gc_debugf(struct gc *gc, const char *fmt, ...) {
-  if (!gc->config.debug) {
-    return;
-  }
-
-  va_list args;
-  va_start(args, fmt);
-  vfprintf(stderr, fmt, args);
-  va_end(args);
-}
+#include "internal.h"
 
 static void sanity_check_space_config(struct gc_space_config *config) {
   assert(config != NULL);
@@ -86,22 +18,102 @@ static void sanity_check_space_config(struct gc_space_config *config) {
   } else {
     assert(config->free != NULL);  // If alloc is custom, free must also be custom
   }
+
+  // Context-carrying hooks come as a pair too
+  assert((config->alloc_with_context == NULL) == (config->free_with_context == NULL));
+}
+
+// Initial trigger for a space, before any survival rates have been observed.
+static void gc_space_reset_trigger(struct gc_space *space) {
+  size_t trigger = space->config.max_size / 8;
+  if (trigger < GC_MIN_TRIGGER) {
+    trigger = GC_MIN_TRIGGER;
+  }
+  if (trigger > space->config.max_size) {
+    trigger = space->config.max_size;
+  }
+
+  space->trigger = trigger;
 }
 
 static void gc_default_config(struct gc *gc) {
+  gc->slot_pages = NULL;
+  gc->slot_page_count = 0;
+  gc->slot_page_capacity = 0;
+  gc->free_slots = NULL;
+  gc->page_map = NULL;
+  gc->page_map_capacity = 0;
+  gc->stack_base = NULL;
+  gc->regions = NULL;
+  gc->region_count = 0;
+  gc->region_capacity = 0;
+  gc->pinned_holes = 0;
+  gc->loose_freed = 0;
+  gc->roots = NULL;
+  gc->root_count = 0;
+  gc->root_capacity = 0;
+  gc->scoped = NULL;
+  gc->scoped_count = 0;
+  gc->scoped_capacity = 0;
+  gc->remembered = NULL;
+  gc->remembered_count = 0;
+  gc->remembered_capacity = 0;
+  gc->force_major = 0;
+  gc->tracing = GC_ALL_SPACES;
+  gc->found_young = 0;
+  gc->collecting = 0;
+  gc->snapshot = NULL;
+  gc->types = NULL;
+  gc->type_count = 0;
+  gc->type_capacity = 0;
+  gc->sites = NULL;
+  gc->site_count = 0;
+  gc->site_capacity = 0;
+  gc->weak_refs = NULL;
+  gc->weak_count = 0;
+  gc->weak_capacity = 0;
+  gc->ephemeron_tables = NULL;
+  gc->ephemeron_table_count = 0;
+  gc->ephemeron_table_capacity = 0;
+  gc->finalize_queue = NULL;
+  gc->finalize_count = 0;
+  gc->finalize_capacity = 0;
+  gc->finalizing = 0;
+  gc->threads = NULL;
+  gc->thread_count = 0;
+  gc->thread_capacity = 0;
+  gc->buffers = NULL;
+  gc->buffer_count = 0;
+  gc->buffer_capacity = 0;
+  gc->stop_requested = 0;
+  gc->collector = NULL;
+  gc->stop_depth = 0;
+  gc_threads_init(gc);
+  gc->owned_allocators[0] = NULL;
+  gc->owned_allocators[1] = NULL;
+  gc->cycle_count = 0;
+  memset(&gc->pauses, 0, sizeof(gc->pauses));
+
   gc->config.alloc = malloc;
   gc->config.free = free;
   gc->config.young_max_cycles = 10;
   gc->config.large_threshold = 1024 * 1024;  // 1 MB
+  gc->config.auto_collect = 1;
+  gc->config.compact_fragmentation = 50;
+  gc->config.pretenure_sample = 256;
+  gc->config.pretenure_survival = 80;
 
   gc->spaces[GC_SPACE_YOUNG].config.sweep_every = 1;
   gc->spaces[GC_SPACE_YOUNG].config.max_size = 256 * 1024 * 1024;  // 256 MiB young space
   gc->spaces[GC_SPACE_OLD].config.sweep_every = 10;
   gc->spaces[GC_SPACE_OLD].config.max_size = 1024 * 1024 * 1024;  // 1 GiB old space
-  gc->spaces[GC_SPACE_LARGE].config.sweep_every = 100;
+  // Sweeping the large space alongside the old space costs little, as the same cycle has to trace
+  // everything anyway, and returns the pages of dead large objects sooner.
+  gc->spaces[GC_SPACE_LARGE].config.sweep_every = 10;
   gc->spaces[GC_SPACE_LARGE].config.max_size = 1024 * 1024 * 1024;  // 1 GiB large space
+  gc->spaces[GC_SPACE_LARGE].config.map_pages = 1;
 
-  for (int i = GC_SPACE_CUSTOM1; i < 8; ++i) {
+  for (int i = 0; i < 8; ++i) {
     gc->spaces[i].config.alloc = gc->config.alloc;
     gc->spaces[i].config.free = gc->config.free;
 
@@ -111,6 +123,7 @@ static void gc_default_config(struct gc *gc) {
     }
 
     sanity_check_space_config(&gc->spaces[i].config);
+    gc_space_reset_trigger(&gc->spaces[i]);
   }
 }
 
@@ -134,6 +147,7 @@ struct gc *gc_create_with_allocator(GCAllocateFunc alloc, GCFreeFunc free) {
     return NULL;
   }
 
+  memset(gc, 0, sizeof(struct gc));
   gc_default_config(gc);
 
   gc->config.alloc = alloc;
@@ -166,6 +180,11 @@ struct gc *gc_create_with_config(struct gc_config *config) {
     sanity_check_space_config(&gc->spaces[i].config);
   }
 
+  if (gc->config.allocator_region_size && !gc_create_allocators(gc)) {
+    gc_destroy(gc);
+    return NULL;
+  }
+
   return gc;
 }
 
@@ -183,38 +202,92 @@ void gc_configure_space(struct gc *gc, enum GCSpace space, struct gc_space_confi
   }
 
   sanity_check_space_config(&gc_space->config);
-}
-
-static void gc_space_destroy(struct gc *gc, struct gc_space *space) {
-  assert(space != NULL);
-
-  GCFreeFunc free_func = gc->config.free;
-
-  while (space->roots) {
-    struct gcroot *next = space->roots->next;
-    free_func(space->roots);
-    space->roots = next;
-  }
-
-  // Force an immediate sweep of the space in the next cycle
-  space->config.sweep_every = 0;
+  gc_space_reset_trigger(gc_space);
 }
 
 void gc_destroy(struct gc *gc) {
   assert(gc != NULL);
 
-  // Clean up all spaces of their roots so we can perform a full collection
+  // Drop all roots, stop scanning stacks and force an immediate sweep of every space so we
+  // perform a full collection. Nothing survives it, so there is nothing worth compacting.
+  gc->config.compact_fragmentation = 0;
+  gc->root_count = 0;
+  gc->scoped_count = 0;
+  gc->stack_base = NULL;
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    gc->threads[i]->stack_base = NULL;
+  }
   for (int i = 0; i < 8; ++i) {
-    gc_space_destroy(gc, &gc->spaces[i]);
+    gc->spaces[i].config.sweep_every = 0;
   }
 
   gc_run(gc, NULL);
+  gc_run_finalizers(gc);
 
   GCFreeFunc free_func = gc->config.free;
 
+  if (gc->roots) {
+    free_func(gc->roots);
+  }
+
+  if (gc->scoped) {
+    free_func(gc->scoped);
+  }
+
+  if (gc->remembered) {
+    free_func(gc->remembered);
+  }
+
+  gc_weak_destroy(gc);
+  gc_types_destroy(gc);
+  gc_sites_destroy(gc);
+  gc_threads_destroy(gc);
+  gc_slots_destroy(gc);
+  gc_regions_destroy(gc);
+  gc_destroy_allocators(gc);
+
   free_func(gc);
 }
 
+static void gc_cycle(struct gc *gc, unsigned force);
+
+// Runs a cycle with every attached thread stopped.
+static void gc_collect(struct gc *gc, unsigned force) {
+  gc_stop_world(gc);
+  gc_cycle(gc, force);
+  gc_resume_world(gc);
+}
+
+static int gc_space_would_exceed(struct gc *gc, struct gc_space *space, size_t size) {
+  int locked = gc_lock(gc);
+  int exceeds = space->stats.total_allocated + size > space->config.max_size;
+  gc_unlock(gc, locked);
+  return exceeds;
+}
+
+void gc_collect_for_allocation(struct gc *gc, enum GCSpace space, size_t size) {
+  struct gc_space *gc_space = &gc->spaces[space];
+
+  int locked = gc_lock(gc);
+  int exceeds = gc_space->stats.total_allocated + size > gc_space->config.max_size;
+  int due = gc->config.auto_collect && gc_space->allocation_debt + size > gc_space->trigger;
+  gc_unlock(gc, locked);
+
+  if (exceeds) {
+    gc_debugf(gc, "gc: space %d would exceed its maximum size, collecting\n", space);
+    gc_collect(gc, GC_SPACE_BIT(space));
+
+    if (gc_space_would_exceed(gc, gc_space, size)) {
+      gc_debugf(gc, "gc: space %d still exceeds its maximum size, collecting everything\n", space);
+      gc_collect(gc, GC_ALL_SPACES);
+    }
+  } else if (due) {
+    gc_debugf(gc, "gc: space %d reached its trigger of %zu bytes, collecting\n", space,
+              gc_space->trigger);
+    gc_collect(gc, GC_SPACE_BIT(space));
+  }
+}
+
 struct gc_slot *gc_alloc(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseFunc eraser) {
   enum GCSpace space = GC_SPACE_YOUNG;
   if (size >= gc->config.large_threshold) {
@@ -224,19 +297,28 @@ struct gc_slot *gc_alloc(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseF
   return gc_alloc_with_space(gc, size, marker, eraser, space);
 }
 
+struct gc_slot *gc_alloc_zeroed(struct gc *gc, size_t size, GCMarkFunc marker, GCEraseFunc eraser) {
+  struct gc_slot *slot = gc_alloc(gc, size, marker, eraser);
+  if (slot && !gc_node_load(slot->node).mapped) {
+    memset(gc_node_data(slot->node), 0, size);
+  }
+
+  return slot;
+}
+
 struct gc_slot *gc_alloc_with_space(struct gc *gc, size_t size, GCMarkFunc marker,
                                     GCEraseFunc eraser, enum GCSpace space) {
   assert(gc != NULL);
 
   if (size == 0) {
     return NULL;
-  } else if (size > gc->spaces[space].config.max_size) {
-    // If the size exceeds the maximum size of the space, we cannot allocate it here
-    return NULL;
   } else if (space < 0 || space >= 8) {
     // Invalid space
     return NULL;
-  } else if (size >= (1ULL << 51ULL)) {
+  } else if (size > gc->spaces[space].config.max_size) {
+    // If the size exceeds the maximum size of the space, we cannot allocate it here
+    return NULL;
+  } else if (size >= (1ULL << GCNODE_SIZE_BITS)) {
     // Can't fit in our metadata
     gc_debugf(gc,
               "gc: cannot allocate %zu bytes in space %d, size exceeds maximum possible for a "
@@ -247,35 +329,53 @@ struct gc_slot *gc_alloc_with_space(struct gc *gc, size_t size, GCMarkFunc marke
 
   struct gc_space *gc_space = &gc->spaces[space];
 
-  void *ptr = gc_space->config.alloc(size + sizeof(struct gcnode));
-  if (!ptr) {
+  // Attached threads allocate small young objects from their own buffers, without the lock.
+  struct gc_thread *thread = gc_current_thread(gc);
+  if (thread && space == GC_SPACE_YOUNG &&
+      sizeof(struct gcnode) + size <= GC_THREAD_BUFFER_MAX_OBJECT) {
+    return gc_thread_alloc(gc, thread, size, marker, eraser);
+  } else if (thread) {
+    gc_safepoint(gc);
+  }
+
+  if (!gc->collecting) {
+    gc_collect_for_allocation(gc, space, size);
+  }
+
+  int locked = gc_lock(gc);
+
+  struct gcnode *node = gc_node_alloc(gc, gc_space, size);
+  if (!node) {
+    gc_unlock(gc, locked);
     return NULL;
   }
 
-  struct gc_slot *list_node = gc->config.alloc(sizeof(struct gc_slot));
-  if (!list_node) {
-    gc_space->config.free(ptr);
+  struct gc_slot *slot = gc_slot_alloc(gc);
+  if (!slot) {
+    gc_free_node(gc, gc_space, node);
+    gc_unlock(gc, locked);
     return NULL;
   }
 
   assert(size <= (1ULL << 32ULL));
 
-  struct gcnode *node = (struct gcnode *)ptr;
   node->marker = marker;
   node->eraser = eraser;
-  node->meta = 0;
   node->size = (uint32_t)size;
   node->space = space;
-  node->slot = list_node;
+  node->slot = slot;
 
   gc_space->stats.total_allocated += size;
   gc_space->stats.total_objects++;
+  gc_space->allocation_debt += size;
 
-  list_node->node = node;
-  list_node->next = gc_space->nodes;
-  gc_space->nodes = list_node;
+  slot->node = node;
+  if (space == GC_SPACE_YOUNG) {
+    gc_slot_set_young(gc, slot, 1);
+  }
 
-  return list_node;
+  gc_unlock(gc, locked);
+  return slot;
 }
 
 void *gc_lock_slot(struct gc_slot *slot) {
@@ -283,231 +383,694 @@ void *gc_lock_slot(struct gc_slot *slot) {
 
   struct gcnode *node = slot->node;
 
-  if (node->locked) {
+  if (!gc_node_try_lock(node)) {
     return NULL;
   }
 
-  node->locked = 1;
-  return (void *)(node + 1);
+  return gc_node_data(node);
 }
 
 void gc_unlock_slot(struct gc_slot *slot) {
   assert(slot != NULL);
 
-  struct gcnode *node = slot->node;
+  gc_node_unlock(slot->node);
+}
+
+static void gc_root_locked(struct gc *gc, struct gc_slot *slot) {
+  if (slot->root_index) {
+    gc->roots[slot->root_index - 1].count++;
+    return;
+  }
+
+  struct gc_root *roots =
+      gc_grow_array(gc, gc->roots, sizeof(struct gc_root), gc->root_count, &gc->root_capacity);
+  if (!roots) {
+    return;
+  }
+  gc->roots = roots;
 
-  node->locked = 0;
+  roots[gc->root_count].slot = slot;
+  roots[gc->root_count].count = 1;
+  slot->root_index = (uint32_t)++gc->root_count;
 }
 
 void gc_root(struct gc *gc, struct gc_slot *slot) {
   assert(gc != NULL);
   assert(slot != NULL);
 
-  struct gc_space *space = &gc->spaces[slot->node->space];
+  int locked = gc_lock(gc);
+  gc_root_locked(gc, slot);
+  gc_unlock(gc, locked);
+}
 
-  struct gcroot *root = space->config.alloc(sizeof(struct gcroot));
-  if (!root) {
-    return;
+static int gc_unroot_locked(struct gc *gc, struct gc_slot *slot) {
+  if (!slot->root_index) {
+    return 0;
   }
 
-  root->slot = slot;
-  root->next = space->roots;
-  space->roots = root;
+  struct gc_root *root = &gc->roots[slot->root_index - 1];
+  if (--root->count) {
+    return 1;
+  }
+
+  // Swap the last root into this slot's position
+  *root = gc->roots[--gc->root_count];
+  root->slot->root_index = slot->root_index;
+  slot->root_index = 0;
+
+  return 1;
 }
 
 int gc_unroot(struct gc *gc, struct gc_slot *slot) {
   assert(gc != NULL);
   assert(slot != NULL);
 
-  struct gc_space *space = &gc->spaces[slot->node->space];
+  int locked = gc_lock(gc);
+  int rooted = gc_unroot_locked(gc, slot);
+  gc_unlock(gc, locked);
+  return rooted;
+}
 
-  struct gcroot *current = space->roots;
-  struct gcroot *prev = NULL;
-  while (current) {
-    if (current->slot == slot) {
-      if (prev) {
-        prev->next = current->next;
-      } else {
-        space->roots = current->next;
-      }
-      space->config.free(current);
-      return 1;
-    }
+// Handle scopes belong to the calling thread if it's attached, or to the collector otherwise.
+static struct gc_slot ***gc_handle_scope_stack(struct gc *gc, size_t **count, size_t **capacity) {
+  struct gc_thread *thread = gc_current_thread(gc);
+  if (thread) {
+    *count = &thread->scoped_count;
+    *capacity = &thread->scoped_capacity;
+    return &thread->scoped;
+  }
+
+  *count = &gc->scoped_count;
+  *capacity = &gc->scoped_capacity;
+  return &gc->scoped;
+}
+
+size_t gc_push_handle_scope(struct gc *gc) {
+  assert(gc != NULL);
 
-    prev = current;
-    current = current->next;
+  size_t *count;
+  size_t *capacity;
+  gc_handle_scope_stack(gc, &count, &capacity);
+  return *count;
+}
+
+struct gc_slot *gc_scope_root(struct gc *gc, struct gc_slot *slot) {
+  assert(gc != NULL);
+
+  if (!slot) {
+    return NULL;
+  }
+
+  size_t *count;
+  size_t *capacity;
+  struct gc_slot ***stack = gc_handle_scope_stack(gc, &count, &capacity);
+
+  struct gc_slot **scoped = gc_grow_array(gc, *stack, sizeof(struct gc_slot *), *count, capacity);
+  if (!scoped) {
+    return NULL;
   }
+  *stack = scoped;
+
+  scoped[(*count)++] = slot;
+  return slot;
+}
+
+void gc_pop_handle_scope(struct gc *gc, size_t scope) {
+  assert(gc != NULL);
+
+  size_t *count;
+  size_t *capacity;
+  gc_handle_scope_stack(gc, &count, &capacity);
+  assert(scope <= *count);
 
-  return 0;
+  *count = scope;
+}
+
+static void gc_remember(struct gc *gc, struct gc_slot *slot) {
+  struct gc_slot **remembered = gc_grow_array(gc, gc->remembered, sizeof(struct gc_slot *),
+                                              gc->remembered_count, &gc->remembered_capacity);
+  if (!remembered) {
+    // Without the entry a minor cycle could miss young objects; trace everything next time.
+    gc->force_major = 1;
+    return;
+  }
+  gc->remembered = remembered;
+
+  gc_node_set_remembered(slot->node, 1);
+  gc->remembered[gc->remembered_count++] = slot;
+}
+
+// Visits the object's references without tracing them, returning 1 if any of them are young.
+static int gc_references_young(struct gc *gc, struct gc_slot *slot) {
+  if (!gc_node_traces(slot->node)) {
+    return 0;
+  }
+
+  unsigned tracing = gc->tracing;
+  gc->tracing = 0;
+  gc->found_young = 0;
+  gc_trace(gc, slot);
+  gc->tracing = tracing;
+
+  return gc->found_young;
+}
+
+void gc_write_barrier(struct gc *gc, struct gc_slot *parent, struct gc_slot *child) {
+  assert(gc != NULL);
+  assert(parent != NULL);
+
+  if (!child) {
+    return;
+  }
+
+  // Other mutators may be locking either object, or remembering the parent, at the same time.
+  struct gcnode *node = parent->node;
+  struct gcnode flags = gc_node_load(node);
+  if (flags.space == GC_SPACE_YOUNG || flags.remembered ||
+      gc_node_load(child->node).space != GC_SPACE_YOUNG) {
+    return;
+  }
+
+  int locked = gc_lock(gc);
+  flags = gc_node_load(node);
+  if (!flags.remembered) {
+    gc_debugf(gc, "gc: remembering object %p (%zd bytes)\n", (void *)node, (size_t)flags.size);
+    gc_remember(gc, parent);
+  }
+  gc_unlock(gc, locked);
 }
 
 int gc_mark(struct gc *gc, struct gc_slot *slot) {
   assert(gc != NULL);
   assert(slot != NULL);
 
+  // While a snapshot is being written, markers only report the references they find.
+  if (gc->snapshot) {
+    gc_snapshot_edge(gc->snapshot, slot);
+    return 0;
+  }
+
   enum GCSpace space = slot->node->space;
 
-  int marked = slot->node->marked;
-  slot->node->marked = 1;
+  if (space == GC_SPACE_YOUNG) {
+    gc->found_young = 1;
+  }
 
-  if (marked) {
+  // Minor cycles don't trace outside the young space; young objects referenced from other spaces
+  // are found through the remembered set instead.
+  if (!(gc->tracing & GC_SPACE_BIT(space))) {
     return 0;
   }
 
-  if (slot->node->marker) {
-    slot->node->marker(gc, slot);
+  if (gc_slot_test_and_mark(gc, slot)) {
+    return 0;
   }
 
+  gc_trace(gc, slot);
+
   gc->spaces[space].stats.total_marked++;
 
   return 1;
 }
 
-static void gc_space_run(struct gc *gc, struct gc_space *space) {
-  assert(gc != NULL);
-  assert(space != NULL);
-
-  if ((++space->cycles_since_sweep) < space->config.sweep_every) {
-    gc_debugf(gc, "gc: skipping sweep, cycles since last sweep: %zu, needed at least %zd\n",
-              space->cycles_since_sweep, space->config.sweep_every);
+void gc_mark_root(struct gc *gc, struct gc_slot *slot) {
+  struct gcnode *node = slot->node;
+  if (!(gc->tracing & GC_SPACE_BIT(node->space)) || gc_slot_test_and_mark(gc, slot)) {
     return;
   }
 
-  GCFreeFunc gc_free_func = gc->config.free;
-  GCFreeFunc space_free_func = space->config.free;
+  gc_debugf(gc, "gc: marking root %p (%zd bytes)\n", (void *)node, (size_t)node->size);
 
-  space->stats.total_collected = 0;
-  space->stats.total_freed = 0;
-  space->stats.total_marked = 0;
+  gc->spaces[node->space].stats.total_marked++;
 
-  // Phase 1: Mark
-  struct gcroot *current = space->roots;
-  while (current) {
-    struct gc_slot *slot = current->slot;
-    struct gcnode *node = slot->node;
-    if (!node->marked) {
-      gc_debugf(gc, "gc: marking root %p (%zd bytes)\n", (void *)node, (size_t)node->size);
+  gc_trace(gc, slot);
+}
 
-      node->marked = 1;
-      space->stats.total_marked++;
+static void gc_mark_roots(struct gc *gc) {
+  for (size_t i = 0; i < gc->root_count; ++i) {
+    gc_mark_root(gc, gc->roots[i].slot);
+  }
 
-      if (node->marker) {
-        node->marker(gc, slot);
-      }
+  for (size_t i = 0; i < gc->scoped_count; ++i) {
+    gc_mark_root(gc, gc->scoped[i]);
+  }
+
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    struct gc_thread *thread = gc->threads[i];
+    for (size_t j = 0; j < thread->scoped_count; ++j) {
+      gc_mark_root(gc, thread->scoped[j]);
     }
+  }
+
+  gc_scan_stacks(gc, gc_mark_root);
+}
+
+// Marks young objects reachable from the remembered set, dropping entries that no longer
+// reference anything young.
+static void gc_mark_remembered(struct gc *gc) {
+  size_t kept = 0;
+  for (size_t i = 0; i < gc->remembered_count; ++i) {
+    struct gc_slot *slot = gc->remembered[i];
+    struct gcnode *node = slot->node;
 
-    current = current->next;
+    gc->found_young = 0;
+    gc_trace(gc, slot);
+
+    if (gc->found_young) {
+      gc->remembered[kept++] = slot;
+    } else {
+      gc_debugf(gc, "gc: forgetting object %p (%zd bytes)\n", (void *)node, (size_t)node->size);
+      gc_node_set_remembered(node, 0);
+    }
   }
 
-  // Phase 2: Sweep
-  struct gc_slot *nodelist = space->nodes;
-  struct gc_slot *prev = NULL;
-  while (nodelist) {
-    struct gc_slot *next = nodelist->next;
-
-    struct gcnode *node = nodelist->node;
-    if (node->locked) {
-      // We can't do anything with this node.
-      // We won't increment the survived count, as it technically hasn't survived a cycle, it's
-      // just currently locked.
-      gc_debugf(gc, "gc: skipping locked object %p (%zd bytes)\n", (void *)node,
-                (size_t)node->size);
-    } else if (node->marked) {
-      node->marked = 0;
-      if (node->survived < 255) {
-        node->survived++;
-      }
-      gc_debugf(gc, "gc: skipping marked object %p (%zd bytes, survived %d cycles)\n", (void *)node,
-                (size_t)node->size, node->survived);
+  gc->remembered_count = kept;
+}
+
+// Drops remembered set entries for objects that are about to be swept.
+static void gc_prune_remembered(struct gc *gc, unsigned sweeping) {
+  size_t kept = 0;
+  for (size_t i = 0; i < gc->remembered_count; ++i) {
+    struct gc_slot *slot = gc->remembered[i];
+    struct gcnode *node = slot->node;
+
+    if ((sweeping & GC_SPACE_BIT(node->space)) && !gc_slot_is_marked(gc, slot) &&
+        !gc_node_is_locked(node)) {
+      gc_node_set_remembered(node, 0);
     } else {
-      gc_debugf(gc, "gc: collecting unmarked object %p (%zd bytes)\n", (void *)node,
-                (size_t)node->size);
+      gc->remembered[kept++] = slot;
+    }
+  }
+
+  gc->remembered_count = kept;
+}
+
+static void gc_clear_marks(struct gc *gc) {
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    memset(gc->slot_pages[i]->marked, 0, sizeof(gc->slot_pages[i]->marked));
+  }
+}
+
+// Sizes the next trigger for a space from the outcome of the sweep that just finished.
+static void gc_space_adapt_trigger(struct gc_space *space, int young, size_t survived_bytes) {
+  size_t max_size = space->config.max_size;
+  size_t min_trigger = GC_MIN_TRIGGER < max_size ? GC_MIN_TRIGGER : max_size;
+  size_t trigger = space->trigger;
+
+  if (young) {
+    // Most young objects should die before their first sweep. A high survival rate means sweeps
+    // happen before objects get the chance, so grow the space; a very low rate means the space is
+    // bigger than it needs to be, so shrink it to keep it cache-friendly.
+    size_t swept_bytes = survived_bytes + space->stats.total_freed;
+    if (survived_bytes * 4 > swept_bytes) {
+      trigger = trigger > max_size / 2 ? max_size : trigger * 2;
+    } else if (survived_bytes * 20 < swept_bytes) {
+      trigger /= 2;
+    }
+  } else {
+    // Let older spaces grow by their live size before they are swept again.
+    size_t live_bytes = space->stats.total_allocated;
+    size_t headroom = live_bytes < max_size ? max_size - live_bytes : 0;
+    trigger = live_bytes < headroom ? live_bytes : headroom;
+  }
+
+  space->trigger = trigger < min_trigger ? min_trigger : trigger;
+}
+
+struct gcnode *gc_node_alloc(struct gc *gc, struct gc_space *space, size_t size) {
+  if (space->config.map_pages) {
+    return gc_map_node(gc, size);
+  }
 
-      if (node->eraser) {
-        node->eraser(gc, nodelist);
+  struct gcnode *node = gc_space_alloc(space, size + sizeof(struct gcnode));
+  if (node) {
+    node->meta = 0;
+  }
+  return node;
+}
+
+void gc_free_node(struct gc *gc, struct gc_space *space, struct gcnode *node) {
+  if (node->in_region) {
+    gc_region_release(gc, node);
+  } else if (node->in_buffer) {
+    gc_buffer_release(gc, node);
+  } else if (node->mapped) {
+    gc_unmap_node(gc, node);
+  } else {
+    if (space == &gc->spaces[GC_SPACE_OLD]) {
+      gc->loose_freed += node->size;
+    }
+    gc_space_free(space, node);
+  }
+}
+
+static void gc_sweep_slot(struct gc *gc, struct gc_slot_page *page, size_t word,
+                          struct gc_slot *slot, size_t *survived_bytes) {
+  struct gcnode *node = slot->node;
+  struct gc_space *space = &gc->spaces[node->space];
+  uint64_t bit = gc_slot_bit(slot);
+
+  if (node->finalizing) {
+    // Already collected, and waiting for its eraser to run.
+  } else if (gc_node_is_locked(node)) {
+    // We can't do anything with this node.
+    // We won't increment the survived count, as it technically hasn't survived a cycle, it's
+    // just currently locked.
+    gc_debugf(gc, "gc: skipping locked object %p (%zd bytes)\n", (void *)node, (size_t)node->size);
+  } else if (page->marked[word] & bit) {
+    page->marked[word] &= ~bit;
+    if (node->survived < 255) {
+      node->survived++;
+    }
+    survived_bytes[node->space] += node->size;
+    // Young objects are judged when they are tenured; pretenured ones by their first old sweep.
+    if (node->site && node->space != GC_SPACE_YOUNG) {
+      gc_site_judge(gc, node, 1);
+    }
+    gc_debugf(gc, "gc: skipping marked object %p (%zd bytes, survived %d cycles)\n", (void *)node,
+              (size_t)node->size, node->survived);
+  } else {
+    gc_debugf(gc, "gc: collecting unmarked object %p (%zd bytes)\n", (void *)node,
+              (size_t)node->size);
+
+    space->stats.total_objects--;
+    space->stats.total_collected++;
+    space->stats.total_freed += node->size;
+    space->stats.total_allocated -= node->size;
+
+    if (node->site) {
+      gc_site_judge(gc, node, 0);
+    }
+
+    // Objects with erasers are released once every eraser in the batch has run. If the queue
+    // can't be grown, fall back to erasing the object on the spot.
+    if (node->eraser) {
+      node->finalizing = 1;
+      gc_slot_set_young(gc, slot, 0);
+      if (gc_queue_finalizer(gc, slot)) {
+        return;
       }
 
-      space->stats.total_objects--;
-      space->stats.total_collected++;
-      space->stats.total_freed += node->size;
-      space->stats.total_allocated -= node->size;
+      node->eraser(gc, slot);
+    }
+
+    gc_free_node(gc, space, node);
+    gc_slot_free(gc, slot);
+  }
+}
 
-      space_free_func(node);
+// Sweeps the given spaces, recording the bytes that survived in each space in survived_bytes.
+static void gc_sweep(struct gc *gc, unsigned sweeping, size_t *survived_bytes) {
 
-      if (prev) {
-        prev->next = next;
-      } else {
-        space->nodes = next;
+  // Minor cycles only need to visit young slots, which the young bitmaps find directly.
+  int young_only = sweeping == GC_SPACE_BIT(GC_SPACE_YOUNG);
+
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    struct gc_slot_page *page = gc->slot_pages[i];
+    for (size_t word = 0; word < GC_SLOT_PAGE_WORDS; ++word) {
+      uint64_t candidates = young_only ? page->young[word] : page->allocated[word];
+      while (candidates) {
+        size_t bit = (size_t)__builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+
+        struct gc_slot *slot = &page->slots[(word * 64) + bit];
+        if (sweeping & GC_SPACE_BIT(slot->node->space)) {
+          gc_sweep_slot(gc, page, word, slot, survived_bytes);
+        }
       }
+    }
+  }
 
-      gc_free_func(nodelist);
+  for (int i = 0; i < 8; ++i) {
+    if (sweeping & GC_SPACE_BIT(i)) {
+      struct gc_space *space = &gc->spaces[i];
+      gc_space_adapt_trigger(space, i == GC_SPACE_YOUNG, survived_bytes[i]);
+
+      space->cycles_since_sweep = 0;
+      space->allocation_debt = 0;
     }
+  }
+}
 
-    nodelist = next;
+// Works out where objects in the given space are tenured to, and after how many sweeps. Returns 0
+// if objects never leave the space.
+static int gc_space_tenuring(struct gc *gc, int space, size_t *after, enum GCSpace *to) {
+  struct gc_space_config *config = &gc->spaces[space].config;
+
+  if (space == GC_SPACE_YOUNG) {
+    *after = config->tenure_after ? config->tenure_after : gc->config.young_max_cycles;
+    *to = config->tenure_space == GC_SPACE_YOUNG ? GC_SPACE_OLD : config->tenure_space;
+    return 1;
+  } else if (!config->tenure_after || config->tenure_space == GC_SPACE_YOUNG ||
+             (int)config->tenure_space == space) {
+    return 0;
   }
 
-  space->cycles_since_sweep = 0;
+  *after = config->tenure_after;
+  *to = config->tenure_space;
+  return 1;
 }
 
-void gc_run(struct gc *gc, struct gc_stats *stats) {
-  assert(gc != NULL);
+static void gc_tenure_slot(struct gc *gc, struct gc_slot *slot, enum GCSpace to) {
+  struct gcnode *node = slot->node;
+  struct gc_space *from_space = &gc->spaces[node->space];
+  struct gc_space *to_space = &gc->spaces[to];
+  size_t size = node->size;
+
+  // If both spaces share an allocator, the object can simply be re-tagged where it is. Otherwise
+  // it has to be copied into memory owned by the destination space. Objects in compacted regions
+  // or thread allocation buffers always have to be copied out, as they can't be freed on their own.
+  // Mapped objects stay where they are if the destination maps pages too.
+  int in_place = !node->in_region && !node->in_buffer &&
+                 (node->mapped ? to_space->config.map_pages
+                               : !to_space->config.map_pages &&
+                                     gc_spaces_share_allocator(from_space, to_space));
+
+  if (!in_place) {
+    if (gc_node_is_locked(node)) {
+      // Locked objects can't be moved, they'll be promoted once unlocked.
+      return;
+    }
 
-  for (int i = 0; i < 8; ++i) {
-    gc_debugf(gc, "gc: running space %d\n", i);
-    gc_space_run(gc, &gc->spaces[i]);
+    struct gcnode *promoted = gc_node_alloc(gc, to_space, size);
+    if (!promoted) {
+      // Try again next cycle.
+      return;
+    }
+
+    uint64_t mapped = promoted->mapped;
+    memcpy(promoted, node, sizeof(struct gcnode));
+    promoted->in_region = 0;
+    promoted->in_buffer = 0;
+    promoted->mapped = mapped & 1;
+    memcpy(gc_node_data(promoted), gc_node_data(node), size);
+    slot->node = promoted;
+
+    gc_free_node(gc, from_space, node);
+    from_space->stats.total_freed += size;
+    from_space->stats.total_copied += size;
+    node = promoted;
   }
 
-  // Can we promote any objects from young to old space?
-  struct gc_space *young_space = &gc->spaces[GC_SPACE_YOUNG];
-  struct gc_space *old_space = &gc->spaces[GC_SPACE_OLD];
+  gc_debugf(gc, "gc: promoted slot %p (object %p of %zd bytes) from space %d to space %d%s\n",
+            (void *)slot, (void *)node, size, node->space, to, in_place ? " in place" : "");
+
+  gc_slot_set_young(gc, slot, 0);
 
-  struct gc_slot *nodelist = young_space->nodes;
-  struct gc_slot *prev = NULL;
-  while (nodelist) {
-    struct gc_slot *next = nodelist->next;
+  from_space->stats.total_objects--;
+  from_space->stats.total_allocated -= size;
+  from_space->stats.total_promoted += size;
+  to_space->stats.total_objects++;
+  to_space->stats.total_allocated += size;
+  to_space->allocation_debt += size;
+
+  if (node->site) {
+    gc_site_judge(gc, node, 1);
+  }
 
-    struct gcnode *node = nodelist->node;
-    if (node->survived > gc->config.young_max_cycles) {
-      gc_debugf(gc,
-                "gc: promoting slot %p (object %p of %zd bytes) from young space to old space\n",
-                (void *)nodelist, (void *)node, (size_t)node->size);
+  node->survived = 0;
+  node->space = to;
 
-      int needs_root = gc_unroot(gc, nodelist);
+  // The promoted object may still reference objects that remain in the young space.
+  if (!node->remembered && gc_references_young(gc, slot)) {
+    gc_remember(gc, slot);
+  }
+}
 
-      // Move the node to the old space & clear it out of the young space
-      nodelist->node = old_space->config.alloc(node->size + sizeof(struct gcnode));
-      memcpy(nodelist->node, node, sizeof(struct gcnode) + node->size);
+static void gc_promote(struct gc *gc) {
+  size_t after[8];
+  enum GCSpace to[8];
+  unsigned tenuring = 0;
+  for (int i = 0; i < 8; ++i) {
+    gc->spaces[i].stats.total_promoted = 0;
+    gc->spaces[i].stats.total_copied = 0;
 
-      young_space->config.free(node);
-      node = nodelist->node;
+    if (gc_space_tenuring(gc, i, &after[i], &to[i])) {
+      tenuring |= GC_SPACE_BIT(i);
+    }
+  }
 
-      if (prev) {
-        prev->next = next;
-      } else {
-        young_space->nodes = next;
+  // Usually only the young space tenures objects, and its bitmap finds candidates directly.
+  int young_only = tenuring == GC_SPACE_BIT(GC_SPACE_YOUNG);
+
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    struct gc_slot_page *page = gc->slot_pages[i];
+    for (size_t word = 0; word < GC_SLOT_PAGE_WORDS; ++word) {
+      uint64_t candidates = young_only ? page->young[word] : page->allocated[word];
+      while (candidates) {
+        size_t bit = (size_t)__builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+
+        struct gc_slot *slot = &page->slots[(word * 64) + bit];
+        unsigned space = slot->node->space;
+        if ((tenuring & GC_SPACE_BIT(space)) && !slot->node->finalizing &&
+            slot->node->survived > after[space]) {
+          gc_tenure_slot(gc, slot, to[space]);
+        }
       }
+    }
+  }
+}
+
+// Records the time spent in a phase of the current cycle, and starts timing the next one.
+static void gc_end_phase(struct gc_cycle_info *info, enum GCPhase phase, uint64_t *phase_start) {
+  uint64_t now = get_ticks_ns();
+  info->phase_ns[phase] = now - *phase_start;
+  *phase_start = now;
+}
+
+// Runs a single cycle. Spaces in `force` are swept even if they aren't otherwise due.
+static void gc_cycle(struct gc *gc, unsigned force) {
+  // Erasers may run a cycle of their own, in the middle of this one.
+  int collecting = gc->collecting;
+  gc->collecting = 1;
+
+  struct gc_cycle_info info;
+  memset(&info, 0, sizeof(info));
+  info.cycle = ++gc->cycle_count;
+
+  uint64_t start = get_ticks_ns();
+  uint64_t phase_start = start;
+
+  // Work out which spaces are due for a sweep this cycle. Empty spaces have nothing to sweep and
+  // are left out so that they don't force a full trace.
+  unsigned sweeping = 0;
+  for (int i = 0; i < 8; ++i) {
+    struct gc_space *space = &gc->spaces[i];
+    int due = (++space->cycles_since_sweep) >= space->config.sweep_every ||
+              (force & GC_SPACE_BIT(i)) ||
+              (gc->config.auto_collect && space->allocation_debt >= space->trigger);
+    if (!due) {
+      gc_debugf(gc, "gc: skipping sweep of space %d, cycles since last sweep: %zu, needed %zu\n",
+                i, space->cycles_since_sweep, space->config.sweep_every);
+      continue;
+    }
+
+    if (space->stats.total_objects) {
+      sweeping |= GC_SPACE_BIT(i);
+    }
+
+    space->stats.total_collected = 0;
+    space->stats.total_freed = 0;
+    space->stats.total_marked = 0;
+  }
+
+  // A minor cycle only sweeps the young space, so it only needs to trace young objects from the
+  // young roots and the remembered set. Anything else requires a trace of the whole heap.
+  int minor = !gc->force_major && (sweeping & ~GC_SPACE_BIT(GC_SPACE_YOUNG)) == 0;
+  gc_debugf(gc, "gc: running %s cycle (sweeping spaces 0x%x)\n", minor ? "minor" : "major",
+            sweeping);
+
+  info.minor = minor;
+  info.swept_spaces = sweeping;
+
+  // Phase 1: Mark
+  if (!sweeping) {
+    // Nothing to sweep, so nothing to mark either.
+  } else if (minor) {
+    gc->tracing = GC_SPACE_BIT(GC_SPACE_YOUNG);
+    gc_mark_roots(gc);
+    gc_mark_remembered(gc);
+  } else {
+    gc_mark_roots(gc);
+  }
+
+  if (sweeping) {
+    // Ephemeron values are only reachable through their keys, so they're marked once everything
+    // else is. Anything still unmarked after that is dead, and weak references to it are cleared.
+    gc_mark_ephemerons(gc, sweeping);
+    gc_clear_weak(gc, sweeping);
+  }
 
-      nodelist->next = old_space->nodes;
-      old_space->nodes = nodelist;
+  if (sweeping && !minor) {
+    gc_prune_remembered(gc, sweeping);
+    gc->force_major = 0;
+  }
+
+  gc->tracing = GC_ALL_SPACES;
 
-      old_space->stats.total_objects++;
-      old_space->stats.total_allocated += node->size;
-      young_space->stats.total_objects--;
-      young_space->stats.total_allocated -= node->size;
-      young_space->stats.total_freed += node->size;
+  gc_end_phase(&info, GC_PHASE_MARK, &phase_start);
+
+  // Phase 2: Sweep
+  if (sweeping) {
+    for (int i = 0; i < 8; ++i) {
+      info.swept_bytes[i] = (sweeping & GC_SPACE_BIT(i)) ? gc->spaces[i].stats.total_allocated : 0;
+    }
 
-      node->survived = 0;
-      node->space = GC_SPACE_OLD;
+    gc_sweep(gc, sweeping, info.survived_bytes);
 
-      if (needs_root) {
-        gc_debugf(gc, "gc: re-rooting object %p in old space\n", (void *)node);
-        gc_root(gc, nodelist);
+    for (int i = 0; i < 8; ++i) {
+      if (sweeping & GC_SPACE_BIT(i)) {
+        info.bytes_freed += gc->spaces[i].stats.total_freed;
       }
     }
+  }
+
+  if (!minor) {
+    // A full trace marks objects in every space; don't let those marks leak into the next cycle.
+    gc_clear_marks(gc);
+  }
+
+  // Objects collected by the sweep have their erasers run together, unless they've been deferred.
+  if (!gc->config.defer_finalizers) {
+    gc_run_finalizers(gc);
+  }
+
+  gc_end_phase(&info, GC_PHASE_SWEEP, &phase_start);
+
+  // Phase 3: Promote
+  gc_promote(gc);
 
-    nodelist = next;
+  gc_end_phase(&info, GC_PHASE_PROMOTE, &phase_start);
+
+  // Phase 4: Compact
+  gc->spaces[GC_SPACE_OLD].stats.total_compacted = 0;
+  if (sweeping & GC_SPACE_BIT(GC_SPACE_OLD)) {
+    gc_maybe_compact(gc);
+  }
+
+  gc_end_phase(&info, GC_PHASE_COMPACT, &phase_start);
+
+  info.pause_ns = phase_start - start;
+  for (int i = 0; i < 8; ++i) {
+    info.bytes_promoted += gc->spaces[i].stats.total_promoted;
+    info.bytes_compacted += gc->spaces[i].stats.total_compacted;
+  }
+
+  gc_record_pause(gc, info.pause_ns);
+
+  if (gc->config.on_cycle) {
+    gc->config.on_cycle(gc, &info, gc->config.event_context);
   }
 
+  gc->collecting = collecting;
+}
+
+void gc_run(struct gc *gc, struct gc_stats *stats) {
+  assert(gc != NULL);
+
+  gc_collect(gc, 0);
+
   if (stats) {
     gc_get_stats(gc, stats);
   }
@@ -517,6 +1080,8 @@ void gc_get_stats(struct gc *gc, struct gc_stats *stats) {
   assert(gc != NULL);
   assert(stats != NULL);
 
+  int locked = gc_lock(gc);
+
   memset(stats, 0, sizeof(struct gc_stats));
   for (int i = 0; i < 8; ++i) {
     stats->total_allocated += gc->spaces[i].stats.total_allocated;
@@ -524,10 +1089,15 @@ void gc_get_stats(struct gc *gc, struct gc_stats *stats) {
     stats->total_collected += gc->spaces[i].stats.total_collected;
     stats->total_marked += gc->spaces[i].stats.total_marked;
     stats->total_objects += gc->spaces[i].stats.total_objects;
+    stats->total_promoted += gc->spaces[i].stats.total_promoted;
+    stats->total_copied += gc->spaces[i].stats.total_copied;
+    stats->total_compacted += gc->spaces[i].stats.total_compacted;
   }
+
+  gc_unlock(gc, locked);
 }
 
 enum GCSpace gc_get_space(struct gc_slot *slot) {
   assert(slot != NULL);
-  return slot->node->space;
+  return gc_node_load(slot->node).space;
 }
@@ -0,0 +1,682 @@
+#ifndef _POCKETKNIFE_GC_INTERNAL_H
+#define _POCKETKNIFE_GC_INTERNAL_H
+
+#include <pocketknife/gc/gc.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GC_ALL_SPACES 0xffu
+#define GC_SPACE_BIT(space) (1u << (unsigned)(space))
+
+// Smallest allocation debt that will trigger an automatic cycle
+#define GC_MIN_TRIGGER (64 * 1024)
+
+// Slots are carved out of pages of this many slots. Must be a multiple of 64.
+#define GC_SLOT_PAGE_SHIFT 9
+#define GC_SLOTS_PER_PAGE (1u << GC_SLOT_PAGE_SHIFT)
+#define GC_SLOT_PAGE_WORDS (GC_SLOTS_PER_PAGE / 64)
+
+#define GCNODE_SIZE_BITS 34
+// Objects record the allocation site they came from in this many bits; zero means no site.
+#define GCNODE_SITE_BITS 12
+#define GC_MAX_SITES ((1u << GCNODE_SITE_BITS) - 1)
+
+// Compaction packs old objects into regions of this many bytes, tracking object starts at
+// GC_REGION_GRANULE granularity. Objects bigger than GC_REGION_MAX_OBJECT are never compacted.
+#define GC_REGION_SIZE (1024 * 1024)
+#define GC_REGION_GRANULE 16
+#define GC_REGION_GRANULES (GC_REGION_SIZE / GC_REGION_GRANULE)
+#define GC_REGION_MAX_OBJECT (GC_REGION_SIZE / 8)
+
+// Attached threads bump allocate young objects whose footprint is at most
+// GC_THREAD_BUFFER_MAX_OBJECT bytes from buffers of GC_THREAD_BUFFER_SIZE bytes, and take free
+// slots from the shared free list GC_THREAD_SLOT_CACHE at a time. Buffers are big enough that
+// liballoc gives them their own pages, so allocator compaction never tries to move them.
+#define GC_THREAD_BUFFER_SIZE (64 * 1024)
+#define GC_THREAD_BUFFER_MAX_OBJECT (GC_THREAD_BUFFER_SIZE / 8)
+#define GC_THREAD_SLOT_CACHE 64
+
+// When a thread with a registered stack stops, up to this many words of the frame that stopped it,
+// including its spilled registers, are copied aside for conservative scanning.
+#define GC_STACK_SPILL_WORDS 64
+
+// Pause times are recorded in a log-linear histogram: each power of two is split into
+// 2^GC_PAUSE_SUB_BITS buckets.
+#define GC_PAUSE_SUB_BITS 3
+#define GC_PAUSE_BUCKETS (64 << GC_PAUSE_SUB_BITS)
+
+struct gcnode;
+struct gc_slot;
+struct gc_space;
+struct gc_snapshot;
+
+struct gc_space {
+  struct gc_stats stats;
+
+  size_t cycles_since_sweep;
+
+  // Bytes allocated in (or promoted into) this space since it was last swept.
+  size_t allocation_debt;
+  // Allocation debt at which an automatic cycle sweeps this space (see gc_config.auto_collect).
+  size_t trigger;
+
+  struct gc_space_config config;
+};
+
+// Layout of a kind of object: which of its words hold references.
+struct gc_type {
+  // Called after the described references are traced, for anything else the object references.
+  GCMarkFunc marker;
+
+  // Objects must be at least this many bytes, to cover every described reference.
+  size_t extent;
+
+  // One bit per pointer-sized word of the object, set where the word holds a struct gc_slot *.
+  size_t bitmap_words;
+  uint64_t bitmap[];
+};
+
+// An allocation site, and what it has learned about the lifetimes of its objects.
+struct gc_site {
+  const char *name;
+  // Position of the site in the site table plus one, as recorded in its objects.
+  uint32_t index;
+
+  // Set while the site allocates into the old space. Read by allocations without the lock.
+  int pretenured;
+
+  // Allocation counts, which attached threads update atomically.
+  uint64_t allocated_objects;
+  uint64_t allocated_bytes;
+  uint64_t pretenured_objects;
+
+  // Judged objects, in total and since the site last made a decision.
+  uint64_t survived_objects;
+  uint64_t died_objects;
+  uint64_t window_survived;
+  uint64_t window_died;
+
+  uint64_t decisions;
+};
+
+struct gc_root {
+  struct gc_slot *slot;
+  // Number of outstanding gc_root calls for the slot.
+  size_t count;
+};
+
+struct gc_slot {
+  union {
+    // The object this slot refers to, while the slot is allocated.
+    struct gcnode *node;
+    // The next free slot, while the slot is on the free list.
+    struct gc_slot *next_free;
+  };
+
+  // Global index of this slot, which locates its page and bitmap bits.
+  uint32_t index;
+  // Position of this slot in the root table plus one, or zero if the slot is not rooted.
+  uint32_t root_index;
+};
+
+// A page of slots. Per-slot state that the collector scans in bulk lives in bitmaps alongside the
+// slots, so that sweeping and mark checks touch as little memory as possible.
+struct gc_slot_page {
+  // Slots that are currently handed out.
+  uint64_t allocated[GC_SLOT_PAGE_WORDS];
+  // Slots whose objects were marked in the current cycle.
+  uint64_t marked[GC_SLOT_PAGE_WORDS];
+  // Slots whose objects are in the young space.
+  uint64_t young[GC_SLOT_PAGE_WORDS];
+
+  struct gc_slot slots[GC_SLOTS_PER_PAGE];
+};
+
+// A dense region of old space objects, created by compaction.
+struct gc_region {
+  // Start of the object area, aligned to GC_REGION_GRANULE.
+  char *data;
+  // The old space allocation backing the object area.
+  void *raw;
+
+  // Bytes from the start of the object area to the end of the last object.
+  size_t used;
+  // Footprint (header, payload and padding) of the objects in the region.
+  size_t live_bytes;
+  // Payload bytes of the objects in the region.
+  size_t payload_bytes;
+
+  // One bit per granule, set where an object starts.
+  uint64_t starts[GC_REGION_GRANULES / 64];
+};
+
+// A thread allocation buffer. The header sits at the start of a young space allocation, and
+// objects are bump allocated after it.
+struct gc_buffer {
+  // Next free byte, and the end of the buffer.
+  char *cursor;
+  char *limit;
+
+  // Objects in the buffer that have yet to be released. The owning thread adds to this without the
+  // lock, so it's only ever updated atomically.
+  size_t live;
+
+  // Set once the owning thread has moved on to another buffer. Retired buffers are released along
+  // with their last object.
+  int retired;
+};
+
+enum GCThreadState {
+  // Running mutator code, and will only stop at a safepoint.
+  GC_THREAD_RUNNING,
+  // Stopped at a safepoint until the current collection finishes.
+  GC_THREAD_PARKED,
+  // Inside a safe region, and not touching the heap.
+  GC_THREAD_SAFE,
+};
+
+// A thread attached to a collector.
+struct gc_thread {
+  struct gc *gc;
+
+  // Position of this thread in gc->threads.
+  size_t index;
+  // The next record for the same OS thread, which may be attached to several collectors.
+  struct gc_thread *next_for_thread;
+
+  // Only changed with the collector's lock held.
+  enum GCThreadState state;
+
+  struct gc_buffer *buffer;
+
+  // Free slots taken from the shared free list, but not yet marked allocated.
+  struct gc_slot *slots[GC_THREAD_SLOT_CACHE];
+  size_t slot_count;
+
+  // Young space allocations not yet added to the space's stats.
+  size_t allocated_bytes;
+  size_t allocated_objects;
+
+  // This thread's handle scope stack.
+  struct gc_slot **scoped;
+  size_t scoped_count;
+  size_t scoped_capacity;
+
+  // The end of the thread's stack if it's registered for conservative scanning, and the lowest
+  // address still in use when the thread last parked or entered a safe region.
+  char *stack_base;
+  char *stack_top;
+
+  // Copy of the frame that parked the thread or entered the safe region, taken after the frame
+  // spilled every callee-saved register.
+  uintptr_t spill[GC_STACK_SPILL_WORDS];
+  size_t spill_words;
+};
+
+struct gc_pause_histogram {
+  size_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  size_t buckets[GC_PAUSE_BUCKETS];
+};
+
+struct gc {
+  struct gc_config config;
+
+  struct gc_space spaces[8];
+
+  // Slot pages, indexed by slot index >> GC_SLOT_PAGE_SHIFT.
+  struct gc_slot_page **slot_pages;
+  size_t slot_page_count;
+  size_t slot_page_capacity;
+
+  // Free slots across all pages.
+  struct gc_slot *free_slots;
+
+  // The same slot pages sorted by address, so that conservative scanning can tell whether a word
+  // points at a slot. Has the same count as slot_pages.
+  struct gc_slot_page **page_map;
+  size_t page_map_capacity;
+
+  // Stack registered for conservative scanning by a thread that isn't attached, which is only
+  // scanned by collections that thread runs.
+  char *stack_base;
+  pthread_t stack_thread;
+
+  // Compacted old space regions, sorted by address.
+  struct gc_region **regions;
+  size_t region_count;
+  size_t region_capacity;
+
+  // Holes left in the regions by the last compaction, which pinned objects kept it from closing.
+  size_t pinned_holes;
+  // Bytes freed since the last compaction from old objects that had their own allocations.
+  size_t loose_freed;
+
+  // Root table. Each rooted slot appears once and records its own index, so rooting and unrooting
+  // are constant time regardless of how many roots exist.
+  struct gc_root *roots;
+  size_t root_count;
+  size_t root_capacity;
+
+  // Handle scope stack: temporary roots that are released together by gc_pop_handle_scope.
+  struct gc_slot **scoped;
+  size_t scoped_count;
+  size_t scoped_capacity;
+
+  // Remembered set: objects outside the young space that may hold references to young objects.
+  // Minor cycles use these as extra roots instead of tracing the rest of the heap.
+  struct gc_slot **remembered;
+  size_t remembered_count;
+  size_t remembered_capacity;
+
+  // Set if the remembered set could not be grown; the next cycle must trace the whole heap.
+  int force_major;
+
+  // Bitmask of spaces that gc_mark will trace into. Outside of a cycle this covers every space.
+  unsigned tracing;
+
+  // Set by gc_mark whenever it encounters a young object (used to refine the remembered set).
+  int found_young;
+
+  // Set while a cycle is running, so allocations made from callbacks can't start another one.
+  int collecting;
+
+  // Set while gc_heap_snapshot is running, so that gc_mark records edges instead of marking.
+  struct gc_snapshot *snapshot;
+
+  // Types created by gc_type_new, which live as long as the collector.
+  struct gc_type **types;
+  size_t type_count;
+  size_t type_capacity;
+
+  // Allocation sites created by gc_site_new, indexed by site index minus one.
+  struct gc_site **sites;
+  size_t site_count;
+  size_t site_capacity;
+
+  // Weak references, each of which records its own index.
+  struct gc_weak **weak_refs;
+  size_t weak_count;
+  size_t weak_capacity;
+
+  // Ephemeron tables, each of which records its own index.
+  struct gc_ephemeron_table **ephemeron_tables;
+  size_t ephemeron_table_count;
+  size_t ephemeron_table_capacity;
+
+  // Collected objects whose erasers have yet to run.
+  struct gc_slot **finalize_queue;
+  size_t finalize_count;
+  size_t finalize_capacity;
+
+  // Set while gc_run_finalizers is running erasers.
+  int finalizing;
+
+  // Attached threads, each of which records its own index. thread_count is also read without the
+  // lock, to tell whether the collector is shared at all.
+  struct gc_thread **threads;
+  size_t thread_count;
+  size_t thread_capacity;
+
+  // Allocation buffers of attached threads (and retired buffers with live objects), sorted by
+  // address.
+  struct gc_buffer **buffers;
+  size_t buffer_count;
+  size_t buffer_capacity;
+
+  // Guards the collector's shared state while threads are attached.
+  pthread_mutex_t lock;
+  // Signalled whenever a thread parks, enters a safe region or detaches.
+  pthread_cond_t stopped_cond;
+  // Broadcast when a collection finishes and parked threads can carry on.
+  pthread_cond_t resume_cond;
+  // Set while a thread is stopping, or has stopped, the world. Polled without the lock.
+  int stop_requested;
+  // The attached thread that stopped the world, if any.
+  struct gc_thread *collector;
+  // The thread that stopped the world, attached or not, and how many more times it has stopped it
+  // since, for cycles run from its own callbacks.
+  pthread_t stopping_thread;
+  unsigned stop_depth;
+
+  // Allocators created for gc_config.allocator_region_size.
+  struct allocator *owned_allocators[2];
+
+  // Number of cycles run so far.
+  uint64_t cycle_count;
+
+  struct gc_pause_histogram pauses;
+};
+
+// Used as a header on the resulting allocation
+// Currently a 32-byte header - if adding fields, try to ensure at least 16-byte alignment
+struct gcnode {
+  union {
+    GCMarkFunc marker;
+    // The object's type, if `typed` is set.
+    const struct gc_type *type;
+  };
+  GCEraseFunc eraser;
+
+  struct gc_slot *slot;
+
+  union {
+    struct {
+      // If set, the object is locked and cannot be moved.
+      uint64_t locked : 1;
+      // If set, the object is in the remembered set.
+      uint64_t remembered : 1;
+      // If set, the object lives in a compacted region rather than its own allocation.
+      uint64_t in_region : 1;
+      // If set, the object has been collected and is waiting in the finalization queue.
+      uint64_t finalizing : 1;
+      // If set, the object was bump allocated from a thread allocation buffer.
+      uint64_t in_buffer : 1;
+      // If set, the object's references are described by `type` rather than traced by `marker`.
+      uint64_t typed : 1;
+      // If set, the object has its own mapping, and this header is a struct gc_mapped_node.
+      uint64_t mapped : 1;
+      // GCSpace the object is currently in
+      uint64_t space : 3;
+      // # of cycles the object has lived in its current space (will not wrap around to zero)
+      uint64_t survived : 8;
+      // Allocation site the object came from, until the site has judged whether it survived.
+      uint64_t site : GCNODE_SITE_BITS;
+      // Size of the object in bytes
+      uint64_t size : GCNODE_SIZE_BITS;
+    };
+    uint64_t meta;
+  };
+} __attribute__((packed)) __attribute__((aligned(8)));
+
+// Out-of-line header of an object in a space that maps pages. The payload starts its own mapping,
+// so that it's page aligned and its pages go straight back to the OS when it's collected.
+struct gc_mapped_node {
+  struct gcnode node;
+  void *data;
+  size_t length;
+};
+
+// gc_lock_slot and gc_unlock_slot run without the lock, and the locked bit shares the meta word
+// with the remembered bit that write barriers set, so both are only ever updated atomically on
+// the whole word: a bitfield store to either could undo a concurrent change to the other.
+static inline uint64_t *gc_node_meta(struct gcnode *node) {
+  return (uint64_t *)(void *)((char *)node + offsetof(struct gcnode, meta));
+}
+
+// Reads the meta word in one atomic load, for code that runs alongside other mutators, which may
+// be locking the object or remembering it. Only the bitfields of the copy are set.
+static inline struct gcnode gc_node_load(struct gcnode *node) {
+  struct gcnode copy = {.meta = __atomic_load_n(gc_node_meta(node), __ATOMIC_RELAXED)};
+  return copy;
+}
+
+static inline void *gc_node_data(struct gcnode *node) {
+  if (gc_node_load(node).mapped) {
+    return ((struct gc_mapped_node *)node)->data;
+  }
+  return (void *)(node + 1);
+}
+
+static inline uint64_t gc_node_locked_bit(void) {
+  struct gcnode node = {.meta = 0};
+  node.locked = 1;
+  return node.meta;
+}
+
+static inline uint64_t gc_node_remembered_bit(void) {
+  struct gcnode node = {.meta = 0};
+  node.remembered = 1;
+  return node.meta;
+}
+
+static inline int gc_node_is_locked(struct gcnode *node) {
+  return (__atomic_load_n(gc_node_meta(node), __ATOMIC_ACQUIRE) & gc_node_locked_bit()) != 0;
+}
+
+// Sets the locked bit, returning 1 if it was clear.
+static inline int gc_node_try_lock(struct gcnode *node) {
+  uint64_t bit = gc_node_locked_bit();
+  return !(__atomic_fetch_or(gc_node_meta(node), bit, __ATOMIC_ACQUIRE) & bit);
+}
+
+static inline void gc_node_unlock(struct gcnode *node) {
+  __atomic_fetch_and(gc_node_meta(node), ~gc_node_locked_bit(), __ATOMIC_RELEASE);
+}
+
+static inline void gc_node_set_remembered(struct gcnode *node, int remembered) {
+  if (remembered) {
+    __atomic_fetch_or(gc_node_meta(node), gc_node_remembered_bit(), __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_and(gc_node_meta(node), ~gc_node_remembered_bit(), __ATOMIC_RELAXED);
+  }
+}
+
+void gc_debugf(struct gc *gc, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Returns an array with room for at least one more element than `count`, growing it (and
+// updating `capacity`) if needed. Returns NULL if the array could not be grown, in which case the
+// original array is left untouched.
+void *gc_grow_array(struct gc *gc, void *array, size_t element_size, size_t count,
+                    size_t *capacity);
+
+struct gc_slot *gc_slot_alloc(struct gc *gc);
+void gc_slot_free(struct gc *gc, struct gc_slot *slot);
+// Takes a slot off the free list without marking it allocated, for a thread's slot cache.
+struct gc_slot *gc_slot_take(struct gc *gc);
+// Returns a slot that was taken but never allocated to the free list.
+void gc_slot_put(struct gc *gc, struct gc_slot *slot);
+// Returns the allocated slot at the given address, or NULL if the address isn't one. Requires the
+// lock, or a stopped world.
+struct gc_slot *gc_find_slot(struct gc *gc, uintptr_t address);
+void gc_slots_destroy(struct gc *gc);
+
+static inline void *gc_space_alloc(struct gc_space *space, size_t size) {
+  if (space->config.alloc_with_context) {
+    return space->config.alloc_with_context(space->config.allocator_context, size);
+  }
+  return space->config.alloc(size);
+}
+
+static inline void gc_space_free(struct gc_space *space, void *ptr) {
+  if (space->config.free_with_context) {
+    space->config.free_with_context(space->config.allocator_context, ptr);
+  } else {
+    space->config.free(ptr);
+  }
+}
+
+static inline int gc_spaces_share_allocator(struct gc_space *a, struct gc_space *b) {
+  if (a->config.alloc_with_context || b->config.alloc_with_context) {
+    return a->config.alloc_with_context == b->config.alloc_with_context &&
+           a->config.free_with_context == b->config.free_with_context &&
+           a->config.allocator_context == b->config.allocator_context;
+  }
+  return a->config.alloc == b->config.alloc && a->config.free == b->config.free;
+}
+
+// Returns the liballoc allocator backing the space, if any.
+struct allocator *gc_space_allocator(struct gc_space *space);
+// Creates the allocators requested by gc_config.allocator_region_size. Returns 0 on failure.
+int gc_create_allocators(struct gc *gc);
+void gc_destroy_allocators(struct gc *gc);
+// Compacts a liballoc allocator backing GC spaces, returning the number of bytes moved.
+size_t gc_compact_allocator(struct gc *gc, struct allocator *allocator);
+
+// Allocates a node of `size` payload bytes in the space, with its meta cleared apart from
+// `mapped`.
+struct gcnode *gc_node_alloc(struct gc *gc, struct gc_space *space, size_t size);
+void gc_free_node(struct gc *gc, struct gc_space *space, struct gcnode *node);
+
+// Maps a node of `size` payload bytes, or returns NULL if it can't be mapped.
+struct gcnode *gc_map_node(struct gc *gc, size_t size);
+void gc_unmap_node(struct gc *gc, struct gcnode *node);
+
+void gc_types_destroy(struct gc *gc);
+
+// Records that an object allocated at a site survived or died, and clears its site.
+void gc_site_judge(struct gc *gc, struct gcnode *node, int survived);
+void gc_sites_destroy(struct gc *gc);
+
+static inline int gc_node_traces(struct gcnode *node) {
+  return node->typed || node->marker;
+}
+
+// Marks the object's references: described ones in a tight loop, without locking the object or
+// calling through a pointer, and anything else through the marker.
+static inline void gc_trace(struct gc *gc, struct gc_slot *slot) {
+  struct gcnode *node = slot->node;
+  if (!node->typed) {
+    if (node->marker) {
+      node->marker(gc, slot);
+    }
+    return;
+  }
+
+  const struct gc_type *type = node->type;
+  struct gc_slot **words = (struct gc_slot **)gc_node_data(node);
+  for (size_t i = 0; i < type->bitmap_words; ++i) {
+    uint64_t bits = type->bitmap[i];
+    while (bits) {
+      size_t bit = (size_t)__builtin_ctzll(bits);
+      bits &= bits - 1;
+
+      struct gc_slot *child = words[(i * 64) + bit];
+      if (child) {
+        gc_mark(gc, child);
+      }
+    }
+  }
+
+  if (type->marker) {
+    type->marker(gc, slot);
+  }
+}
+
+// Runs any collections needed before `size` more bytes can be allocated in the given space.
+void gc_collect_for_allocation(struct gc *gc, enum GCSpace space, size_t size);
+
+// Returns the calling thread's record for the collector, or NULL if it isn't attached.
+struct gc_thread *gc_find_thread(struct gc *gc);
+// Stops every attached thread other than the caller at a safepoint (or in a safe region), waiting
+// for any collection that's already underway first. Stops nest when the thread that stopped the
+// world stops it again, each resume undoing one.
+void gc_stop_world(struct gc *gc);
+void gc_resume_world(struct gc *gc);
+// Bump allocates a young object from the thread's buffer.
+struct gc_slot *gc_thread_alloc(struct gc *gc, struct gc_thread *thread, size_t size,
+                                GCMarkFunc marker, GCEraseFunc eraser);
+// Releases an object that was allocated from a thread allocation buffer.
+void gc_buffer_release(struct gc *gc, struct gcnode *node);
+void gc_threads_init(struct gc *gc);
+void gc_threads_destroy(struct gc *gc);
+
+// Marks an object as a root for the current cycle.
+void gc_mark_root(struct gc *gc, struct gc_slot *slot);
+typedef void (*GCStackVisitor)(struct gc *gc, struct gc_slot *slot);
+// Calls `visit` for every slot referenced from the registered stacks that can be scanned, which
+// must be stopped unless they belong to the calling thread.
+void gc_scan_stacks(struct gc *gc, GCStackVisitor visit);
+// Copies the frame at `frame` aside and records the stack top, so that the thread's stack can be
+// scanned while it's stopped. Callers use __builtin_unwind_init() first, so that the frame holds
+// every callee-saved register.
+void gc_thread_save_stack(struct gc_thread *thread, char *frame);
+
+static inline struct gc_thread *gc_current_thread(struct gc *gc) {
+  return __atomic_load_n(&gc->thread_count, __ATOMIC_ACQUIRE) ? gc_find_thread(gc) : NULL;
+}
+
+// Takes the collector's lock if any threads are attached, returning whether it did.
+static inline int gc_lock(struct gc *gc) {
+  if (!__atomic_load_n(&gc->thread_count, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&gc->lock);
+  return 1;
+}
+
+static inline void gc_unlock(struct gc *gc, int locked) {
+  if (locked) {
+    pthread_mutex_unlock(&gc->lock);
+  }
+}
+
+// Marks the values of ephemerons whose keys survive the sweep of the given spaces, until no more
+// values are found.
+void gc_mark_ephemerons(struct gc *gc, unsigned sweeping);
+// Clears weak references and ephemerons whose objects will not survive the sweep.
+void gc_clear_weak(struct gc *gc, unsigned sweeping);
+// Queues a collected object for finalization. Returns 0 if the queue could not be grown.
+int gc_queue_finalizer(struct gc *gc, struct gc_slot *slot);
+void gc_weak_destroy(struct gc *gc);
+// Writes an ephemeron record for every entry in every ephemeron table to the current snapshot.
+void gc_snapshot_ephemerons(struct gc *gc);
+
+// Records a reference from the object whose marker is running to `slot`.
+void gc_snapshot_edge(struct gc_snapshot *snapshot, struct gc_slot *slot);
+void gc_snapshot_ephemeron(struct gc_snapshot *snapshot, struct gc_slot *key,
+                           struct gc_slot *value);
+
+// Releases a node that lives in a compacted region.
+void gc_region_release(struct gc *gc, struct gcnode *node);
+// Compacts the old space if it has become fragmented enough.
+void gc_maybe_compact(struct gc *gc);
+void gc_regions_destroy(struct gc *gc);
+
+// Adds a cycle's pause time to the pause histogram.
+void gc_record_pause(struct gc *gc, uint64_t pause_ns);
+
+// Works the page out from the slot's address, rather than looking it up in gc->slot_pages, which
+// another thread may be growing.
+static inline struct gc_slot_page *gc_slot_page(struct gc *gc, struct gc_slot *slot) {
+  (void)gc;
+  struct gc_slot *first = slot - (slot->index & (GC_SLOTS_PER_PAGE - 1));
+  return (struct gc_slot_page *)((char *)first - offsetof(struct gc_slot_page, slots));
+}
+
+static inline uint64_t gc_slot_bit(struct gc_slot *slot) {
+  return 1ULL << (slot->index & 63u);
+}
+
+static inline size_t gc_slot_word(struct gc_slot *slot) {
+  return (slot->index & (GC_SLOTS_PER_PAGE - 1)) / 64;
+}
+
+static inline int gc_slot_is_marked(struct gc *gc, struct gc_slot *slot) {
+  return (gc_slot_page(gc, slot)->marked[gc_slot_word(slot)] & gc_slot_bit(slot)) != 0;
+}
+
+// Sets the mark bit for the slot, returning its previous value.
+static inline int gc_slot_test_and_mark(struct gc *gc, struct gc_slot *slot) {
+  uint64_t *word = &gc_slot_page(gc, slot)->marked[gc_slot_word(slot)];
+  uint64_t bit = gc_slot_bit(slot);
+  int marked = (*word & bit) != 0;
+  *word |= bit;
+  return marked;
+}
+
+// Attached threads set allocated and young bits without the lock, so those bitmaps are only ever
+// updated atomically. Mark bits are left to the collector.
+static inline void gc_slot_set_young(struct gc *gc, struct gc_slot *slot, int young) {
+  uint64_t *word = &gc_slot_page(gc, slot)->young[gc_slot_word(slot)];
+  if (young) {
+    __atomic_fetch_or(word, gc_slot_bit(slot), __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_and(word, ~gc_slot_bit(slot), __ATOMIC_RELAXED);
+  }
+}
+
+static inline void gc_slot_set_allocated(struct gc *gc, struct gc_slot *slot, int allocated) {
+  uint64_t *word = &gc_slot_page(gc, slot)->allocated[gc_slot_word(slot)];
+  if (allocated) {
+    __atomic_fetch_or(word, gc_slot_bit(slot), __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_and(word, ~gc_slot_bit(slot), __ATOMIC_RELAXED);
+  }
+}
+
+#endif  // _POCKETKNIFE_GC_INTERNAL_H
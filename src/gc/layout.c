@@ -0,0 +1,100 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+struct gc_type *gc_type_new(struct gc *gc, const size_t *offsets, size_t count,
+                            GCMarkFunc marker) {
+  assert(gc != NULL);
+  assert(offsets != NULL || count == 0);
+
+  size_t extent = 0;
+  for (size_t i = 0; i < count; ++i) {
+    assert(offsets[i] % sizeof(struct gc_slot *) == 0);
+    if (offsets[i] + sizeof(struct gc_slot *) > extent) {
+      extent = offsets[i] + sizeof(struct gc_slot *);
+    }
+  }
+
+  size_t words = extent / sizeof(struct gc_slot *);
+  size_t bitmap_words = (words + 63) / 64;
+  struct gc_type *type =
+      gc->config.alloc(sizeof(struct gc_type) + (bitmap_words * sizeof(uint64_t)));
+  if (!type) {
+    return NULL;
+  }
+
+  type->marker = marker;
+  type->extent = extent;
+  type->bitmap_words = bitmap_words;
+  memset(type->bitmap, 0, bitmap_words * sizeof(uint64_t));
+  for (size_t i = 0; i < count; ++i) {
+    size_t word = offsets[i] / sizeof(struct gc_slot *);
+    type->bitmap[word / 64] |= 1ULL << (word & 63);
+  }
+
+  int locked = gc_lock(gc);
+
+  struct gc_type **types = gc_grow_array(gc, gc->types, sizeof(struct gc_type *), gc->type_count,
+                                         &gc->type_capacity);
+  if (!types) {
+    gc_unlock(gc, locked);
+    gc->config.free(type);
+    return NULL;
+  }
+  gc->types = types;
+  gc->types[gc->type_count++] = type;
+
+  gc_unlock(gc, locked);
+  return type;
+}
+
+struct gc_slot *gc_alloc_typed(struct gc *gc, size_t size, const struct gc_type *type,
+                               GCEraseFunc eraser) {
+  enum GCSpace space = GC_SPACE_YOUNG;
+  if (size >= gc->config.large_threshold) {
+    space = GC_SPACE_LARGE;
+  }
+
+  return gc_alloc_typed_with_space(gc, size, type, eraser, space);
+}
+
+struct gc_slot *gc_alloc_typed_with_space(struct gc *gc, size_t size, const struct gc_type *type,
+                                          GCEraseFunc eraser, enum GCSpace space) {
+  assert(type != NULL);
+  assert(size >= type->extent);
+
+  struct gc_slot *slot = gc_alloc_with_space(gc, size, NULL, eraser, space);
+  if (!slot) {
+    return NULL;
+  }
+
+  // The collector reads described references directly, so they can never hold garbage.
+  struct gcnode *node = slot->node;
+  struct gc_slot **words = (struct gc_slot **)gc_node_data(node);
+  for (size_t i = 0; i < type->bitmap_words; ++i) {
+    uint64_t bits = type->bitmap[i];
+    while (bits) {
+      size_t bit = (size_t)__builtin_ctzll(bits);
+      bits &= bits - 1;
+      words[(i * 64) + bit] = NULL;
+    }
+  }
+
+  node->type = type;
+  node->typed = 1;
+  return slot;
+}
+
+void gc_types_destroy(struct gc *gc) {
+  for (size_t i = 0; i < gc->type_count; ++i) {
+    gc->config.free(gc->types[i]);
+  }
+
+  if (gc->types) {
+    gc->config.free(gc->types);
+  }
+}
@@ -0,0 +1,38 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+struct gcnode *gc_map_node(struct gc *gc, size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t length = (size + page - 1) & ~(page - 1);
+
+  struct gc_mapped_node *header = gc->config.alloc(sizeof(struct gc_mapped_node));
+  if (!header) {
+    return NULL;
+  }
+
+  void *data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    gc_debugf(gc, "gc: failed to map %zu bytes\n", length);
+    gc->config.free(header);
+    return NULL;
+  }
+
+  header->data = data;
+  header->length = length;
+  header->node.meta = 0;
+  header->node.mapped = 1;
+  return &header->node;
+}
+
+void gc_unmap_node(struct gc *gc, struct gcnode *node) {
+  assert(node->mapped);
+
+  struct gc_mapped_node *header = (struct gc_mapped_node *)node;
+  munmap(header->data, header->length);
+  gc->config.free(header);
+}
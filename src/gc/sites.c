@@ -0,0 +1,162 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "internal.h"
+
+struct gc_site *gc_site_new(struct gc *gc, const char *name) {
+  assert(gc != NULL);
+
+  struct gc_site *site = gc->config.alloc(sizeof(struct gc_site));
+  if (!site) {
+    return NULL;
+  }
+
+  site->name = name ? name : "(unnamed)";
+  site->pretenured = 0;
+  site->allocated_objects = 0;
+  site->allocated_bytes = 0;
+  site->pretenured_objects = 0;
+  site->survived_objects = 0;
+  site->died_objects = 0;
+  site->window_survived = 0;
+  site->window_died = 0;
+  site->decisions = 0;
+
+  int locked = gc_lock(gc);
+
+  struct gc_site **sites = NULL;
+  if (gc->site_count < GC_MAX_SITES) {
+    sites = gc_grow_array(gc, gc->sites, sizeof(struct gc_site *), gc->site_count,
+                          &gc->site_capacity);
+  }
+  if (!sites) {
+    gc_unlock(gc, locked);
+    gc->config.free(site);
+    return NULL;
+  }
+  gc->sites = sites;
+  gc->sites[gc->site_count++] = site;
+  site->index = (uint32_t)gc->site_count;
+
+  gc_unlock(gc, locked);
+  return site;
+}
+
+// Works out the space for an object allocated at a site, the way gc_alloc would otherwise.
+static enum GCSpace gc_site_space(struct gc *gc, struct gc_site *site, size_t size) {
+  if (size >= gc->config.large_threshold) {
+    return GC_SPACE_LARGE;
+  }
+  return site->pretenured ? GC_SPACE_OLD : GC_SPACE_YOUNG;
+}
+
+// Tags a new object with its site. Large objects are never pretenured, so they aren't tracked.
+static void gc_site_record(struct gc_site *site, struct gc_slot *slot) {
+  struct gcnode *node = slot->node;
+
+  __atomic_fetch_add(&site->allocated_objects, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->allocated_bytes, (uint64_t)node->size, __ATOMIC_RELAXED);
+  if (node->space == GC_SPACE_OLD) {
+    __atomic_fetch_add(&site->pretenured_objects, 1, __ATOMIC_RELAXED);
+  }
+
+  if (node->space != GC_SPACE_LARGE) {
+    node->site = site->index & GC_MAX_SITES;
+  }
+}
+
+struct gc_slot *gc_alloc_at(struct gc *gc, struct gc_site *site, size_t size, GCMarkFunc marker,
+                            GCEraseFunc eraser) {
+  assert(gc != NULL);
+  assert(site != NULL);
+
+  struct gc_slot *slot =
+      gc_alloc_with_space(gc, size, marker, eraser, gc_site_space(gc, site, size));
+  if (slot) {
+    gc_site_record(site, slot);
+  }
+  return slot;
+}
+
+struct gc_slot *gc_alloc_typed_at(struct gc *gc, struct gc_site *site, size_t size,
+                                  const struct gc_type *type, GCEraseFunc eraser) {
+  assert(gc != NULL);
+  assert(site != NULL);
+
+  struct gc_slot *slot =
+      gc_alloc_typed_with_space(gc, size, type, eraser, gc_site_space(gc, site, size));
+  if (slot) {
+    gc_site_record(site, slot);
+  }
+  return slot;
+}
+
+// Decides whether the site should pretenure once it has judged a full sample of objects. Sites
+// stop pretenuring at a lower survival rate than they start, so that a site hovering around the
+// threshold doesn't flip back and forth.
+static void gc_site_decide(struct gc *gc, struct gc_site *site) {
+  uint64_t judged = site->window_survived + site->window_died;
+  if (!gc->config.pretenure_sample || judged < gc->config.pretenure_sample) {
+    return;
+  }
+
+  uint64_t percent = (site->window_survived * 100) / judged;
+  int pretenure = site->pretenured ? percent * 2 >= gc->config.pretenure_survival
+                                   : percent >= gc->config.pretenure_survival;
+
+  if (pretenure != site->pretenured) {
+    gc_debugf(gc, "gc: site %s %s pretenuring (%llu%% of %llu objects survived)\n", site->name,
+              pretenure ? "started" : "stopped", (unsigned long long)percent,
+              (unsigned long long)judged);
+    site->pretenured = pretenure;
+    site->decisions++;
+  }
+
+  site->window_survived = 0;
+  site->window_died = 0;
+}
+
+void gc_site_judge(struct gc *gc, struct gcnode *node, int survived) {
+  assert(node->site != 0 && node->site <= gc->site_count);
+
+  struct gc_site *site = gc->sites[node->site - 1];
+  node->site = 0;
+
+  if (survived) {
+    site->survived_objects++;
+    site->window_survived++;
+  } else {
+    site->died_objects++;
+    site->window_died++;
+  }
+
+  gc_site_decide(gc, site);
+}
+
+void gc_get_site_stats(struct gc *gc, const struct gc_site *site, struct gc_site_stats *stats) {
+  assert(gc != NULL);
+  assert(site != NULL);
+  assert(stats != NULL);
+
+  int locked = gc_lock(gc);
+  stats->allocated_objects = __atomic_load_n(&site->allocated_objects, __ATOMIC_RELAXED);
+  stats->allocated_bytes = __atomic_load_n(&site->allocated_bytes, __ATOMIC_RELAXED);
+  stats->pretenured_objects = __atomic_load_n(&site->pretenured_objects, __ATOMIC_RELAXED);
+  stats->survived_objects = site->survived_objects;
+  stats->died_objects = site->died_objects;
+  stats->decisions = site->decisions;
+  stats->pretenured = site->pretenured;
+  gc_unlock(gc, locked);
+}
+
+void gc_sites_destroy(struct gc *gc) {
+  for (size_t i = 0; i < gc->site_count; ++i) {
+    gc->config.free(gc->sites[i]);
+  }
+
+  if (gc->sites) {
+    gc->config.free(gc->sites);
+  }
+}
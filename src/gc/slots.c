@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+// Adds a page to the page map, keeping it sorted by address.
+static void gc_page_map_insert(struct gc *gc, struct gc_slot_page *page) {
+  size_t count = gc->slot_page_count;
+  size_t i = count;
+  while (i > 0 && (uintptr_t)gc->page_map[i - 1] > (uintptr_t)page) {
+    gc->page_map[i] = gc->page_map[i - 1];
+    i--;
+  }
+  gc->page_map[i] = page;
+}
+
+static int gc_slot_page_new(struct gc *gc) {
+  if (gc->slot_page_count >= (UINT32_MAX >> GC_SLOT_PAGE_SHIFT)) {
+    // Slot indices are 32 bits
+    return 0;
+  }
+
+  struct gc_slot_page **pages = gc_grow_array(gc, gc->slot_pages, sizeof(struct gc_slot_page *),
+                                              gc->slot_page_count, &gc->slot_page_capacity);
+  if (!pages) {
+    return 0;
+  }
+  gc->slot_pages = pages;
+
+  struct gc_slot_page **page_map =
+      gc_grow_array(gc, gc->page_map, sizeof(struct gc_slot_page *), gc->slot_page_count,
+                    &gc->page_map_capacity);
+  if (!page_map) {
+    return 0;
+  }
+  gc->page_map = page_map;
+
+  struct gc_slot_page *page = gc->config.alloc(sizeof(struct gc_slot_page));
+  if (!page) {
+    return 0;
+  }
+
+  memset(page, 0, sizeof(struct gc_slot_page));
+
+  uint32_t base = (uint32_t)(gc->slot_page_count << GC_SLOT_PAGE_SHIFT);
+  gc_page_map_insert(gc, page);
+  gc->slot_pages[gc->slot_page_count++] = page;
+
+  // Push in reverse so that allocation walks the page from the start
+  for (uint32_t i = GC_SLOTS_PER_PAGE; i > 0; --i) {
+    struct gc_slot *slot = &page->slots[i - 1];
+    slot->index = base + i - 1;
+    slot->next_free = gc->free_slots;
+    gc->free_slots = slot;
+  }
+
+  return 1;
+}
+
+struct gc_slot *gc_slot_take(struct gc *gc) {
+  if (!gc->free_slots && !gc_slot_page_new(gc)) {
+    return NULL;
+  }
+
+  struct gc_slot *slot = gc->free_slots;
+  gc->free_slots = slot->next_free;
+
+  slot->node = NULL;
+  slot->root_index = 0;
+
+  return slot;
+}
+
+void gc_slot_put(struct gc *gc, struct gc_slot *slot) {
+  slot->next_free = gc->free_slots;
+  gc->free_slots = slot;
+}
+
+struct gc_slot *gc_slot_alloc(struct gc *gc) {
+  struct gc_slot *slot = gc_slot_take(gc);
+  if (slot) {
+    // Free slots already have their bits cleared.
+    gc_slot_set_allocated(gc, slot, 1);
+  }
+
+  return slot;
+}
+
+void gc_slot_free(struct gc *gc, struct gc_slot *slot) {
+  struct gc_slot_page *page = gc_slot_page(gc, slot);
+  size_t word = gc_slot_word(slot);
+
+  assert(page->allocated[word] & gc_slot_bit(slot));
+
+  gc_slot_set_allocated(gc, slot, 0);
+  gc_slot_set_young(gc, slot, 0);
+  page->marked[word] &= ~gc_slot_bit(slot);
+
+  gc_slot_put(gc, slot);
+}
+
+struct gc_slot *gc_find_slot(struct gc *gc, uintptr_t address) {
+  size_t count = gc->slot_page_count;
+  if (!count || address < (uintptr_t)gc->page_map[0]->slots ||
+      address >= (uintptr_t)(gc->page_map[count - 1]->slots + GC_SLOTS_PER_PAGE)) {
+    return NULL;
+  }
+
+  // Find the last page starting at or below the address.
+  size_t low = 0;
+  size_t high = count;
+  while (high - low > 1) {
+    size_t mid = low + ((high - low) / 2);
+    if ((uintptr_t)gc->page_map[mid]->slots <= address) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  struct gc_slot_page *page = gc->page_map[low];
+  uintptr_t offset = address - (uintptr_t)page->slots;
+  if (offset >= sizeof(page->slots) || offset % sizeof(struct gc_slot) != 0) {
+    return NULL;
+  }
+
+  // The allocated bitmap doubles as an object start bitmap: only slots that are handed out hold
+  // objects.
+  size_t index = offset / sizeof(struct gc_slot);
+  if (!(page->allocated[index / 64] & (1ULL << (index & 63)))) {
+    return NULL;
+  }
+
+  struct gc_slot *slot = &page->slots[index];
+  return slot->node && !slot->node->finalizing ? slot : NULL;
+}
+
+void gc_slots_destroy(struct gc *gc) {
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    gc->config.free(gc->slot_pages[i]);
+  }
+
+  if (gc->slot_pages) {
+    gc->config.free(gc->slot_pages);
+  }
+
+  if (gc->page_map) {
+    gc->config.free(gc->page_map);
+  }
+
+  gc->slot_pages = NULL;
+  gc->page_map = NULL;
+  gc->page_map_capacity = 0;
+  gc->slot_page_count = 0;
+  gc->slot_page_capacity = 0;
+  gc->free_slots = NULL;
+}
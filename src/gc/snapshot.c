@@ -0,0 +1,220 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Records are staged in a buffer of this many bytes before being written out, which bounds the
+// memory a snapshot needs regardless of the size of the heap.
+#define GC_SNAPSHOT_BUFFER_SIZE (64 * 1024)
+
+// Largest record: the end record's tag and two u64 counts.
+#define GC_SNAPSHOT_MAX_RECORD 17
+
+struct gc_snapshot {
+  int fd;
+  // Set once a write has failed; everything after that is dropped.
+  int failed;
+
+  uint64_t object_count;
+  uint64_t edge_count;
+
+  size_t used;
+  unsigned char buffer[GC_SNAPSHOT_BUFFER_SIZE];
+};
+
+static void gc_snapshot_flush(struct gc_snapshot *snapshot) {
+  size_t written = 0;
+  while (!snapshot->failed && written < snapshot->used) {
+    ssize_t result = write(snapshot->fd, snapshot->buffer + written, snapshot->used - written);
+    if (result < 0) {
+      if (errno != EINTR) {
+        snapshot->failed = 1;
+      }
+      continue;
+    }
+    written += (size_t)result;
+  }
+
+  snapshot->used = 0;
+}
+
+// Returns room for a record of up to GC_SNAPSHOT_MAX_RECORD bytes, flushing the buffer if needed.
+static unsigned char *gc_snapshot_reserve(struct gc_snapshot *snapshot) {
+  if (snapshot->used + GC_SNAPSHOT_MAX_RECORD > GC_SNAPSHOT_BUFFER_SIZE) {
+    gc_snapshot_flush(snapshot);
+  }
+  return snapshot->buffer + snapshot->used;
+}
+
+static unsigned char *gc_snapshot_put_u8(unsigned char *out, unsigned value) {
+  *out = (unsigned char)value;
+  return out + 1;
+}
+
+static unsigned char *gc_snapshot_put_u32(unsigned char *out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out[i] = (unsigned char)(value >> (i * 8));
+  }
+  return out + 4;
+}
+
+static unsigned char *gc_snapshot_put_u64(unsigned char *out, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out[i] = (unsigned char)(value >> (i * 8));
+  }
+  return out + 8;
+}
+
+static void gc_snapshot_commit(struct gc_snapshot *snapshot, unsigned char *end) {
+  snapshot->used = (size_t)(end - snapshot->buffer);
+}
+
+static void gc_snapshot_root(struct gc_snapshot *snapshot, struct gc_slot *slot,
+                             enum GCSnapshotRootKind kind) {
+  unsigned char *out = gc_snapshot_reserve(snapshot);
+  out = gc_snapshot_put_u8(out, GC_SNAPSHOT_ROOT);
+  out = gc_snapshot_put_u32(out, slot->index);
+  out = gc_snapshot_put_u8(out, kind);
+  gc_snapshot_commit(snapshot, out);
+}
+
+static void gc_snapshot_object(struct gc_snapshot *snapshot, struct gc_slot *slot) {
+  struct gcnode *node = slot->node;
+  unsigned flags = (gc_node_is_locked(node) ? GC_SNAPSHOT_FLAG_LOCKED : 0) |
+                   (node->remembered ? GC_SNAPSHOT_FLAG_REMEMBERED : 0);
+
+  unsigned char *out = gc_snapshot_reserve(snapshot);
+  out = gc_snapshot_put_u8(out, GC_SNAPSHOT_OBJECT);
+  out = gc_snapshot_put_u32(out, slot->index);
+  out = gc_snapshot_put_u64(out, node->size);
+  out = gc_snapshot_put_u8(out, node->space);
+  out = gc_snapshot_put_u8(out, flags);
+  gc_snapshot_commit(snapshot, out);
+
+  snapshot->object_count++;
+}
+
+void gc_snapshot_edge(struct gc_snapshot *snapshot, struct gc_slot *slot) {
+  unsigned char *out = gc_snapshot_reserve(snapshot);
+  out = gc_snapshot_put_u8(out, GC_SNAPSHOT_EDGE);
+  out = gc_snapshot_put_u32(out, slot->index);
+  gc_snapshot_commit(snapshot, out);
+
+  snapshot->edge_count++;
+}
+
+void gc_snapshot_ephemeron(struct gc_snapshot *snapshot, struct gc_slot *key,
+                           struct gc_slot *value) {
+  unsigned char *out = gc_snapshot_reserve(snapshot);
+  out = gc_snapshot_put_u8(out, GC_SNAPSHOT_EPHEMERON);
+  out = gc_snapshot_put_u32(out, key->index);
+  out = gc_snapshot_put_u32(out, value->index);
+  gc_snapshot_commit(snapshot, out);
+}
+
+static void gc_snapshot_stack_root(struct gc *gc, struct gc_slot *slot) {
+  gc_snapshot_root(gc->snapshot, slot, GC_SNAPSHOT_ROOT_STACK);
+}
+
+static void gc_snapshot_roots(struct gc *gc, struct gc_snapshot *snapshot) {
+  for (size_t i = 0; i < gc->root_count; ++i) {
+    gc_snapshot_root(snapshot, gc->roots[i].slot, GC_SNAPSHOT_ROOT_TABLE);
+  }
+
+  for (size_t i = 0; i < gc->scoped_count; ++i) {
+    gc_snapshot_root(snapshot, gc->scoped[i], GC_SNAPSHOT_ROOT_SCOPED);
+  }
+
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    struct gc_thread *thread = gc->threads[i];
+    for (size_t j = 0; j < thread->scoped_count; ++j) {
+      gc_snapshot_root(snapshot, thread->scoped[j], GC_SNAPSHOT_ROOT_SCOPED);
+    }
+  }
+
+  gc_scan_stacks(gc, gc_snapshot_stack_root);
+}
+
+// Writes every allocated object, followed by the references its marker reports. Objects waiting
+// for their erasers to run are already dead, and are left out.
+static void gc_snapshot_objects(struct gc *gc, struct gc_snapshot *snapshot) {
+  for (size_t i = 0; i < gc->slot_page_count; ++i) {
+    struct gc_slot_page *page = gc->slot_pages[i];
+    for (size_t word = 0; word < GC_SLOT_PAGE_WORDS; ++word) {
+      uint64_t allocated = page->allocated[word];
+      while (allocated) {
+        size_t bit = (size_t)__builtin_ctzll(allocated);
+        allocated &= allocated - 1;
+
+        struct gc_slot *slot = &page->slots[(word * 64) + bit];
+        struct gcnode *node = slot->node;
+        if (node->finalizing) {
+          continue;
+        }
+
+        if (gc_node_is_locked(node)) {
+          gc_snapshot_root(snapshot, slot, GC_SNAPSHOT_ROOT_LOCKED);
+        }
+
+        gc_snapshot_object(snapshot, slot);
+        gc_trace(gc, slot);
+      }
+    }
+  }
+}
+
+int gc_heap_snapshot(struct gc *gc, int fd) {
+  assert(gc != NULL);
+  assert(gc->snapshot == NULL);
+
+  struct gc_snapshot *snapshot = gc->config.alloc(sizeof(struct gc_snapshot));
+  if (!snapshot) {
+    return 0;
+  }
+
+  snapshot->fd = fd;
+  snapshot->failed = 0;
+  snapshot->object_count = 0;
+  snapshot->edge_count = 0;
+  snapshot->used = 0;
+
+  gc_stop_world(gc);
+
+  // Markers may allocate; that must not start a cycle in the middle of the snapshot.
+  int collecting = gc->collecting;
+  gc->collecting = 1;
+  gc->snapshot = snapshot;
+
+  unsigned char *out = gc_snapshot_reserve(snapshot);
+  memcpy(out, GC_SNAPSHOT_MAGIC, 8);
+  out = gc_snapshot_put_u32(out + 8, GC_SNAPSHOT_VERSION);
+  gc_snapshot_commit(snapshot, out);
+
+  gc_snapshot_roots(gc, snapshot);
+  gc_snapshot_objects(gc, snapshot);
+  gc_snapshot_ephemerons(gc);
+
+  out = gc_snapshot_reserve(snapshot);
+  out = gc_snapshot_put_u8(out, GC_SNAPSHOT_END);
+  out = gc_snapshot_put_u64(out, snapshot->object_count);
+  out = gc_snapshot_put_u64(out, snapshot->edge_count);
+  gc_snapshot_commit(snapshot, out);
+  gc_snapshot_flush(snapshot);
+
+  gc->snapshot = NULL;
+  gc->collecting = collecting;
+
+  gc_resume_world(gc);
+
+  gc_debugf(gc, "gc: wrote heap snapshot of %llu objects and %llu edges\n",
+            (unsigned long long)snapshot->object_count, (unsigned long long)snapshot->edge_count);
+
+  int ok = !snapshot->failed;
+  gc->config.free(snapshot);
+  return ok;
+}
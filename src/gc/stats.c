@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define GC_PAUSE_SUB_BUCKETS (1u << GC_PAUSE_SUB_BITS)
+
+static size_t gc_pause_bucket(uint64_t ns) {
+  if (ns < GC_PAUSE_SUB_BUCKETS) {
+    return (size_t)ns;
+  }
+
+  // The top bit picks the power of two, and the bits below it pick the linear sub-bucket.
+  unsigned msb = 63u - (unsigned)__builtin_clzll(ns);
+  size_t sub = (size_t)(ns >> (msb - GC_PAUSE_SUB_BITS)) & (GC_PAUSE_SUB_BUCKETS - 1);
+  return ((size_t)(msb - GC_PAUSE_SUB_BITS + 1) << GC_PAUSE_SUB_BITS) | sub;
+}
+
+// Returns the largest pause that falls into the given bucket.
+static uint64_t gc_pause_bucket_limit(size_t bucket) {
+  if (bucket < GC_PAUSE_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  unsigned shift = (unsigned)(bucket >> GC_PAUSE_SUB_BITS) - 1;
+  uint64_t base = (uint64_t)(GC_PAUSE_SUB_BUCKETS | (bucket & (GC_PAUSE_SUB_BUCKETS - 1)));
+  return (base << shift) + ((1ULL << shift) - 1);
+}
+
+static uint64_t gc_pause_percentile(struct gc_pause_histogram *pauses, size_t percent) {
+  // Rank of the pause we're looking for, rounded up.
+  size_t rank = ((pauses->count * percent) + 99) / 100;
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  size_t seen = 0;
+  for (size_t i = 0; i < GC_PAUSE_BUCKETS; ++i) {
+    seen += pauses->buckets[i];
+    if (seen >= rank) {
+      uint64_t limit = gc_pause_bucket_limit(i);
+      return limit < pauses->max_ns ? limit : pauses->max_ns;
+    }
+  }
+
+  return pauses->max_ns;
+}
+
+void gc_record_pause(struct gc *gc, uint64_t pause_ns) {
+  struct gc_pause_histogram *pauses = &gc->pauses;
+
+  pauses->count++;
+  pauses->total_ns += pause_ns;
+  if (pause_ns > pauses->max_ns) {
+    pauses->max_ns = pause_ns;
+  }
+  pauses->buckets[gc_pause_bucket(pause_ns)]++;
+}
+
+void gc_get_pause_stats(struct gc *gc, struct gc_pause_stats *stats) {
+  assert(gc != NULL);
+  assert(stats != NULL);
+
+  memset(stats, 0, sizeof(struct gc_pause_stats));
+  if (!gc->pauses.count) {
+    return;
+  }
+
+  stats->cycles = gc->pauses.count;
+  stats->total_ns = gc->pauses.total_ns;
+  stats->p50_ns = gc_pause_percentile(&gc->pauses, 50);
+  stats->p99_ns = gc_pause_percentile(&gc->pauses, 99);
+  stats->max_ns = gc->pauses.max_ns;
+}
+
+void gc_reset_pause_stats(struct gc *gc) {
+  assert(gc != NULL);
+
+  memset(&gc->pauses, 0, sizeof(gc->pauses));
+}
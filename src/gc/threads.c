@@ -0,0 +1,424 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+// Records for every collector the calling thread is attached to.
+static _Thread_local struct gc_thread *gc_attached_threads = NULL;
+
+struct gc_thread *gc_find_thread(struct gc *gc) {
+  for (struct gc_thread *thread = gc_attached_threads; thread; thread = thread->next_for_thread) {
+    if (thread->gc == gc) {
+      return thread;
+    }
+  }
+
+  return NULL;
+}
+
+void gc_threads_init(struct gc *gc) {
+  pthread_mutex_init(&gc->lock, NULL);
+  pthread_cond_init(&gc->stopped_cond, NULL);
+  pthread_cond_init(&gc->resume_cond, NULL);
+}
+
+// Adds the thread's allocations to the young space's stats. Requires the lock, or a stopped world.
+static void gc_thread_flush(struct gc *gc, struct gc_thread *thread) {
+  struct gc_space *young = &gc->spaces[GC_SPACE_YOUNG];
+  young->stats.total_allocated += thread->allocated_bytes;
+  young->stats.total_objects += thread->allocated_objects;
+  young->allocation_debt += thread->allocated_bytes;
+
+  thread->allocated_bytes = 0;
+  thread->allocated_objects = 0;
+}
+
+// Parks the thread until the collection in progress is done. Requires the lock.
+static void gc_thread_wait(struct gc *gc, struct gc_thread *thread) {
+  __builtin_unwind_init();
+  gc_thread_save_stack(thread, __builtin_frame_address(0));
+
+  gc_thread_flush(gc, thread);
+  thread->state = GC_THREAD_PARKED;
+  pthread_cond_broadcast(&gc->stopped_cond);
+
+  while (gc->stop_requested) {
+    pthread_cond_wait(&gc->resume_cond, &gc->lock);
+  }
+
+  thread->state = GC_THREAD_RUNNING;
+}
+
+static void gc_thread_park(struct gc *gc, struct gc_thread *thread) {
+  pthread_mutex_lock(&gc->lock);
+
+  // The collecting thread itself gets here when its callbacks allocate.
+  if (gc->stop_requested && gc->collector != thread) {
+    gc_thread_wait(gc, thread);
+  }
+
+  pthread_mutex_unlock(&gc->lock);
+}
+
+int gc_thread_attach(struct gc *gc) {
+  assert(gc != NULL);
+  assert(gc_find_thread(gc) == NULL);
+
+  struct gc_thread *thread = gc->config.alloc(sizeof(struct gc_thread));
+  if (!thread) {
+    return 0;
+  }
+
+  memset(thread, 0, sizeof(struct gc_thread));
+  thread->gc = gc;
+  thread->state = GC_THREAD_RUNNING;
+
+  pthread_mutex_lock(&gc->lock);
+
+  // A running thread would hold up the collection, so don't join in the middle of one.
+  while (gc->stop_requested) {
+    pthread_cond_wait(&gc->resume_cond, &gc->lock);
+  }
+
+  struct gc_thread **threads = gc_grow_array(gc, gc->threads, sizeof(struct gc_thread *),
+                                             gc->thread_count, &gc->thread_capacity);
+  if (!threads) {
+    pthread_mutex_unlock(&gc->lock);
+    gc->config.free(thread);
+    return 0;
+  }
+  gc->threads = threads;
+
+  thread->index = gc->thread_count;
+  gc->threads[gc->thread_count] = thread;
+  __atomic_store_n(&gc->thread_count, gc->thread_count + 1, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&gc->lock);
+
+  thread->next_for_thread = gc_attached_threads;
+  gc_attached_threads = thread;
+  return 1;
+}
+
+// Finds the buffer holding the given address. Requires the lock, or a stopped world.
+static size_t gc_buffer_find(struct gc *gc, void *ptr) {
+  size_t lo = 0;
+  size_t hi = gc->buffer_count;
+  while (hi - lo > 1) {
+    size_t mid = lo + ((hi - lo) / 2);
+    if ((char *)gc->buffers[mid] <= (char *)ptr) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  assert(lo < gc->buffer_count && (char *)ptr >= (char *)gc->buffers[lo] &&
+         (char *)ptr < (char *)gc->buffers[lo] + GC_THREAD_BUFFER_SIZE);
+  return lo;
+}
+
+static void gc_buffer_destroy(struct gc *gc, struct gc_buffer *buffer) {
+  size_t index = gc_buffer_find(gc, buffer);
+  memmove(&gc->buffers[index], &gc->buffers[index + 1],
+          (gc->buffer_count - index - 1) * sizeof(struct gc_buffer *));
+  gc->buffer_count--;
+
+  gc_space_free(&gc->spaces[GC_SPACE_YOUNG], buffer);
+}
+
+// Requires the lock.
+static struct gc_buffer *gc_buffer_new(struct gc *gc) {
+  struct gc_buffer **buffers = gc_grow_array(gc, gc->buffers, sizeof(struct gc_buffer *),
+                                             gc->buffer_count, &gc->buffer_capacity);
+  if (!buffers) {
+    return NULL;
+  }
+  gc->buffers = buffers;
+
+  struct gc_buffer *buffer = gc_space_alloc(&gc->spaces[GC_SPACE_YOUNG], GC_THREAD_BUFFER_SIZE);
+  if (!buffer) {
+    return NULL;
+  }
+
+  uintptr_t start = ((uintptr_t)(buffer + 1) + 15) & ~(uintptr_t)15;
+  buffer->cursor = (char *)start;
+  buffer->limit = (char *)buffer + GC_THREAD_BUFFER_SIZE;
+  buffer->live = 0;
+  buffer->retired = 0;
+
+  size_t index = gc->buffer_count;
+  while (index > 0 && (char *)gc->buffers[index - 1] > (char *)buffer) {
+    gc->buffers[index] = gc->buffers[index - 1];
+    index--;
+  }
+  gc->buffers[index] = buffer;
+  gc->buffer_count++;
+
+  return buffer;
+}
+
+// Requires the lock.
+static void gc_buffer_retire(struct gc *gc, struct gc_buffer *buffer) {
+  buffer->retired = 1;
+  if (__atomic_load_n(&buffer->live, __ATOMIC_RELAXED) == 0) {
+    gc_buffer_destroy(gc, buffer);
+  }
+}
+
+void gc_buffer_release(struct gc *gc, struct gcnode *node) {
+  struct gc_buffer *buffer = gc->buffers[gc_buffer_find(gc, node)];
+  if (__atomic_sub_fetch(&buffer->live, 1, __ATOMIC_RELAXED) == 0 && buffer->retired) {
+    gc_buffer_destroy(gc, buffer);
+  }
+}
+
+void gc_thread_detach(struct gc *gc) {
+  assert(gc != NULL);
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  assert(thread != NULL);
+
+  pthread_mutex_lock(&gc->lock);
+
+  gc_thread_flush(gc, thread);
+
+  while (thread->slot_count) {
+    gc_slot_put(gc, thread->slots[--thread->slot_count]);
+  }
+
+  if (thread->buffer) {
+    gc_buffer_retire(gc, thread->buffer);
+  }
+
+  struct gc_thread *last = gc->threads[gc->thread_count - 1];
+  gc->threads[thread->index] = last;
+  last->index = thread->index;
+  __atomic_store_n(&gc->thread_count, gc->thread_count - 1, __ATOMIC_RELEASE);
+
+  // A collection may be waiting on this thread.
+  pthread_cond_broadcast(&gc->stopped_cond);
+
+  pthread_mutex_unlock(&gc->lock);
+
+  struct gc_thread **link = &gc_attached_threads;
+  while (*link != thread) {
+    link = &(*link)->next_for_thread;
+  }
+  *link = thread->next_for_thread;
+
+  if (thread->scoped) {
+    gc->config.free(thread->scoped);
+  }
+
+  gc->config.free(thread);
+}
+
+void gc_safepoint(struct gc *gc) {
+  assert(gc != NULL);
+
+  if (!__atomic_load_n(&gc->stop_requested, __ATOMIC_RELAXED)) {
+    return;
+  }
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  if (thread) {
+    gc_thread_park(gc, thread);
+  }
+}
+
+void gc_enter_safe_region(struct gc *gc) {
+  assert(gc != NULL);
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  assert(thread != NULL);
+
+  __builtin_unwind_init();
+  gc_thread_save_stack(thread, __builtin_frame_address(0));
+
+  pthread_mutex_lock(&gc->lock);
+  gc_thread_flush(gc, thread);
+  thread->state = GC_THREAD_SAFE;
+  pthread_cond_broadcast(&gc->stopped_cond);
+  pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_leave_safe_region(struct gc *gc) {
+  assert(gc != NULL);
+
+  struct gc_thread *thread = gc_find_thread(gc);
+  assert(thread != NULL);
+
+  pthread_mutex_lock(&gc->lock);
+  while (gc->stop_requested) {
+    pthread_cond_wait(&gc->resume_cond, &gc->lock);
+  }
+  thread->state = GC_THREAD_RUNNING;
+  pthread_mutex_unlock(&gc->lock);
+}
+
+// Counts attached threads, other than `self`, that could still be touching the heap.
+static size_t gc_running_threads(struct gc *gc, struct gc_thread *self) {
+  size_t running = 0;
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    if (gc->threads[i] != self && gc->threads[i]->state == GC_THREAD_RUNNING) {
+      running++;
+    }
+  }
+
+  return running;
+}
+
+void gc_stop_world(struct gc *gc) {
+  struct gc_thread *self = gc_find_thread(gc);
+
+  pthread_mutex_lock(&gc->lock);
+
+  if (gc->stop_requested && pthread_equal(gc->stopping_thread, pthread_self())) {
+    // The collecting thread's callbacks, such as erasers, can run a cycle of their own. The world
+    // is already stopped, and waiting for that stop to end would wait forever.
+    gc->stop_depth++;
+  } else {
+    // Only one thread collects at a time; any other waits for it, parked if it's a mutator.
+    while (gc->stop_requested) {
+      if (self) {
+        gc_thread_wait(gc, self);
+      } else {
+        pthread_cond_wait(&gc->resume_cond, &gc->lock);
+      }
+    }
+
+    __atomic_store_n(&gc->stop_requested, 1, __ATOMIC_RELAXED);
+    gc->collector = self;
+    gc->stopping_thread = pthread_self();
+
+    while (gc_running_threads(gc, self)) {
+      pthread_cond_wait(&gc->stopped_cond, &gc->lock);
+    }
+  }
+
+  // Every thread is stopped, so their allocations can be accounted for before the cycle.
+  for (size_t i = 0; i < gc->thread_count; ++i) {
+    gc_thread_flush(gc, gc->threads[i]);
+  }
+
+  pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_resume_world(struct gc *gc) {
+  pthread_mutex_lock(&gc->lock);
+  if (gc->stop_depth) {
+    // The outer cycle still has the world stopped.
+    gc->stop_depth--;
+  } else {
+    __atomic_store_n(&gc->stop_requested, 0, __ATOMIC_RELAXED);
+    gc->collector = NULL;
+    pthread_cond_broadcast(&gc->resume_cond);
+  }
+  pthread_mutex_unlock(&gc->lock);
+}
+
+// Gets the thread a buffer with room for `footprint` bytes and a non-empty slot cache, collecting
+// first if the young space is due. Returns 0 if either could not be allocated.
+static int gc_thread_refill(struct gc *gc, struct gc_thread *thread, size_t size,
+                            size_t footprint) {
+  if (!gc->collecting) {
+    pthread_mutex_lock(&gc->lock);
+    gc_thread_flush(gc, thread);
+    pthread_mutex_unlock(&gc->lock);
+
+    gc_collect_for_allocation(gc, GC_SPACE_YOUNG, size);
+  }
+
+  pthread_mutex_lock(&gc->lock);
+
+  struct gc_buffer *buffer = thread->buffer;
+  if (!buffer || (size_t)(buffer->limit - buffer->cursor) < footprint) {
+    struct gc_buffer *fresh = gc_buffer_new(gc);
+    if (!fresh) {
+      pthread_mutex_unlock(&gc->lock);
+      return 0;
+    }
+
+    if (buffer) {
+      gc_buffer_retire(gc, buffer);
+    }
+    thread->buffer = fresh;
+  }
+
+  while (thread->slot_count < GC_THREAD_SLOT_CACHE) {
+    struct gc_slot *slot = gc_slot_take(gc);
+    if (!slot) {
+      break;
+    }
+    thread->slots[thread->slot_count++] = slot;
+  }
+
+  pthread_mutex_unlock(&gc->lock);
+  return thread->slot_count != 0;
+}
+
+struct gc_slot *gc_thread_alloc(struct gc *gc, struct gc_thread *thread, size_t size,
+                                GCMarkFunc marker, GCEraseFunc eraser) {
+  // Allocation is a safepoint.
+  if (__atomic_load_n(&gc->stop_requested, __ATOMIC_RELAXED)) {
+    gc_thread_park(gc, thread);
+  }
+
+  size_t footprint = (sizeof(struct gcnode) + size + 15) & ~(size_t)15;
+  struct gc_buffer *buffer = thread->buffer;
+  if (!buffer || (size_t)(buffer->limit - buffer->cursor) < footprint || !thread->slot_count) {
+    if (!gc_thread_refill(gc, thread, size, footprint)) {
+      return NULL;
+    }
+    buffer = thread->buffer;
+  }
+
+  struct gcnode *node = (struct gcnode *)buffer->cursor;
+  buffer->cursor += footprint;
+  __atomic_add_fetch(&buffer->live, 1, __ATOMIC_RELAXED);
+
+  struct gc_slot *slot = thread->slots[--thread->slot_count];
+
+  node->marker = marker;
+  node->eraser = eraser;
+  node->meta = 0;
+  node->size = (uint32_t)size;
+  node->space = GC_SPACE_YOUNG;
+  node->in_buffer = 1;
+  node->slot = slot;
+
+  slot->node = node;
+  gc_slot_set_allocated(gc, slot, 1);
+  gc_slot_set_young(gc, slot, 1);
+
+  thread->allocated_bytes += size;
+  thread->allocated_objects++;
+
+  return slot;
+}
+
+void gc_threads_destroy(struct gc *gc) {
+  assert(gc->thread_count == 0);
+
+  // Anything still in a buffer survived the final collection (locked objects, say).
+  while (gc->buffer_count) {
+    gc_buffer_destroy(gc, gc->buffers[gc->buffer_count - 1]);
+  }
+
+  if (gc->buffers) {
+    gc->config.free(gc->buffers);
+  }
+
+  if (gc->threads) {
+    gc->config.free(gc->threads);
+  }
+
+  pthread_cond_destroy(&gc->resume_cond);
+  pthread_cond_destroy(&gc->stopped_cond);
+  pthread_mutex_destroy(&gc->lock);
+}
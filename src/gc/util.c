@@ -0,0 +1,37 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "internal.h"
+
+void gc_debugf(struct gc *gc, const char *fmt, ...) {
+  if (!gc->config.debug) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+void *gc_grow_array(struct gc *gc, void *array, size_t element_size, size_t count,
+                    size_t *capacity) {
+  if (count < *capacity) {
+    return array;
+  }
+
+  size_t new_capacity = *capacity ? *capacity * 2 : 64;
+  void *grown = gc->config.alloc(new_capacity * element_size);
+  if (!grown) {
+    return NULL;
+  }
+
+  if (array) {
+    memcpy(grown, array, count * element_size);
+    gc->config.free(array);
+  }
+
+  *capacity = new_capacity;
+  return grown;
+}
@@ -0,0 +1,442 @@
+#include <pocketknife/gc/gc.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+// Ephemeron tables start with this many entries, and are kept at most 3/4 full (counting
+// tombstones). Must be a power of two.
+#define GC_EPHEMERON_MIN_CAPACITY 16
+
+// Marks an entry whose key was removed, so that probing continues past it.
+#define GC_EPHEMERON_TOMBSTONE ((struct gc_slot *)(uintptr_t)1)
+
+struct gc_weak {
+  // The object referred to, or NULL once it has been collected.
+  struct gc_slot *slot;
+  // Position of this reference in gc->weak_refs.
+  size_t index;
+};
+
+struct gc_ephemeron {
+  // NULL for an empty entry, or GC_EPHEMERON_TOMBSTONE for a removed one.
+  struct gc_slot *key;
+  struct gc_slot *value;
+};
+
+struct gc_ephemeron_table {
+  struct gc *gc;
+
+  // Open addressed with linear probing; capacity is a power of two.
+  struct gc_ephemeron *entries;
+  size_t capacity;
+  size_t count;
+  size_t tombstones;
+
+  // Position of this table in gc->ephemeron_tables.
+  size_t index;
+};
+
+// Whether an object will still be around once the given spaces have been swept. Only valid
+// between marking and sweeping.
+static int gc_slot_survives(struct gc *gc, struct gc_slot *slot, unsigned sweeping) {
+  struct gcnode *node = slot->node;
+  return !(sweeping & GC_SPACE_BIT(node->space)) || gc_node_is_locked(node) ||
+         gc_slot_is_marked(gc, slot);
+}
+
+struct gc_weak *gc_weak_new(struct gc *gc, struct gc_slot *slot) {
+  assert(gc != NULL);
+  assert(slot != NULL);
+  assert(!gc_node_load(slot->node).finalizing);
+
+  struct gc_weak *weak = gc->config.alloc(sizeof(struct gc_weak));
+  if (!weak) {
+    return NULL;
+  }
+
+  int locked = gc_lock(gc);
+
+  struct gc_weak **refs =
+      gc_grow_array(gc, gc->weak_refs, sizeof(struct gc_weak *), gc->weak_count,
+                    &gc->weak_capacity);
+  if (!refs) {
+    gc_unlock(gc, locked);
+    gc->config.free(weak);
+    return NULL;
+  }
+  gc->weak_refs = refs;
+
+  weak->slot = slot;
+  weak->index = gc->weak_count;
+  gc->weak_refs[gc->weak_count++] = weak;
+
+  gc_unlock(gc, locked);
+  return weak;
+}
+
+struct gc_slot *gc_weak_get(struct gc_weak *weak) {
+  assert(weak != NULL);
+  return weak->slot;
+}
+
+void gc_weak_free(struct gc *gc, struct gc_weak *weak) {
+  assert(gc != NULL);
+  assert(weak != NULL);
+
+  int locked = gc_lock(gc);
+  assert(weak->index < gc->weak_count && gc->weak_refs[weak->index] == weak);
+
+  // Swap the last reference into the vacated position.
+  struct gc_weak *last = gc->weak_refs[--gc->weak_count];
+  gc->weak_refs[weak->index] = last;
+  last->index = weak->index;
+
+  gc_unlock(gc, locked);
+  gc->config.free(weak);
+}
+
+static size_t gc_ephemeron_hash(struct gc_slot *key, size_t capacity) {
+  uint64_t hash = (uint64_t)key->index * 0x9e3779b97f4a7c15ULL;
+  return (size_t)(hash ^ (hash >> 32)) & (capacity - 1);
+}
+
+// Finds the entry for a key, or NULL if it has none.
+static struct gc_ephemeron *gc_ephemeron_find(struct gc_ephemeron_table *table,
+                                              struct gc_slot *key) {
+  if (!table->capacity) {
+    return NULL;
+  }
+
+  size_t mask = table->capacity - 1;
+  for (size_t i = gc_ephemeron_hash(key, table->capacity);; i = (i + 1) & mask) {
+    struct gc_ephemeron *entry = &table->entries[i];
+    if (entry->key == key) {
+      return entry;
+    } else if (entry->key == NULL) {
+      return NULL;
+    }
+  }
+}
+
+static void gc_ephemeron_clear(struct gc_ephemeron_table *table, struct gc_ephemeron *entry) {
+  entry->key = GC_EPHEMERON_TOMBSTONE;
+  entry->value = NULL;
+  table->count--;
+  table->tombstones++;
+}
+
+// Rebuilds the table with the given capacity, dropping tombstones. Returns 0 on failure.
+static int gc_ephemeron_rehash(struct gc *gc, struct gc_ephemeron_table *table, size_t capacity) {
+  struct gc_ephemeron *entries = gc->config.alloc(capacity * sizeof(struct gc_ephemeron));
+  if (!entries) {
+    return 0;
+  }
+  memset(entries, 0, capacity * sizeof(struct gc_ephemeron));
+
+  for (size_t i = 0; i < table->capacity; ++i) {
+    struct gc_ephemeron *entry = &table->entries[i];
+    if (entry->key == NULL || entry->key == GC_EPHEMERON_TOMBSTONE) {
+      continue;
+    }
+
+    size_t j = gc_ephemeron_hash(entry->key, capacity);
+    while (entries[j].key) {
+      j = (j + 1) & (capacity - 1);
+    }
+    entries[j] = *entry;
+  }
+
+  if (table->entries) {
+    gc->config.free(table->entries);
+  }
+
+  table->entries = entries;
+  table->capacity = capacity;
+  table->tombstones = 0;
+  return 1;
+}
+
+struct gc_ephemeron_table *gc_ephemeron_table_new(struct gc *gc) {
+  assert(gc != NULL);
+
+  struct gc_ephemeron_table *table = gc->config.alloc(sizeof(struct gc_ephemeron_table));
+  if (!table) {
+    return NULL;
+  }
+
+  memset(table, 0, sizeof(struct gc_ephemeron_table));
+  table->gc = gc;
+
+  int locked = gc_lock(gc);
+
+  struct gc_ephemeron_table **tables =
+      gc_grow_array(gc, gc->ephemeron_tables, sizeof(struct gc_ephemeron_table *),
+                    gc->ephemeron_table_count, &gc->ephemeron_table_capacity);
+  if (!tables) {
+    gc_unlock(gc, locked);
+    gc->config.free(table);
+    return NULL;
+  }
+  gc->ephemeron_tables = tables;
+
+  table->index = gc->ephemeron_table_count;
+  gc->ephemeron_tables[gc->ephemeron_table_count++] = table;
+
+  gc_unlock(gc, locked);
+  return table;
+}
+
+void gc_ephemeron_table_free(struct gc *gc, struct gc_ephemeron_table *table) {
+  assert(gc != NULL);
+  assert(table != NULL);
+
+  int locked = gc_lock(gc);
+  assert(table->index < gc->ephemeron_table_count &&
+         gc->ephemeron_tables[table->index] == table);
+
+  struct gc_ephemeron_table *last = gc->ephemeron_tables[--gc->ephemeron_table_count];
+  gc->ephemeron_tables[table->index] = last;
+  last->index = table->index;
+
+  gc_unlock(gc, locked);
+
+  if (table->entries) {
+    gc->config.free(table->entries);
+  }
+
+  gc->config.free(table);
+}
+
+static int gc_ephemeron_set_locked(struct gc *gc, struct gc_ephemeron_table *table,
+                                   struct gc_slot *key, struct gc_slot *value) {
+  struct gc_ephemeron *entry = gc_ephemeron_find(table, key);
+  if (entry) {
+    entry->value = value;
+    return 1;
+  }
+
+  if ((table->count + table->tombstones + 1) * 4 > table->capacity * 3) {
+    // Only grow if the table is actually filling up; otherwise clearing the tombstones will do.
+    size_t capacity = table->capacity ? table->capacity : GC_EPHEMERON_MIN_CAPACITY;
+    if ((table->count + 1) * 2 > capacity) {
+      capacity *= 2;
+    }
+
+    if (!gc_ephemeron_rehash(gc, table, capacity)) {
+      return 0;
+    }
+  }
+
+  size_t mask = table->capacity - 1;
+  size_t i = gc_ephemeron_hash(key, table->capacity);
+  while (table->entries[i].key && table->entries[i].key != GC_EPHEMERON_TOMBSTONE) {
+    i = (i + 1) & mask;
+  }
+
+  if (table->entries[i].key == GC_EPHEMERON_TOMBSTONE) {
+    table->tombstones--;
+  }
+
+  table->entries[i].key = key;
+  table->entries[i].value = value;
+  table->count++;
+  return 1;
+}
+
+int gc_ephemeron_set(struct gc *gc, struct gc_ephemeron_table *table, struct gc_slot *key,
+                     struct gc_slot *value) {
+  assert(gc != NULL);
+  assert(table != NULL);
+  assert(key != NULL);
+  assert(value != NULL);
+  assert(!gc_node_load(key->node).finalizing && !gc_node_load(value->node).finalizing);
+
+  int locked = gc_lock(gc);
+  int set = gc_ephemeron_set_locked(gc, table, key, value);
+  gc_unlock(gc, locked);
+  return set;
+}
+
+struct gc_slot *gc_ephemeron_get(struct gc_ephemeron_table *table, struct gc_slot *key) {
+  assert(table != NULL);
+  assert(key != NULL);
+
+  int locked = gc_lock(table->gc);
+  struct gc_ephemeron *entry = gc_ephemeron_find(table, key);
+  struct gc_slot *value = entry ? entry->value : NULL;
+  gc_unlock(table->gc, locked);
+  return value;
+}
+
+int gc_ephemeron_remove(struct gc_ephemeron_table *table, struct gc_slot *key) {
+  assert(table != NULL);
+  assert(key != NULL);
+
+  int locked = gc_lock(table->gc);
+  struct gc_ephemeron *entry = gc_ephemeron_find(table, key);
+  if (entry) {
+    gc_ephemeron_clear(table, entry);
+  }
+  gc_unlock(table->gc, locked);
+  return entry != NULL;
+}
+
+size_t gc_ephemeron_count(struct gc_ephemeron_table *table) {
+  assert(table != NULL);
+
+  int locked = gc_lock(table->gc);
+  size_t count = table->count;
+  gc_unlock(table->gc, locked);
+  return count;
+}
+
+void gc_mark_ephemerons(struct gc *gc, unsigned sweeping) {
+  // Marking a value can make other keys reachable, so keep going until a pass marks nothing new.
+  int marked = 1;
+  while (marked) {
+    marked = 0;
+    for (size_t i = 0; i < gc->ephemeron_table_count; ++i) {
+      struct gc_ephemeron_table *table = gc->ephemeron_tables[i];
+      for (size_t j = 0; j < table->capacity; ++j) {
+        struct gc_ephemeron *entry = &table->entries[j];
+        if (entry->key == NULL || entry->key == GC_EPHEMERON_TOMBSTONE) {
+          continue;
+        }
+
+        if (gc_slot_survives(gc, entry->key, sweeping) && gc_mark(gc, entry->value)) {
+          marked = 1;
+        }
+      }
+    }
+  }
+}
+
+void gc_clear_weak(struct gc *gc, unsigned sweeping) {
+  for (size_t i = 0; i < gc->weak_count; ++i) {
+    struct gc_weak *weak = gc->weak_refs[i];
+    if (weak->slot && !gc_slot_survives(gc, weak->slot, sweeping)) {
+      gc_debugf(gc, "gc: clearing weak reference to %p\n", (void *)weak->slot->node);
+      weak->slot = NULL;
+    }
+  }
+
+  for (size_t i = 0; i < gc->ephemeron_table_count; ++i) {
+    struct gc_ephemeron_table *table = gc->ephemeron_tables[i];
+    for (size_t j = 0; j < table->capacity; ++j) {
+      struct gc_ephemeron *entry = &table->entries[j];
+      if (entry->key == NULL || entry->key == GC_EPHEMERON_TOMBSTONE) {
+        continue;
+      }
+
+      // A value can only die along with its key, but check both in case a table is shared
+      // between keys and values that live in differently swept spaces.
+      if (!gc_slot_survives(gc, entry->key, sweeping) ||
+          !gc_slot_survives(gc, entry->value, sweeping)) {
+        gc_ephemeron_clear(table, entry);
+      }
+    }
+  }
+}
+
+int gc_queue_finalizer(struct gc *gc, struct gc_slot *slot) {
+  struct gc_slot **queue = gc_grow_array(gc, gc->finalize_queue, sizeof(struct gc_slot *),
+                                         gc->finalize_count, &gc->finalize_capacity);
+  if (!queue) {
+    return 0;
+  }
+
+  gc->finalize_queue = queue;
+  gc->finalize_queue[gc->finalize_count++] = slot;
+  return 1;
+}
+
+size_t gc_run_finalizers(struct gc *gc) {
+  assert(gc != NULL);
+
+  int locked = gc_lock(gc);
+
+  // Erasers may run a cycle of their own; objects it collects are picked up by the outer call.
+  if (gc->finalizing) {
+    gc_unlock(gc, locked);
+    return 0;
+  }
+  gc->finalizing = 1;
+
+  size_t finalized = 0;
+  while (gc->finalize_count) {
+    size_t batch = gc->finalize_count;
+
+    // Run every eraser in the batch before releasing anything, so erasers can still look at the
+    // other objects that were collected alongside theirs. Erasers are user code, so they run
+    // without the lock.
+    gc_unlock(gc, locked);
+    for (size_t i = 0; i < batch; ++i) {
+      struct gc_slot *slot = gc->finalize_queue[i];
+      if (slot->node->eraser) {
+        slot->node->eraser(gc, slot);
+      }
+    }
+    locked = gc_lock(gc);
+
+    for (size_t i = 0; i < batch; ++i) {
+      struct gc_slot *slot = gc->finalize_queue[i];
+      struct gcnode *node = slot->node;
+      gc_debugf(gc, "gc: releasing finalized object %p (%zd bytes)\n", (void *)node,
+                (size_t)node->size);
+      gc_free_node(gc, &gc->spaces[node->space], node);
+      gc_slot_free(gc, slot);
+    }
+
+    // Keep anything queued by cycles that the erasers ran for the next batch.
+    gc->finalize_count -= batch;
+    memmove(gc->finalize_queue, gc->finalize_queue + batch,
+            gc->finalize_count * sizeof(struct gc_slot *));
+    finalized += batch;
+  }
+
+  gc->finalizing = 0;
+  gc_unlock(gc, locked);
+  return finalized;
+}
+
+void gc_snapshot_ephemerons(struct gc *gc) {
+  for (size_t i = 0; i < gc->ephemeron_table_count; ++i) {
+    struct gc_ephemeron_table *table = gc->ephemeron_tables[i];
+    for (size_t j = 0; j < table->capacity; ++j) {
+      struct gc_ephemeron *entry = &table->entries[j];
+      if (entry->key && entry->key != GC_EPHEMERON_TOMBSTONE) {
+        gc_snapshot_ephemeron(gc->snapshot, entry->key, entry->value);
+      }
+    }
+  }
+}
+
+void gc_weak_destroy(struct gc *gc) {
+  GCFreeFunc free_func = gc->config.free;
+
+  for (size_t i = 0; i < gc->weak_count; ++i) {
+    free_func(gc->weak_refs[i]);
+  }
+
+  for (size_t i = 0; i < gc->ephemeron_table_count; ++i) {
+    if (gc->ephemeron_tables[i]->entries) {
+      free_func(gc->ephemeron_tables[i]->entries);
+    }
+    free_func(gc->ephemeron_tables[i]);
+  }
+
+  if (gc->weak_refs) {
+    free_func(gc->weak_refs);
+  }
+
+  if (gc->ephemeron_tables) {
+    free_func(gc->ephemeron_tables);
+  }
+
+  if (gc->finalize_queue) {
+    free_func(gc->finalize_queue);
+  }
+}
@@ -0,0 +1,126 @@
+#include <pocketknife/hash/bloom.h>
+#include <pocketknife/hash/fast.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define HASH_BLOOM_BLOCK 64
+#define HASH_BLOOM_WORDS (HASH_BLOOM_BLOCK / 8)
+
+struct hash_bloom {
+  uint64_t *blocks;
+  uint64_t count;
+  int avx2;
+};
+
+// The block for a hash, and the two halves of its double hashing. h2 is multiplied by an odd
+// constant so that its high bits, which pick the bits within the block, don't repeat the high
+// bits of the hash, which picked the block.
+HASH_INLINE const uint64_t *hash_bloom_block(const struct hash_bloom *bloom, uint64_t hash) {
+  return bloom->blocks + (hash_multiply_high(hash, bloom->count) * HASH_BLOOM_WORDS);
+}
+
+HASH_INLINE uint32_t hash_bloom_h1(uint64_t hash) { return (uint32_t)hash; }
+
+HASH_INLINE uint32_t hash_bloom_h2(uint64_t hash) {
+  return (uint32_t)(hash >> 32) * 0x9e3779b1u;
+}
+
+// Bit i of a block is in word i, at the top six bits of h1 + i * h2.
+HASH_INLINE uint64_t hash_bloom_bit(uint32_t h1, uint32_t h2, uint32_t i) {
+  return 1ULL << ((h1 + (i * h2)) >> 26);
+}
+
+#ifdef HASH_X86
+
+HASH_TARGET("avx2")
+static int hash_bloom_contains_avx2(const uint64_t *block, uint32_t h1, uint32_t h2) {
+  __m256i bits = _mm256_add_epi32(
+      _mm256_set1_epi32((int)h1),
+      _mm256_mullo_epi32(_mm256_set1_epi32((int)h2), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+  bits = _mm256_srli_epi32(bits, 26);
+
+  const __m256i one = _mm256_set1_epi64x(1);
+  __m256i low = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+  __m256i high = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+  return _mm256_testc_si256(_mm256_load_si256((const __m256i *)(const void *)block), low) &
+         _mm256_testc_si256(_mm256_load_si256((const __m256i *)(const void *)(block + 4)), high);
+}
+
+#endif
+
+struct hash_bloom *hash_bloom_new(size_t keys, size_t bits_per_key) {
+  struct hash_bloom *bloom = malloc(sizeof(struct hash_bloom));
+  if (!bloom) {
+    return NULL;
+  }
+
+  uint64_t bits = (uint64_t)keys * bits_per_key;
+  bloom->count = (bits + (HASH_BLOOM_BLOCK * 8) - 1) / (HASH_BLOOM_BLOCK * 8);
+  if (bloom->count == 0) {
+    bloom->count = 1;
+  }
+  bloom->blocks = aligned_alloc(HASH_BLOOM_BLOCK, (size_t)bloom->count * HASH_BLOOM_BLOCK);
+  if (!bloom->blocks) {
+    free(bloom);
+    return NULL;
+  }
+  hash_bloom_clear(bloom);
+
+#ifdef HASH_X86
+  __builtin_cpu_init();
+  bloom->avx2 = __builtin_cpu_supports("avx2");
+#else
+  bloom->avx2 = 0;
+#endif
+  return bloom;
+}
+
+void hash_bloom_destroy(struct hash_bloom *bloom) {
+  free(bloom->blocks);
+  free(bloom);
+}
+
+void hash_bloom_add_hash(struct hash_bloom *bloom, uint64_t hash) {
+  uint64_t *block = (uint64_t *)hash_bloom_block(bloom, hash);
+  uint32_t h1 = hash_bloom_h1(hash), h2 = hash_bloom_h2(hash);
+  for (uint32_t i = 0; i < HASH_BLOOM_WORDS; ++i) {
+    block[i] |= hash_bloom_bit(h1, h2, i);
+  }
+}
+
+int hash_bloom_contains_hash(const struct hash_bloom *bloom, uint64_t hash) {
+  const uint64_t *block = hash_bloom_block(bloom, hash);
+  uint32_t h1 = hash_bloom_h1(hash), h2 = hash_bloom_h2(hash);
+#ifdef HASH_X86
+  if (bloom->avx2) {
+    return hash_bloom_contains_avx2(block, h1, h2);
+  }
+#endif
+
+  uint64_t missing = 0;
+  for (uint32_t i = 0; i < HASH_BLOOM_WORDS; ++i) {
+    missing |= hash_bloom_bit(h1, h2, i) & ~block[i];
+  }
+  return missing == 0;
+}
+
+void hash_bloom_add(struct hash_bloom *bloom, const uint8_t *key, size_t length) {
+  hash_bloom_add_hash(bloom, hash_fast64(key, length, 0));
+}
+
+int hash_bloom_contains(const struct hash_bloom *bloom, const uint8_t *key, size_t length) {
+  return hash_bloom_contains_hash(bloom, hash_fast64(key, length, 0));
+}
+
+void hash_bloom_clear(struct hash_bloom *bloom) {
+  memset(bloom->blocks, 0, (size_t)bloom->count * HASH_BLOOM_BLOCK);
+}
+
+size_t hash_bloom_bytes(const struct hash_bloom *bloom) {
+  return (size_t)bloom->count * HASH_BLOOM_BLOCK;
+}
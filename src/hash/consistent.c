@@ -0,0 +1,170 @@
+#include <pocketknife/hash/consistent.h>
+#include <pocketknife/hash/fast.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t hash_jump(uint64_t hash, uint32_t shards) {
+  // Follows the key's shard as shards are added one at a time, jumping straight to the next
+  // number of shards at which it moves.
+  int64_t shard = -1, next = 0;
+  while (next < (int64_t)shards) {
+    shard = next;
+    hash = (hash * 2862933555777941757ULL) + 1;
+    next = (int64_t)((double)(shard + 1) * ((double)(1LL << 31) / (double)((hash >> 33) + 1)));
+  }
+  return (uint32_t)(shard < 0 ? 0 : shard);
+}
+
+// Scrambles a hash with a node id, giving the node's rendezvous score.
+static uint64_t hash_consistent_mix(uint64_t hash, uint64_t node) {
+  uint64_t x = hash ^ (node * 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+size_t hash_rendezvous(uint64_t hash, const uint64_t *nodes, size_t count) {
+  size_t best = 0;
+  uint64_t best_score = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t score = hash_consistent_mix(hash, nodes[i]);
+    if (score > best_score || i == 0) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+struct hash_ring_point {
+  uint64_t position;
+  uint64_t node;
+};
+
+struct hash_ring {
+  // Sorted by position, then node.
+  struct hash_ring_point *points;
+  size_t count;
+  size_t capacity;
+  size_t nodes;
+};
+
+struct hash_ring *hash_ring_new(void) { return calloc(1, sizeof(struct hash_ring)); }
+
+void hash_ring_destroy(struct hash_ring *ring) {
+  free(ring->points);
+  free(ring);
+}
+
+static int hash_ring_compare(const void *a, const void *b) {
+  const struct hash_ring_point *x = a, *y = b;
+  if (x->position != y->position) {
+    return x->position < y->position ? -1 : 1;
+  }
+  return (x->node > y->node) - (x->node < y->node);
+}
+
+static int hash_ring_contains(const struct hash_ring *ring, uint64_t node) {
+  for (size_t i = 0; i < ring->count; ++i) {
+    if (ring->points[i].node == node) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int hash_ring_add(struct hash_ring *ring, uint64_t node, size_t points) {
+  if (hash_ring_contains(ring, node)) {
+    return 0;
+  }
+  if (points == 0) {
+    points = 1;
+  }
+
+  if (ring->count + points > ring->capacity) {
+    size_t capacity = ring->capacity ? ring->capacity : 64;
+    while (capacity < ring->count + points) {
+      capacity *= 2;
+    }
+    struct hash_ring_point *grown =
+        realloc(ring->points, capacity * sizeof(struct hash_ring_point));
+    if (!grown) {
+      return -1;
+    }
+    ring->points = grown;
+    ring->capacity = capacity;
+  }
+
+  // A node's points are its id mixed with each point's number, hashed. The existing points are
+  // already sorted, so only the new ones are sorted before the two runs are merged from the end.
+  struct hash_ring_point *added = ring->points + ring->count;
+  for (size_t i = 0; i < points; ++i) {
+    uint64_t id[2] = {node, i};
+    added[i].position = hash_fast64((const uint8_t *)id, sizeof(id), 0);
+    added[i].node = node;
+  }
+  qsort(added, points, sizeof(struct hash_ring_point), hash_ring_compare);
+
+  struct hash_ring_point *merged = malloc(points * sizeof(struct hash_ring_point));
+  if (!merged) {
+    return -1;
+  }
+  memcpy(merged, added, points * sizeof(struct hash_ring_point));
+  size_t old = ring->count, incoming = points, out = old + points;
+  while (incoming > 0) {
+    if (old > 0 && hash_ring_compare(&ring->points[old - 1], &merged[incoming - 1]) > 0) {
+      ring->points[--out] = ring->points[--old];
+    } else {
+      ring->points[--out] = merged[--incoming];
+    }
+  }
+  free(merged);
+
+  ring->count += points;
+  ++ring->nodes;
+  return 1;
+}
+
+int hash_ring_remove(struct hash_ring *ring, uint64_t node) {
+  size_t kept = 0;
+  for (size_t i = 0; i < ring->count; ++i) {
+    if (ring->points[i].node != node) {
+      ring->points[kept++] = ring->points[i];
+    }
+  }
+  if (kept == ring->count) {
+    return 0;
+  }
+  ring->count = kept;
+  --ring->nodes;
+  return 1;
+}
+
+int hash_ring_lookup(const struct hash_ring *ring, uint64_t hash, uint64_t *node) {
+  if (ring->count == 0) {
+    return 0;
+  }
+
+  // Finds the first point at or after hash without branching on the comparisons, which are
+  // unpredictable; past the last point, the ring wraps around to the first.
+  const struct hash_ring_point *base = ring->points;
+  size_t length = ring->count;
+  while (length > 1) {
+    size_t half = length / 2;
+    base = base[half].position < hash ? base + half : base;
+    length -= half;
+  }
+  if (base->position < hash) {
+    base = base + 1 == ring->points + ring->count ? ring->points : base + 1;
+  }
+  *node = base->node;
+  return 1;
+}
+
+size_t hash_ring_size(const struct hash_ring *ring) { return ring->nodes; }
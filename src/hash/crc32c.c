@@ -0,0 +1,213 @@
+#include <pocketknife/hash/crc32c.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+// The Castagnoli polynomial, bit-reversed: CRCs are computed least significant bit first, so bit i
+// of a CRC holds the coefficient of x^(31 - i).
+#define HASH_CRC32C_POLYNOMIAL 0x82f63b78u
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+static uint32_t hash_crc32c_table[8][256];
+
+__attribute__((constructor)) static void hash_crc32c_init_tables(void) {
+  for (uint32_t b = 0; b < 256; ++b) {
+    uint32_t crc = b;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ ((crc & 1) ? HASH_CRC32C_POLYNOMIAL : 0);
+    }
+    hash_crc32c_table[0][b] = crc;
+  }
+  for (int k = 1; k < 8; ++k) {
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint32_t previous = hash_crc32c_table[k - 1][b];
+      hash_crc32c_table[k][b] = (previous >> 8) ^ hash_crc32c_table[0][previous & 0xff];
+    }
+  }
+}
+
+static uint64_t hash_crc32c_read64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+// The functions below all take and return the CRC register, before the final inversion.
+typedef uint32_t (*HashCrc32cFunc)(uint32_t crc, const uint8_t *p, size_t length);
+
+static uint32_t hash_crc32c_table_update(uint32_t crc, const uint8_t *p, size_t length) {
+  for (; length >= 8; p += 8, length -= 8) {
+    uint64_t word = hash_crc32c_read64(p) ^ crc;
+    crc = hash_crc32c_table[7][word & 0xff] ^ hash_crc32c_table[6][(word >> 8) & 0xff] ^
+          hash_crc32c_table[5][(word >> 16) & 0xff] ^ hash_crc32c_table[4][(word >> 24) & 0xff] ^
+          hash_crc32c_table[3][(word >> 32) & 0xff] ^ hash_crc32c_table[2][(word >> 40) & 0xff] ^
+          hash_crc32c_table[1][(word >> 48) & 0xff] ^ hash_crc32c_table[0][word >> 56];
+  }
+  for (; length > 0; ++p, --length) {
+    crc = (crc >> 8) ^ hash_crc32c_table[0][(crc ^ *p) & 0xff];
+  }
+  return crc;
+}
+
+#ifdef HASH_X86_64
+
+HASH_TARGET("sse4.2")
+HASH_INLINE uint32_t hash_crc32c_words_sse42(uint32_t crc, const uint8_t *p, size_t length) {
+  uint64_t crc64 = crc;
+  for (; length >= 8; p += 8, length -= 8) {
+    crc64 = _mm_crc32_u64(crc64, hash_crc32c_read64(p));
+  }
+  crc = (uint32_t)crc64;
+  for (; length > 0; ++p, --length) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+  return crc;
+}
+
+HASH_TARGET("sse4.2")
+static uint32_t hash_crc32c_sse42_update(uint32_t crc, const uint8_t *p, size_t length) {
+  return hash_crc32c_words_sse42(crc, p, length);
+}
+
+// A crc32 instruction takes three cycles, but a new one can start every cycle, so three
+// independent streams go three times as fast as one. Each block is split into thirds, each third
+// is checksummed by its own stream, and the streams are joined:
+//
+//   crc(a b c) = crc(a) * x^(16L) + crc(b) * x^(8L) + crc(c)  (mod P)
+//
+// where crc(b) and crc(c) start from zero and L is the length of a third in bytes. Multiplying a
+// CRC by x^(8n) is a carry-less multiply by x^(8n - 33) mod P, then a crc32 of the 64-bit product
+// from zero, which supplies the remaining x^33 and the reduction. Two sizes of block cover both
+// large buffers and those of a few hundred bytes.
+#define HASH_CRC32C_LONG_THIRD 2048
+#define HASH_CRC32C_SHORT_THIRD 128
+
+// Returns x^n mod the polynomial, bit-reversed like a CRC.
+static uint32_t hash_crc32c_power(uint64_t n) {
+  uint32_t power = 0x80000000u;
+  for (uint64_t i = 0; i < n; ++i) {
+    power = (power >> 1) ^ ((power & 1) ? HASH_CRC32C_POLYNOMIAL : 0);
+  }
+  return power;
+}
+
+// The multipliers x^(8L - 33) and x^(16L - 33) mod P for each size.
+static uint32_t hash_crc32c_long_shift[2];
+static uint32_t hash_crc32c_short_shift[2];
+
+__attribute__((constructor)) static void hash_crc32c_init_shifts(void) {
+  hash_crc32c_long_shift[0] = hash_crc32c_power((8 * HASH_CRC32C_LONG_THIRD) - 33);
+  hash_crc32c_long_shift[1] = hash_crc32c_power((16 * HASH_CRC32C_LONG_THIRD) - 33);
+  hash_crc32c_short_shift[0] = hash_crc32c_power((8 * HASH_CRC32C_SHORT_THIRD) - 33);
+  hash_crc32c_short_shift[1] = hash_crc32c_power((16 * HASH_CRC32C_SHORT_THIRD) - 33);
+}
+
+HASH_TARGET("sse4.2,pclmul")
+HASH_INLINE uint64_t hash_crc32c_multiply(uint32_t crc, uint32_t shift) {
+  __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc),
+                                         _mm_cvtsi32_si128((int)shift), 0);
+  return (uint64_t)_mm_cvtsi128_si64(product);
+}
+
+HASH_TARGET("sse4.2,pclmul")
+HASH_INLINE uint32_t hash_crc32c_blocks(uint32_t crc, const uint8_t **data, size_t *length,
+                                        size_t third, const uint32_t shift[2]) {
+  const uint8_t *p = *data;
+  for (; *length >= 3 * third; p += 3 * third, *length -= 3 * third) {
+    uint64_t a = crc, b = 0, c = 0;
+    for (size_t i = 0; i < third; i += 8) {
+      a = _mm_crc32_u64(a, hash_crc32c_read64(p + i));
+      b = _mm_crc32_u64(b, hash_crc32c_read64(p + third + i));
+      c = _mm_crc32_u64(c, hash_crc32c_read64(p + (2 * third) + i));
+    }
+    uint64_t joined = hash_crc32c_multiply((uint32_t)a, shift[1]) ^
+                      hash_crc32c_multiply((uint32_t)b, shift[0]);
+    crc = (uint32_t)_mm_crc32_u64(0, joined) ^ (uint32_t)c;
+  }
+  *data = p;
+  return crc;
+}
+
+HASH_TARGET("sse4.2,pclmul")
+static uint32_t hash_crc32c_pclmul_update(uint32_t crc, const uint8_t *p, size_t length) {
+  crc = hash_crc32c_blocks(crc, &p, &length, HASH_CRC32C_LONG_THIRD, hash_crc32c_long_shift);
+  crc = hash_crc32c_blocks(crc, &p, &length, HASH_CRC32C_SHORT_THIRD, hash_crc32c_short_shift);
+  return hash_crc32c_words_sse42(crc, p, length);
+}
+
+#endif  // HASH_X86_64
+
+static const HashCrc32cFunc hash_crc32c_funcs[] = {
+    hash_crc32c_table_update,
+#ifdef HASH_X86_64
+    hash_crc32c_sse42_update,
+    hash_crc32c_pclmul_update,
+#endif
+};
+
+// Index into hash_crc32c_funcs plus one, or zero until the first checksum picks one.
+static int hash_crc32c_selected = 0;
+
+static int hash_crc32c_supported(enum HashCrc32cImpl impl) {
+  switch (impl) {
+    case HASH_CRC32C_TABLE:
+      return 1;
+#ifdef HASH_X86_64
+    case HASH_CRC32C_SSE42:
+      return __builtin_cpu_supports("sse4.2");
+    case HASH_CRC32C_PCLMUL:
+      return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+#endif
+    default:
+      return 0;
+  }
+}
+
+enum HashCrc32cImpl hash_crc32c_impl(void) {
+  int selected = __atomic_load_n(&hash_crc32c_selected, __ATOMIC_RELAXED);
+  if (!selected) {
+#ifdef HASH_X86_64
+    __builtin_cpu_init();
+#endif
+    enum HashCrc32cImpl best = HASH_CRC32C_TABLE;
+    if (hash_crc32c_supported(HASH_CRC32C_PCLMUL)) {
+      best = HASH_CRC32C_PCLMUL;
+    } else if (hash_crc32c_supported(HASH_CRC32C_SSE42)) {
+      best = HASH_CRC32C_SSE42;
+    }
+    selected = (int)best + 1;
+    __atomic_store_n(&hash_crc32c_selected, selected, __ATOMIC_RELAXED);
+  }
+
+  return (enum HashCrc32cImpl)(selected - 1);
+}
+
+int hash_crc32c_set_impl(enum HashCrc32cImpl impl) {
+#ifdef HASH_X86_64
+  __builtin_cpu_init();
+#endif
+  if (!hash_crc32c_supported(impl)) {
+    return 0;
+  }
+
+  __atomic_store_n(&hash_crc32c_selected, (int)impl + 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+uint32_t hash_crc32c(const uint8_t *data, size_t length) {
+  return ~hash_crc32c_funcs[hash_crc32c_impl()](0xffffffffu, data, length);
+}
+
+void hash_crc32c_init(struct hash_crc32c_state *state) { state->crc = 0xffffffffu; }
+
+void hash_crc32c_update(struct hash_crc32c_state *state, const uint8_t *data, size_t length) {
+  state->crc = hash_crc32c_funcs[hash_crc32c_impl()](state->crc, data, length);
+}
+
+uint32_t hash_crc32c_final(const struct hash_crc32c_state *state) { return ~state->crc; }
@@ -0,0 +1,236 @@
+#include <pocketknife/hash/cuckoo.h>
+#include <pocketknife/hash/fast.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_CUCKOO_SLOTS 4
+
+// How many fingerprints an insert may move before it gives up and parks the last one as the
+// victim. Tables 95% full rarely need more than a few dozen.
+#define HASH_CUCKOO_MAX_KICKS 500
+
+struct hash_cuckoo {
+  // Buckets of four fingerprints, packed into 32-bit words for 8-bit fingerprints and 64-bit ones
+  // for 16-bit fingerprints. Zero marks an empty slot, so no fingerprint is zero.
+  uint8_t *table;
+  uint64_t mask;
+  unsigned bits;
+  size_t size;
+
+  // A fingerprint that had no room at the end of an insert. While there is one, the table counts
+  // as full; it is put back once an erase makes room.
+  int has_victim;
+  uint64_t victim;
+  uint64_t victim_bucket;
+
+  uint64_t random;
+};
+
+static uint64_t hash_cuckoo_load(const struct hash_cuckoo *cuckoo, uint64_t bucket) {
+  if (cuckoo->bits == 8) {
+    uint32_t word;
+    memcpy(&word, cuckoo->table + (bucket * sizeof(word)), sizeof(word));
+    return word;
+  }
+  uint64_t word;
+  memcpy(&word, cuckoo->table + (bucket * sizeof(word)), sizeof(word));
+  return word;
+}
+
+static void hash_cuckoo_store(struct hash_cuckoo *cuckoo, uint64_t bucket, uint64_t value) {
+  if (cuckoo->bits == 8) {
+    uint32_t word = (uint32_t)value;
+    memcpy(cuckoo->table + (bucket * sizeof(word)), &word, sizeof(word));
+    return;
+  }
+  memcpy(cuckoo->table + (bucket * sizeof(value)), &value, sizeof(value));
+}
+
+// Returns a mask with the top bit set of every slot of a bucket that holds fingerprint, and maybe
+// of higher slots too. All four slots are compared at once: after xoring the fingerprint into
+// every slot, the lowest slot that became zero is the lowest whose top bit is set by subtracting
+// one from every slot while it wasn't set before.
+static uint64_t hash_cuckoo_match(const struct hash_cuckoo *cuckoo, uint64_t word,
+                                  uint64_t fingerprint) {
+  uint64_t ones = cuckoo->bits == 8 ? 0x01010101ULL : 0x0001000100010001ULL;
+  uint64_t value = word ^ (fingerprint * ones);
+  return (value - ones) & ~value & (ones << (cuckoo->bits - 1));
+}
+
+// Returns the first slot of a bucket that holds fingerprint, or -1.
+static int hash_cuckoo_find(const struct hash_cuckoo *cuckoo, uint64_t word,
+                            uint64_t fingerprint) {
+  uint64_t match = hash_cuckoo_match(cuckoo, word, fingerprint);
+  return match ? __builtin_ctzll(match) / (int)cuckoo->bits : -1;
+}
+
+static uint64_t hash_cuckoo_set(const struct hash_cuckoo *cuckoo, uint64_t word, int slot,
+                                uint64_t fingerprint) {
+  unsigned shift = (unsigned)slot * cuckoo->bits;
+  uint64_t lane = ((1ULL << cuckoo->bits) - 1) << shift;
+  return (word & ~lane) | (fingerprint << shift);
+}
+
+static uint64_t hash_cuckoo_fingerprint(const struct hash_cuckoo *cuckoo, uint64_t hash) {
+  uint64_t fingerprint = hash & ((1ULL << cuckoo->bits) - 1);
+  return fingerprint ? fingerprint : 1;
+}
+
+// The other bucket a fingerprint may be in. Applying it twice gives back the first.
+static uint64_t hash_cuckoo_other(const struct hash_cuckoo *cuckoo, uint64_t bucket,
+                                  uint64_t fingerprint) {
+  return (bucket ^ (fingerprint * 0x5bd1e995ULL)) & cuckoo->mask;
+}
+
+// Puts a fingerprint in a free slot of a bucket. Returns 0 if there is none.
+static int hash_cuckoo_put(struct hash_cuckoo *cuckoo, uint64_t bucket, uint64_t fingerprint) {
+  uint64_t word = hash_cuckoo_load(cuckoo, bucket);
+  int slot = hash_cuckoo_find(cuckoo, word, 0);
+  if (slot < 0) {
+    return 0;
+  }
+  hash_cuckoo_store(cuckoo, bucket, hash_cuckoo_set(cuckoo, word, slot, fingerprint));
+  return 1;
+}
+
+static uint64_t hash_cuckoo_next_random(struct hash_cuckoo *cuckoo) {
+  cuckoo->random ^= cuckoo->random << 13;
+  cuckoo->random ^= cuckoo->random >> 7;
+  cuckoo->random ^= cuckoo->random << 17;
+  return cuckoo->random;
+}
+
+static void hash_cuckoo_insert(struct hash_cuckoo *cuckoo, uint64_t bucket, uint64_t fingerprint) {
+  uint64_t other = hash_cuckoo_other(cuckoo, bucket, fingerprint);
+  if (hash_cuckoo_put(cuckoo, bucket, fingerprint) ||
+      hash_cuckoo_put(cuckoo, other, fingerprint)) {
+    return;
+  }
+
+  // Both buckets are full: swap the fingerprint with a random one from either, and move that one
+  // to its other bucket, and so on until one fits.
+  bucket = hash_cuckoo_next_random(cuckoo) & 1 ? other : bucket;
+  for (int kick = 0; kick < HASH_CUCKOO_MAX_KICKS; ++kick) {
+    int slot = (int)(hash_cuckoo_next_random(cuckoo) % HASH_CUCKOO_SLOTS);
+    uint64_t word = hash_cuckoo_load(cuckoo, bucket);
+    uint64_t evicted = (word >> ((unsigned)slot * cuckoo->bits)) & ((1ULL << cuckoo->bits) - 1);
+    hash_cuckoo_store(cuckoo, bucket, hash_cuckoo_set(cuckoo, word, slot, fingerprint));
+
+    fingerprint = evicted;
+    bucket = hash_cuckoo_other(cuckoo, bucket, fingerprint);
+    if (hash_cuckoo_put(cuckoo, bucket, fingerprint)) {
+      return;
+    }
+  }
+
+  cuckoo->has_victim = 1;
+  cuckoo->victim = fingerprint;
+  cuckoo->victim_bucket = bucket;
+}
+
+struct hash_cuckoo *hash_cuckoo_new(size_t keys, unsigned fingerprint_bits) {
+  if (fingerprint_bits != 8 && fingerprint_bits != 16) {
+    return NULL;
+  }
+
+  // Enough buckets to hold the keys at 95% load, rounded up to a power of two so that the other
+  // bucket of a fingerprint can be found by xor.
+  uint64_t needed = (((uint64_t)keys * 100) + (95 * HASH_CUCKOO_SLOTS) - 1) /
+                    (95 * HASH_CUCKOO_SLOTS);
+  uint64_t buckets = 1;
+  while (buckets < needed) {
+    buckets *= 2;
+  }
+
+  struct hash_cuckoo *cuckoo = calloc(1, sizeof(struct hash_cuckoo));
+  if (!cuckoo) {
+    return NULL;
+  }
+  cuckoo->table = calloc((size_t)buckets, fingerprint_bits / 2);
+  if (!cuckoo->table) {
+    free(cuckoo);
+    return NULL;
+  }
+  cuckoo->mask = buckets - 1;
+  cuckoo->bits = fingerprint_bits;
+  cuckoo->random = 0x2545f4914f6cdd1dULL;
+  return cuckoo;
+}
+
+void hash_cuckoo_destroy(struct hash_cuckoo *cuckoo) {
+  free(cuckoo->table);
+  free(cuckoo);
+}
+
+int hash_cuckoo_add_hash(struct hash_cuckoo *cuckoo, uint64_t hash) {
+  if (cuckoo->has_victim) {
+    return 0;
+  }
+  hash_cuckoo_insert(cuckoo, (hash >> 32) & cuckoo->mask, hash_cuckoo_fingerprint(cuckoo, hash));
+  ++cuckoo->size;
+  return 1;
+}
+
+int hash_cuckoo_contains_hash(const struct hash_cuckoo *cuckoo, uint64_t hash) {
+  uint64_t fingerprint = hash_cuckoo_fingerprint(cuckoo, hash);
+  uint64_t bucket = (hash >> 32) & cuckoo->mask;
+  uint64_t other = hash_cuckoo_other(cuckoo, bucket, fingerprint);
+  if (cuckoo->has_victim && cuckoo->victim == fingerprint &&
+      (cuckoo->victim_bucket == bucket || cuckoo->victim_bucket == other)) {
+    return 1;
+  }
+  // Both buckets are always tested, without branching on the first, which is as likely to hold
+  // the fingerprint as the second.
+  return (hash_cuckoo_match(cuckoo, hash_cuckoo_load(cuckoo, bucket), fingerprint) |
+          hash_cuckoo_match(cuckoo, hash_cuckoo_load(cuckoo, other), fingerprint)) != 0;
+}
+
+int hash_cuckoo_erase_hash(struct hash_cuckoo *cuckoo, uint64_t hash) {
+  uint64_t fingerprint = hash_cuckoo_fingerprint(cuckoo, hash);
+  uint64_t bucket = (hash >> 32) & cuckoo->mask;
+  uint64_t other = hash_cuckoo_other(cuckoo, bucket, fingerprint);
+
+  if (cuckoo->has_victim && cuckoo->victim == fingerprint &&
+      (cuckoo->victim_bucket == bucket || cuckoo->victim_bucket == other)) {
+    cuckoo->has_victim = 0;
+    --cuckoo->size;
+    return 1;
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    uint64_t candidate = i ? other : bucket;
+    uint64_t word = hash_cuckoo_load(cuckoo, candidate);
+    int slot = hash_cuckoo_find(cuckoo, word, fingerprint);
+    if (slot >= 0) {
+      hash_cuckoo_store(cuckoo, candidate, hash_cuckoo_set(cuckoo, word, slot, 0));
+      --cuckoo->size;
+      if (cuckoo->has_victim) {
+        cuckoo->has_victim = 0;
+        hash_cuckoo_insert(cuckoo, cuckoo->victim_bucket, cuckoo->victim);
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int hash_cuckoo_add(struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length) {
+  return hash_cuckoo_add_hash(cuckoo, hash_fast64(key, length, 0));
+}
+
+int hash_cuckoo_contains(const struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length) {
+  return hash_cuckoo_contains_hash(cuckoo, hash_fast64(key, length, 0));
+}
+
+int hash_cuckoo_erase(struct hash_cuckoo *cuckoo, const uint8_t *key, size_t length) {
+  return hash_cuckoo_erase_hash(cuckoo, hash_fast64(key, length, 0));
+}
+
+size_t hash_cuckoo_size(const struct hash_cuckoo *cuckoo) { return cuckoo->size; }
+
+size_t hash_cuckoo_bytes(const struct hash_cuckoo *cuckoo) {
+  return (size_t)(cuckoo->mask + 1) * (cuckoo->bits / 2);
+}
@@ -0,0 +1,537 @@
+#include <pocketknife/hash/fast.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+// Inputs longer than this take the striped bulk path.
+#define HASH_FAST_SHORT_MAX 240
+
+// The bulk path consumes 64 byte stripes, and scrambles its accumulators after every block of 16
+// stripes. Each stripe within a block is keyed by the secret shifted one word further along.
+#define HASH_FAST_STRIPE 64
+#define HASH_FAST_STRIPES_PER_BLOCK 16
+#define HASH_FAST_BLOCK (HASH_FAST_STRIPE * HASH_FAST_STRIPES_PER_BLOCK)
+#define HASH_FAST_SECRET_WORDS 24
+
+// Offsets into the secret, in words, for the scramble, the final stripe and the two merges.
+#define HASH_FAST_SCRAMBLE_KEY 16
+#define HASH_FAST_LAST_STRIPE_KEY 7
+#define HASH_FAST_LOW_KEY 1
+#define HASH_FAST_HIGH_KEY 13
+
+static const uint64_t PRIME32_1 = 0x9e3779b1ULL;
+static const uint64_t PRIME32_2 = 0x85ebca77ULL;
+static const uint64_t PRIME32_3 = 0xc2b2ae3dULL;
+static const uint64_t PRIME64_1 = 0x9e3779b185ebca87ULL;
+static const uint64_t PRIME64_2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t PRIME64_3 = 0x165667b19e3779f9ULL;
+static const uint64_t PRIME64_4 = 0x85ebca77c2b2ae63ULL;
+static const uint64_t PRIME64_5 = 0x27d4eb2f165667c5ULL;
+
+// Mixing constants for short inputs (from wyhash).
+static const uint64_t WY0 = 0xa0761d6478bd642fULL;
+static const uint64_t WY1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t WY2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t WY3 = 0x589965cc75374cc3ULL;
+
+// Keys for the bulk path: the first 24 outputs of splitmix64 seeded with zero.
+static const uint64_t hash_fast_secret[HASH_FAST_SECRET_WORDS] = {
+    0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL, 0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL,
+    0x1b39896a51a8749bULL, 0x53cb9f0c747ea2eaULL, 0x2c829abe1f4532e1ULL, 0xc584133ac916ab3cULL,
+    0x3ee5789041c98ac3ULL, 0xf3b8488c368cb0a6ULL, 0x657eecdd3cb13d09ULL, 0xc2d326e0055bdef6ULL,
+    0x8621a03fe0bbdb7bULL, 0x8e1f7555983aa92fULL, 0xb54e0f1600cc4d19ULL, 0x84bb3f97971d80abULL,
+    0x7d29825c75521255ULL, 0xc3cf17102b7f7f86ULL, 0x3466e9a083914f64ULL, 0xd81a8d2b5a4485acULL,
+    0xdb01602b100b9ed7ULL, 0xa9038a921825f10dULL, 0xedf5f1d90dca2f6aULL, 0x54496ad67bd2634cULL,
+};
+
+static uint64_t hash_read64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+static uint64_t hash_read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+// Full 64x64->128-bit multiply, returning the low half in *a and the high half in *b.
+static void hash_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  hash_uint128 product = (hash_uint128)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static uint64_t hash_mix(uint64_t a, uint64_t b) {
+  hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static uint64_t hash_avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= PRIME64_3;
+  return h ^ (h >> 32);
+}
+
+// Inputs of up to HASH_FAST_SHORT_MAX bytes, following wyhash: up to 16 bytes are read as two
+// (possibly overlapping) words, and longer inputs are folded 48 then 16 bytes at a time. Leaves
+// the final 128-bit product in *a and *b.
+static void hash_fast_short(const uint8_t *p, size_t length, uint64_t seed, uint64_t *a,
+                            uint64_t *b) {
+  seed ^= hash_mix(seed ^ WY0, WY1);
+
+  uint64_t x, y;
+  if (length <= 16) {
+    if (length >= 4) {
+      size_t shift = (length >> 3) << 2;
+      x = (hash_read32(p) << 32) | hash_read32(p + shift);
+      y = (hash_read32(p + length - 4) << 32) | hash_read32(p + length - 4 - shift);
+    } else if (length > 0) {
+      x = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+      y = 0;
+    } else {
+      x = 0;
+      y = 0;
+    }
+  } else {
+    size_t i = length;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = hash_mix(hash_read64(p) ^ WY1, hash_read64(p + 8) ^ seed);
+        see1 = hash_mix(hash_read64(p + 16) ^ WY2, hash_read64(p + 24) ^ see1);
+        see2 = hash_mix(hash_read64(p + 32) ^ WY3, hash_read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = hash_mix(hash_read64(p) ^ WY1, hash_read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    x = hash_read64(p + i - 16);
+    y = hash_read64(p + i - 8);
+  }
+
+  *a = x ^ WY1;
+  *b = y ^ seed;
+  hash_mum(a, b);
+}
+
+// Bulk loops. Each stripe adds every input word to its neighbouring accumulator, and the product
+// of the keyed word's two halves to its own; the scramble folds high bits back down. The SIMD
+// loops compute exactly the same thing, two or four accumulators at a time.
+//
+// A loop consumes the given number of stripes, starting at the given stripe within the current
+// block, and returns the position within the block that it stopped at.
+typedef size_t (*HashFastLoop)(uint64_t acc[8], const uint8_t *p, size_t stripes, size_t position,
+                               const uint64_t *key);
+
+HASH_INLINE void hash_fast_stripe_scalar(uint64_t acc[8], const uint8_t *p, const uint64_t *key) {
+  for (size_t i = 0; i < 8; ++i) {
+    uint64_t data = hash_read64(p + (i * 8));
+    uint64_t keyed = data ^ key[i];
+    acc[i ^ 1] += data;
+    acc[i] += (keyed & 0xffffffffULL) * (keyed >> 32);
+  }
+}
+
+HASH_INLINE void hash_fast_scramble_scalar(uint64_t acc[8], const uint64_t *key) {
+  for (size_t i = 0; i < 8; ++i) {
+    uint64_t value = acc[i];
+    value ^= value >> 47;
+    value ^= key[i];
+    acc[i] = value * PRIME32_1;
+  }
+}
+
+static size_t hash_fast_loop_scalar(uint64_t acc[8], const uint8_t *p, size_t stripes,
+                                    size_t position, const uint64_t *key) {
+  for (size_t s = 0; s < stripes;) {
+    size_t count = HASH_FAST_STRIPES_PER_BLOCK - position;
+    if (count > stripes - s) {
+      count = stripes - s;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      hash_fast_stripe_scalar(acc, p + ((s + i) * HASH_FAST_STRIPE), key + position + i);
+    }
+    s += count;
+    position += count;
+    if (position == HASH_FAST_STRIPES_PER_BLOCK) {
+      hash_fast_scramble_scalar(acc, key + HASH_FAST_SCRAMBLE_KEY);
+      position = 0;
+    }
+  }
+
+  return position;
+}
+
+#ifdef HASH_X86
+
+HASH_TARGET("sse2")
+HASH_INLINE void hash_fast_stripe_sse2(__m128i acc[4], const uint8_t *p, const uint64_t *key) {
+  for (int i = 0; i < 4; ++i) {
+    __m128i data = HASH_LOAD128(p + (i * 16));
+    __m128i keyed = _mm_xor_si128(data, HASH_LOAD128(key + (i * 2)));
+    __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+  }
+}
+
+HASH_TARGET("sse2")
+HASH_INLINE void hash_fast_scramble_sse2(__m128i acc[4], const uint64_t *key) {
+  const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+  for (int i = 0; i < 4; ++i) {
+    __m128i value = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+    value = _mm_xor_si128(value, HASH_LOAD128(key + (i * 2)));
+    __m128i low = _mm_mul_epu32(value, prime);
+    __m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+    acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+  }
+}
+
+HASH_TARGET("sse2")
+static size_t hash_fast_loop_sse2(uint64_t acc[8], const uint8_t *p, size_t stripes,
+                                  size_t position, const uint64_t *key) {
+  __m128i vacc[4];
+  memcpy(vacc, acc, sizeof(vacc));
+
+  for (size_t s = 0; s < stripes;) {
+    size_t count = HASH_FAST_STRIPES_PER_BLOCK - position;
+    if (count > stripes - s) {
+      count = stripes - s;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      hash_fast_stripe_sse2(vacc, p + ((s + i) * HASH_FAST_STRIPE), key + position + i);
+    }
+    s += count;
+    position += count;
+    if (position == HASH_FAST_STRIPES_PER_BLOCK) {
+      hash_fast_scramble_sse2(vacc, key + HASH_FAST_SCRAMBLE_KEY);
+      position = 0;
+    }
+  }
+
+  memcpy(acc, vacc, sizeof(vacc));
+  return position;
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE void hash_fast_stripe_avx2(__m256i acc[2], const uint8_t *p, const uint64_t *key) {
+  for (int i = 0; i < 2; ++i) {
+    __m256i data = HASH_LOAD256(p + (i * 32));
+    __m256i keyed = _mm256_xor_si256(data, HASH_LOAD256(key + (i * 4)));
+    __m256i product =
+        _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    acc[i] = _mm256_add_epi64(acc[i], _mm256_add_epi64(product, swapped));
+  }
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE void hash_fast_scramble_avx2(__m256i acc[2], const uint64_t *key) {
+  const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+  for (int i = 0; i < 2; ++i) {
+    __m256i value = _mm256_xor_si256(acc[i], _mm256_srli_epi64(acc[i], 47));
+    value = _mm256_xor_si256(value, HASH_LOAD256(key + (i * 4)));
+    __m256i low = _mm256_mul_epu32(value, prime);
+    __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime);
+    acc[i] = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+  }
+}
+
+HASH_TARGET("avx2")
+static size_t hash_fast_loop_avx2(uint64_t acc[8], const uint8_t *p, size_t stripes,
+                                  size_t position, const uint64_t *key) {
+  __m256i vacc[2];
+  memcpy(vacc, acc, sizeof(vacc));
+
+  for (size_t s = 0; s < stripes;) {
+    size_t count = HASH_FAST_STRIPES_PER_BLOCK - position;
+    if (count > stripes - s) {
+      count = stripes - s;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      hash_fast_stripe_avx2(vacc, p + ((s + i) * HASH_FAST_STRIPE), key + position + i);
+    }
+    s += count;
+    position += count;
+    if (position == HASH_FAST_STRIPES_PER_BLOCK) {
+      hash_fast_scramble_avx2(vacc, key + HASH_FAST_SCRAMBLE_KEY);
+      position = 0;
+    }
+  }
+
+  memcpy(acc, vacc, sizeof(vacc));
+  return position;
+}
+
+#endif  // HASH_X86
+
+static const HashFastLoop hash_fast_loops[] = {
+    hash_fast_loop_scalar,
+#ifdef HASH_X86
+    hash_fast_loop_sse2,
+    hash_fast_loop_avx2,
+#endif
+};
+
+// Index into hash_fast_loops plus one, or zero until the first long input picks one.
+static int hash_fast_selected = 0;
+
+static int hash_fast_supported(enum HashFastImpl impl) {
+  switch (impl) {
+    case HASH_FAST_SCALAR:
+      return 1;
+#ifdef HASH_X86
+    case HASH_FAST_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case HASH_FAST_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return 0;
+  }
+}
+
+enum HashFastImpl hash_fast_impl(void) {
+  int selected = __atomic_load_n(&hash_fast_selected, __ATOMIC_RELAXED);
+  if (!selected) {
+#ifdef HASH_X86
+    __builtin_cpu_init();
+#endif
+    enum HashFastImpl best = HASH_FAST_SCALAR;
+    if (hash_fast_supported(HASH_FAST_AVX2)) {
+      best = HASH_FAST_AVX2;
+    } else if (hash_fast_supported(HASH_FAST_SSE2)) {
+      best = HASH_FAST_SSE2;
+    }
+    selected = (int)best + 1;
+    __atomic_store_n(&hash_fast_selected, selected, __ATOMIC_RELAXED);
+  }
+
+  return (enum HashFastImpl)(selected - 1);
+}
+
+int hash_fast_set_impl(enum HashFastImpl impl) {
+#ifdef HASH_X86
+  __builtin_cpu_init();
+#endif
+  if (!hash_fast_supported(impl)) {
+    return 0;
+  }
+
+  __atomic_store_n(&hash_fast_selected, (int)impl + 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+// Fills in the keys for a seed. With no seed these are the secret itself.
+static void hash_fast_keys(uint64_t key[HASH_FAST_SECRET_WORDS], uint64_t seed) {
+  for (size_t i = 0; i < HASH_FAST_SECRET_WORDS; i += 2) {
+    key[i] = hash_fast_secret[i] + seed;
+    key[i + 1] = hash_fast_secret[i + 1] - seed;
+  }
+}
+
+static void hash_fast_reset(uint64_t acc[8]) {
+  acc[0] = PRIME32_3;
+  acc[1] = PRIME64_1;
+  acc[2] = PRIME64_2;
+  acc[3] = PRIME64_3;
+  acc[4] = PRIME64_4;
+  acc[5] = PRIME32_2;
+  acc[6] = PRIME64_5;
+  acc[7] = PRIME32_1;
+}
+
+// Runs the bulk loop over an input longer than HASH_FAST_SHORT_MAX, leaving the keys it used in
+// key, which must have room for HASH_FAST_SECRET_WORDS words. Stripes are consumed only while
+// input follows them; the last 64 bytes are always consumed as a final stripe with their own key,
+// which is what lets streaming stop at any point.
+static const uint64_t *hash_fast_long(uint64_t acc[8], const uint8_t *p, size_t length,
+                                      uint64_t seed, uint64_t key[HASH_FAST_SECRET_WORDS]) {
+  const uint64_t *keys = hash_fast_secret;
+  if (seed) {
+    hash_fast_keys(key, seed);
+    keys = key;
+  }
+
+  hash_fast_reset(acc);
+  hash_fast_loops[hash_fast_impl()](acc, p, (length - 1) / HASH_FAST_STRIPE, 0, keys);
+  hash_fast_stripe_scalar(acc, p + length - HASH_FAST_STRIPE, keys + HASH_FAST_LAST_STRIPE_KEY);
+  return keys;
+}
+
+static uint64_t hash_fast_merge(const uint64_t acc[8], const uint64_t *key, uint64_t start) {
+  uint64_t result = start;
+  for (size_t i = 0; i < 8; i += 2) {
+    result += hash_mix(acc[i] ^ key[i], acc[i + 1] ^ key[i + 1]);
+  }
+  return hash_avalanche(result);
+}
+
+static uint64_t hash_fast_short64(const uint8_t *data, size_t length, uint64_t seed) {
+  uint64_t a, b;
+  hash_fast_short(data, length, seed, &a, &b);
+  return hash_mix(a ^ WY0 ^ length, b ^ WY1);
+}
+
+static struct hash128 hash_fast_short128(const uint8_t *data, size_t length, uint64_t seed) {
+  struct hash128 hash;
+  uint64_t a, b;
+  hash_fast_short(data, length, seed, &a, &b);
+  hash.low = hash_mix(a ^ WY0 ^ length, b ^ WY1);
+  hash.high = hash_mix(a ^ WY2, b ^ WY3 ^ length);
+  return hash;
+}
+
+uint64_t hash_fast64(const uint8_t *data, size_t length, uint64_t seed) {
+  if (length <= HASH_FAST_SHORT_MAX) {
+    return hash_fast_short64(data, length, seed);
+  }
+
+  uint64_t acc[8];
+  uint64_t key[HASH_FAST_SECRET_WORDS];
+  const uint64_t *keys = hash_fast_long(acc, data, length, seed, key);
+  return hash_fast_merge(acc, keys + HASH_FAST_LOW_KEY, length * PRIME64_1);
+}
+
+struct hash128 hash_fast128(const uint8_t *data, size_t length, uint64_t seed) {
+  if (length <= HASH_FAST_SHORT_MAX) {
+    return hash_fast_short128(data, length, seed);
+  }
+
+  uint64_t acc[8];
+  uint64_t key[HASH_FAST_SECRET_WORDS];
+  const uint64_t *keys = hash_fast_long(acc, data, length, seed, key);
+  struct hash128 hash;
+  hash.low = hash_fast_merge(acc, keys + HASH_FAST_LOW_KEY, length * PRIME64_1);
+  hash.high = hash_fast_merge(acc, keys + HASH_FAST_HIGH_KEY, ~(length * PRIME64_2));
+  return hash;
+}
+
+// Streaming. The buffer holds input that hasn't been consumed; it is only consumed once it is full
+// and more input arrives, so an input that ends up short is still whole in the buffer at the end,
+// and a long one always has input following each consumed stripe. Updates consume long inputs in
+// place, in whole buffers' worth of stripes, and copy the last stripe they consumed to the end of
+// the buffer, so that final can always find the 64 bytes before the end of the input.
+
+_Static_assert(HASH_FAST_STATE_BUFFER > HASH_FAST_SHORT_MAX, "buffer must hold a short input");
+_Static_assert(HASH_FAST_STATE_BUFFER % HASH_FAST_STRIPE == 0, "buffer must hold whole stripes");
+_Static_assert(sizeof(((struct hash_fast_state *)0)->key) == sizeof(hash_fast_secret),
+               "state must hold every key");
+
+#define HASH_FAST_BUFFER_STRIPES (HASH_FAST_STATE_BUFFER / HASH_FAST_STRIPE)
+
+void hash_fast_init(struct hash_fast_state *state, uint64_t seed) {
+  hash_fast_reset(state->acc);
+  hash_fast_keys(state->key, seed);
+  state->seed = seed;
+  state->length = 0;
+  state->position = 0;
+  state->buffered = 0;
+}
+
+static void hash_fast_consume(struct hash_fast_state *state, const uint8_t *p, size_t stripes) {
+  state->position =
+      hash_fast_loops[hash_fast_impl()](state->acc, p, stripes, state->position, state->key);
+}
+
+void hash_fast_update(struct hash_fast_state *state, const uint8_t *data, size_t length) {
+  state->length += length;
+
+  // Fill the buffer, leaving the input that follows it, if any, to consume it.
+  size_t fill = HASH_FAST_STATE_BUFFER - state->buffered;
+  if (length <= fill) {
+    memcpy(state->buffer + state->buffered, data, length);
+    state->buffered += length;
+    return;
+  }
+  memcpy(state->buffer + state->buffered, data, fill);
+  data += fill;
+  length -= fill;
+  hash_fast_consume(state, state->buffer, HASH_FAST_BUFFER_STRIPES);
+
+  // Consume whole buffers' worth straight from the input while more input follows them.
+  if (length > HASH_FAST_STATE_BUFFER) {
+    size_t stripes = ((length - 1) / HASH_FAST_STATE_BUFFER) * HASH_FAST_BUFFER_STRIPES;
+    hash_fast_consume(state, data, stripes);
+    data += stripes * HASH_FAST_STRIPE;
+    length -= stripes * HASH_FAST_STRIPE;
+    memcpy(state->buffer + HASH_FAST_STATE_BUFFER - HASH_FAST_STRIPE, data - HASH_FAST_STRIPE,
+           HASH_FAST_STRIPE);
+  }
+
+  memcpy(state->buffer, data, length);
+  state->buffered = length;
+}
+
+// Finishes the bulk loop on a copy of the accumulators.
+static void hash_fast_state_finish(const struct hash_fast_state *state, uint64_t acc[8]) {
+  memcpy(acc, state->acc, sizeof(state->acc));
+
+  const uint8_t *p = state->buffer;
+  size_t buffered = state->buffered;
+  size_t stripes = (buffered - 1) / HASH_FAST_STRIPE;
+  hash_fast_loops[hash_fast_impl()](acc, p, stripes, state->position, state->key);
+
+  // The last stripe may straddle the start of the buffer, in which case its start is the end of
+  // the previous stripe, still at the end of the buffer.
+  uint8_t last[HASH_FAST_STRIPE];
+  if (buffered >= HASH_FAST_STRIPE) {
+    p += buffered - HASH_FAST_STRIPE;
+  } else {
+    size_t before = HASH_FAST_STRIPE - buffered;
+    memcpy(last, state->buffer + HASH_FAST_STATE_BUFFER - before, before);
+    memcpy(last + before, state->buffer, buffered);
+    p = last;
+  }
+  hash_fast_stripe_scalar(acc, p, state->key + HASH_FAST_LAST_STRIPE_KEY);
+}
+
+uint64_t hash_fast64_final(const struct hash_fast_state *state) {
+  if (state->length <= HASH_FAST_SHORT_MAX) {
+    return hash_fast_short64(state->buffer, state->buffered, state->seed);
+  }
+
+  uint64_t acc[8];
+  hash_fast_state_finish(state, acc);
+  return hash_fast_merge(acc, state->key + HASH_FAST_LOW_KEY, state->length * PRIME64_1);
+}
+
+struct hash128 hash_fast128_final(const struct hash_fast_state *state) {
+  if (state->length <= HASH_FAST_SHORT_MAX) {
+    return hash_fast_short128(state->buffer, state->buffered, state->seed);
+  }
+
+  uint64_t acc[8];
+  hash_fast_state_finish(state, acc);
+  struct hash128 hash;
+  hash.low = hash_fast_merge(acc, state->key + HASH_FAST_LOW_KEY, state->length * PRIME64_1);
+  hash.high = hash_fast_merge(acc, state->key + HASH_FAST_HIGH_KEY, ~(state->length * PRIME64_2));
+  return hash;
+}
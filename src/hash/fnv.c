@@ -2,13 +2,14 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
 
 static const uint64_t FNV_offset_basis = 0xcbf29ce484222325ULL;
 static const uint64_t FNV_prime = 0x100000001b3ULL;
 
-uint64_t hash_fnv1(const uint8_t *data, size_t length) {
-  uint64_t hash = FNV_offset_basis;
-
+static uint64_t hash_fnv1_continue(uint64_t hash, const uint8_t *data, size_t length) {
   for (size_t i = 0; i < length; i++) {
     hash *= FNV_prime;
     hash ^= (uint64_t)data[i];
@@ -17,9 +18,7 @@ uint64_t hash_fnv1(const uint8_t *data, size_t length) {
   return hash;
 }
 
-uint64_t hash_fnv1a(const uint8_t *data, size_t length) {
-  uint64_t hash = FNV_offset_basis;
-
+static uint64_t hash_fnv1a_continue(uint64_t hash, const uint8_t *data, size_t length) {
   for (size_t i = 0; i < length; i++) {
     hash ^= (uint64_t)data[i];
     hash *= FNV_prime;
@@ -27,3 +26,240 @@ uint64_t hash_fnv1a(const uint8_t *data, size_t length) {
 
   return hash;
 }
+
+uint64_t hash_fnv1(const uint8_t *data, size_t length) {
+  return hash_fnv1_continue(FNV_offset_basis, data, length);
+}
+
+uint64_t hash_fnv1a(const uint8_t *data, size_t length) {
+  return hash_fnv1a_continue(FNV_offset_basis, data, length);
+}
+
+// Batches. The AVX2 loop hashes sixteen keys in four registers of four 64-bit states, which gives
+// enough independent multiplies to hide their latency. It takes eight bytes of each key at a time
+// and shifts them out of a word per lane; states whose key has ended are left alone. AVX2 has no
+// 64-bit multiply, but the prime is 2^40 + 0x1b3, so multiplying by it takes two 32-bit
+// multiplies and a shift.
+#define HASH_FNV_BATCH_LANES 16
+
+typedef void (*HashFnvBatchFunc)(const uint8_t *const *keys, const size_t *lengths,
+                                 uint64_t *hashes, int alternate);
+
+static void hash_fnv_batch_scalar(const uint8_t *const *keys, const size_t *lengths,
+                                  uint64_t *hashes, int alternate) {
+  for (size_t i = 0; i < HASH_FNV_BATCH_LANES; ++i) {
+    hashes[i] = alternate ? hash_fnv1a(keys[i], lengths[i]) : hash_fnv1(keys[i], lengths[i]);
+  }
+}
+
+#ifdef HASH_X86_64
+
+// Reads the eight bytes of a key from offset. Bytes past its end are never used, and reads never
+// go past it. Keys of at least eight bytes read the word that ends with the key and shift it into
+// place, without branching on the length; shorter ones are read as two overlapping halves.
+static uint64_t hash_fnv_read(const uint8_t *key, size_t length, size_t offset) {
+  if (length >= 8) {
+    size_t start = offset < length - 8 ? offset : length - 8;
+    uint64_t word;
+    memcpy(&word, key + start, sizeof(word));
+    return word >> (((offset - start) * 8) & 63);
+  }
+  if (offset >= length) {
+    return 0;
+  }
+
+  const uint8_t *p = key + offset;
+  size_t remaining = length - offset;
+  if (remaining >= 4) {
+    uint32_t low, high;
+    memcpy(&low, p, sizeof(low));
+    memcpy(&high, p + remaining - 4, sizeof(high));
+    return low | ((uint64_t)high << ((remaining - 4) * 8));
+  }
+  return p[0] | ((uint64_t)p[remaining / 2] << ((remaining / 2) * 8)) |
+         ((uint64_t)p[remaining - 1] << ((remaining - 1) * 8));
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE __m256i hash_fnv_multiply_avx2(__m256i hash) {
+  const __m256i low_prime = _mm256_set1_epi64x(0x1b3);
+  __m256i low = _mm256_mul_epu32(hash, low_prime);
+  __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(hash, 32), low_prime);
+  return _mm256_add_epi64(_mm256_add_epi64(low, _mm256_slli_epi64(high, 32)),
+                          _mm256_slli_epi64(hash, 40));
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE __m256i hash_fnv_step_avx2(__m256i hash, __m256i byte, int alternate) {
+  if (alternate) {
+    return hash_fnv_multiply_avx2(_mm256_xor_si256(hash, byte));
+  }
+  return _mm256_xor_si256(hash_fnv_multiply_avx2(hash), byte);
+}
+
+// Hashes the next byte of each lane's word into its state, and shifts it out of the word.
+HASH_TARGET("avx2")
+HASH_INLINE void hash_fnv_byte_avx2(__m256i *hash, __m256i *word, int alternate) {
+  __m256i byte = _mm256_and_si256(*word, _mm256_set1_epi64x(0xff));
+  *hash = hash_fnv_step_avx2(*hash, byte, alternate);
+  *word = _mm256_srli_epi64(*word, 8);
+}
+
+// Like hash_fnv_byte_avx2, but leaves lanes alone whose key has ended before position.
+HASH_TARGET("avx2")
+HASH_INLINE void hash_fnv_tail_byte_avx2(__m256i *hash, __m256i *word, __m256i lengths,
+                                         __m256i position, int alternate) {
+  __m256i active = _mm256_cmpgt_epi64(lengths, position);
+  __m256i byte = _mm256_and_si256(*word, _mm256_set1_epi64x(0xff));
+  *hash = _mm256_blendv_epi8(*hash, hash_fnv_step_avx2(*hash, byte, alternate), active);
+  *word = _mm256_srli_epi64(*word, 8);
+}
+
+// Loads the words at offset of four keys that all have eight bytes there. (Four loads are faster
+// than a gather on CPUs with gather mitigations, and no slower elsewhere.)
+static uint64_t hash_fnv_load(const uint8_t *p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE __m256i hash_fnv_gather_avx2(const uint8_t *const *keys, size_t offset) {
+  return _mm256_set_epi64x(
+      (long long)hash_fnv_load(keys[3] + offset), (long long)hash_fnv_load(keys[2] + offset),
+      (long long)hash_fnv_load(keys[1] + offset), (long long)hash_fnv_load(keys[0] + offset));
+}
+
+// Loads the words at offset of four keys, any of which may end before or within them.
+HASH_TARGET("avx2")
+HASH_INLINE __m256i hash_fnv_read_avx2(const uint8_t *const *keys, const size_t *lengths,
+                                       size_t offset) {
+  return _mm256_set_epi64x((long long)hash_fnv_read(keys[3], lengths[3], offset),
+                           (long long)hash_fnv_read(keys[2], lengths[2], offset),
+                           (long long)hash_fnv_read(keys[1], lengths[1], offset),
+                           (long long)hash_fnv_read(keys[0], lengths[0], offset));
+}
+
+HASH_TARGET("avx2")
+HASH_INLINE void hash_fnv_batch_avx2(const uint8_t *const *keys, const size_t *lengths,
+                                     uint64_t *hashes, int alternate) {
+  size_t shortest = lengths[0], longest = lengths[0];
+  for (size_t i = 1; i < HASH_FNV_BATCH_LANES; ++i) {
+    shortest = lengths[i] < shortest ? lengths[i] : shortest;
+    longest = lengths[i] > longest ? lengths[i] : longest;
+  }
+
+  // Four registers' steps are interleaved byte by byte: each register's steps depend on each
+  // other, so only interleaving them keeps the multipliers busy.
+  const __m256i basis = _mm256_set1_epi64x((long long)FNV_offset_basis);
+  __m256i hash0 = basis, hash1 = basis, hash2 = basis, hash3 = basis;
+
+  // Every lane takes whole words until the shortest key ends.
+  size_t offset = 0;
+  for (; offset + 8 <= shortest; offset += 8) {
+    __m256i word0 = hash_fnv_gather_avx2(keys, offset);
+    __m256i word1 = hash_fnv_gather_avx2(keys + 4, offset);
+    __m256i word2 = hash_fnv_gather_avx2(keys + 8, offset);
+    __m256i word3 = hash_fnv_gather_avx2(keys + 12, offset);
+    for (int b = 0; b < 8; ++b) {
+      hash_fnv_byte_avx2(&hash0, &word0, alternate);
+      hash_fnv_byte_avx2(&hash1, &word1, alternate);
+      hash_fnv_byte_avx2(&hash2, &word2, alternate);
+      hash_fnv_byte_avx2(&hash3, &word3, alternate);
+    }
+  }
+
+  const __m256i lengths0 = HASH_LOAD256(lengths), lengths1 = HASH_LOAD256(lengths + 4);
+  const __m256i lengths2 = HASH_LOAD256(lengths + 8), lengths3 = HASH_LOAD256(lengths + 12);
+  for (; offset < longest; offset += 8) {
+    __m256i word0 = hash_fnv_read_avx2(keys, lengths, offset);
+    __m256i word1 = hash_fnv_read_avx2(keys + 4, lengths + 4, offset);
+    __m256i word2 = hash_fnv_read_avx2(keys + 8, lengths + 8, offset);
+    __m256i word3 = hash_fnv_read_avx2(keys + 12, lengths + 12, offset);
+    for (size_t b = 0; b < 8; ++b) {
+      __m256i position = _mm256_set1_epi64x((long long)(offset + b));
+      hash_fnv_tail_byte_avx2(&hash0, &word0, lengths0, position, alternate);
+      hash_fnv_tail_byte_avx2(&hash1, &word1, lengths1, position, alternate);
+      hash_fnv_tail_byte_avx2(&hash2, &word2, lengths2, position, alternate);
+      hash_fnv_tail_byte_avx2(&hash3, &word3, lengths3, position, alternate);
+    }
+  }
+
+  _mm256_storeu_si256((__m256i *)(void *)hashes, hash0);
+  _mm256_storeu_si256((__m256i *)(void *)(hashes + 4), hash1);
+  _mm256_storeu_si256((__m256i *)(void *)(hashes + 8), hash2);
+  _mm256_storeu_si256((__m256i *)(void *)(hashes + 12), hash3);
+}
+
+HASH_TARGET("avx2")
+static void hash_fnv_batch_avx2_fnv1(const uint8_t *const *keys, const size_t *lengths,
+                                     uint64_t *hashes, int alternate) {
+  (void)alternate;
+  hash_fnv_batch_avx2(keys, lengths, hashes, 0);
+}
+
+HASH_TARGET("avx2")
+static void hash_fnv_batch_avx2_fnv1a(const uint8_t *const *keys, const size_t *lengths,
+                                      uint64_t *hashes, int alternate) {
+  (void)alternate;
+  hash_fnv_batch_avx2(keys, lengths, hashes, 1);
+}
+
+// Whether the CPU supports AVX2, plus one, or zero until the first batch checks.
+static int hash_fnv_avx2 = 0;
+
+static int hash_fnv_has_avx2(void) {
+  int supported = __atomic_load_n(&hash_fnv_avx2, __ATOMIC_RELAXED);
+  if (!supported) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx2") ? 2 : 1;
+    __atomic_store_n(&hash_fnv_avx2, supported, __ATOMIC_RELAXED);
+  }
+  return supported - 1;
+}
+
+#endif  // HASH_X86_64
+
+static void hash_fnv_batch(const uint8_t *const *keys, const size_t *lengths, size_t count,
+                           uint64_t *hashes, int alternate) {
+  HashFnvBatchFunc batch = hash_fnv_batch_scalar;
+#ifdef HASH_X86_64
+  if (hash_fnv_has_avx2()) {
+    batch = alternate ? hash_fnv_batch_avx2_fnv1a : hash_fnv_batch_avx2_fnv1;
+  }
+#endif
+
+  size_t i = 0;
+  for (; i + HASH_FNV_BATCH_LANES <= count; i += HASH_FNV_BATCH_LANES) {
+    batch(keys + i, lengths + i, hashes + i, alternate);
+  }
+  for (; i < count; ++i) {
+    hashes[i] = alternate ? hash_fnv1a(keys[i], lengths[i]) : hash_fnv1(keys[i], lengths[i]);
+  }
+}
+
+void hash_fnv1_batch(const uint8_t *const *keys, const size_t *lengths, size_t count,
+                     uint64_t *hashes) {
+  hash_fnv_batch(keys, lengths, count, hashes, 0);
+}
+
+void hash_fnv1a_batch(const uint8_t *const *keys, const size_t *lengths, size_t count,
+                      uint64_t *hashes) {
+  hash_fnv_batch(keys, lengths, count, hashes, 1);
+}
+
+void hash_fnv1_init(struct hash_fnv_state *state) { state->hash = FNV_offset_basis; }
+
+void hash_fnv1_update(struct hash_fnv_state *state, const uint8_t *data, size_t length) {
+  state->hash = hash_fnv1_continue(state->hash, data, length);
+}
+
+uint64_t hash_fnv1_final(const struct hash_fnv_state *state) { return state->hash; }
+
+void hash_fnv1a_init(struct hash_fnv_state *state) { state->hash = FNV_offset_basis; }
+
+void hash_fnv1a_update(struct hash_fnv_state *state, const uint8_t *data, size_t length) {
+  state->hash = hash_fnv1a_continue(state->hash, data, length);
+}
+
+uint64_t hash_fnv1a_final(const struct hash_fnv_state *state) { return state->hash; }
@@ -0,0 +1,391 @@
+#include <pocketknife/hash/fast.h>
+#include <pocketknife/hash/hll.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define HASH_HLL_VERSION 1
+#define HASH_HLL_HEADER 4
+#define HASH_HLL_SPARSE_ENTRY 3
+#define HASH_HLL_MIN_TABLE 16
+
+struct hash_hll {
+  // One byte per register once dense, NULL while sparse.
+  uint8_t *registers;
+
+  // While sparse, an open addressing table of the registers that are set, each entry the
+  // register's index shifted left 8 bits, or'd with its rank, so 0 is an empty slot.
+  uint32_t *table;
+  size_t count;
+  size_t capacity;
+
+  int precision;
+  int avx2;
+};
+
+HASH_INLINE size_t hash_hll_registers(const struct hash_hll *hll) {
+  return (size_t)1 << hll->precision;
+}
+
+// The largest rank, for a hash whose bits below the index are all zero.
+HASH_INLINE uint8_t hash_hll_max_rank(int precision) { return (uint8_t)(65 - precision); }
+
+// A table is only worth having while it is no larger than the registers would be.
+HASH_INLINE int hash_hll_table_fits(const struct hash_hll *hll, size_t capacity) {
+  return capacity * sizeof(uint32_t) <= hash_hll_registers(hll);
+}
+
+struct hash_hll *hash_hll_new(int precision) {
+  if (precision < HASH_HLL_MIN_PRECISION || precision > HASH_HLL_MAX_PRECISION) {
+    return NULL;
+  }
+
+  struct hash_hll *hll = calloc(1, sizeof(struct hash_hll));
+  if (!hll) {
+    return NULL;
+  }
+  hll->precision = precision;
+  if (hash_hll_table_fits(hll, HASH_HLL_MIN_TABLE)) {
+    hll->capacity = HASH_HLL_MIN_TABLE;
+    hll->table = calloc(hll->capacity, sizeof(uint32_t));
+  } else {
+    hll->registers = calloc(hash_hll_registers(hll), 1);
+  }
+  if (!hll->table && !hll->registers) {
+    free(hll);
+    return NULL;
+  }
+
+#ifdef HASH_X86
+  __builtin_cpu_init();
+  hll->avx2 = __builtin_cpu_supports("avx2");
+#else
+  hll->avx2 = 0;
+#endif
+  return hll;
+}
+
+void hash_hll_destroy(struct hash_hll *hll) {
+  free(hll->registers);
+  free(hll->table);
+  free(hll);
+}
+
+// Points at the slot holding a register, or the empty slot where it would go.
+static uint32_t *hash_hll_slot(const struct hash_hll *hll, uint32_t index) {
+  // The index comes from the top bits of a hash, so is already uniform.
+  size_t mask = hll->capacity - 1;
+  for (size_t slot = index & mask;; slot = (slot + 1) & mask) {
+    uint32_t entry = hll->table[slot];
+    if (!entry || entry >> 8 == index) {
+      return &hll->table[slot];
+    }
+  }
+}
+
+// Switches to dense registers. Returns -1, leaving the sketch sparse, if memory runs out.
+static int hash_hll_densify(struct hash_hll *hll) {
+  uint8_t *registers = calloc(hash_hll_registers(hll), 1);
+  if (!registers) {
+    return -1;
+  }
+  for (size_t slot = 0; slot < hll->capacity; ++slot) {
+    uint32_t entry = hll->table[slot];
+    if (entry) {
+      registers[entry >> 8] = (uint8_t)entry;
+    }
+  }
+  free(hll->table);
+  hll->table = NULL;
+  hll->registers = registers;
+  hll->count = hll->capacity = 0;
+  return 1;
+}
+
+// Makes room in a sparse sketch for entries registers at under 3/4 load, growing its table or,
+// once the table would be larger than the registers, switching to them. Returns -1, leaving the
+// sketch as it was, if memory runs out.
+static int hash_hll_reserve(struct hash_hll *hll, size_t entries) {
+  if (hll->registers || entries * 4 <= hll->capacity * 3) {
+    return 1;
+  }
+  size_t capacity = hll->capacity;
+  while (entries * 4 > capacity * 3) {
+    capacity *= 2;
+  }
+  if (!hash_hll_table_fits(hll, capacity)) {
+    return hash_hll_densify(hll);
+  }
+
+  uint32_t *old = hll->table;
+  size_t old_capacity = hll->capacity;
+  hll->table = calloc(capacity, sizeof(uint32_t));
+  if (!hll->table) {
+    hll->table = old;
+    return -1;
+  }
+  hll->capacity = capacity;
+  for (size_t slot = 0; slot < old_capacity; ++slot) {
+    if (old[slot]) {
+      *hash_hll_slot(hll, old[slot] >> 8) = old[slot];
+    }
+  }
+  free(old);
+  return 1;
+}
+
+// Raises a register to rank. Returns 1 if it changed, 0 if not, or -1 if memory ran out.
+static int hash_hll_set(struct hash_hll *hll, uint32_t index, uint8_t rank) {
+  if (hll->registers) {
+    if (hll->registers[index] >= rank) {
+      return 0;
+    }
+    hll->registers[index] = rank;
+    return 1;
+  }
+
+  uint32_t *slot = hash_hll_slot(hll, index);
+  if (*slot) {
+    if ((uint8_t)*slot >= rank) {
+      return 0;
+    }
+    *slot = (index << 8) | rank;
+    return 1;
+  }
+  if ((hll->count + 1) * 4 > hll->capacity * 3) {
+    if (hash_hll_reserve(hll, hll->count + 1) < 0) {
+      return -1;
+    }
+    return hash_hll_set(hll, index, rank);
+  }
+  *slot = (index << 8) | rank;
+  ++hll->count;
+  return 1;
+}
+
+int hash_hll_add_hash(struct hash_hll *hll, uint64_t hash) {
+  uint32_t index = (uint32_t)(hash >> (64 - hll->precision));
+  // The marker bit stops the count at the largest rank when the remaining bits are all zero.
+  uint64_t rest = (hash << hll->precision) | (1ULL << (hll->precision - 1));
+  return hash_hll_set(hll, index, (uint8_t)(__builtin_clzll(rest) + 1));
+}
+
+int hash_hll_add(struct hash_hll *hll, const uint8_t *key, size_t length) {
+  return hash_hll_add_hash(hll, hash_fast64(key, length, 0));
+}
+
+// sigma and tau from Ertl, "New cardinality estimation algorithms for HyperLogLog sketches"
+// (2017), which correct for registers that are still zero and for those at the largest rank.
+static double hash_hll_sigma(double x) {
+  if (x == 1) {
+    return INFINITY;
+  }
+  double y = 1, z = x, previous;
+  do {
+    x *= x;
+    previous = z;
+    z += x * y;
+    y += y;
+  } while (z != previous);
+  return z;
+}
+
+static double hash_hll_tau(double x) {
+  if (x == 0 || x == 1) {
+    return 0;
+  }
+  double y = 1, z = 1 - x, previous;
+  do {
+    x = sqrt(x);
+    previous = z;
+    y *= 0.5;
+    z -= (1 - x) * (1 - x) * y;
+  } while (z != previous);
+  return z / 3;
+}
+
+double hash_hll_estimate(const struct hash_hll *hll) {
+  // How many registers hold each rank.
+  size_t histogram[66] = {0};
+  size_t registers = hash_hll_registers(hll);
+  if (hll->registers) {
+    for (size_t i = 0; i < registers; ++i) {
+      ++histogram[hll->registers[i]];
+    }
+  } else {
+    for (size_t slot = 0; slot < hll->capacity; ++slot) {
+      ++histogram[(uint8_t)hll->table[slot]];
+    }
+    histogram[0] = registers - hll->count;
+  }
+
+  double m = (double)registers;
+  int max_rank = hash_hll_max_rank(hll->precision);
+  double z = m * hash_hll_tau((m - (double)histogram[max_rank]) / m);
+  for (int rank = max_rank - 1; rank >= 1; --rank) {
+    z = 0.5 * (z + (double)histogram[rank]);
+  }
+  z += m * hash_hll_sigma((double)histogram[0] / m);
+  return m * m / (2 * M_LN2 * z);
+}
+
+static void hash_hll_max(uint8_t *dst, const uint8_t *src, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    dst[i] = dst[i] > src[i] ? dst[i] : src[i];
+  }
+}
+
+#ifdef HASH_X86
+
+HASH_TARGET("avx2")
+static void hash_hll_max_avx2(uint8_t *dst, const uint8_t *src, size_t length) {
+  size_t i = 0;
+  for (; i + 128 <= length; i += 128) {
+    __m256i a = _mm256_max_epu8(HASH_LOAD256(dst + i), HASH_LOAD256(src + i));
+    __m256i b = _mm256_max_epu8(HASH_LOAD256(dst + i + 32), HASH_LOAD256(src + i + 32));
+    __m256i c = _mm256_max_epu8(HASH_LOAD256(dst + i + 64), HASH_LOAD256(src + i + 64));
+    __m256i d = _mm256_max_epu8(HASH_LOAD256(dst + i + 96), HASH_LOAD256(src + i + 96));
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i), a);
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i + 32), b);
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i + 64), c);
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i + 96), d);
+  }
+  hash_hll_max(dst + i, src + i, length - i);
+}
+
+#endif
+
+int hash_hll_merge(struct hash_hll *dst, const struct hash_hll *src) {
+  if (dst->precision != src->precision) {
+    return 0;
+  }
+
+  if (src->registers) {
+    if (!dst->registers && hash_hll_densify(dst) < 0) {
+      return -1;
+    }
+#ifdef HASH_X86
+    if (dst->avx2) {
+      hash_hll_max_avx2(dst->registers, src->registers, hash_hll_registers(dst));
+      return 1;
+    }
+#endif
+    hash_hll_max(dst->registers, src->registers, hash_hll_registers(dst));
+    return 1;
+  }
+
+  // Room for every register of src up front, so that setting them can't fail halfway.
+  if (hash_hll_reserve(dst, dst->count + src->count) < 0) {
+    return -1;
+  }
+  for (size_t slot = 0; slot < src->capacity; ++slot) {
+    uint32_t entry = src->table[slot];
+    if (entry) {
+      hash_hll_set(dst, entry >> 8, (uint8_t)entry);
+    }
+  }
+  return 1;
+}
+
+void hash_hll_clear(struct hash_hll *hll) {
+  if (hll->registers) {
+    memset(hll->registers, 0, hash_hll_registers(hll));
+  } else {
+    memset(hll->table, 0, hll->capacity * sizeof(uint32_t));
+    hll->count = 0;
+  }
+}
+
+int hash_hll_precision(const struct hash_hll *hll) { return hll->precision; }
+
+size_t hash_hll_bytes(const struct hash_hll *hll) {
+  return hll->registers ? hash_hll_registers(hll) : hll->capacity * sizeof(uint32_t);
+}
+
+// Serialized, a sketch is a header of a version byte, the precision, and 1 if it is dense, then
+// either its registers or, if sparse, 3 little-endian bytes for each register set, its index
+// shifted left 6 bits or'd with its rank.
+size_t hash_hll_serialize(const struct hash_hll *hll, uint8_t *out, size_t size) {
+  size_t bytes = HASH_HLL_HEADER + (hll->registers ? hash_hll_registers(hll)
+                                                   : hll->count * HASH_HLL_SPARSE_ENTRY);
+  if (size < bytes) {
+    return bytes;
+  }
+
+  out[0] = HASH_HLL_VERSION;
+  out[1] = (uint8_t)hll->precision;
+  out[2] = hll->registers != NULL;
+  out[3] = 0;
+  out += HASH_HLL_HEADER;
+  if (hll->registers) {
+    memcpy(out, hll->registers, hash_hll_registers(hll));
+    return bytes;
+  }
+  for (size_t slot = 0; slot < hll->capacity; ++slot) {
+    uint32_t entry = hll->table[slot];
+    if (entry) {
+      uint32_t packed = ((entry >> 8) << 6) | (uint8_t)entry;
+      out[0] = (uint8_t)packed;
+      out[1] = (uint8_t)(packed >> 8);
+      out[2] = (uint8_t)(packed >> 16);
+      out += HASH_HLL_SPARSE_ENTRY;
+    }
+  }
+  return bytes;
+}
+
+// Reads the registers that follow the header into a new sketch. Returns 0 if they are invalid or
+// memory runs out.
+static int hash_hll_load(struct hash_hll *hll, int dense, const uint8_t *data, size_t size) {
+  uint8_t max_rank = hash_hll_max_rank(hll->precision);
+  size_t registers = hash_hll_registers(hll);
+  if (dense) {
+    if (size != registers || (!hll->registers && hash_hll_densify(hll) < 0)) {
+      return 0;
+    }
+    for (size_t i = 0; i < registers; ++i) {
+      if (data[i] > max_rank) {
+        return 0;
+      }
+    }
+    memcpy(hll->registers, data, registers);
+    return 1;
+  }
+
+  size_t entries = size / HASH_HLL_SPARSE_ENTRY;
+  if (size % HASH_HLL_SPARSE_ENTRY != 0 || entries > registers ||
+      hash_hll_reserve(hll, entries) < 0) {
+    return 0;
+  }
+  for (; size > 0; data += HASH_HLL_SPARSE_ENTRY, size -= HASH_HLL_SPARSE_ENTRY) {
+    uint32_t packed = data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16);
+    uint32_t index = packed >> 6;
+    uint8_t rank = packed & 0x3f;
+    if (index >= registers || rank == 0 || rank > max_rank) {
+      return 0;
+    }
+    // The reservation above leaves room for every entry.
+    hash_hll_set(hll, index, rank);
+  }
+  return 1;
+}
+
+struct hash_hll *hash_hll_deserialize(const uint8_t *data, size_t size) {
+  if (size < HASH_HLL_HEADER || data[0] != HASH_HLL_VERSION || data[2] > 1 || data[3] != 0) {
+    return NULL;
+  }
+  struct hash_hll *hll = hash_hll_new(data[1]);
+  if (!hll) {
+    return NULL;
+  }
+  if (!hash_hll_load(hll, data[2], data + HASH_HLL_HEADER, size - HASH_HLL_HEADER)) {
+    hash_hll_destroy(hll);
+    return NULL;
+  }
+  return hll;
+}
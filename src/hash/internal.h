@@ -0,0 +1,42 @@
+#ifndef _POCKETKNIFE_HASH_INTERNAL_H
+#define _POCKETKNIFE_HASH_INTERNAL_H
+
+#include <stdint.h>
+
+// SIMD loops are compiled for their instruction set with target attributes and picked at runtime,
+// so the library itself can be built for the baseline.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_X86 1
+#define HASH_TARGET(isa) __attribute__((target(isa)))
+#define HASH_LOAD128(p) _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define HASH_LOAD256(p) _mm256_loadu_si256((const __m256i *)(const void *)(p))
+#endif
+
+// Loops that need 64-bit general purpose registers, or that hold pointers and sizes in 64-bit
+// lanes, are only built for x86-64.
+#if defined(__x86_64__)
+#define HASH_X86_64 1
+#endif
+
+// Loops only run fast if their steps are inlined into them, so that their state stays in
+// registers.
+#define HASH_INLINE static inline __attribute__((always_inline))
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 hash_uint128;
+#endif
+
+// Returns the high half of the 128-bit product of a and b. For a uniform a, that is a uniform
+// index below b, without a division.
+HASH_INLINE uint64_t hash_multiply_high(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  return (uint64_t)(((hash_uint128)a * b) >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t middle = (ha * lb) + ((la * lb) >> 32);
+  return (ha * hb) + (middle >> 32) + (((la * hb) + (uint32_t)middle) >> 32);
+#endif
+}
+
+#endif  // _POCKETKNIFE_HASH_INTERNAL_H
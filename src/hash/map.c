@@ -0,0 +1,449 @@
+#include <pocketknife/hash/fast.h>
+#include <pocketknife/hash/map.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Slots per group. Groups are aligned, so a group never wraps around the end of the table.
+#define HASH_MAP_GROUP 16
+
+// Control bytes. Full slots hold the low seven bits of their hash, so only markers are negative.
+#define HASH_MAP_EMPTY ((int8_t)-128)
+#define HASH_MAP_DELETED ((int8_t)-2)
+
+#define HASH_MAP_NONE SIZE_MAX
+
+struct hash_map_slot {
+  uint64_t hash;
+  union {
+    uint64_t integer;
+    char *string;
+  } key;
+  size_t length;
+  void *value;
+};
+
+struct hash_map {
+  struct hash_map_config config;
+
+  // One allocation: capacity control bytes, followed by capacity slots.
+  int8_t *ctrl;
+  struct hash_map_slot *slots;
+
+  // Zero until the first insert, then a power of two no smaller than HASH_MAP_GROUP.
+  size_t capacity;
+  size_t size;
+  size_t deleted;
+};
+
+static void *hash_map_malloc(void *context, size_t size) {
+  (void)context;
+  return malloc(size);
+}
+
+static void hash_map_free(void *context, void *ptr) {
+  (void)context;
+  free(ptr);
+}
+
+static uint64_t hash_map_fast64(const uint8_t *data, size_t length) {
+  return hash_fast64(data, length, 0);
+}
+
+// The most entries a table can hold before it has to grow: 7/8 of its slots, so that every probe
+// sequence reaches an empty slot soon.
+static size_t hash_map_max_load(size_t capacity) { return capacity - (capacity / 8); }
+
+// Bitmasks of the slots in a group whose control byte is equal to value, and of those that are
+// free (empty or deleted).
+static uint32_t hash_map_match(const int8_t *ctrl, int8_t value) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i *)(const void *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HASH_MAP_GROUP; ++i) {
+    mask |= (uint32_t)(ctrl[i] == value) << i;
+  }
+  return mask;
+#endif
+}
+
+static uint32_t hash_map_match_free(const int8_t *ctrl) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i *)(const void *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(group);
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HASH_MAP_GROUP; ++i) {
+    mask |= (uint32_t)(ctrl[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+static int8_t hash_map_h2(uint64_t hash) { return (int8_t)(hash & 0x7f); }
+
+// Groups are probed quadratically (by triangular numbers), which visits every group of a table
+// with a power of two number of them.
+static size_t hash_map_first_group(const struct hash_map *map, uint64_t hash) {
+  return (size_t)(hash >> 7) & ((map->capacity / HASH_MAP_GROUP) - 1);
+}
+
+static size_t hash_map_next_group(const struct hash_map *map, size_t group, size_t step) {
+  return (group + step) & ((map->capacity / HASH_MAP_GROUP) - 1);
+}
+
+static uint64_t hash_map_hash_int(const struct hash_map *map, uint64_t key) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  key = __builtin_bswap64(key);
+#endif
+  uint8_t bytes[8];
+  memcpy(bytes, &key, sizeof(bytes));
+  return map->config.hash(bytes, sizeof(bytes));
+}
+
+static size_t hash_map_find_string(const struct hash_map *map, uint64_t hash, const char *key,
+                                   size_t length) {
+  if (!map->capacity) {
+    return HASH_MAP_NONE;
+  }
+
+  int8_t h2 = hash_map_h2(hash);
+  size_t group = hash_map_first_group(map, hash);
+  for (size_t step = 1;; ++step) {
+    const int8_t *ctrl = map->ctrl + (group * HASH_MAP_GROUP);
+    for (uint32_t match = hash_map_match(ctrl, h2); match; match &= match - 1) {
+      size_t index = (group * HASH_MAP_GROUP) + (size_t)__builtin_ctz(match);
+      const struct hash_map_slot *slot = &map->slots[index];
+      if (slot->hash == hash && slot->length == length &&
+          (!length || memcmp(slot->key.string, key, length) == 0)) {
+        return index;
+      }
+    }
+    if (hash_map_match(ctrl, HASH_MAP_EMPTY)) {
+      return HASH_MAP_NONE;
+    }
+    group = hash_map_next_group(map, group, step);
+  }
+}
+
+static size_t hash_map_find_int(const struct hash_map *map, uint64_t hash, uint64_t key) {
+  if (!map->capacity) {
+    return HASH_MAP_NONE;
+  }
+
+  int8_t h2 = hash_map_h2(hash);
+  size_t group = hash_map_first_group(map, hash);
+  for (size_t step = 1;; ++step) {
+    const int8_t *ctrl = map->ctrl + (group * HASH_MAP_GROUP);
+    for (uint32_t match = hash_map_match(ctrl, h2); match; match &= match - 1) {
+      size_t index = (group * HASH_MAP_GROUP) + (size_t)__builtin_ctz(match);
+      if (map->slots[index].key.integer == key) {
+        return index;
+      }
+    }
+    if (hash_map_match(ctrl, HASH_MAP_EMPTY)) {
+      return HASH_MAP_NONE;
+    }
+    group = hash_map_next_group(map, group, step);
+  }
+}
+
+// Returns the first free slot on the hash's probe sequence. Tables always have one.
+static size_t hash_map_find_free(const struct hash_map *map, uint64_t hash) {
+  size_t group = hash_map_first_group(map, hash);
+  for (size_t step = 1;; ++step) {
+    uint32_t match = hash_map_match_free(map->ctrl + (group * HASH_MAP_GROUP));
+    if (match) {
+      return (group * HASH_MAP_GROUP) + (size_t)__builtin_ctz(match);
+    }
+    group = hash_map_next_group(map, group, step);
+  }
+}
+
+// Moves every entry into a new table of the given capacity, dropping deleted markers. Returns 0,
+// leaving the map as it was, if the table can't be allocated.
+static int hash_map_resize(struct hash_map *map, size_t capacity) {
+  int8_t *ctrl = map->config.alloc(map->config.allocator_context,
+                                   capacity * (1 + sizeof(struct hash_map_slot)));
+  if (!ctrl) {
+    return 0;
+  }
+  memset(ctrl, HASH_MAP_EMPTY, capacity);
+
+  struct hash_map old = *map;
+  map->ctrl = ctrl;
+  map->slots = (struct hash_map_slot *)(void *)(ctrl + capacity);
+  map->capacity = capacity;
+  map->deleted = 0;
+
+  for (size_t i = 0; i < old.capacity; ++i) {
+    if (old.ctrl[i] >= 0) {
+      size_t index = hash_map_find_free(map, old.slots[i].hash);
+      map->ctrl[index] = old.ctrl[i];
+      map->slots[index] = old.slots[i];
+    }
+  }
+
+  if (old.ctrl) {
+    map->config.free(map->config.allocator_context, old.ctrl);
+  }
+  return 1;
+}
+
+// Makes room for more entries once a table is full. Tables that are at least half deleted markers
+// are rebuilt at the same size; otherwise they double.
+static int hash_map_grow(struct hash_map *map) {
+  size_t capacity = map->capacity ? map->capacity : HASH_MAP_GROUP;
+  if (map->size + 1 > hash_map_max_load(capacity) / 2) {
+    capacity *= 2;
+  }
+  return hash_map_resize(map, capacity);
+}
+
+// Claims the first free slot for a new entry. Deleted slots can always be reused, but taking an
+// empty one grows the table first if it is full. Returns HASH_MAP_NONE if the table can't grow.
+static size_t hash_map_claim(struct hash_map *map, uint64_t hash) {
+  size_t index = map->capacity ? hash_map_find_free(map, hash) : HASH_MAP_NONE;
+  if (index == HASH_MAP_NONE || (map->ctrl[index] == HASH_MAP_EMPTY &&
+                                 map->size + map->deleted >= hash_map_max_load(map->capacity))) {
+    if (!hash_map_grow(map)) {
+      return HASH_MAP_NONE;
+    }
+    index = hash_map_find_free(map, hash);
+  }
+
+  if (map->ctrl[index] == HASH_MAP_DELETED) {
+    map->deleted--;
+  }
+  map->ctrl[index] = hash_map_h2(hash);
+  map->slots[index].hash = hash;
+  map->size++;
+  return index;
+}
+
+// Empties a slot. If its group still has an empty slot, no probe ever went past the group, so the
+// slot can be marked empty rather than deleted.
+static void hash_map_release(struct hash_map *map, size_t index) {
+  size_t group = index & ~(size_t)(HASH_MAP_GROUP - 1);
+  if (hash_map_match(map->ctrl + group, HASH_MAP_EMPTY)) {
+    map->ctrl[index] = HASH_MAP_EMPTY;
+  } else {
+    map->ctrl[index] = HASH_MAP_DELETED;
+    map->deleted++;
+  }
+  map->size--;
+}
+
+struct hash_map *hash_map_new(enum HashMapKeys keys) {
+  struct hash_map_config config;
+  memset(&config, 0, sizeof(config));
+  config.keys = keys;
+  return hash_map_new_with_config(&config);
+}
+
+struct hash_map *hash_map_new_with_config(const struct hash_map_config *config) {
+  assert(config != NULL);
+  assert(!config->alloc == !config->free);
+
+  struct hash_map_config defaults = *config;
+  if (!defaults.hash) {
+    defaults.hash = hash_map_fast64;
+  }
+  if (!defaults.alloc) {
+    defaults.alloc = hash_map_malloc;
+    defaults.free = hash_map_free;
+  }
+
+  struct hash_map *map = defaults.alloc(defaults.allocator_context, sizeof(struct hash_map));
+  if (!map) {
+    return NULL;
+  }
+  memset(map, 0, sizeof(struct hash_map));
+  map->config = defaults;
+
+  if (config->capacity) {
+    size_t capacity = HASH_MAP_GROUP;
+    while (hash_map_max_load(capacity) < config->capacity) {
+      capacity *= 2;
+    }
+    if (!hash_map_resize(map, capacity)) {
+      defaults.free(defaults.allocator_context, map);
+      return NULL;
+    }
+  }
+
+  return map;
+}
+
+static void hash_map_free_keys(struct hash_map *map) {
+  if (map->config.keys != HASH_MAP_STRING_KEYS) {
+    return;
+  }
+
+  for (size_t i = 0; i < map->capacity; ++i) {
+    if (map->ctrl[i] >= 0) {
+      map->config.free(map->config.allocator_context, map->slots[i].key.string);
+    }
+  }
+}
+
+void hash_map_destroy(struct hash_map *map) {
+  if (!map) {
+    return;
+  }
+
+  hash_map_free_keys(map);
+  if (map->ctrl) {
+    map->config.free(map->config.allocator_context, map->ctrl);
+  }
+  map->config.free(map->config.allocator_context, map);
+}
+
+size_t hash_map_size(const struct hash_map *map) { return map->size; }
+
+int hash_map_insert(struct hash_map *map, const char *key, size_t length, void *value) {
+  assert(map->config.keys == HASH_MAP_STRING_KEYS);
+
+  uint64_t hash = map->config.hash((const uint8_t *)key, length);
+  size_t index = hash_map_find_string(map, hash, key, length);
+  if (index != HASH_MAP_NONE) {
+    map->slots[index].value = value;
+    return 0;
+  }
+
+  char *copy = map->config.alloc(map->config.allocator_context, length + 1);
+  if (!copy) {
+    return -1;
+  }
+  if (length) {
+    memcpy(copy, key, length);
+  }
+  copy[length] = 0;
+
+  index = hash_map_claim(map, hash);
+  if (index == HASH_MAP_NONE) {
+    map->config.free(map->config.allocator_context, copy);
+    return -1;
+  }
+  map->slots[index].key.string = copy;
+  map->slots[index].length = length;
+  map->slots[index].value = value;
+  return 1;
+}
+
+int hash_map_insert_int(struct hash_map *map, uint64_t key, void *value) {
+  assert(map->config.keys == HASH_MAP_INT_KEYS);
+
+  uint64_t hash = hash_map_hash_int(map, key);
+  size_t index = hash_map_find_int(map, hash, key);
+  if (index != HASH_MAP_NONE) {
+    map->slots[index].value = value;
+    return 0;
+  }
+
+  index = hash_map_claim(map, hash);
+  if (index == HASH_MAP_NONE) {
+    return -1;
+  }
+  map->slots[index].key.integer = key;
+  map->slots[index].length = 0;
+  map->slots[index].value = value;
+  return 1;
+}
+
+void *hash_map_lookup(const struct hash_map *map, const char *key, size_t length) {
+  assert(map->config.keys == HASH_MAP_STRING_KEYS);
+
+  uint64_t hash = map->config.hash((const uint8_t *)key, length);
+  size_t index = hash_map_find_string(map, hash, key, length);
+  return index == HASH_MAP_NONE ? NULL : map->slots[index].value;
+}
+
+void *hash_map_lookup_int(const struct hash_map *map, uint64_t key) {
+  assert(map->config.keys == HASH_MAP_INT_KEYS);
+
+  size_t index = hash_map_find_int(map, hash_map_hash_int(map, key), key);
+  return index == HASH_MAP_NONE ? NULL : map->slots[index].value;
+}
+
+int hash_map_contains(const struct hash_map *map, const char *key, size_t length) {
+  assert(map->config.keys == HASH_MAP_STRING_KEYS);
+
+  uint64_t hash = map->config.hash((const uint8_t *)key, length);
+  return hash_map_find_string(map, hash, key, length) != HASH_MAP_NONE;
+}
+
+int hash_map_contains_int(const struct hash_map *map, uint64_t key) {
+  assert(map->config.keys == HASH_MAP_INT_KEYS);
+
+  return hash_map_find_int(map, hash_map_hash_int(map, key), key) != HASH_MAP_NONE;
+}
+
+int hash_map_erase(struct hash_map *map, const char *key, size_t length) {
+  assert(map->config.keys == HASH_MAP_STRING_KEYS);
+
+  uint64_t hash = map->config.hash((const uint8_t *)key, length);
+  size_t index = hash_map_find_string(map, hash, key, length);
+  if (index == HASH_MAP_NONE) {
+    return 0;
+  }
+
+  map->config.free(map->config.allocator_context, map->slots[index].key.string);
+  hash_map_release(map, index);
+  return 1;
+}
+
+int hash_map_erase_int(struct hash_map *map, uint64_t key) {
+  assert(map->config.keys == HASH_MAP_INT_KEYS);
+
+  size_t index = hash_map_find_int(map, hash_map_hash_int(map, key), key);
+  if (index == HASH_MAP_NONE) {
+    return 0;
+  }
+
+  hash_map_release(map, index);
+  return 1;
+}
+
+void hash_map_clear(struct hash_map *map) {
+  hash_map_free_keys(map);
+  if (map->ctrl) {
+    memset(map->ctrl, HASH_MAP_EMPTY, map->capacity);
+  }
+  map->size = 0;
+  map->deleted = 0;
+}
+
+int hash_map_next(const struct hash_map *map, size_t *position, struct hash_map_entry *entry) {
+  for (size_t i = *position; i < map->capacity; ++i) {
+    if (map->ctrl[i] < 0) {
+      continue;
+    }
+
+    const struct hash_map_slot *slot = &map->slots[i];
+    if (map->config.keys == HASH_MAP_STRING_KEYS) {
+      entry->key = slot->key.string;
+      entry->length = slot->length;
+      entry->int_key = 0;
+    } else {
+      entry->key = NULL;
+      entry->length = 0;
+      entry->int_key = slot->key.integer;
+    }
+    entry->value = slot->value;
+    *position = i + 1;
+    return 1;
+  }
+
+  *position = map->capacity;
+  return 0;
+}
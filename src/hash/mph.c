@@ -0,0 +1,371 @@
+#include <pocketknife/hash/fast.h>
+#include <pocketknife/hash/mph.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define HASH_MPH_MAGIC 0x48504d50u  // "PMPH"
+
+// 60% of keys are hashed to the first 30% of buckets. The uneven sizes make the buckets that are
+// placed first, while the table is still empty, larger, which keeps pilots small overall.
+#define HASH_MPH_DENSE_KEYS 2576980378u  // 0.6 * 2^32
+#define HASH_MPH_DENSE_BUCKETS(buckets) ((buckets) * 3 / 10)
+
+// A build gives up on a seed if a bucket needs a pilot this large, or has two keys whose hashes
+// are equal, and tries the next one.
+#define HASH_MPH_MAX_PILOT (1u << 20)
+#define HASH_MPH_SEEDS 16
+
+struct hash_mph {
+  uint32_t magic;
+  uint32_t pilot_bits;
+  uint64_t seed;
+  uint64_t count;
+  uint64_t slots;
+  uint64_t buckets;
+  uint64_t dense_buckets;
+  uint64_t bytes;
+
+  // Pilots packed pilot_bits apiece, plus a word of padding so that any of them can be read with
+  // one unaligned load; then, for each slot from count on, the index below count it stands for.
+  uint64_t data[];
+};
+
+// A key, as the builder sees it while placing buckets.
+struct hash_mph_key {
+  uint64_t hash;
+  uint32_t bucket;
+  uint32_t index;
+};
+
+static size_t hash_mph_pilot_words(uint64_t buckets, uint32_t pilot_bits) {
+  return (size_t)(((buckets * pilot_bits) + 63) / 64) + 1;
+}
+
+static size_t hash_mph_size(uint64_t count, uint64_t slots, uint64_t buckets, uint32_t bits) {
+  size_t remap = (size_t)(slots - count) * sizeof(uint32_t);
+  return sizeof(struct hash_mph) + (hash_mph_pilot_words(buckets, bits) * sizeof(uint64_t)) +
+         ((remap + 7) & ~(size_t)7);
+}
+
+static uint32_t *hash_mph_remap(const struct hash_mph *mph) {
+  return (uint32_t *)(void *)(mph->data + hash_mph_pilot_words(mph->buckets, mph->pilot_bits));
+}
+
+HASH_INLINE uint64_t hash_mph_bucket(uint64_t hash, uint64_t buckets, uint64_t dense_buckets) {
+  uint64_t low = (uint32_t)hash;
+  if ((uint32_t)(hash >> 32) < HASH_MPH_DENSE_KEYS) {
+    return (low * dense_buckets) >> 32;
+  }
+  return dense_buckets + ((low * (buckets - dense_buckets)) >> 32);
+}
+
+HASH_INLINE uint64_t hash_mph_position(uint64_t hash, uint64_t pilot, uint64_t slots) {
+  uint64_t x = hash ^ (pilot * 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ULL;
+  x ^= x >> 32;
+  return hash_multiply_high(x, slots);
+}
+
+HASH_INLINE uint64_t hash_mph_pilot(const struct hash_mph *mph, uint64_t bucket) {
+  uint64_t bit = bucket * mph->pilot_bits;
+  uint64_t word;
+  memcpy(&word, (const uint8_t *)mph->data + (bit / 8), sizeof(word));
+  return (word >> (bit % 8)) & ((1ULL << mph->pilot_bits) - 1);
+}
+
+static void hash_mph_set_pilot(struct hash_mph *mph, uint64_t bucket, uint64_t pilot) {
+  uint64_t bit = bucket * mph->pilot_bits;
+  uint8_t *p = (uint8_t *)mph->data + (bit / 8);
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  word |= pilot << (bit % 8);
+  memcpy(p, &word, sizeof(word));
+}
+
+size_t hash_mph_lookup(const struct hash_mph *mph, const uint8_t *key, size_t length) {
+  struct hash128 hash = hash_fast128(key, length, mph->seed);
+  uint64_t bucket = hash_mph_bucket(hash.low, mph->buckets, mph->dense_buckets);
+  uint64_t position = hash_mph_position(hash.high, hash_mph_pilot(mph, bucket), mph->slots);
+  if (position < mph->count) {
+    return (size_t)position;
+  }
+  return hash_mph_remap(mph)[position - mph->count];
+}
+
+size_t hash_mph_count(const struct hash_mph *mph) { return (size_t)mph->count; }
+
+size_t hash_mph_bytes(const struct hash_mph *mph) { return (size_t)mph->bytes; }
+
+void hash_mph_destroy(struct hash_mph *mph) { free(mph); }
+
+// Scratch space for a build, sized for its keys.
+struct hash_mph_builder {
+  const uint8_t *const *keys;
+  const size_t *lengths;
+  uint64_t count;
+  uint64_t slots;
+  uint64_t buckets;
+  uint64_t dense_buckets;
+
+  struct hash_mph_key *hashed;
+  struct hash_mph_key *sorted;
+
+  // sorted[starts[b]] to sorted[starts[b + 1]] are the keys in bucket b.
+  uint32_t *starts;
+
+  // Buckets from largest to smallest, their pilots, and the slots taken so far.
+  uint32_t *order;
+  uint32_t *pilots;
+  uint64_t *taken;
+
+  // Positions of the bucket being placed.
+  uint64_t *positions;
+};
+
+static int hash_mph_taken(const uint64_t *taken, uint64_t slot) {
+  return (int)((taken[slot / 64] >> (slot % 64)) & 1);
+}
+
+static void hash_mph_flip(uint64_t *taken, uint64_t slot) {
+  taken[slot / 64] ^= 1ULL << (slot % 64);
+}
+
+// Hashes the keys with seed, groups them by bucket, and orders the buckets by size.
+static void hash_mph_group(struct hash_mph_builder *builder, uint64_t seed) {
+  memset(builder->starts, 0, (size_t)(builder->buckets + 1) * sizeof(uint32_t));
+  for (uint64_t i = 0; i < builder->count; ++i) {
+    struct hash128 hash = hash_fast128(builder->keys[i], builder->lengths[i], seed);
+    struct hash_mph_key *key = &builder->hashed[i];
+    key->hash = hash.high;
+    key->bucket =
+        (uint32_t)hash_mph_bucket(hash.low, builder->buckets, builder->dense_buckets);
+    key->index = (uint32_t)i;
+    ++builder->starts[key->bucket + 1];
+  }
+
+  uint32_t largest = 0;
+  for (uint64_t b = 0; b < builder->buckets; ++b) {
+    largest = builder->starts[b + 1] > largest ? builder->starts[b + 1] : largest;
+    builder->starts[b + 1] += builder->starts[b];
+  }
+
+  // starts[b] is used as bucket b's insertion point, and ends up at the start of bucket b + 1,
+  // so the starts are shifted back afterwards.
+  for (uint64_t i = 0; i < builder->count; ++i) {
+    builder->sorted[builder->starts[builder->hashed[i].bucket]++] = builder->hashed[i];
+  }
+  memmove(builder->starts + 1, builder->starts, (size_t)builder->buckets * sizeof(uint32_t));
+  builder->starts[0] = 0;
+
+  // Counting sort of the buckets by size, largest first.
+  uint32_t *sizes = builder->pilots;
+  memset(sizes, 0, ((size_t)largest + 2) * sizeof(uint32_t));
+  for (uint64_t b = 0; b < builder->buckets; ++b) {
+    ++sizes[largest - (builder->starts[b + 1] - builder->starts[b]) + 1];
+  }
+  for (uint32_t s = 0; s <= largest; ++s) {
+    sizes[s + 1] += sizes[s];
+  }
+  for (uint64_t b = 0; b < builder->buckets; ++b) {
+    builder->order[sizes[largest - (builder->starts[b + 1] - builder->starts[b])]++] =
+        (uint32_t)b;
+  }
+}
+
+// Returns 1 if two keys in a bucket have the same hash, so that no pilot can separate them.
+static int hash_mph_inseparable(const struct hash_mph_key *keys, uint32_t size,
+                                const struct hash_mph_key **first,
+                                const struct hash_mph_key **second) {
+  for (uint32_t i = 0; i < size; ++i) {
+    for (uint32_t j = i + 1; j < size; ++j) {
+      if (keys[i].hash == keys[j].hash) {
+        *first = &keys[i];
+        *second = &keys[j];
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Finds the smallest pilot that puts every key of a bucket in a free slot, and takes the slots.
+// Returns 0 if there is none small enough.
+static int hash_mph_place(struct hash_mph_builder *builder, uint32_t bucket) {
+  const struct hash_mph_key *keys = builder->sorted + builder->starts[bucket];
+  uint32_t size = builder->starts[bucket + 1] - builder->starts[bucket];
+  for (uint32_t pilot = 0; pilot < HASH_MPH_MAX_PILOT; ++pilot) {
+    uint32_t placed = 0;
+    for (; placed < size; ++placed) {
+      uint64_t slot = hash_mph_position(keys[placed].hash, pilot, builder->slots);
+      if (hash_mph_taken(builder->taken, slot)) {
+        break;
+      }
+      hash_mph_flip(builder->taken, slot);
+      builder->positions[placed] = slot;
+    }
+    if (placed == size) {
+      builder->pilots[bucket] = pilot;
+      return 1;
+    }
+    for (uint32_t i = 0; i < placed; ++i) {
+      hash_mph_flip(builder->taken, builder->positions[i]);
+    }
+  }
+  return 0;
+}
+
+// Places every bucket with the given seed. Returns 1 on success, 0 if the seed didn't work out,
+// or -1 if the keys include duplicates.
+static int hash_mph_try(struct hash_mph_builder *builder, uint64_t seed) {
+  hash_mph_group(builder, seed);
+  memset(builder->pilots, 0, (size_t)builder->buckets * sizeof(uint32_t));
+  memset(builder->taken, 0, (size_t)((builder->slots + 63) / 64) * sizeof(uint64_t));
+
+  for (uint64_t i = 0; i < builder->buckets; ++i) {
+    uint32_t bucket = builder->order[i];
+    uint32_t size = builder->starts[bucket + 1] - builder->starts[bucket];
+    if (size == 0) {
+      break;
+    }
+
+    const struct hash_mph_key *first, *second;
+    if (hash_mph_inseparable(builder->sorted + builder->starts[bucket], size, &first, &second)) {
+      size_t length = builder->lengths[first->index];
+      if (length == builder->lengths[second->index] &&
+          (length == 0 ||
+           memcmp(builder->keys[first->index], builder->keys[second->index], length) == 0)) {
+        return -1;
+      }
+      return 0;
+    }
+    if (!hash_mph_place(builder, bucket)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static struct hash_mph *hash_mph_finish(const struct hash_mph_builder *builder, uint64_t seed) {
+  uint32_t largest = 0;
+  for (uint64_t b = 0; b < builder->buckets; ++b) {
+    largest = builder->pilots[b] > largest ? builder->pilots[b] : largest;
+  }
+  uint32_t bits = 0;
+  while (bits < 32 && (largest >> bits) != 0) {
+    ++bits;
+  }
+
+  size_t bytes = hash_mph_size(builder->count, builder->slots, builder->buckets, bits);
+  struct hash_mph *mph = calloc(1, bytes);
+  if (!mph) {
+    return NULL;
+  }
+  mph->magic = HASH_MPH_MAGIC;
+  mph->pilot_bits = bits;
+  mph->seed = seed;
+  mph->count = builder->count;
+  mph->slots = builder->slots;
+  mph->buckets = builder->buckets;
+  mph->dense_buckets = builder->dense_buckets;
+  mph->bytes = bytes;
+  for (uint64_t b = 0; b < builder->buckets; ++b) {
+    hash_mph_set_pilot(mph, b, builder->pilots[b]);
+  }
+
+  // Sends each taken slot from count on to a free one below count. There are as many of each.
+  uint32_t *remap = hash_mph_remap(mph);
+  uint64_t free_slot = 0;
+  for (uint64_t slot = builder->count; slot < builder->slots; ++slot) {
+    if (!hash_mph_taken(builder->taken, slot)) {
+      continue;
+    }
+    while (hash_mph_taken(builder->taken, free_slot)) {
+      ++free_slot;
+    }
+    remap[slot - builder->count] = (uint32_t)free_slot++;
+  }
+  return mph;
+}
+
+struct hash_mph *hash_mph_build(const uint8_t *const *keys, const size_t *lengths, size_t count) {
+  if ((uint64_t)count > UINT32_MAX) {
+    return NULL;
+  }
+
+  // About 5n / log2(n) buckets, and 3% more slots than keys, with at least one to spare so that
+  // lookups on an empty set have somewhere to go.
+  uint64_t log2 = 1;
+  while (((uint64_t)count >> (log2 + 1)) != 0) {
+    ++log2;
+  }
+  struct hash_mph_builder builder = {
+      .keys = keys,
+      .lengths = lengths,
+      .count = count,
+      .slots = count + (count / 32) + 1,
+      .buckets = (((uint64_t)count * 5) + log2 - 1) / log2,
+  };
+  if (builder.buckets == 0) {
+    builder.buckets = 1;
+  }
+  builder.dense_buckets = HASH_MPH_DENSE_BUCKETS(builder.buckets);
+
+  builder.hashed = malloc((count + 1) * sizeof(struct hash_mph_key));
+  builder.sorted = malloc((count + 1) * sizeof(struct hash_mph_key));
+  builder.starts = malloc((size_t)(builder.buckets + 1) * sizeof(uint32_t));
+  builder.order = malloc((size_t)builder.buckets * sizeof(uint32_t));
+  builder.pilots = malloc(((size_t)builder.buckets + count + 2) * sizeof(uint32_t));
+  builder.taken = malloc((size_t)((builder.slots + 63) / 64) * sizeof(uint64_t));
+  builder.positions = malloc((count + 1) * sizeof(uint64_t));
+
+  struct hash_mph *mph = NULL;
+  if (builder.hashed && builder.sorted && builder.starts && builder.order && builder.pilots &&
+      builder.taken && builder.positions) {
+    for (uint64_t seed = 0; seed < HASH_MPH_SEEDS; ++seed) {
+      int result = hash_mph_try(&builder, seed);
+      if (result > 0) {
+        mph = hash_mph_finish(&builder, seed);
+      }
+      if (result != 0) {
+        break;
+      }
+    }
+  }
+
+  free(builder.hashed);
+  free(builder.sorted);
+  free(builder.starts);
+  free(builder.order);
+  free(builder.pilots);
+  free(builder.taken);
+  free(builder.positions);
+  return mph;
+}
+
+const struct hash_mph *hash_mph_view(const void *data, size_t size) {
+  const struct hash_mph *mph = data;
+  if ((uintptr_t)data % 8 != 0 || size < sizeof(struct hash_mph) ||
+      mph->magic != HASH_MPH_MAGIC || mph->bytes != size || mph->pilot_bits > 32 ||
+      mph->count > UINT32_MAX || mph->slots <= mph->count || mph->slots > 2 * mph->count + 1 ||
+      mph->buckets == 0 || mph->buckets > 8 * mph->count + 1 ||
+      mph->dense_buckets != HASH_MPH_DENSE_BUCKETS(mph->buckets) ||
+      hash_mph_size(mph->count, mph->slots, mph->buckets, mph->pilot_bits) != size) {
+    return NULL;
+  }
+
+  // Every index must be in range, even for keys that aren't in the set.
+  const uint32_t *remap = hash_mph_remap(mph);
+  uint64_t limit = mph->count ? mph->count : 1;
+  for (uint64_t i = 0; i < mph->slots - mph->count; ++i) {
+    if (remap[i] >= limit) {
+      return NULL;
+    }
+  }
+  return mph;
+}
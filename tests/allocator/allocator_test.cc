@@ -98,3 +98,136 @@ TEST(AllocatorTest, AllocateLargeAllocation) {
   allocator_destroy(alloc);
   free_region_for_test(region);
 }
+
+TEST(AllocatorTest, LargeAllocationSpansPages) {
+  void *region = region_for_test();
+  struct allocator *alloc = allocator_new_with_region(region, TEST_REGION_SIZE);
+  ASSERT_NE(alloc, nullptr);
+
+  char *ptr = (char *)allocator_alloc(alloc, 4096 * 3);
+  ASSERT_NE(ptr, nullptr);
+  memset(ptr, 0xAB, 4096 * 3);
+
+  // The next allocation must not overlap the first one.
+  char *ptr2 = (char *)allocator_alloc(alloc, 4096);
+  ASSERT_NE(ptr2, nullptr);
+  ASSERT_TRUE(ptr2 >= ptr + (4096 * 3) || ptr2 + 4096 <= ptr);
+
+  allocator_free(alloc, ptr);
+  ASSERT_EQ(allocator_alloc(alloc, 4096 * 3), ptr);
+
+  allocator_destroy(alloc);
+  free_region_for_test(region);
+}
+
+TEST(AllocatorTest, FreedPagesAreReused) {
+  void *region = region_for_test();
+  struct allocator *alloc = allocator_new_with_region(region, TEST_REGION_SIZE);
+  ASSERT_NE(alloc, nullptr);
+
+  // Far more memory in total than the region holds.
+  for (int i = 0; i < 1024; ++i) {
+    void *ptr = allocator_alloc(alloc, 4096 * 4);
+    ASSERT_NE(ptr, nullptr);
+    allocator_free(alloc, ptr);
+  }
+
+  allocator_destroy(alloc);
+  free_region_for_test(region);
+}
+
+TEST(AllocatorTest, SizesRoundUpToSizeClass) {
+  void *region = region_for_test();
+  struct allocator *alloc = allocator_new_with_region(region, TEST_REGION_SIZE);
+  ASSERT_NE(alloc, nullptr);
+
+  char *ptr = (char *)allocator_alloc(alloc, 17);
+  char *ptr2 = (char *)allocator_alloc(alloc, 17);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_NE(ptr2, nullptr);
+  ASSERT_GE(ptr2 > ptr ? ptr2 - ptr : ptr - ptr2, 32);
+
+  allocator_free(alloc, ptr);
+  allocator_free(alloc, ptr2);
+
+  allocator_destroy(alloc);
+  free_region_for_test(region);
+}
+
+static void record_move(void *old_ptr, void *new_ptr) {
+  (void)old_ptr;
+  // Each block records its own original address, so the move can be checked.
+  ASSERT_EQ(*(void **)new_ptr, old_ptr);
+  *(void **)new_ptr = new_ptr;
+}
+
+TEST(AllocatorTest, CompactReleasesSparsePages) {
+  void *region = region_for_test();
+  struct allocator *alloc = allocator_new_with_region(region, TEST_REGION_SIZE);
+  ASSERT_NE(alloc, nullptr);
+
+  // Four pages of 64-byte blocks, then free all but every eighth block.
+  const int count = 4 * (4096 / 64);
+  void *ptrs[count];
+  for (int i = 0; i < count; ++i) {
+    ptrs[i] = allocator_alloc(alloc, 64);
+    ASSERT_NE(ptrs[i], nullptr);
+    *(void **)ptrs[i] = ptrs[i];
+  }
+
+  ASSERT_EQ(allocator_should_compact(alloc), 0);
+
+  for (int i = 0; i < count; ++i) {
+    if (i % 8 != 0) {
+      allocator_free(alloc, ptrs[i]);
+    }
+  }
+
+  ASSERT_EQ(allocator_should_compact(alloc), 1);
+  allocator_compact(alloc, record_move);
+  ASSERT_EQ(allocator_should_compact(alloc), 0);
+
+  allocator_destroy(alloc);
+  free_region_for_test(region);
+}
+
+static int refuse_move(void *context, void *old_ptr, void *new_ptr) {
+  (void)old_ptr;
+  (void)new_ptr;
+  (*(int *)context)++;
+  return 0;
+}
+
+TEST(AllocatorTest, CompactMovesCanBeRefused) {
+  void *region = region_for_test();
+  struct allocator *alloc = allocator_new_with_region(region, TEST_REGION_SIZE);
+  ASSERT_NE(alloc, nullptr);
+
+  const int count = 4 * (4096 / 64);
+  void *ptrs[count];
+  for (int i = 0; i < count; ++i) {
+    ptrs[i] = allocator_alloc(alloc, 64);
+    ASSERT_NE(ptrs[i], nullptr);
+    memset(ptrs[i], i, 64);
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (i % 8 != 0) {
+      allocator_free(alloc, ptrs[i]);
+    }
+  }
+
+  // Every page refuses its first move, so nothing can be released.
+  int refused = 0;
+  allocator_compact_with_context(alloc, refuse_move, &refused);
+  ASSERT_GT(refused, 0);
+  ASSERT_EQ(allocator_should_compact(alloc), 1);
+
+  for (int i = 0; i < count; i += 8) {
+    ASSERT_EQ(((unsigned char *)ptrs[i])[63], (unsigned char)i);
+    allocator_free(alloc, ptrs[i]);
+  }
+
+  allocator_destroy(alloc);
+  free_region_for_test(region);
+}
@@ -1,7 +1,20 @@
+#include <pocketknife/allocator/allocator.h>
 #include <pocketknife/gc/gc.h>
 
 #include <gtest/gtest.h>
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
 struct gc_object {
   int value;
   struct gc_slot *child;
@@ -19,6 +32,14 @@ static struct gc_config gc_config = {
     .large_threshold = 1024,  // 1K
 };
 
+static void *gc_test_old_alloc(size_t size) {
+  return malloc(size);
+}
+
+static void gc_test_old_free(void *ptr) {
+  free(ptr);
+}
+
 static struct gc *gc_create_for_test() {
   return gc_create_with_config(&gc_config);
 }
@@ -196,9 +217,11 @@ TEST(GCTest, YoungSpacePromotion) {
   obj = (struct gc_object *)old_space_ptr;
   gc_unlock_slot(slot);
 
-  // Make sure the object actually moved & retained the value
-  ASSERT_NE(young_space_ptr, old_space_ptr);
+  // Both spaces share an allocator, so the object was promoted without being copied
+  ASSERT_EQ(young_space_ptr, old_space_ptr);
   ASSERT_EQ(obj->value, 42);
+  ASSERT_EQ(stats.total_promoted, sizeof(struct gc_object));
+  ASSERT_EQ(stats.total_copied, 0);
 
   gc_run(gc, &stats);
   ASSERT_EQ(stats.total_collected, 1);
@@ -307,3 +330,1791 @@ TEST(GCTest, AllocAndFreeLargeSpace) {
 
   gc_destroy(gc);
 }
+
+TEST(GCTest, WriteBarrierKeepsYoungChildAlive) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *parent =
+      gc_alloc_with_space(gc, sizeof(struct gc_object), gc_object_marker, NULL, GC_SPACE_OLD);
+  ASSERT_TRUE(parent != NULL);
+  gc_root(gc, parent);
+
+  struct gc_slot *child = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(child != NULL);
+  ASSERT_EQ(gc_get_space(child), GC_SPACE_YOUNG);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(parent);
+  obj->child = child;
+  gc_unlock_slot(parent);
+  gc_write_barrier(gc, parent, child);
+
+  obj = (struct gc_object *)gc_lock_slot(child);
+  obj->child = NULL;
+  gc_unlock_slot(child);
+
+  // The old space isn't due for a sweep, so these are all minor cycles.
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+  ASSERT_EQ(stats.total_objects, 2);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+  ASSERT_EQ(stats.total_objects, 2);
+
+  // Dropping the reference lets the next minor cycle collect the child.
+  obj = (struct gc_object *)gc_lock_slot(parent);
+  obj->child = NULL;
+  gc_unlock_slot(parent);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 1);
+  ASSERT_EQ(stats.total_objects, 1);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, MinorCycleDoesNotTraceOldSpace) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  // Unreachable, but the old space isn't due for a sweep.
+  struct gc_slot *old =
+      gc_alloc_with_space(gc, sizeof(struct gc_object), gc_object_marker, NULL, GC_SPACE_OLD);
+  ASSERT_TRUE(old != NULL);
+
+  struct gc_slot *young = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(young != NULL);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(young);
+  obj->child = old;
+  gc_unlock_slot(young);
+  gc_root(gc, young);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+  ASSERT_EQ(stats.total_objects, 2);
+
+  // Only the young root was marked; the old object it references was not traced.
+  ASSERT_EQ(stats.total_marked, 1);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, PromotedParentKeepsYoungChildAlive) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *parent = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(parent != NULL);
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(parent);
+  obj->child = NULL;
+  gc_unlock_slot(parent);
+  gc_root(gc, parent);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  gc_run(gc, &stats);
+
+  // Both objects are young here, so no barrier is needed for the store.
+  struct gc_slot *child = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(child != NULL);
+  obj = (struct gc_object *)gc_lock_slot(child);
+  obj->child = NULL;
+  gc_unlock_slot(child);
+
+  obj = (struct gc_object *)gc_lock_slot(parent);
+  obj->child = child;
+  gc_unlock_slot(parent);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(gc_get_space(parent), GC_SPACE_OLD);
+  ASSERT_EQ(gc_get_space(child), GC_SPACE_YOUNG);
+
+  // The parent was promoted ahead of its child; minor cycles must still find the child.
+  for (int i = 0; i < 5; ++i) {
+    gc_run(gc, &stats);
+    ASSERT_EQ(stats.total_collected, 0);
+    ASSERT_EQ(stats.total_objects, 2);
+  }
+
+  ASSERT_EQ(gc_get_space(child), GC_SPACE_OLD);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, RootMultipleTimes) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *slot = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(slot != NULL);
+
+  gc_root(gc, slot);
+  gc_root(gc, slot);
+
+  struct gc_stats stats;
+  ASSERT_EQ(gc_unroot(gc, slot), 1);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+
+  ASSERT_EQ(gc_unroot(gc, slot), 1);
+  ASSERT_EQ(gc_unroot(gc, slot), 0);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 1);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, UnrootOutOfOrder) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *slots[16];
+  for (int i = 0; i < 16; ++i) {
+    slots[i] = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+    ASSERT_TRUE(slots[i] != NULL);
+    gc_root(gc, slots[i]);
+  }
+
+  // Unroot every other slot, starting from the middle of the table
+  for (int i = 0; i < 16; i += 2) {
+    ASSERT_EQ(gc_unroot(gc, slots[(i + 8) % 16]), 1);
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 8);
+  ASSERT_EQ(stats.total_objects, 8);
+
+  for (int i = 1; i < 16; i += 2) {
+    ASSERT_EQ(gc_unroot(gc, slots[i]), 1);
+  }
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 8);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, HandleScopes) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_stats stats;
+
+  size_t outer = gc_push_handle_scope(gc);
+  ASSERT_TRUE(gc_scope_root(gc, gc_alloc(gc, sizeof(struct gc_object), NULL, NULL)) != NULL);
+
+  size_t inner = gc_push_handle_scope(gc);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(gc_scope_root(gc, gc_alloc(gc, sizeof(struct gc_object), NULL, NULL)) != NULL);
+  }
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+  ASSERT_EQ(stats.total_objects, 5);
+
+  gc_pop_handle_scope(gc, inner);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 4);
+  ASSERT_EQ(stats.total_objects, 1);
+
+  gc_pop_handle_scope(gc, outer);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 1);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, MaxSizeTriggersCollection) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config young_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_YOUNG, &young_space_config);
+
+  struct gc_slot *root = gc_alloc(gc, 128, NULL, NULL);
+  ASSERT_TRUE(root != NULL);
+  gc_root(gc, root);
+
+  // Never calls gc_run; the allocations themselves must keep the space under its maximum.
+  struct gc_stats stats;
+  for (int i = 0; i < 64; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, 128, NULL, NULL) != NULL);
+
+    // The root gets promoted along the way, so it no longer counts against the young space.
+    gc_get_stats(gc, &stats);
+    ASSERT_LE(stats.total_allocated, 1024 + 128);
+  }
+
+  ASSERT_EQ(gc_get_space(root), GC_SPACE_OLD);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, AutoCollectFromAllocationDebt) {
+  struct gc_config config = gc_config;
+  config.auto_collect = 1;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  // Starts the young space with a 512K trigger, well below its maximum size.
+  struct gc_space_config young_space_config = {
+      .sweep_every = 1,
+      .max_size = 4 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_YOUNG, &young_space_config);
+
+  struct gc_slot *root = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(root != NULL);
+  gc_root(gc, root);
+
+  // Allocate well past the trigger without ever calling gc_run.
+  struct gc_stats stats;
+  for (int i = 0; i < 4096; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, 512, NULL, NULL) != NULL);
+  }
+
+  gc_get_stats(gc, &stats);
+  ASSERT_LT(stats.total_objects, 4096);
+  ASSERT_LT(stats.total_allocated, 4096 * 512);
+
+  // The root survived every automatic cycle.
+  ASSERT_TRUE(gc_lock_slot(root) != NULL);
+  gc_unlock_slot(root);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, SweepAcrossSlotPages) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  // Enough objects to span several slot pages
+  const int count = 2000;
+  struct gc_slot *slots[count];
+  for (int i = 0; i < count; ++i) {
+    slots[i] = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+    ASSERT_TRUE(slots[i] != NULL);
+    if (i % 3 == 0) {
+      gc_root(gc, slots[i]);
+    }
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count - 667);
+  ASSERT_EQ(stats.total_objects, 667);
+
+  // Freed slots are reused and the survivors are untouched
+  for (int i = 0; i < count; ++i) {
+    if (i % 3 != 0) {
+      slots[i] = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+      ASSERT_TRUE(slots[i] != NULL);
+    }
+  }
+
+  for (int i = 0; i < count; i += 3) {
+    ASSERT_EQ(gc_unroot(gc, slots[i]), 1);
+  }
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, YoungSpacePromotionCopiesAcrossAllocators) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+      .alloc = gc_test_old_alloc,
+      .free = gc_test_old_free,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  struct gc_slot *slot = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(slot != NULL);
+  gc_root(gc, slot);
+
+  void *young_space_ptr = gc_lock_slot(slot);
+  ((struct gc_object *)young_space_ptr)->value = 42;
+  gc_unlock_slot(slot);
+
+  struct gc_stats stats;
+  for (int i = 0; i < 3; ++i) {
+    gc_run(gc, &stats);
+  }
+  ASSERT_EQ(gc_get_space(slot), GC_SPACE_OLD);
+  ASSERT_EQ(stats.total_promoted, sizeof(struct gc_object));
+  ASSERT_EQ(stats.total_copied, sizeof(struct gc_object));
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+  ASSERT_NE((void *)obj, young_space_ptr);
+  ASSERT_EQ(obj->value, 42);
+  gc_unlock_slot(slot);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, SurvivorSpaceAging) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  // young -(1 sweep)-> CUSTOM1 -(2 sweeps)-> old
+  struct gc_space_config young_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+      .tenure_after = 1,
+      .tenure_space = GC_SPACE_CUSTOM1,
+  };
+  gc_configure_space(gc, GC_SPACE_YOUNG, &young_space_config);
+
+  struct gc_space_config survivor_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+      .tenure_after = 2,
+      .tenure_space = GC_SPACE_OLD,
+  };
+  gc_configure_space(gc, GC_SPACE_CUSTOM1, &survivor_space_config);
+
+  struct gc_slot *slot = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(slot != NULL);
+  gc_root(gc, slot);
+
+  enum GCSpace expected[] = {GC_SPACE_YOUNG,   GC_SPACE_CUSTOM1, GC_SPACE_CUSTOM1,
+                             GC_SPACE_CUSTOM1, GC_SPACE_OLD,     GC_SPACE_OLD};
+  struct gc_stats stats;
+  for (enum GCSpace space : expected) {
+    gc_run(gc, &stats);
+    ASSERT_EQ(gc_get_space(slot), space);
+    ASSERT_EQ(stats.total_objects, 1);
+    ASSERT_EQ(stats.total_copied, 0);
+  }
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, CompactOldSpace) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 16 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  // Every fourth object is a root that keeps the object after it alive.
+  const int count = 64;
+  struct gc_slot *slots[count];
+  for (int i = 0; i < count; ++i) {
+    slots[i] = gc_alloc_with_space(gc, sizeof(struct gc_object), gc_object_marker, NULL,
+                                   GC_SPACE_OLD);
+    ASSERT_TRUE(slots[i] != NULL);
+
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+    obj->value = i;
+    obj->child = NULL;
+    gc_unlock_slot(slots[i]);
+
+    if (i % 4 == 0) {
+      gc_root(gc, slots[i]);
+    } else if (i % 4 == 1) {
+      obj = (struct gc_object *)gc_lock_slot(slots[i - 1]);
+      obj->child = slots[i];
+      gc_unlock_slot(slots[i - 1]);
+    }
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count / 2);
+
+  // Checks that the pairs starting every `step` objects are intact and packed back to back.
+  auto check_dense = [&](int step) {
+    char *first = NULL;
+    ptrdiff_t stride = 0;
+    int n = 0;
+    for (int i = 0; i < count; i += step) {
+      for (int j = i; j < i + 2; ++j, ++n) {
+        char *ptr = (char *)gc_lock_slot(slots[j]);
+        struct gc_object *obj = (struct gc_object *)ptr;
+        ASSERT_EQ(obj->value, j);
+        ASSERT_EQ(obj->child, j == i ? slots[i + 1] : NULL);
+        gc_unlock_slot(slots[j]);
+
+        if (n == 0) {
+          first = ptr;
+        } else if (n == 1) {
+          stride = ptr - first;
+          ASSERT_GT(stride, 0);
+        } else {
+          ASSERT_EQ(ptr - first, stride * n);
+        }
+      }
+    }
+  };
+
+  // Survivors all have their own allocations, so they are all moved into a region.
+  ASSERT_EQ(gc_compact(gc), (count / 2) * sizeof(struct gc_object));
+  check_dense(4);
+
+  // Drop half of the remaining objects, and slide the rest down into the holes. The first pair
+  // stays where it is.
+  for (int i = 4; i < count; i += 8) {
+    ASSERT_EQ(gc_unroot(gc, slots[i]), 1);
+  }
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count / 4);
+  ASSERT_EQ(gc_compact(gc), (count / 4 - 2) * sizeof(struct gc_object));
+  check_dense(8);
+
+  // Nothing left to compact.
+  ASSERT_EQ(gc_compact(gc), 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, CompactionSkipsLockedObjects) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  const int count = 8;
+  struct gc_slot *slots[count];
+  for (int i = 0; i < count; ++i) {
+    slots[i] = gc_alloc_with_space(gc, sizeof(struct gc_object), NULL, NULL, GC_SPACE_OLD);
+    ASSERT_TRUE(slots[i] != NULL);
+    gc_root(gc, slots[i]);
+
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+    obj->value = i;
+    gc_unlock_slot(slots[i]);
+  }
+
+  ASSERT_EQ(gc_compact(gc), count * sizeof(struct gc_object));
+
+  gc_unroot(gc, slots[2]);
+  struct gc_stats stats;
+  while (gc_run(gc, &stats), stats.total_collected == 0) {
+  }
+  ASSERT_EQ(stats.total_objects, count - 1);
+
+  // 3 and 4 slide down into the hole left by 2, 6 fits in front of the locked 5, and 7 follows 5.
+  void *locked = gc_lock_slot(slots[5]);
+  ASSERT_EQ(gc_compact(gc), 4 * sizeof(struct gc_object));
+  gc_unlock_slot(slots[5]);
+  ASSERT_EQ(gc_lock_slot(slots[5]), locked);
+  gc_unlock_slot(slots[5]);
+
+  for (int i = 0; i < count; ++i) {
+    if (i != 2) {
+      struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+      ASSERT_EQ(obj->value, i);
+      gc_unlock_slot(slots[i]);
+    }
+  }
+
+  // The gap in front of 5 was filled, so there's nothing left to compact once it's unlocked.
+  ASSERT_EQ(gc_compact(gc), 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, AutoCompactFragmentedOldSpace) {
+  struct gc_config config = gc_config;
+  config.compact_fragmentation = 50;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 16 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  const int count = 2048;
+  const size_t size = 64;
+  struct gc_slot *slots[count];
+  for (int i = 0; i < count; ++i) {
+    slots[i] = gc_alloc_with_space(gc, size, NULL, NULL, GC_SPACE_OLD);
+    ASSERT_TRUE(slots[i] != NULL);
+    gc_root(gc, slots[i]);
+  }
+
+  // Objects that have never been compacted aren't fragmentation.
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_compacted, 0);
+
+  // A small number of holes isn't worth compacting.
+  gc_unroot(gc, slots[0]);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 1);
+  ASSERT_EQ(stats.total_compacted, 0);
+
+  for (int i = 1; i < count; ++i) {
+    if (i % 4 != 0) {
+      gc_unroot(gc, slots[i]);
+    }
+  }
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, count / 4 - 1);
+  ASSERT_EQ(stats.total_compacted, (count / 4 - 1) * size);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, AutoCompactLeavesHeapWithoutGarbage) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  config.compact_fragmentation = 50;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 16 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  // The old space keeps growing but nothing is ever freed, so nothing should ever be moved.
+  std::vector<struct gc_slot *> slots;
+  struct gc_stats stats;
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 2048; ++i) {
+      slots.push_back(gc_alloc_with_space(gc, 256, NULL, NULL, GC_SPACE_OLD));
+      ASSERT_TRUE(slots.back() != NULL);
+      gc_root(gc, slots.back());
+    }
+    for (int cycle = 0; cycle < 10; ++cycle) {
+      gc_run(gc, &stats);
+      ASSERT_EQ(stats.total_compacted, 0) << round << " " << cycle;
+    }
+  }
+  ASSERT_EQ(stats.total_objects, slots.size());
+
+  for (struct gc_slot *slot : slots) {
+    gc_unroot(gc, slot);
+  }
+  gc_destroy(gc);
+}
+
+static void gc_record_cycle(struct gc *gc, const struct gc_cycle_info *info, void *context) {
+  (void)gc;
+  static_cast<std::vector<struct gc_cycle_info> *>(context)->push_back(*info);
+}
+
+TEST(GCTest, CycleEvents) {
+  std::vector<struct gc_cycle_info> cycles;
+
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  config.on_cycle = gc_record_cycle;
+  config.event_context = &cycles;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *root = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(root != NULL);
+  gc_root(gc, root);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, NULL) != NULL);
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    gc_run(gc, NULL);
+  }
+  ASSERT_EQ(cycles.size(), 3);
+
+  // First cycle: a quarter of the young space survives.
+  const struct gc_cycle_info &first = cycles[0];
+  ASSERT_EQ(first.cycle, 1);
+  ASSERT_TRUE(first.minor);
+  ASSERT_EQ(first.swept_spaces, 1u << GC_SPACE_YOUNG);
+  ASSERT_EQ(first.swept_bytes[GC_SPACE_YOUNG], 4 * sizeof(struct gc_object));
+  ASSERT_EQ(first.survived_bytes[GC_SPACE_YOUNG], sizeof(struct gc_object));
+  ASSERT_EQ(first.bytes_freed, 3 * sizeof(struct gc_object));
+  ASSERT_EQ(first.bytes_promoted, 0);
+
+  uint64_t phases = 0;
+  for (int i = 0; i < GC_PHASE_COUNT; ++i) {
+    phases += first.phase_ns[i];
+  }
+  ASSERT_EQ(phases, first.pause_ns);
+
+  // The root is promoted once it has survived young_max_cycles sweeps.
+  ASSERT_EQ(cycles[2].cycle, 3);
+  ASSERT_EQ(cycles[2].bytes_freed, 0);
+  ASSERT_EQ(cycles[2].bytes_promoted, sizeof(struct gc_object));
+
+  gc_unroot(gc, root);
+  gc_destroy(gc);
+}
+
+TEST(GCTest, PauseStats) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_pause_stats stats;
+  gc_get_pause_stats(gc, &stats);
+  ASSERT_EQ(stats.cycles, 0);
+  ASSERT_EQ(stats.max_ns, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, NULL) != NULL);
+    gc_run(gc, NULL);
+  }
+
+  gc_get_pause_stats(gc, &stats);
+  ASSERT_EQ(stats.cycles, 100);
+  ASSERT_LE(stats.p50_ns, stats.p99_ns);
+  ASSERT_LE(stats.p99_ns, stats.max_ns);
+  ASSERT_LE(stats.max_ns, stats.total_ns);
+  ASSERT_GT(stats.max_ns, 0);
+
+  gc_reset_pause_stats(gc);
+  gc_get_pause_stats(gc, &stats);
+  ASSERT_EQ(stats.cycles, 0);
+  ASSERT_EQ(stats.total_ns, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, LiballocBackedSpaces) {
+  struct gc_config config = gc_config;
+  config.allocator_region_size = 64 * 1024 * 1024;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *slot = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  ASSERT_TRUE(slot != NULL);
+  gc_root(gc, slot);
+
+  void *young_space_ptr = gc_lock_slot(slot);
+  ((struct gc_object *)young_space_ptr)->value = 42;
+  gc_unlock_slot(slot);
+
+  // Spans several pages in the large space's allocator.
+  const size_t large_size = 4096 * 3;
+  struct gc_slot *large = gc_alloc(gc, large_size, NULL, NULL);
+  ASSERT_TRUE(large != NULL);
+  ASSERT_EQ(gc_get_space(large), GC_SPACE_LARGE);
+  gc_root(gc, large);
+  memset(gc_lock_slot(large), 0x5A, large_size);
+  gc_unlock_slot(large);
+
+  // Young and old share an allocator, so promotion doesn't copy.
+  struct gc_stats stats;
+  for (int i = 0; i < 3; ++i) {
+    gc_run(gc, &stats);
+  }
+  ASSERT_EQ(gc_get_space(slot), GC_SPACE_OLD);
+  ASSERT_EQ(stats.total_copied, 0);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+  ASSERT_EQ((void *)obj, young_space_ptr);
+  ASSERT_EQ(obj->value, 42);
+  gc_unlock_slot(slot);
+
+  unsigned char *bytes = (unsigned char *)gc_lock_slot(large);
+  ASSERT_EQ(bytes[0], 0x5A);
+  ASSERT_EQ(bytes[large_size - 1], 0x5A);
+  gc_unlock_slot(large);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, CompactLiballocOldSpace) {
+  struct allocator *allocator = allocator_new(16 * 1024 * 1024);
+  ASSERT_TRUE(allocator != NULL);
+
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 16 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+  gc_space_use_allocator(gc, GC_SPACE_YOUNG, allocator);
+  gc_space_use_allocator(gc, GC_SPACE_OLD, allocator);
+
+  // Several arena pages' worth of objects, of which only every eighth survives.
+  const int count = 512;
+  struct gc_slot *slots[count];
+  for (int i = 0; i < count; ++i) {
+    slots[i] = gc_alloc_with_space(gc, sizeof(struct gc_object), NULL, NULL, GC_SPACE_OLD);
+    ASSERT_TRUE(slots[i] != NULL);
+
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+    obj->value = i;
+    gc_unlock_slot(slots[i]);
+
+    if (i % 8 == 0) {
+      gc_root(gc, slots[i]);
+    }
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, count / 8);
+  ASSERT_TRUE(allocator_should_compact(allocator));
+
+  void *locked = gc_lock_slot(slots[8]);
+  ASSERT_GT(gc_compact(gc), 0);
+  ASSERT_FALSE(allocator_should_compact(allocator));
+
+  gc_unlock_slot(slots[8]);
+  ASSERT_EQ(gc_lock_slot(slots[8]), locked);
+  gc_unlock_slot(slots[8]);
+
+  for (int i = 0; i < count; i += 8) {
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+    ASSERT_EQ(obj->value, i);
+    gc_unlock_slot(slots[i]);
+  }
+
+  gc_destroy(gc);
+  allocator_destroy(allocator);
+}
+
+TEST(GCTest, WeakReferences) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *kept = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  struct gc_slot *dropped = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  gc_root(gc, kept);
+
+  struct gc_weak *weak_kept = gc_weak_new(gc, kept);
+  struct gc_weak *weak_dropped = gc_weak_new(gc, dropped);
+  ASSERT_TRUE(weak_kept != NULL);
+  ASSERT_TRUE(weak_dropped != NULL);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 1);
+  ASSERT_EQ(gc_weak_get(weak_kept), kept);
+  ASSERT_TRUE(gc_weak_get(weak_dropped) == NULL);
+
+  gc_weak_free(gc, weak_dropped);
+
+  gc_unroot(gc, kept);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+  ASSERT_TRUE(gc_weak_get(weak_kept) == NULL);
+
+  // gc_destroy releases the remaining weak reference.
+  gc_destroy(gc);
+}
+
+TEST(GCTest, EphemeronsKeepValuesWhileKeysLive) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_ephemeron_table *table = gc_ephemeron_table_new(gc);
+  ASSERT_TRUE(table != NULL);
+
+  // The value refers back to its key, which must not keep the key alive.
+  struct gc_slot *key = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+  struct gc_slot *value = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(value);
+  obj->value = 42;
+  obj->child = key;
+  gc_unlock_slot(value);
+
+  ASSERT_TRUE(gc_ephemeron_set(gc, table, key, value));
+  ASSERT_EQ(gc_ephemeron_get(table, key), value);
+  ASSERT_EQ(gc_ephemeron_count(table), 1);
+
+  gc_root(gc, key);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 2);
+  ASSERT_EQ(gc_ephemeron_get(table, key), value);
+
+  obj = (struct gc_object *)gc_lock_slot(value);
+  ASSERT_EQ(obj->value, 42);
+  gc_unlock_slot(value);
+
+  gc_unroot(gc, key);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 2);
+  ASSERT_EQ(stats.total_objects, 0);
+  ASSERT_EQ(gc_ephemeron_count(table), 0);
+
+  gc_ephemeron_table_free(gc, table);
+  gc_destroy(gc);
+}
+
+TEST(GCTest, EphemeronTableGrowsAndRemoves) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_ephemeron_table *table = gc_ephemeron_table_new(gc);
+  ASSERT_TRUE(table != NULL);
+
+  const int count = 200;
+  std::vector<struct gc_slot *> keys;
+  for (int i = 0; i < count; ++i) {
+    struct gc_slot *key = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+    struct gc_slot *value = gc_alloc(gc, sizeof(struct gc_object), NULL, NULL);
+    gc_root(gc, key);
+    ASSERT_TRUE(gc_ephemeron_set(gc, table, key, value));
+    keys.push_back(key);
+  }
+  ASSERT_EQ(gc_ephemeron_count(table), count);
+
+  // Removing an entry stops its key from keeping the value alive.
+  for (int i = 0; i < count; i += 2) {
+    ASSERT_TRUE(gc_ephemeron_remove(table, keys[i]));
+  }
+  ASSERT_FALSE(gc_ephemeron_remove(table, keys[0]));
+  ASSERT_EQ(gc_ephemeron_count(table), count / 2);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count / 2);
+  ASSERT_EQ(stats.total_objects, count + (count / 2));
+
+  for (int i = 0; i < count; ++i) {
+    ASSERT_EQ(gc_ephemeron_get(table, keys[i]) != NULL, i % 2 == 1);
+  }
+
+  gc_destroy(gc);
+}
+
+static int gc_test_child_values = 0;
+static struct gc_weak *gc_test_eraser_weak = NULL;
+
+static void gc_object_child_eraser(struct gc *gc, struct gc_slot *slot) {
+  (void)gc;
+
+  // Weak references are cleared before any eraser runs.
+  if (gc_test_eraser_weak) {
+    EXPECT_TRUE(gc_weak_get(gc_test_eraser_weak) == NULL);
+  }
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+  if (obj->child) {
+    struct gc_object *child = (struct gc_object *)gc_lock_slot(obj->child);
+    gc_test_child_values += child->value;
+    gc_unlock_slot(obj->child);
+  }
+  gc_unlock_slot(slot);
+}
+
+TEST(GCTest, FinalizersRunAfterSweep) {
+  gc_test_child_values = 0;
+
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  // Each parent looks at its child from its eraser, although both die in the same cycle.
+  const int count = 64;
+  for (int i = 0; i < count; ++i) {
+    struct gc_slot *child =
+        gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, gc_object_child_eraser);
+    struct gc_slot *parent =
+        gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, gc_object_child_eraser);
+
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(child);
+    obj->value = 1;
+    obj->child = NULL;
+    gc_unlock_slot(child);
+
+    obj = (struct gc_object *)gc_lock_slot(parent);
+    obj->value = 0;
+    obj->child = child;
+    gc_unlock_slot(parent);
+
+    if (i == 0) {
+      gc_test_eraser_weak = gc_weak_new(gc, parent);
+    }
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count * 2);
+  ASSERT_EQ(stats.total_objects, 0);
+  ASSERT_EQ(gc_test_child_values, count);
+
+  gc_weak_free(gc, gc_test_eraser_weak);
+  gc_test_eraser_weak = NULL;
+  gc_destroy(gc);
+}
+
+static int gc_test_finalized = 0;
+
+static void gc_counting_eraser(struct gc *gc, struct gc_slot *slot) {
+  (void)gc;
+  (void)slot;
+  gc_test_finalized++;
+}
+
+TEST(GCTest, DeferredFinalizers) {
+  gc_test_finalized = 0;
+
+  struct gc_config config = gc_config;
+  config.defer_finalizers = 1;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  const int count = 10;
+  for (int i = 0; i < count; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, gc_counting_eraser) != NULL);
+  }
+
+  // Collected objects are accounted for straight away, but their erasers wait.
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, count);
+  ASSERT_EQ(stats.total_objects, 0);
+  ASSERT_EQ(gc_test_finalized, 0);
+
+  // Queued objects are left alone by later cycles.
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_collected, 0);
+  ASSERT_EQ(gc_test_finalized, 0);
+
+  ASSERT_EQ(gc_run_finalizers(gc), count);
+  ASSERT_EQ(gc_test_finalized, count);
+  ASSERT_EQ(gc_run_finalizers(gc), 0);
+
+  // Anything still queued is finalized when the collector is destroyed.
+  ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, gc_counting_eraser) != NULL);
+  gc_destroy(gc);
+  ASSERT_EQ(gc_test_finalized, count + 1);
+}
+
+static void gc_collecting_eraser(struct gc *gc, struct gc_slot *slot) {
+  (void)slot;
+  gc_test_finalized++;
+
+  // Garbage made by the eraser is collected by its own cycle and finalized by the outer one.
+  ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, gc_counting_eraser) != NULL);
+  gc_run(gc, NULL);
+}
+
+TEST(GCTest, EraserCanRunACycle) {
+  gc_test_finalized = 0;
+
+  struct gc *gc = gc_create();
+  ASSERT_TRUE(gc != NULL);
+
+  ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, gc_collecting_eraser) != NULL);
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(gc_test_finalized, 2);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  // The same from an attached thread, which has to stop the other threads first.
+  ASSERT_TRUE(gc_thread_attach(gc));
+  ASSERT_TRUE(gc_alloc(gc, sizeof(struct gc_object), NULL, gc_collecting_eraser) != NULL);
+  gc_run(gc, &stats);
+  ASSERT_EQ(gc_test_finalized, 4);
+  gc_thread_detach(gc);
+
+  gc_destroy(gc);
+}
+
+static void gc_allocating_eraser(struct gc *gc, struct gc_slot *slot) {
+  (void)slot;
+  gc_test_finalized++;
+
+  // Well past the young space's maximum, which would collect if no cycle were running.
+  for (int i = 0; i < 16; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, 256, NULL, gc_counting_eraser) != NULL);
+  }
+  gc_run(gc, NULL);
+  for (int i = 0; i < 16; ++i) {
+    ASSERT_TRUE(gc_alloc(gc, 256, NULL, gc_counting_eraser) != NULL);
+  }
+}
+
+TEST(GCTest, EraserCanAllocatePastMaxSize) {
+  gc_test_finalized = 0;
+
+  struct gc *gc = gc_create();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config young_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_YOUNG, &young_space_config);
+
+  ASSERT_TRUE(gc_alloc(gc, 256, NULL, gc_allocating_eraser) != NULL);
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(gc_test_finalized, 1 + 16);
+
+  // The next allocation brings the space back under its maximum.
+  ASSERT_TRUE(gc_alloc(gc, 256, NULL, NULL) != NULL);
+  gc_get_stats(gc, &stats);
+  ASSERT_LE(stats.total_allocated, 1024 + 256);
+
+  gc_destroy(gc);
+  ASSERT_EQ(gc_test_finalized, 1 + 32);
+}
+
+TEST(GCTest, SlotLockIsExclusive) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_slot *parent =
+      gc_alloc_with_space(gc, sizeof(struct gc_object), gc_object_marker, NULL, GC_SPACE_OLD);
+  ASSERT_TRUE(parent != NULL);
+  gc_root(gc, parent);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(parent);
+  ASSERT_TRUE(obj != NULL);
+  EXPECT_TRUE(gc_lock_slot(parent) == NULL);
+  obj->value = 0;
+  obj->child = NULL;
+  gc_unlock_slot(parent);
+
+  // Threads take turns holding the lock, while a write barrier sets the remembered bit that
+  // shares its word.
+  const int thread_count = 4;
+  const int iterations = 20000;
+  std::atomic<int> held(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([parent, &held]() {
+      for (int i = 0; i < iterations;) {
+        struct gc_object *locked = (struct gc_object *)gc_lock_slot(parent);
+        if (!locked) {
+          continue;
+        }
+        EXPECT_EQ(held.fetch_add(1), 0);
+        locked->value++;
+        held.fetch_sub(1);
+        gc_unlock_slot(parent);
+        ++i;
+      }
+    });
+  }
+
+  struct gc_slot *child = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(child != NULL);
+  gc_write_barrier(gc, parent, child);
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  obj = (struct gc_object *)gc_lock_slot(parent);
+  ASSERT_TRUE(obj != NULL);
+  EXPECT_EQ(obj->value, thread_count * iterations);
+  gc_unlock_slot(parent);
+
+  gc_unroot(gc, parent);
+  gc_destroy(gc);
+}
+
+TEST(GCTest, ThreadsShareHeap) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  // Kept objects get promoted; sweep them every cycle too so they're counted accurately.
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 16 * 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  const int thread_count = 4;
+  const int allocations = 20000;
+  std::vector<std::vector<struct gc_slot *>> kept(thread_count);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([gc, t, &kept]() {
+      ASSERT_TRUE(gc_thread_attach(gc));
+
+      for (int i = 0; i < allocations; ++i) {
+        size_t scope = gc_push_handle_scope(gc);
+
+        struct gc_slot *slot =
+            gc_scope_root(gc, gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL));
+        ASSERT_TRUE(slot != NULL);
+        struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+        obj->value = (t * allocations) + i;
+        obj->child = NULL;
+        gc_unlock_slot(slot);
+
+        if (i % 100 == 0) {
+          gc_root(gc, slot);
+          kept[t].push_back(slot);
+        }
+
+        // Every thread collects now and then, stopping the others.
+        if (i % 2000 == 1999) {
+          gc_run(gc, NULL);
+        }
+
+        gc_pop_handle_scope(gc, scope);
+        gc_safepoint(gc);
+      }
+
+      gc_thread_detach(gc);
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, thread_count * (allocations / 100));
+
+  for (int t = 0; t < thread_count; ++t) {
+    for (size_t i = 0; i < kept[t].size(); ++i) {
+      struct gc_object *obj = (struct gc_object *)gc_lock_slot(kept[t][i]);
+      ASSERT_EQ(obj->value, (t * allocations) + ((int)i * 100));
+      gc_unlock_slot(kept[t][i]);
+      gc_unroot(gc, kept[t][i]);
+    }
+  }
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, SafeRegionsDontBlockCollection) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+  ASSERT_TRUE(gc_thread_attach(gc));
+
+  std::atomic<int> step(0);
+  std::thread worker([gc, &step]() {
+    ASSERT_TRUE(gc_thread_attach(gc));
+
+    size_t scope = gc_push_handle_scope(gc);
+    struct gc_slot *slot =
+        gc_scope_root(gc, gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL));
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+    obj->value = 42;
+    obj->child = NULL;
+    gc_unlock_slot(slot);
+
+    // Block without reaching a safepoint; the other thread's cycle must not wait for us.
+    gc_enter_safe_region(gc);
+    step = 1;
+    while (step != 2) {
+      std::this_thread::yield();
+    }
+    gc_leave_safe_region(gc);
+
+    // Handle scopes of threads in safe regions are still roots.
+    obj = (struct gc_object *)gc_lock_slot(slot);
+    EXPECT_EQ(obj->value, 42);
+    gc_unlock_slot(slot);
+
+    gc_pop_handle_scope(gc, scope);
+    gc_thread_detach(gc);
+  });
+
+  while (step != 1) {
+    std::this_thread::yield();
+  }
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 1);
+  step = 2;
+
+  worker.join();
+  gc_thread_detach(gc);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+struct gc_snapshot_object {
+  uint32_t id;
+  uint64_t size;
+  unsigned space;
+  unsigned flags;
+  std::vector<uint32_t> edges;
+};
+
+struct gc_snapshot_contents {
+  std::vector<std::pair<uint32_t, unsigned>> roots;
+  std::vector<gc_snapshot_object> objects;
+  std::vector<std::pair<uint32_t, uint32_t>> ephemerons;
+};
+
+static uint64_t gc_snapshot_read(const std::vector<unsigned char> &data, size_t &pos,
+                                 size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= (uint64_t)data.at(pos + i) << (i * 8);
+  }
+  pos += bytes;
+  return value;
+}
+
+static gc_snapshot_contents gc_snapshot_parse(struct gc *gc) {
+  FILE *file = tmpfile();
+  EXPECT_TRUE(file != NULL);
+  EXPECT_TRUE(gc_heap_snapshot(gc, fileno(file)));
+
+  std::vector<unsigned char> data;
+  rewind(file);
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    data.push_back((unsigned char)c);
+  }
+  fclose(file);
+
+  gc_snapshot_contents contents;
+  EXPECT_GE(data.size(), 12u);
+  EXPECT_EQ(memcmp(data.data(), GC_SNAPSHOT_MAGIC, 8), 0);
+
+  size_t pos = 8;
+  EXPECT_EQ(gc_snapshot_read(data, pos, 4), GC_SNAPSHOT_VERSION);
+
+  size_t edge_count = 0;
+  for (;;) {
+    unsigned tag = (unsigned)gc_snapshot_read(data, pos, 1);
+    if (tag == GC_SNAPSHOT_END) {
+      EXPECT_EQ(gc_snapshot_read(data, pos, 8), contents.objects.size());
+      EXPECT_EQ(gc_snapshot_read(data, pos, 8), edge_count);
+      break;
+    }
+
+    if (tag == GC_SNAPSHOT_ROOT) {
+      uint32_t id = (uint32_t)gc_snapshot_read(data, pos, 4);
+      contents.roots.emplace_back(id, (unsigned)gc_snapshot_read(data, pos, 1));
+    } else if (tag == GC_SNAPSHOT_OBJECT) {
+      gc_snapshot_object object;
+      object.id = (uint32_t)gc_snapshot_read(data, pos, 4);
+      object.size = gc_snapshot_read(data, pos, 8);
+      object.space = (unsigned)gc_snapshot_read(data, pos, 1);
+      object.flags = (unsigned)gc_snapshot_read(data, pos, 1);
+      contents.objects.push_back(object);
+    } else if (tag == GC_SNAPSHOT_EDGE) {
+      EXPECT_FALSE(contents.objects.empty());
+      contents.objects.back().edges.push_back((uint32_t)gc_snapshot_read(data, pos, 4));
+      edge_count++;
+    } else {
+      EXPECT_EQ(tag, GC_SNAPSHOT_EPHEMERON);
+      uint32_t key = (uint32_t)gc_snapshot_read(data, pos, 4);
+      contents.ephemerons.emplace_back(key, (uint32_t)gc_snapshot_read(data, pos, 4));
+    }
+  }
+
+  EXPECT_EQ(pos, data.size());
+  return contents;
+}
+
+static const gc_snapshot_object *gc_snapshot_find(const gc_snapshot_contents &contents,
+                                                  uint64_t size) {
+  for (const gc_snapshot_object &object : contents.objects) {
+    if (object.size == size) {
+      return &object;
+    }
+  }
+  return NULL;
+}
+
+TEST(GCTest, HeapSnapshot) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  // root -> child, plus an unreachable object, a locked object and an ephemeron. Sizes tell the
+  // objects apart, since snapshots identify them by slot index.
+  struct gc_slot *root = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  struct gc_slot *child = gc_alloc(gc, 100, NULL, NULL);
+  struct gc_slot *garbage = gc_alloc(gc, 200, NULL, NULL);
+  struct gc_slot *locked = gc_alloc(gc, 300, NULL, NULL);
+  struct gc_slot *value = gc_alloc(gc, 400, NULL, NULL);
+  ASSERT_TRUE(root && child && garbage && locked && value);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(root);
+  obj->value = 1;
+  obj->child = child;
+  gc_unlock_slot(root);
+  gc_root(gc, root);
+
+  struct gc_ephemeron_table *table = gc_ephemeron_table_new(gc);
+  ASSERT_TRUE(table != NULL);
+  ASSERT_TRUE(gc_ephemeron_set(gc, table, child, value));
+
+  ASSERT_TRUE(gc_lock_slot(locked) != NULL);
+
+  gc_snapshot_contents contents = gc_snapshot_parse(gc);
+  ASSERT_EQ(contents.objects.size(), 5u);
+
+  const gc_snapshot_object *root_object = gc_snapshot_find(contents, sizeof(struct gc_object));
+  const gc_snapshot_object *child_object = gc_snapshot_find(contents, 100);
+  const gc_snapshot_object *garbage_object = gc_snapshot_find(contents, 200);
+  const gc_snapshot_object *locked_object = gc_snapshot_find(contents, 300);
+  const gc_snapshot_object *value_object = gc_snapshot_find(contents, 400);
+  ASSERT_TRUE(root_object && child_object && garbage_object && locked_object && value_object);
+
+  ASSERT_EQ(root_object->edges.size(), 1u);
+  EXPECT_EQ(root_object->edges[0], child_object->id);
+  EXPECT_TRUE(child_object->edges.empty());
+  EXPECT_EQ(root_object->space, (unsigned)GC_SPACE_YOUNG);
+  EXPECT_EQ(locked_object->flags & GC_SNAPSHOT_FLAG_LOCKED, (unsigned)GC_SNAPSHOT_FLAG_LOCKED);
+  EXPECT_EQ(root_object->flags & GC_SNAPSHOT_FLAG_LOCKED, 0u);
+
+  ASSERT_EQ(contents.roots.size(), 2u);
+  EXPECT_EQ(contents.roots[0], std::make_pair(root_object->id, (unsigned)GC_SNAPSHOT_ROOT_TABLE));
+  EXPECT_EQ(contents.roots[1],
+            std::make_pair(locked_object->id, (unsigned)GC_SNAPSHOT_ROOT_LOCKED));
+
+  ASSERT_EQ(contents.ephemerons.size(), 1u);
+  EXPECT_EQ(contents.ephemerons[0], std::make_pair(child_object->id, value_object->id));
+
+  // Taking a snapshot doesn't collect anything.
+  struct gc_stats stats;
+  gc_get_stats(gc, &stats);
+  EXPECT_EQ(stats.total_objects, 5);
+
+  // Write failures are reported.
+  EXPECT_FALSE(gc_heap_snapshot(gc, -1));
+
+  gc_unlock_slot(locked);
+  gc_ephemeron_table_free(gc, table);
+  gc_unroot(gc, root);
+  gc_destroy(gc);
+}
+
+// Runs tools/gc/gc_snapshot over a snapshot of the heap, returning each object's retained size
+// and dominator from its report, keyed by object id. Roots dominate themselves.
+static std::map<uint32_t, std::pair<uint64_t, uint32_t>> gc_snapshot_tool_report(struct gc *gc) {
+  std::map<uint32_t, std::pair<uint64_t, uint32_t>> report;
+  char path[] = "/tmp/gc_snapshot_testXXXXXX";
+  int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  EXPECT_TRUE(gc_heap_snapshot(gc, fd));
+  close(fd);
+
+  std::string command = std::string(GC_SNAPSHOT_TOOL) + " -n 100 " + path;
+  FILE *output = popen(command.c_str(), "r");
+  EXPECT_TRUE(output != NULL);
+  char line[256];
+  int table = 0;
+  while (fgets(line, sizeof(line), output)) {
+    if (!table) {
+      table = strstr(line, "dominator") != NULL;
+      continue;
+    }
+    unsigned long long retained, size;
+    char space[16], dominator[16];
+    uint32_t id;
+    if (sscanf(line, "%llu %llu %15s %u %15s", &retained, &size, space, &id, dominator) == 5) {
+      uint32_t dominator_id = strcmp(dominator, "(root)") == 0 ? id : (uint32_t)atol(dominator);
+      report[id] = std::make_pair((uint64_t)retained, dominator_id);
+    }
+  }
+  EXPECT_EQ(pclose(output), 0);
+  unlink(path);
+  return report;
+}
+
+TEST(GCTest, SnapshotToolFindsDominators) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  // a -> b -> c -> e and d -> c, with a and d rooted: c is shared, so only the roots dominate it,
+  // and it dominates e. Each object has a distinct size.
+  const size_t sizes[] = {100, 200, 400, 800, 1600};
+  struct gc_slot *slots[5];
+  for (size_t i = 0; i < 5; ++i) {
+    slots[i] = gc_alloc(gc, sizes[i], gc_object_marker, NULL);
+    ASSERT_TRUE(slots[i] != NULL);
+  }
+  const int children[] = {1, 2, 4, 2, -1};
+  for (size_t i = 0; i < 5; ++i) {
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slots[i]);
+    obj->child = children[i] < 0 ? NULL : slots[children[i]];
+    gc_unlock_slot(slots[i]);
+  }
+  gc_root(gc, slots[0]);
+  gc_root(gc, slots[3]);
+
+  // Objects are identified by their sizes in the snapshot.
+  std::map<uint64_t, uint32_t> ids;
+  for (const gc_snapshot_object &object : gc_snapshot_parse(gc).objects) {
+    ids[object.size] = object.id;
+  }
+  ASSERT_EQ(ids.size(), 5u);
+  uint32_t a = ids[100], b = ids[200], c = ids[400], d = ids[800], e = ids[1600];
+
+  std::map<uint32_t, std::pair<uint64_t, uint32_t>> report = gc_snapshot_tool_report(gc);
+  ASSERT_EQ(report.size(), 5u);
+  EXPECT_EQ(report[a], std::make_pair((uint64_t)300, a));
+  EXPECT_EQ(report[b], std::make_pair((uint64_t)200, a));
+  EXPECT_EQ(report[c], std::make_pair((uint64_t)2000, c));
+  EXPECT_EQ(report[d], std::make_pair((uint64_t)800, d));
+  EXPECT_EQ(report[e], std::make_pair((uint64_t)1600, c));
+
+  gc_unroot(gc, slots[0]);
+  gc_unroot(gc, slots[3]);
+  gc_destroy(gc);
+}
+
+TEST(GCTest, ConservativeStackRoots) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+  ASSERT_TRUE(gc_register_stack(gc, NULL));
+
+  // Neither object is rooted; the parent is only referenced from this frame.
+  struct gc_slot *volatile parent =
+      gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  struct gc_slot *child = gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+  ASSERT_TRUE(parent != NULL && child != NULL);
+
+  struct gc_object *obj = (struct gc_object *)gc_lock_slot(child);
+  obj->value = 7;
+  obj->child = NULL;
+  gc_unlock_slot(child);
+
+  obj = (struct gc_object *)gc_lock_slot(parent);
+  obj->value = 42;
+  obj->child = child;
+  gc_unlock_slot(parent);
+  child = NULL;
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 2);
+
+  obj = (struct gc_object *)gc_lock_slot(parent);
+  EXPECT_EQ(obj->value, 42);
+  struct gc_object *child_obj = (struct gc_object *)gc_lock_slot(obj->child);
+  EXPECT_EQ(child_obj->value, 7);
+  gc_unlock_slot(obj->child);
+  gc_unlock_slot(parent);
+
+  // Once the stack is no longer scanned, nothing keeps the objects alive.
+  gc_unregister_stack(gc);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, DestroyIgnoresRegisteredStack) {
+  gc_test_finalized = 0;
+
+  struct gc *gc = gc_create_with_config(&gc_config);
+  ASSERT_TRUE(gc != NULL);
+  ASSERT_TRUE(gc_register_stack(gc, NULL));
+
+  // Still referenced from this frame, but destroying the collector erases everything.
+  struct gc_slot *volatile slot = gc_alloc(gc, sizeof(struct gc_object), NULL, gc_counting_eraser);
+  ASSERT_TRUE(slot != NULL);
+  gc_destroy(gc);
+  EXPECT_EQ(gc_test_finalized, 1);
+}
+
+TEST(GCTest, ConservativeScanOfStoppedThreads) {
+  struct gc_config config = gc_config;
+  config.debug = 0;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  std::atomic<int> step(0);
+  std::thread worker([gc, &step]() {
+    ASSERT_TRUE(gc_thread_attach(gc));
+    ASSERT_TRUE(gc_register_stack(gc, NULL));
+
+    struct gc_slot *volatile slot =
+        gc_alloc(gc, sizeof(struct gc_object), gc_object_marker, NULL);
+    struct gc_object *obj = (struct gc_object *)gc_lock_slot(slot);
+    obj->value = 42;
+    obj->child = NULL;
+    gc_unlock_slot(slot);
+
+    gc_enter_safe_region(gc);
+    step = 1;
+    while (step != 2) {
+      std::this_thread::yield();
+    }
+    gc_leave_safe_region(gc);
+
+    obj = (struct gc_object *)gc_lock_slot(slot);
+    EXPECT_EQ(obj->value, 42);
+    gc_unlock_slot(slot);
+
+    gc_unregister_stack(gc);
+    gc_thread_detach(gc);
+  });
+
+  while (step != 1) {
+    std::this_thread::yield();
+  }
+
+  // The worker's stack is scanned while it's in the safe region.
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 1);
+
+  // Snapshots report what the scan finds as roots.
+  gc_snapshot_contents contents = gc_snapshot_parse(gc);
+  ASSERT_EQ(contents.objects.size(), 1u);
+  EXPECT_NE(std::find(contents.roots.begin(), contents.roots.end(),
+                      std::make_pair(contents.objects[0].id, (unsigned)GC_SNAPSHOT_ROOT_STACK)),
+            contents.roots.end());
+  step = 2;
+
+  worker.join();
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+struct gc_typed_object {
+  int value;
+  struct gc_slot *left;
+  struct gc_slot *right;
+  struct gc_slot *extra;
+};
+
+static void gc_typed_object_marker(struct gc *gc, struct gc_slot *slot) {
+  struct gc_typed_object *obj = (struct gc_typed_object *)gc_lock_slot(slot);
+  if (obj->extra) {
+    gc_mark(gc, obj->extra);
+  }
+  gc_unlock_slot(slot);
+}
+
+TEST(GCTest, TypedObjectsAreTracedByLayout) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  // `extra` isn't described, so the type's marker traces it.
+  size_t offsets[] = {offsetof(struct gc_typed_object, left),
+                      offsetof(struct gc_typed_object, right)};
+  struct gc_type *type = gc_type_new(gc, offsets, 2, gc_typed_object_marker);
+  ASSERT_TRUE(type != NULL);
+
+  struct gc_slot *root = gc_alloc_typed(gc, sizeof(struct gc_typed_object), type, NULL);
+  ASSERT_TRUE(root != NULL);
+  gc_root(gc, root);
+
+  // Described references start out NULL.
+  struct gc_typed_object *obj = (struct gc_typed_object *)gc_lock_slot(root);
+  EXPECT_EQ(obj->left, nullptr);
+  EXPECT_EQ(obj->right, nullptr);
+  obj->value = 1;
+  obj->extra = NULL;
+  gc_unlock_slot(root);
+
+  struct gc_slot *children[3];
+  for (struct gc_slot *&child : children) {
+    child = gc_alloc_typed(gc, sizeof(struct gc_typed_object), type, NULL);
+    ASSERT_TRUE(child != NULL);
+    struct gc_typed_object *child_obj = (struct gc_typed_object *)gc_lock_slot(child);
+    child_obj->value = 2;
+    child_obj->extra = NULL;
+    gc_unlock_slot(child);
+  }
+
+  obj = (struct gc_typed_object *)gc_lock_slot(root);
+  obj->left = children[0];
+  obj->right = children[1];
+  obj->extra = children[2];
+  gc_unlock_slot(root);
+
+  // Everything survives, through promotion into the old space too.
+  struct gc_stats stats;
+  for (int i = 0; i < 4; ++i) {
+    gc_run(gc, &stats);
+    ASSERT_EQ(stats.total_objects, 4);
+  }
+  EXPECT_EQ(gc_get_space(root), GC_SPACE_OLD);
+  EXPECT_EQ(gc_get_space(children[0]), GC_SPACE_OLD);
+
+  obj = (struct gc_typed_object *)gc_lock_slot(root);
+  obj->right = NULL;
+  obj->extra = NULL;
+  gc_unlock_slot(root);
+
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 2);
+
+  gc_unroot(gc, root);
+  gc_run(gc, &stats);
+  ASSERT_EQ(stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, SitesPretenureLongLivedObjects) {
+  struct gc_config config = gc_config;
+  config.pretenure_sample = 16;
+  config.pretenure_survival = 80;
+  struct gc *gc = gc_create_with_config(&config);
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config old_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+  };
+  gc_configure_space(gc, GC_SPACE_OLD, &old_space_config);
+
+  struct gc_site *interned = gc_site_new(gc, "interned");
+  struct gc_site *temporary = gc_site_new(gc, "temporary");
+  ASSERT_TRUE(interned != NULL);
+  ASSERT_TRUE(temporary != NULL);
+
+  std::vector<struct gc_slot *> kept;
+  for (int i = 0; i < 16; ++i) {
+    struct gc_slot *slot = gc_alloc_at(gc, interned, sizeof(struct gc_object), NULL, NULL);
+    ASSERT_TRUE(slot != NULL);
+    EXPECT_EQ(gc_get_space(slot), GC_SPACE_YOUNG);
+    gc_root(gc, slot);
+    kept.push_back(slot);
+
+    ASSERT_TRUE(gc_alloc_at(gc, temporary, sizeof(struct gc_object), NULL, NULL) != NULL);
+  }
+
+  // Interned objects are tenured after surviving three cycles, while temporary ones die in the
+  // first.
+  for (int i = 0; i < 3; ++i) {
+    gc_run(gc, NULL);
+  }
+
+  struct gc_site_stats stats;
+  gc_get_site_stats(gc, interned, &stats);
+  EXPECT_EQ(stats.allocated_objects, 16);
+  EXPECT_EQ(stats.allocated_bytes, 16 * sizeof(struct gc_object));
+  EXPECT_EQ(stats.survived_objects, 16);
+  EXPECT_EQ(stats.died_objects, 0);
+  EXPECT_EQ(stats.decisions, 1);
+  EXPECT_TRUE(stats.pretenured);
+
+  gc_get_site_stats(gc, temporary, &stats);
+  EXPECT_EQ(stats.survived_objects, 0);
+  EXPECT_EQ(stats.died_objects, 16);
+  EXPECT_EQ(stats.decisions, 0);
+  EXPECT_FALSE(stats.pretenured);
+
+  EXPECT_EQ(gc_get_space(gc_alloc_at(gc, temporary, sizeof(struct gc_object), NULL, NULL)),
+            GC_SPACE_YOUNG);
+
+  // The interned site now allocates straight into the old space, until its objects stop living.
+  for (int i = 0; i < 16; ++i) {
+    struct gc_slot *slot = gc_alloc_at(gc, interned, sizeof(struct gc_object), NULL, NULL);
+    ASSERT_TRUE(slot != NULL);
+    EXPECT_EQ(gc_get_space(slot), GC_SPACE_OLD);
+  }
+
+  gc_get_site_stats(gc, interned, &stats);
+  EXPECT_EQ(stats.allocated_objects, 32);
+  EXPECT_EQ(stats.pretenured_objects, 16);
+
+  gc_run(gc, NULL);
+
+  gc_get_site_stats(gc, interned, &stats);
+  EXPECT_EQ(stats.died_objects, 16);
+  EXPECT_EQ(stats.decisions, 2);
+  EXPECT_FALSE(stats.pretenured);
+
+  struct gc_slot *slot = gc_alloc_at(gc, interned, sizeof(struct gc_object), NULL, NULL);
+  EXPECT_EQ(gc_get_space(slot), GC_SPACE_YOUNG);
+
+  for (struct gc_slot *kept_slot : kept) {
+    gc_unroot(gc, kept_slot);
+  }
+  struct gc_stats gc_stats;
+  gc_run(gc, &gc_stats);
+  EXPECT_EQ(gc_stats.total_objects, 0);
+
+  gc_destroy(gc);
+}
+
+TEST(GCTest, LargeObjectsAreMapped) {
+  struct gc *gc = gc_create_for_test();
+  ASSERT_TRUE(gc != NULL);
+
+  struct gc_space_config large_space_config = {
+      .sweep_every = 1,
+      .max_size = 1024 * 1024,
+      .map_pages = 1,
+  };
+  gc_configure_space(gc, GC_SPACE_LARGE, &large_space_config);
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t size = (3 * page) + 100;
+
+  struct gc_slot *slot = gc_alloc_zeroed(gc, size, NULL, NULL);
+  ASSERT_TRUE(slot != NULL);
+  EXPECT_EQ(gc_get_space(slot), GC_SPACE_LARGE);
+
+  // The payload starts on its own page, and fresh pages are already zero.
+  unsigned char *data = (unsigned char *)gc_lock_slot(slot);
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ((uintptr_t)data % page, 0);
+  EXPECT_TRUE(std::all_of(data, data + size, [](unsigned char byte) { return byte == 0; }));
+  memset(data, 0xab, size);
+  gc_unlock_slot(slot);
+
+  // Small zeroed objects are cleared by hand.
+  struct gc_slot *small = gc_alloc_zeroed(gc, 64, NULL, NULL);
+  ASSERT_TRUE(small != NULL);
+  unsigned char *small_data = (unsigned char *)gc_lock_slot(small);
+  EXPECT_TRUE(
+      std::all_of(small_data, small_data + 64, [](unsigned char byte) { return byte == 0; }));
+  gc_unlock_slot(small);
+
+  // Collecting the object unmaps its pages right away.
+  unsigned char resident[4];
+  ASSERT_EQ(mincore(data, 4 * page, resident), 0);
+
+  struct gc_stats stats;
+  gc_run(gc, &stats);
+  EXPECT_EQ(stats.total_objects, 0);
+
+  EXPECT_EQ(mincore(data, 4 * page, resident), -1);
+  EXPECT_EQ(errno, ENOMEM);
+
+  gc_destroy(gc);
+}
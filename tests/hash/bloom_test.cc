@@ -0,0 +1,76 @@
+#include <pocketknife/hash/bloom.h>
+#include <pocketknife/hash/fnv.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+static std::string bloom_test_key(size_t i) { return "key:" + std::to_string(i); }
+
+static bool bloom_test_contains(const struct hash_bloom *bloom, const std::string &key) {
+  return hash_bloom_contains(bloom, (const uint8_t *)key.data(), key.size()) != 0;
+}
+
+// Adds keys 0 to count, and returns the fraction of the next count keys the filter claims to hold.
+static double bloom_test_false_positives(struct hash_bloom *bloom, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    std::string key = bloom_test_key(i);
+    hash_bloom_add(bloom, (const uint8_t *)key.data(), key.size());
+  }
+  size_t positives = 0;
+  for (size_t i = count; i < 2 * count; ++i) {
+    positives += bloom_test_contains(bloom, bloom_test_key(i));
+  }
+  return (double)positives / (double)count;
+}
+
+TEST(BloomTest, NoFalseNegatives) {
+  struct hash_bloom *bloom = hash_bloom_new(100000, 10);
+  ASSERT_NE(bloom, nullptr);
+  bloom_test_false_positives(bloom, 100000);
+  for (size_t i = 0; i < 100000; ++i) {
+    ASSERT_TRUE(bloom_test_contains(bloom, bloom_test_key(i))) << i;
+  }
+  hash_bloom_destroy(bloom);
+}
+
+TEST(BloomTest, FalsePositiveRateFallsWithSize) {
+  struct hash_bloom *small = hash_bloom_new(100000, 8);
+  struct hash_bloom *large = hash_bloom_new(100000, 16);
+  ASSERT_NE(small, nullptr);
+  ASSERT_NE(large, nullptr);
+  EXPECT_EQ(hash_bloom_bytes(small), 100032u);
+  double small_rate = bloom_test_false_positives(small, 100000);
+  double large_rate = bloom_test_false_positives(large, 100000);
+  EXPECT_LT(small_rate, 0.05);
+  EXPECT_LT(large_rate, 0.003);
+  EXPECT_LT(large_rate, small_rate);
+  hash_bloom_destroy(small);
+  hash_bloom_destroy(large);
+}
+
+TEST(BloomTest, PrecomputedHashes) {
+  struct hash_bloom *bloom = hash_bloom_new(1000, 12);
+  ASSERT_NE(bloom, nullptr);
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string key = bloom_test_key(i);
+    hash_bloom_add_hash(bloom, hash_fnv1a((const uint8_t *)key.data(), key.size()));
+  }
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string key = bloom_test_key(i);
+    ASSERT_TRUE(
+        hash_bloom_contains_hash(bloom, hash_fnv1a((const uint8_t *)key.data(), key.size())));
+  }
+  hash_bloom_destroy(bloom);
+}
+
+TEST(BloomTest, Clear) {
+  struct hash_bloom *bloom = hash_bloom_new(0, 10);
+  ASSERT_NE(bloom, nullptr);
+  EXPECT_EQ(hash_bloom_bytes(bloom), 64u);
+  hash_bloom_add(bloom, (const uint8_t *)"a", 1);
+  EXPECT_TRUE(hash_bloom_contains(bloom, (const uint8_t *)"a", 1));
+  hash_bloom_clear(bloom);
+  EXPECT_FALSE(hash_bloom_contains(bloom, (const uint8_t *)"a", 1));
+  hash_bloom_destroy(bloom);
+}
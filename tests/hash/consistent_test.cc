@@ -0,0 +1,137 @@
+#include <pocketknife/hash/consistent.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+static std::vector<uint64_t> consistent_test_hashes(size_t count) {
+  std::mt19937_64 random(1);
+  std::vector<uint64_t> hashes(count);
+  for (uint64_t &hash : hashes) {
+    hash = random();
+  }
+  return hashes;
+}
+
+TEST(ConsistentHashTest, JumpMovesKeysOnlyToTheNewShard) {
+  std::vector<uint64_t> hashes = consistent_test_hashes(100000);
+  for (uint32_t shards = 1; shards < 40; ++shards) {
+    size_t moved = 0;
+    for (uint64_t hash : hashes) {
+      uint32_t before = hash_jump(hash, shards), after = hash_jump(hash, shards + 1);
+      ASSERT_LT(before, shards);
+      if (before != after) {
+        ASSERT_EQ(after, shards);
+        ++moved;
+      }
+    }
+    double expected = (double)hashes.size() / (shards + 1);
+    EXPECT_NEAR((double)moved, expected, expected * 0.1) << shards;
+  }
+}
+
+TEST(ConsistentHashTest, JumpSpreadsKeysEvenly) {
+  std::vector<size_t> counts(10);
+  for (uint64_t hash : consistent_test_hashes(100000)) {
+    ++counts[hash_jump(hash, 10)];
+  }
+  for (size_t count : counts) {
+    EXPECT_NEAR((double)count, 10000.0, 500.0);
+  }
+  EXPECT_EQ(hash_jump(42, 1), 0u);
+}
+
+TEST(ConsistentHashTest, RendezvousMovesOnlyKeysOfChangedNodes) {
+  std::vector<uint64_t> nodes = {11, 22, 33, 44, 55, 66, 77, 88};
+  std::vector<uint64_t> fewer = {11, 22, 33, 55, 66, 77, 88};
+  std::vector<size_t> counts(nodes.size());
+  for (uint64_t hash : consistent_test_hashes(80000)) {
+    uint64_t before = nodes[hash_rendezvous(hash, nodes.data(), nodes.size())];
+    uint64_t after = fewer[hash_rendezvous(hash, fewer.data(), fewer.size())];
+    if (before != 44) {
+      ASSERT_EQ(before, after);
+    }
+    ++counts[hash_rendezvous(hash, nodes.data(), nodes.size())];
+  }
+  for (size_t count : counts) {
+    EXPECT_NEAR((double)count, 10000.0, 600.0);
+  }
+  EXPECT_EQ(hash_rendezvous(1, nullptr, 0), 0u);
+}
+
+// Maps each hash to its node in a ring.
+static std::vector<uint64_t> consistent_test_assign(const struct hash_ring *ring,
+                                                    const std::vector<uint64_t> &hashes) {
+  std::vector<uint64_t> nodes;
+  for (uint64_t hash : hashes) {
+    uint64_t node = 0;
+    EXPECT_TRUE(hash_ring_lookup(ring, hash, &node));
+    nodes.push_back(node);
+  }
+  return nodes;
+}
+
+TEST(ConsistentHashTest, RingMovesOnlyKeysOfChangedNodes) {
+  struct hash_ring *ring = hash_ring_new();
+  ASSERT_NE(ring, nullptr);
+  uint64_t node = 0;
+  EXPECT_FALSE(hash_ring_lookup(ring, 1, &node));
+
+  for (uint64_t id = 1; id <= 8; ++id) {
+    ASSERT_EQ(hash_ring_add(ring, id * 1000, 200), 1);
+  }
+  EXPECT_EQ(hash_ring_add(ring, 3000, 200), 0);
+  EXPECT_EQ(hash_ring_size(ring), 8u);
+
+  std::vector<uint64_t> hashes = consistent_test_hashes(100000);
+  std::vector<uint64_t> before = consistent_test_assign(ring, hashes);
+
+  std::map<uint64_t, size_t> counts;
+  for (uint64_t id : before) {
+    ++counts[id];
+  }
+  ASSERT_EQ(counts.size(), 8u);
+  for (const auto &count : counts) {
+    EXPECT_NEAR((double)count.second, 12500.0, 12500.0 * 0.3) << count.first;
+  }
+
+  ASSERT_EQ(hash_ring_add(ring, 9000, 200), 1);
+  std::vector<uint64_t> added = consistent_test_assign(ring, hashes);
+  size_t moved = 0;
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (added[i] != before[i]) {
+      ASSERT_EQ(added[i], 9000u);
+      ++moved;
+    }
+  }
+  EXPECT_NEAR((double)moved, 100000.0 / 9, 100000.0 / 9 * 0.3);
+
+  ASSERT_EQ(hash_ring_remove(ring, 9000), 1);
+  EXPECT_EQ(consistent_test_assign(ring, hashes), before);
+  EXPECT_EQ(hash_ring_remove(ring, 9000), 0);
+
+  ASSERT_EQ(hash_ring_remove(ring, 5000), 1);
+  std::vector<uint64_t> removed = consistent_test_assign(ring, hashes);
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (before[i] != 5000) {
+      ASSERT_EQ(removed[i], before[i]);
+    }
+  }
+  EXPECT_EQ(std::count(removed.begin(), removed.end(), 5000u), 0);
+  hash_ring_destroy(ring);
+}
+
+TEST(ConsistentHashTest, RingLookupWrapsAround) {
+  struct hash_ring *ring = hash_ring_new();
+  ASSERT_NE(ring, nullptr);
+  ASSERT_EQ(hash_ring_add(ring, 7, 1), 1);
+  uint64_t node = 0;
+  ASSERT_TRUE(hash_ring_lookup(ring, 0, &node));
+  EXPECT_EQ(node, 7u);
+  ASSERT_TRUE(hash_ring_lookup(ring, UINT64_MAX, &node));
+  EXPECT_EQ(node, 7u);
+  hash_ring_destroy(ring);
+}
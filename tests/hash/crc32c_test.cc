@@ -0,0 +1,108 @@
+#include <pocketknife/hash/crc32c.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static std::vector<uint8_t> crc32c_test_data(size_t length) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = (uint8_t)((i * 31) + 7);
+  }
+  return data;
+}
+
+TEST(Crc32cTest, KnownValues) {
+  const char *check = "123456789";
+  EXPECT_EQ(hash_crc32c((const uint8_t *)check, strlen(check)), 0xe3069283u);
+  EXPECT_EQ(hash_crc32c(nullptr, 0), 0u);
+
+  // The examples from RFC 3720, appendix B.4.
+  std::vector<uint8_t> data(32, 0);
+  EXPECT_EQ(hash_crc32c(data.data(), data.size()), 0x8a9136aau);
+  std::fill(data.begin(), data.end(), 0xff);
+  EXPECT_EQ(hash_crc32c(data.data(), data.size()), 0x62a8ab43u);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (uint8_t)i;
+  }
+  EXPECT_EQ(hash_crc32c(data.data(), data.size()), 0x46dd794eu);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (uint8_t)(31 - i);
+  }
+  EXPECT_EQ(hash_crc32c(data.data(), data.size()), 0x113fdb5cu);
+}
+
+TEST(Crc32cTest, ImplementationsAgree) {
+  enum HashCrc32cImpl original = hash_crc32c_impl();
+  std::vector<uint8_t> data = crc32c_test_data(20000);
+
+  // Short lengths cover every tail, long ones every number of blocks of both sizes plus a tail,
+  // all from a misaligned start.
+  std::vector<size_t> lengths;
+  for (size_t length = 0; length < 1600; ++length) {
+    lengths.push_back(length);
+  }
+  for (size_t length = 1600; length < 19000; length += 97) {
+    lengths.push_back(length);
+  }
+  lengths.push_back(3 * 2048);
+  lengths.push_back(6 * 2048);
+
+  std::vector<uint32_t> expected;
+  ASSERT_TRUE(hash_crc32c_set_impl(HASH_CRC32C_TABLE));
+  for (size_t length : lengths) {
+    expected.push_back(hash_crc32c(data.data() + 3, length));
+  }
+
+  for (enum HashCrc32cImpl impl : {HASH_CRC32C_SSE42, HASH_CRC32C_PCLMUL}) {
+    if (!hash_crc32c_set_impl(impl)) {
+      continue;
+    }
+    EXPECT_EQ(hash_crc32c_impl(), impl);
+    for (size_t i = 0; i < lengths.size(); ++i) {
+      ASSERT_EQ(hash_crc32c(data.data() + 3, lengths[i]), expected[i])
+          << "impl " << impl << " length " << lengths[i];
+    }
+  }
+
+  ASSERT_TRUE(hash_crc32c_set_impl(original));
+}
+
+TEST(Crc32cTest, StreamingMatchesOneShot) {
+  std::vector<uint8_t> data = crc32c_test_data(30000);
+  uint32_t expected = hash_crc32c(data.data(), data.size());
+
+  const size_t chunks[] = {1, 7, 64, 1000, 6144, 30000};
+  for (size_t chunk : chunks) {
+    struct hash_crc32c_state crc;
+    hash_crc32c_init(&crc);
+    for (size_t offset = 0; offset < data.size(); offset += chunk) {
+      hash_crc32c_update(&crc, data.data() + offset, std::min(chunk, data.size() - offset));
+    }
+    EXPECT_EQ(hash_crc32c_final(&crc), expected) << chunk;
+  }
+
+  // Finishing doesn't end the stream.
+  struct hash_crc32c_state crc;
+  hash_crc32c_init(&crc);
+  hash_crc32c_update(&crc, data.data(), 100);
+  EXPECT_EQ(hash_crc32c_final(&crc), hash_crc32c(data.data(), 100));
+  hash_crc32c_update(&crc, data.data() + 100, 50);
+  EXPECT_EQ(hash_crc32c_final(&crc), hash_crc32c(data.data(), 150));
+}
+
+TEST(Crc32cTest, DetectsBursts) {
+  std::vector<uint8_t> data = crc32c_test_data(4096);
+  uint32_t crc = hash_crc32c(data.data(), data.size());
+  for (size_t offset = 0; offset + 4 <= data.size(); offset += 61) {
+    for (uint32_t burst : {1u, 0x80000001u, 0xffffffffu, 0x00012345u}) {
+      std::vector<uint8_t> corrupted = data;
+      for (size_t i = 0; i < 4; ++i) {
+        corrupted[offset + i] ^= (uint8_t)(burst >> (8 * i));
+      }
+      ASSERT_NE(hash_crc32c(corrupted.data(), corrupted.size()), crc) << offset << " " << burst;
+    }
+  }
+}
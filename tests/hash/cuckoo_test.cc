@@ -0,0 +1,114 @@
+#include <pocketknife/hash/cuckoo.h>
+#include <pocketknife/hash/fnv.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+static std::string cuckoo_test_key(size_t i) { return "key:" + std::to_string(i); }
+
+static int cuckoo_test_add(struct hash_cuckoo *cuckoo, size_t i) {
+  std::string key = cuckoo_test_key(i);
+  return hash_cuckoo_add(cuckoo, (const uint8_t *)key.data(), key.size());
+}
+
+static bool cuckoo_test_contains(const struct hash_cuckoo *cuckoo, size_t i) {
+  std::string key = cuckoo_test_key(i);
+  return hash_cuckoo_contains(cuckoo, (const uint8_t *)key.data(), key.size()) != 0;
+}
+
+static int cuckoo_test_erase(struct hash_cuckoo *cuckoo, size_t i) {
+  std::string key = cuckoo_test_key(i);
+  return hash_cuckoo_erase(cuckoo, (const uint8_t *)key.data(), key.size());
+}
+
+TEST(CuckooTest, RejectsOtherFingerprintSizes) {
+  EXPECT_EQ(hash_cuckoo_new(100, 12), nullptr);
+  EXPECT_EQ(hash_cuckoo_new(100, 32), nullptr);
+}
+
+TEST(CuckooTest, HoldsKeysAtHighLoad) {
+  // 2^15 buckets of four slots, filled to 95%.
+  const size_t count = 124518;
+  for (unsigned bits : {8u, 16u}) {
+    struct hash_cuckoo *cuckoo = hash_cuckoo_new(count, bits);
+    ASSERT_NE(cuckoo, nullptr);
+    EXPECT_EQ(hash_cuckoo_bytes(cuckoo), (size_t)32768 * bits / 2);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_TRUE(cuckoo_test_add(cuckoo, i)) << bits << " " << i;
+    }
+    EXPECT_EQ(hash_cuckoo_size(cuckoo), count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_TRUE(cuckoo_test_contains(cuckoo, i)) << bits << " " << i;
+    }
+
+    size_t positives = 0;
+    for (size_t i = count; i < 2 * count; ++i) {
+      positives += cuckoo_test_contains(cuckoo, i);
+    }
+    EXPECT_LT((double)positives / (double)count, bits == 8 ? 0.04 : 0.0003) << bits;
+    hash_cuckoo_destroy(cuckoo);
+  }
+}
+
+TEST(CuckooTest, Erase) {
+  struct hash_cuckoo *cuckoo = hash_cuckoo_new(10000, 16);
+  ASSERT_NE(cuckoo, nullptr);
+  for (size_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(cuckoo_test_add(cuckoo, i));
+  }
+  for (size_t i = 0; i < 10000; i += 2) {
+    ASSERT_TRUE(cuckoo_test_erase(cuckoo, i)) << i;
+  }
+  EXPECT_EQ(hash_cuckoo_size(cuckoo), 5000u);
+
+  size_t erased_positives = 0;
+  for (size_t i = 0; i < 10000; ++i) {
+    if (i % 2) {
+      ASSERT_TRUE(cuckoo_test_contains(cuckoo, i)) << i;
+    } else {
+      erased_positives += cuckoo_test_contains(cuckoo, i);
+    }
+  }
+  EXPECT_LT(erased_positives, 5u);
+  hash_cuckoo_destroy(cuckoo);
+}
+
+TEST(CuckooTest, DuplicatesAreCounted) {
+  struct hash_cuckoo *cuckoo = hash_cuckoo_new(100, 16);
+  ASSERT_NE(cuckoo, nullptr);
+  uint64_t hash = hash_fnv1a((const uint8_t *)"twice", 5);
+  ASSERT_TRUE(hash_cuckoo_add_hash(cuckoo, hash));
+  ASSERT_TRUE(hash_cuckoo_add_hash(cuckoo, hash));
+  EXPECT_EQ(hash_cuckoo_size(cuckoo), 2u);
+  EXPECT_TRUE(hash_cuckoo_erase_hash(cuckoo, hash));
+  EXPECT_TRUE(hash_cuckoo_contains_hash(cuckoo, hash));
+  EXPECT_TRUE(hash_cuckoo_erase_hash(cuckoo, hash));
+  EXPECT_FALSE(hash_cuckoo_contains_hash(cuckoo, hash));
+  EXPECT_FALSE(hash_cuckoo_erase_hash(cuckoo, hash));
+  hash_cuckoo_destroy(cuckoo);
+}
+
+TEST(CuckooTest, FullFilterRejectsAddsUntilErase) {
+  // Four buckets of four slots, and room for one more fingerprint that didn't fit.
+  struct hash_cuckoo *cuckoo = hash_cuckoo_new(8, 16);
+  ASSERT_NE(cuckoo, nullptr);
+  size_t added = 0;
+  while (cuckoo_test_add(cuckoo, added)) {
+    ++added;
+    ASSERT_LE(added, 17u);
+  }
+  EXPECT_GE(added, 12u);
+  EXPECT_EQ(hash_cuckoo_size(cuckoo), added);
+  for (size_t i = 0; i < added; ++i) {
+    ASSERT_TRUE(cuckoo_test_contains(cuckoo, i)) << i;
+  }
+
+  // Erasing makes room again, and every remaining key is still found.
+  ASSERT_TRUE(cuckoo_test_erase(cuckoo, 0));
+  ASSERT_TRUE(cuckoo_test_add(cuckoo, added));
+  for (size_t i = 1; i <= added; ++i) {
+    ASSERT_TRUE(cuckoo_test_contains(cuckoo, i)) << i;
+  }
+  hash_cuckoo_destroy(cuckoo);
+}
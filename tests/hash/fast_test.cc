@@ -0,0 +1,136 @@
+#include <pocketknife/hash/fast.h>
+#include <pocketknife/hash/fnv.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+static std::vector<uint8_t> fast_test_data(size_t length) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = (uint8_t)((i * 31) + 7);
+  }
+  return data;
+}
+
+TEST(FastHashTest, KnownValues) {
+  // Pinned so that the output can't change unnoticed; hashes may be persisted.
+  std::vector<uint8_t> data = fast_test_data(5000);
+  EXPECT_EQ(hash_fast64(data.data(), 0, 0), 0x0409638ee2bde459ULL);
+  EXPECT_EQ(hash_fast64(data.data(), 3, 0), 0xaa4dada6d17eebb0ULL);
+  EXPECT_EQ(hash_fast64(data.data(), 16, 0), 0x36b53f8551944db0ULL);
+  EXPECT_EQ(hash_fast64(data.data(), 100, 0), 0xe0c3d79ee1609ba9ULL);
+  EXPECT_EQ(hash_fast64(data.data(), 241, 0), 0xf06900c7a31da7cbULL);
+  EXPECT_EQ(hash_fast64(data.data(), 1025, 0), 0x17f0ecf4f14d735cULL);
+  EXPECT_EQ(hash_fast64(data.data(), 5000, 0), 0x1ecf701e99639fbdULL);
+  EXPECT_EQ(hash_fast64(data.data(), 8, 42), 0xdc918de2c5e1e437ULL);
+  EXPECT_EQ(hash_fast64(data.data(), 1024, 42), 0x7fbc655cee9c5716ULL);
+}
+
+TEST(FastHashTest, LowHalfOf128MatchesHash64) {
+  std::vector<uint8_t> data = fast_test_data(3000);
+  for (size_t length = 0; length < data.size(); length += 7) {
+    struct hash128 hash = hash_fast128(data.data(), length, length);
+    EXPECT_EQ(hash.low, hash_fast64(data.data(), length, length)) << length;
+    EXPECT_NE(hash.low, hash.high) << length;
+  }
+}
+
+TEST(FastHashTest, ImplementationsAgree) {
+  enum HashFastImpl original = hash_fast_impl();
+  std::vector<uint8_t> data = fast_test_data(4200);
+
+  // Covers every remainder of the stripe and block sizes, and a misaligned start.
+  std::vector<uint64_t> expected;
+  ASSERT_TRUE(hash_fast_set_impl(HASH_FAST_SCALAR));
+  for (size_t length = 241; length < 4100; ++length) {
+    expected.push_back(hash_fast64(data.data() + 1, length, length & 3));
+  }
+
+  for (enum HashFastImpl impl : {HASH_FAST_SSE2, HASH_FAST_AVX2}) {
+    if (!hash_fast_set_impl(impl)) {
+      continue;
+    }
+    EXPECT_EQ(hash_fast_impl(), impl);
+    for (size_t length = 241; length < 4100; ++length) {
+      ASSERT_EQ(hash_fast64(data.data() + 1, length, length & 3), expected[length - 241])
+          << "impl " << impl << " length " << length;
+    }
+  }
+
+  ASSERT_TRUE(hash_fast_set_impl(original));
+}
+
+TEST(FastHashTest, EveryBitMatters) {
+  const size_t lengths[] = {1, 4, 9, 16, 17, 64, 240, 241, 1024, 1500};
+  for (size_t length : lengths) {
+    std::vector<uint8_t> data = fast_test_data(length);
+    uint64_t hash = hash_fast64(data.data(), length, 0);
+    for (size_t bit = 0; bit < length * 8; ++bit) {
+      data[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+      ASSERT_NE(hash_fast64(data.data(), length, 0), hash) << length << " " << bit;
+      data[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+    }
+  }
+}
+
+TEST(FastHashTest, SeedAndLengthMatter) {
+  std::vector<uint8_t> data(2048, 0);
+  const size_t lengths[] = {0, 5, 32, 300, 2048};
+  for (size_t length : lengths) {
+    EXPECT_NE(hash_fast64(data.data(), length, 0), hash_fast64(data.data(), length, 1));
+    if (length) {
+      EXPECT_NE(hash_fast64(data.data(), length, 0), hash_fast64(data.data(), length - 1, 0));
+    }
+  }
+}
+
+// Feeds the input through the streaming API in chunks of the given sizes, cycling through them.
+static struct hash128 fast_test_stream(const std::vector<uint8_t> &data, size_t length,
+                                       uint64_t seed, const std::vector<size_t> &chunks) {
+  struct hash_fast_state state;
+  hash_fast_init(&state, seed);
+  size_t offset = 0;
+  for (size_t i = 0; offset < length; ++i) {
+    size_t chunk = std::min(chunks[i % chunks.size()], length - offset);
+    hash_fast_update(&state, data.data() + offset, chunk);
+    offset += chunk;
+  }
+
+  struct hash128 hash = hash_fast128_final(&state);
+  EXPECT_EQ(hash.low, hash_fast64_final(&state));
+  return hash;
+}
+
+TEST(FastHashTest, StreamingMatchesOneShot) {
+  std::vector<uint8_t> data = fast_test_data(5000);
+
+  // Chunk sizes either side of a stripe, the buffer and a block, so that stripes straddle updates
+  // and the last stripe straddles the buffer.
+  const std::vector<std::vector<size_t>> chunkings = {
+      {1}, {7}, {63, 1}, {64}, {65}, {100, 3}, {255}, {256}, {257}, {1000}, {1025, 31}, {5000}};
+  const size_t lengths[] = {0, 1, 17, 240, 241, 255, 256, 257, 300, 319, 320, 321,
+                            511, 512, 513, 1024, 1025, 2000, 4096, 4097, 5000};
+  for (const std::vector<size_t> &chunks : chunkings) {
+    for (size_t length : lengths) {
+      for (uint64_t seed : {0ULL, 42ULL}) {
+        struct hash128 streamed = fast_test_stream(data, length, seed, chunks);
+        struct hash128 expected = hash_fast128(data.data(), length, seed);
+        ASSERT_EQ(streamed.low, expected.low) << chunks[0] << " " << length << " " << seed;
+        ASSERT_EQ(streamed.high, expected.high) << chunks[0] << " " << length << " " << seed;
+      }
+    }
+  }
+}
+
+TEST(FastHashTest, StreamingCanContinueAfterFinal) {
+  std::vector<uint8_t> data = fast_test_data(3000);
+
+  struct hash_fast_state state;
+  hash_fast_init(&state, 7);
+  for (size_t length = 0; length + 97 <= data.size(); length += 97) {
+    ASSERT_EQ(hash_fast64_final(&state), hash_fast64(data.data(), length, 7)) << length;
+    hash_fast_update(&state, data.data() + length, 97);
+  }
+}
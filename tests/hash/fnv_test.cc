@@ -1,7 +1,14 @@
 #include <pocketknife/hash/fnv.h>
+#include <pocketknife/hash/fnv.hpp>
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace pocketknife::hash::literals;
+
 TEST(FNVHashTest, FNV1_KnownValues) {
   // Test vectors from http://www.isthe.com/chongo/tech/comp/fnv/
   const uint8_t empty[1] = {0};
@@ -47,3 +54,96 @@ TEST(FNVHashTest, FNV1a_Consistency) {
   const uint8_t test[] = {'t', 'e', 's', 't'};
   EXPECT_EQ(hash_fnv1a(test, 4), hash_fnv1a(test, 4));
 }
+
+TEST(FNVHashTest, StreamingMatchesOneShot) {
+  const uint8_t text[] = "the quick brown fox jumps over the lazy dog";
+  const size_t length = sizeof(text) - 1;
+
+  for (size_t split = 0; split <= length; ++split) {
+    struct hash_fnv_state fnv1, fnv1a;
+    hash_fnv1_init(&fnv1);
+    hash_fnv1a_init(&fnv1a);
+    hash_fnv1_update(&fnv1, text, split);
+    hash_fnv1a_update(&fnv1a, text, split);
+    EXPECT_EQ(hash_fnv1_final(&fnv1), hash_fnv1(text, split));
+    EXPECT_EQ(hash_fnv1a_final(&fnv1a), hash_fnv1a(text, split));
+
+    hash_fnv1_update(&fnv1, text + split, length - split);
+    hash_fnv1a_update(&fnv1a, text + split, length - split);
+    EXPECT_EQ(hash_fnv1_final(&fnv1), hash_fnv1(text, length)) << split;
+    EXPECT_EQ(hash_fnv1a_final(&fnv1a), hash_fnv1a(text, length)) << split;
+  }
+}
+
+TEST(FNVHashTest, BatchMatchesOneShot) {
+  std::vector<uint8_t> bytes(4096);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = (uint8_t)((i * 37) + 11);
+  }
+
+  // Lengths that vary within each group of sixteen, and counts that leave a partial group.
+  std::vector<const uint8_t *> keys;
+  std::vector<size_t> lengths;
+  for (size_t i = 0; i < 203; ++i) {
+    keys.push_back(bytes.data() + ((i * 13) % 2048));
+    lengths.push_back(i < 64 ? 16 : (i * 7) % 61);
+  }
+
+  for (size_t count : {(size_t)0, (size_t)5, (size_t)16, keys.size()}) {
+    std::vector<uint64_t> fnv1(count), fnv1a(count);
+    hash_fnv1_batch(keys.data(), lengths.data(), count, fnv1.data());
+    hash_fnv1a_batch(keys.data(), lengths.data(), count, fnv1a.data());
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(fnv1[i], hash_fnv1(keys[i], lengths[i])) << i;
+      ASSERT_EQ(fnv1a[i], hash_fnv1a(keys[i], lengths[i])) << i;
+    }
+  }
+}
+
+// The test vectors above, checked at compile time.
+static_assert(pocketknife::hash::fnv1("") == 0xcbf29ce484222325ULL);
+static_assert(pocketknife::hash::fnv1("hello") == 0x7b495389bdbdd4c7ULL);
+static_assert("a"_fnv1 == 0xaf63bd4c8601b7beULL);
+static_assert(pocketknife::hash::fnv1a("") == 0xcbf29ce484222325ULL);
+static_assert(pocketknife::hash::fnv1a("hello") == 0xa430d84680aabd0bULL);
+static_assert("a"_fnv1a == 0xaf63dc4c8601ec8cULL);
+
+TEST(FNVHashTest, ConstexprMatchesC) {
+  // Every byte value, including those that are negative as a char, and embedded NULs.
+  std::string text;
+  for (int i = 0; i < 600; ++i) {
+    text.push_back((char)(unsigned char)((i * 151) + 3));
+  }
+
+  for (size_t length = 0; length <= text.size(); ++length) {
+    std::string_view view(text.data(), length);
+    const uint8_t *data = (const uint8_t *)text.data();
+    ASSERT_EQ(pocketknife::hash::fnv1(view), hash_fnv1(data, length)) << length;
+    ASSERT_EQ(pocketknife::hash::fnv1a(view), hash_fnv1a(data, length)) << length;
+  }
+
+  const uint8_t nul[] = {'a', 0, 'b'};
+  EXPECT_EQ("a\0b"_fnv1, hash_fnv1(nul, 3));
+  EXPECT_EQ("a\0b"_fnv1a, hash_fnv1a(nul, 3));
+}
+
+static int fnv_test_command(std::string_view name) {
+  switch (hash_fnv1a((const uint8_t *)name.data(), name.size())) {
+    case "get"_fnv1a:
+      return 1;
+    case "set"_fnv1a:
+      return 2;
+    case "delete"_fnv1a:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+TEST(FNVHashTest, LiteralsWorkAsCaseLabels) {
+  EXPECT_EQ(fnv_test_command("get"), 1);
+  EXPECT_EQ(fnv_test_command("set"), 2);
+  EXPECT_EQ(fnv_test_command("delete"), 3);
+  EXPECT_EQ(fnv_test_command("put"), 0);
+  EXPECT_EQ(fnv_test_command(""), 0);
+}
@@ -0,0 +1,218 @@
+#include <pocketknife/hash/hll.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+static void hll_test_add(struct hash_hll *hll, uint64_t begin, uint64_t end) {
+  for (uint64_t key = begin; key < end; ++key) {
+    ASSERT_GE(hash_hll_add(hll, (const uint8_t *)&key, sizeof(key)), 0);
+  }
+}
+
+static std::vector<uint8_t> hll_test_serialize(const struct hash_hll *hll) {
+  std::vector<uint8_t> data(hash_hll_serialize(hll, nullptr, 0));
+  EXPECT_EQ(hash_hll_serialize(hll, data.data(), data.size()), data.size());
+  return data;
+}
+
+TEST(HyperLogLogTest, RejectsBadPrecisions) {
+  EXPECT_EQ(hash_hll_new(HASH_HLL_MIN_PRECISION - 1), nullptr);
+  EXPECT_EQ(hash_hll_new(HASH_HLL_MAX_PRECISION + 1), nullptr);
+  for (int precision = HASH_HLL_MIN_PRECISION; precision <= HASH_HLL_MAX_PRECISION; ++precision) {
+    struct hash_hll *hll = hash_hll_new(precision);
+    ASSERT_NE(hll, nullptr);
+    EXPECT_EQ(hash_hll_precision(hll), precision);
+    EXPECT_EQ(hash_hll_estimate(hll), 0);
+    hash_hll_destroy(hll);
+  }
+}
+
+TEST(HyperLogLogTest, EstimatesAreWithinTheError) {
+  for (int precision : {10, 14, 16}) {
+    struct hash_hll *hll = hash_hll_new(precision);
+    // Four times the standard error, so that no count fails by chance.
+    double error = 4 * 1.04 / std::sqrt((double)(1 << precision));
+    uint64_t added = 0;
+    for (uint64_t count : {1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u}) {
+      hll_test_add(hll, added, count);
+      added = count;
+      double estimate = hash_hll_estimate(hll);
+      EXPECT_NEAR(estimate, (double)count, std::max(error * (double)count, 0.5))
+          << precision << " " << count;
+    }
+    hash_hll_destroy(hll);
+  }
+}
+
+TEST(HyperLogLogTest, RepeatsDontCount) {
+  struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  hll_test_add(hll, 0, 5000);
+  double estimate = hash_hll_estimate(hll);
+  for (uint64_t key = 0; key < 5000; ++key) {
+    EXPECT_EQ(hash_hll_add(hll, (const uint8_t *)&key, sizeof(key)), 0);
+  }
+  EXPECT_EQ(hash_hll_estimate(hll), estimate);
+  hash_hll_destroy(hll);
+}
+
+TEST(HyperLogLogTest, MemoryIsBounded) {
+  struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  size_t registers = 1 << HASH_HLL_DEFAULT_PRECISION;
+
+  // Small sketches stay sparse and small.
+  hll_test_add(hll, 0, 100);
+  EXPECT_LT(hash_hll_bytes(hll), registers / 8);
+  EXPECT_LT(hll_test_serialize(hll).size(), registers / 8);
+
+  hll_test_add(hll, 100, 1000000);
+  EXPECT_EQ(hash_hll_bytes(hll), registers);
+  EXPECT_EQ(hll_test_serialize(hll).size(), registers + 4);
+  hash_hll_destroy(hll);
+}
+
+TEST(HyperLogLogTest, SparseAndDenseAgree) {
+  struct hash_hll *sparse = hash_hll_new(12);
+  hll_test_add(sparse, 0, 300);
+  ASSERT_LT(hash_hll_bytes(sparse), 1u << 12);
+
+  // Rewrites the sparse serialization as a dense one.
+  std::vector<uint8_t> data = hll_test_serialize(sparse);
+  std::vector<uint8_t> dense(4 + (1 << 12), 0);
+  dense[0] = data[0];
+  dense[1] = data[1];
+  dense[2] = 1;
+  for (size_t i = 4; i < data.size(); i += 3) {
+    uint32_t packed = data[i] | ((uint32_t)data[i + 1] << 8) | ((uint32_t)data[i + 2] << 16);
+    dense[4 + (packed >> 6)] = (uint8_t)(packed & 0x3f);
+  }
+  struct hash_hll *hll = hash_hll_deserialize(dense.data(), dense.size());
+  ASSERT_NE(hll, nullptr);
+  EXPECT_EQ(hash_hll_bytes(hll), 1u << 12);
+  EXPECT_EQ(hash_hll_estimate(hll), hash_hll_estimate(sparse));
+
+  hash_hll_destroy(hll);
+  hash_hll_destroy(sparse);
+}
+
+TEST(HyperLogLogTest, MergeCountsTheUnion) {
+  // Every combination of sparse and dense, with the two sets overlapping.
+  for (uint64_t dst_count : {200u, 50000u}) {
+    for (uint64_t src_count : {200u, 50000u}) {
+      struct hash_hll *all = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+      struct hash_hll *dst = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+      struct hash_hll *src = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+      hll_test_add(all, 0, std::max(dst_count, (dst_count / 2) + src_count));
+      hll_test_add(dst, 0, dst_count);
+      hll_test_add(src, dst_count / 2, (dst_count / 2) + src_count);
+
+      EXPECT_EQ(hash_hll_merge(dst, src), 1);
+      EXPECT_EQ(hash_hll_estimate(dst), hash_hll_estimate(all)) << dst_count << " " << src_count;
+
+      hash_hll_destroy(all);
+      hash_hll_destroy(dst);
+      hash_hll_destroy(src);
+    }
+  }
+
+  struct hash_hll *a = hash_hll_new(10);
+  struct hash_hll *b = hash_hll_new(11);
+  hll_test_add(b, 0, 10);
+  EXPECT_EQ(hash_hll_merge(a, b), 0);
+  EXPECT_EQ(hash_hll_estimate(a), 0);
+  hash_hll_destroy(a);
+  hash_hll_destroy(b);
+}
+
+TEST(HyperLogLogTest, MergesAcrossThreads) {
+  struct hash_hll *all = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  hll_test_add(all, 0, 400000);
+
+  std::vector<struct hash_hll *> parts;
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < 4; ++i) {
+    parts.push_back(hash_hll_new(HASH_HLL_DEFAULT_PRECISION));
+    threads.emplace_back(hll_test_add, parts.back(), i * 100000, (i + 1) * 100000);
+  }
+  struct hash_hll *merged = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  for (size_t i = 0; i < parts.size(); ++i) {
+    threads[i].join();
+    EXPECT_EQ(hash_hll_merge(merged, parts[i]), 1);
+    hash_hll_destroy(parts[i]);
+  }
+  EXPECT_EQ(hash_hll_estimate(merged), hash_hll_estimate(all));
+
+  hash_hll_destroy(merged);
+  hash_hll_destroy(all);
+}
+
+TEST(HyperLogLogTest, SerializationRoundTrips) {
+  for (uint64_t count : {0u, 100u, 100000u}) {
+    struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+    hll_test_add(hll, 0, count);
+    std::vector<uint8_t> data = hll_test_serialize(hll);
+    EXPECT_EQ(hash_hll_serialize(hll, data.data(), data.size() - 1), data.size());
+
+    struct hash_hll *copy = hash_hll_deserialize(data.data(), data.size());
+    ASSERT_NE(copy, nullptr);
+    EXPECT_EQ(hash_hll_precision(copy), HASH_HLL_DEFAULT_PRECISION);
+    EXPECT_EQ(hash_hll_estimate(copy), hash_hll_estimate(hll)) << count;
+    EXPECT_EQ(hash_hll_bytes(copy), hash_hll_bytes(hll)) << count;
+
+    // The copy goes on counting like the original.
+    hll_test_add(hll, count, count + 1000);
+    hll_test_add(copy, count, count + 1000);
+    EXPECT_EQ(hash_hll_estimate(copy), hash_hll_estimate(hll)) << count;
+
+    hash_hll_destroy(copy);
+    hash_hll_destroy(hll);
+  }
+}
+
+TEST(HyperLogLogTest, DeserializeRejectsBadData) {
+  struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+  hll_test_add(hll, 0, 100);
+  std::vector<uint8_t> sparse = hll_test_serialize(hll);
+  hll_test_add(hll, 100, 100000);
+  std::vector<uint8_t> dense = hll_test_serialize(hll);
+  hash_hll_destroy(hll);
+
+  for (const std::vector<uint8_t> &good : {sparse, dense}) {
+    EXPECT_EQ(hash_hll_deserialize(good.data(), 3), nullptr);
+    EXPECT_EQ(hash_hll_deserialize(good.data(), good.size() - 1), nullptr);
+    std::vector<uint8_t> bad = good;
+    bad[0] = 2;
+    EXPECT_EQ(hash_hll_deserialize(bad.data(), bad.size()), nullptr);
+    bad = good;
+    bad[1] = HASH_HLL_MAX_PRECISION + 1;
+    EXPECT_EQ(hash_hll_deserialize(bad.data(), bad.size()), nullptr);
+    bad = good;
+    bad[2] = 2;
+    EXPECT_EQ(hash_hll_deserialize(bad.data(), bad.size()), nullptr);
+  }
+
+  // Ranks above the largest possible, and a sparse entry of rank zero.
+  std::vector<uint8_t> bad = dense;
+  bad[10] = 64 - HASH_HLL_DEFAULT_PRECISION + 2;
+  EXPECT_EQ(hash_hll_deserialize(bad.data(), bad.size()), nullptr);
+  bad = sparse;
+  bad[4] = (uint8_t)(bad[4] & ~0x3f);
+  EXPECT_EQ(hash_hll_deserialize(bad.data(), bad.size()), nullptr);
+}
+
+TEST(HyperLogLogTest, ClearEmptiesTheSketch) {
+  for (uint64_t count : {100u, 100000u}) {
+    struct hash_hll *hll = hash_hll_new(HASH_HLL_DEFAULT_PRECISION);
+    hll_test_add(hll, 0, count);
+    size_t bytes = hash_hll_bytes(hll);
+    hash_hll_clear(hll);
+    EXPECT_EQ(hash_hll_estimate(hll), 0);
+    EXPECT_EQ(hash_hll_bytes(hll), bytes);
+    hll_test_add(hll, 0, 10);
+    EXPECT_NEAR(hash_hll_estimate(hll), 10, 0.5);
+    hash_hll_destroy(hll);
+  }
+}
@@ -0,0 +1,203 @@
+#include <pocketknife/allocator/allocator.h>
+#include <pocketknife/hash/fnv.h>
+#include <pocketknife/hash/map.h>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+
+static void *map_test_value(size_t i) { return (void *)(i + 1); }
+
+static std::string map_test_key(size_t i) { return "key-" + std::to_string(i); }
+
+TEST(HashMapTest, StringKeys) {
+  struct hash_map *map = hash_map_new(HASH_MAP_STRING_KEYS);
+  ASSERT_NE(map, nullptr);
+  EXPECT_EQ(hash_map_lookup(map, "missing", 7), nullptr);
+
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_insert(map, key.data(), key.size(), map_test_value(i)), 1);
+  }
+  EXPECT_EQ(hash_map_size(map), 1000u);
+
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_lookup(map, key.data(), key.size()), map_test_value(i)) << key;
+  }
+  EXPECT_EQ(hash_map_lookup(map, "key-1000", 8), nullptr);
+  EXPECT_EQ(hash_map_lookup(map, "key-1", 4), nullptr);
+
+  // Replacing keeps the size.
+  EXPECT_EQ(hash_map_insert(map, "key-5", 5, map_test_value(500)), 0);
+  EXPECT_EQ(hash_map_lookup(map, "key-5", 5), map_test_value(500));
+  EXPECT_EQ(hash_map_size(map), 1000u);
+
+  hash_map_destroy(map);
+}
+
+TEST(HashMapTest, StringKeysAreCopied) {
+  struct hash_map *map = hash_map_new(HASH_MAP_STRING_KEYS);
+
+  char key[] = "mutable";
+  ASSERT_EQ(hash_map_insert(map, key, 7, map_test_value(0)), 1);
+  key[0] = 'M';
+  EXPECT_EQ(hash_map_lookup(map, "mutable", 7), map_test_value(0));
+  EXPECT_EQ(hash_map_lookup(map, key, 7), nullptr);
+
+  // Keys are byte strings; the empty key and embedded zeros are fine.
+  ASSERT_EQ(hash_map_insert(map, "", 0, map_test_value(1)), 1);
+  ASSERT_EQ(hash_map_insert(map, "a\0b", 3, map_test_value(2)), 1);
+  EXPECT_EQ(hash_map_lookup(map, "", 0), map_test_value(1));
+  EXPECT_EQ(hash_map_lookup(map, "a\0b", 3), map_test_value(2));
+  EXPECT_EQ(hash_map_lookup(map, "a", 1), nullptr);
+
+  hash_map_destroy(map);
+}
+
+TEST(HashMapTest, IntKeys) {
+  struct hash_map *map = hash_map_new(HASH_MAP_INT_KEYS);
+
+  for (size_t i = 0; i < 5000; ++i) {
+    ASSERT_EQ(hash_map_insert_int(map, i * 7919, map_test_value(i)), 1);
+  }
+  ASSERT_EQ(hash_map_insert_int(map, UINT64_MAX, nullptr), 1);
+
+  for (size_t i = 0; i < 5000; ++i) {
+    ASSERT_EQ(hash_map_lookup_int(map, i * 7919), map_test_value(i)) << i;
+    ASSERT_FALSE(hash_map_contains_int(map, (i * 7919) + 1)) << i;
+  }
+
+  // A NULL value is still present.
+  EXPECT_EQ(hash_map_lookup_int(map, UINT64_MAX), nullptr);
+  EXPECT_TRUE(hash_map_contains_int(map, UINT64_MAX));
+  EXPECT_EQ(hash_map_size(map), 5001u);
+
+  hash_map_destroy(map);
+}
+
+TEST(HashMapTest, MatchesStdMapUnderChurn) {
+  struct hash_map *map = hash_map_new(HASH_MAP_INT_KEYS);
+  std::map<uint64_t, void *> expected;
+  std::mt19937_64 random(42);
+
+  for (size_t i = 0; i < 200000; ++i) {
+    uint64_t key = random() % 3000;
+    switch (random() % 3) {
+      case 0:
+        ASSERT_EQ(hash_map_insert_int(map, key, map_test_value(i)), expected.count(key) ? 0 : 1);
+        expected[key] = map_test_value(i);
+        break;
+      case 1:
+        ASSERT_EQ(hash_map_erase_int(map, key), (int)expected.erase(key));
+        break;
+      default:
+        ASSERT_EQ(hash_map_contains_int(map, key), (int)expected.count(key));
+        break;
+    }
+  }
+
+  ASSERT_EQ(hash_map_size(map), expected.size());
+  std::map<uint64_t, void *> found;
+  struct hash_map_entry entry;
+  for (size_t position = 0; hash_map_next(map, &position, &entry);) {
+    EXPECT_EQ(entry.key, nullptr);
+    found[entry.int_key] = entry.value;
+  }
+  EXPECT_EQ(found, expected);
+
+  hash_map_destroy(map);
+}
+
+TEST(HashMapTest, EraseAndClear) {
+  struct hash_map *map = hash_map_new(HASH_MAP_STRING_KEYS);
+
+  for (size_t i = 0; i < 100; ++i) {
+    std::string key = map_test_key(i);
+    hash_map_insert(map, key.data(), key.size(), map_test_value(i));
+  }
+  for (size_t i = 0; i < 100; i += 2) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_erase(map, key.data(), key.size()), 1);
+    ASSERT_EQ(hash_map_erase(map, key.data(), key.size()), 0);
+  }
+  EXPECT_EQ(hash_map_size(map), 50u);
+  for (size_t i = 0; i < 100; ++i) {
+    std::string key = map_test_key(i);
+    EXPECT_EQ(hash_map_contains(map, key.data(), key.size()), (int)(i % 2)) << key;
+  }
+
+  hash_map_clear(map);
+  EXPECT_EQ(hash_map_size(map), 0u);
+  EXPECT_FALSE(hash_map_contains(map, "key-1", 5));
+  ASSERT_EQ(hash_map_insert(map, "key-1", 5, map_test_value(1)), 1);
+  EXPECT_EQ(hash_map_lookup(map, "key-1", 5), map_test_value(1));
+
+  hash_map_destroy(map);
+}
+
+static uint64_t map_test_constant_hash(const uint8_t *data, size_t length) {
+  (void)data;
+  (void)length;
+  return 0x1234;
+}
+
+TEST(HashMapTest, PluggableHash) {
+  // Every key collides, so lookups have to probe past full groups.
+  struct hash_map_config config = {};
+  config.keys = HASH_MAP_STRING_KEYS;
+  config.hash = map_test_constant_hash;
+  struct hash_map *map = hash_map_new_with_config(&config);
+
+  for (size_t i = 0; i < 200; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_insert(map, key.data(), key.size(), map_test_value(i)), 1);
+  }
+  for (size_t i = 0; i < 200; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_lookup(map, key.data(), key.size()), map_test_value(i)) << key;
+  }
+  hash_map_destroy(map);
+
+  config.hash = hash_fnv1a;
+  map = hash_map_new_with_config(&config);
+  ASSERT_EQ(hash_map_insert(map, "fnv", 3, map_test_value(0)), 1);
+  EXPECT_EQ(hash_map_lookup(map, "fnv", 3), map_test_value(0));
+  hash_map_destroy(map);
+}
+
+static void *map_test_arena_alloc(void *context, size_t size) {
+  return allocator_alloc((struct allocator *)context, size);
+}
+
+static void map_test_arena_free(void *context, void *ptr) {
+  allocator_free((struct allocator *)context, ptr);
+}
+
+TEST(HashMapTest, LivesInAllocatorArenas) {
+  struct allocator *arena = allocator_new(4096 * 256);
+  ASSERT_NE(arena, nullptr);
+
+  struct hash_map_config config = {};
+  config.keys = HASH_MAP_STRING_KEYS;
+  config.alloc = map_test_arena_alloc;
+  config.free = map_test_arena_free;
+  config.allocator_context = arena;
+  config.capacity = 100;
+  struct hash_map *map = hash_map_new_with_config(&config);
+  ASSERT_NE(map, nullptr);
+
+  for (size_t i = 0; i < 2000; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_insert(map, key.data(), key.size(), map_test_value(i)), 1);
+  }
+  for (size_t i = 0; i < 2000; ++i) {
+    std::string key = map_test_key(i);
+    ASSERT_EQ(hash_map_lookup(map, key.data(), key.size()), map_test_value(i));
+  }
+
+  hash_map_destroy(map);
+  allocator_destroy(arena);
+}
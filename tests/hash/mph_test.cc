@@ -0,0 +1,107 @@
+#include <pocketknife/hash/mph.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+// A set of distinct keys of varied lengths, as the arrays hash_mph_build takes.
+struct MphTestKeys {
+  std::vector<std::string> strings;
+  std::vector<const uint8_t *> keys;
+  std::vector<size_t> lengths;
+
+  explicit MphTestKeys(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      strings.push_back("key-" + std::to_string(i * 7919) + std::string(i % 23, 'x'));
+    }
+    for (const std::string &s : strings) {
+      keys.push_back((const uint8_t *)s.data());
+      lengths.push_back(s.size());
+    }
+  }
+};
+
+// Checks that every key maps to a distinct index below the number of keys.
+static void mph_test_expect_minimal_perfect(const struct hash_mph *mph, const MphTestKeys &keys) {
+  ASSERT_EQ(hash_mph_count(mph), keys.keys.size());
+  std::vector<bool> seen(keys.keys.size());
+  for (size_t i = 0; i < keys.keys.size(); ++i) {
+    size_t index = hash_mph_lookup(mph, keys.keys[i], keys.lengths[i]);
+    ASSERT_LT(index, keys.keys.size()) << keys.strings[i];
+    ASSERT_FALSE(seen[index]) << keys.strings[i];
+    seen[index] = true;
+  }
+}
+
+TEST(MphTest, MapsKeysToDistinctIndexes) {
+  for (size_t count : {1u, 2u, 3u, 10u, 64u, 1000u, 100000u}) {
+    MphTestKeys keys(count);
+    struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), count);
+    ASSERT_NE(mph, nullptr) << count;
+    mph_test_expect_minimal_perfect(mph, keys);
+    hash_mph_destroy(mph);
+  }
+}
+
+TEST(MphTest, FewBitsPerKey) {
+  MphTestKeys keys(100000);
+  struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size());
+  ASSERT_NE(mph, nullptr);
+  EXPECT_LT((double)hash_mph_bytes(mph) * 8 / (double)keys.keys.size(), 5.0);
+  hash_mph_destroy(mph);
+}
+
+TEST(MphTest, EmptySet) {
+  struct hash_mph *mph = hash_mph_build(nullptr, nullptr, 0);
+  ASSERT_NE(mph, nullptr);
+  EXPECT_EQ(hash_mph_count(mph), 0u);
+  EXPECT_EQ(hash_mph_lookup(mph, (const uint8_t *)"a", 1), 0u);
+  hash_mph_destroy(mph);
+}
+
+TEST(MphTest, DuplicateKeysFail) {
+  MphTestKeys keys(500);
+  keys.keys[321] = keys.keys[17];
+  keys.lengths[321] = keys.lengths[17];
+  EXPECT_EQ(hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size()), nullptr);
+}
+
+TEST(MphTest, ViewOfCopyLooksUpTheSame) {
+  MphTestKeys keys(5000);
+  struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size());
+  ASSERT_NE(mph, nullptr);
+
+  size_t bytes = hash_mph_bytes(mph);
+  std::vector<uint64_t> buffer((bytes + 7) / 8);
+  memcpy(buffer.data(), mph, bytes);
+  const struct hash_mph *view = hash_mph_view(buffer.data(), bytes);
+  ASSERT_NE(view, nullptr);
+  for (size_t i = 0; i < keys.keys.size(); ++i) {
+    ASSERT_EQ(hash_mph_lookup(view, keys.keys[i], keys.lengths[i]),
+              hash_mph_lookup(mph, keys.keys[i], keys.lengths[i]));
+  }
+  hash_mph_destroy(mph);
+}
+
+TEST(MphTest, ViewRejectsBadBuffers) {
+  MphTestKeys keys(100);
+  struct hash_mph *mph = hash_mph_build(keys.keys.data(), keys.lengths.data(), keys.keys.size());
+  ASSERT_NE(mph, nullptr);
+  size_t bytes = hash_mph_bytes(mph);
+  std::vector<uint64_t> buffer((bytes / 8) + 1);
+  memcpy(buffer.data(), mph, bytes);
+
+  EXPECT_EQ(hash_mph_view(buffer.data(), bytes - 8), nullptr);
+  EXPECT_EQ(hash_mph_view(buffer.data(), 16), nullptr);
+  EXPECT_EQ(hash_mph_view((const uint8_t *)buffer.data() + 1, bytes), nullptr);
+
+  // A remapped index out of range, at the end of the buffer.
+  uint32_t bad = 1000;
+  memcpy((uint8_t *)buffer.data() + bytes - 8, &bad, sizeof(bad));
+  EXPECT_EQ(hash_mph_view(buffer.data(), bytes), nullptr);
+
+  buffer[0] ^= 1;
+  EXPECT_EQ(hash_mph_view(buffer.data(), bytes), nullptr);
+  hash_mph_destroy(mph);
+}
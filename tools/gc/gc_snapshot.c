@@ -0,0 +1,540 @@
+// Reads a heap snapshot written by gc_heap_snapshot, and reports the objects that keep the most
+// memory alive.
+//
+// An object's dominator is the closest object that every path from the roots to it passes
+// through, and its retained size is the memory that would be freed if it were collected: its own
+// size plus the sizes of every object it dominates. Dominators are found with the iterative
+// algorithm from Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm".
+//
+// Usage: gc_snapshot [-n count] snapshot
+
+#include <pocketknife/gc/gc.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNDEFINED UINT32_MAX
+
+struct edge {
+  uint32_t from;
+  uint32_t to;
+};
+
+struct snapshot {
+  // Objects, in the order they appear in the snapshot.
+  uint32_t *ids;
+  uint64_t *sizes;
+  unsigned char *spaces;
+  size_t count;
+  size_t capacity;
+
+  // Edges between object ids. Ephemerons are treated as edges from their keys to their values.
+  struct edge *edges;
+  size_t edge_count;
+  size_t edge_capacity;
+
+  uint32_t *roots;
+  size_t root_count;
+  size_t root_capacity;
+};
+
+// The snapshot as a graph over object indices, with a synthetic root at index `count` whose
+// successors are the snapshot's roots.
+struct graph {
+  size_t count;
+
+  // Successors and predecessors in compressed sparse row form.
+  uint32_t *succ_start;
+  uint32_t *succ;
+  uint32_t *pred_start;
+  uint32_t *pred;
+
+  // Postorder number of each node, or UNDEFINED if it's unreachable, and nodes by postorder.
+  uint32_t *post;
+  uint32_t *order;
+  size_t reachable;
+
+  uint32_t *idom;
+  uint64_t *retained;
+};
+
+static void *xrealloc(void *ptr, size_t size) {
+  void *result = realloc(ptr, size ? size : 1);
+  if (!result) {
+    fprintf(stderr, "gc_snapshot: out of memory\n");
+    exit(1);
+  }
+  return result;
+}
+
+static void *xcalloc(size_t count, size_t size) {
+  void *result = calloc(count ? count : 1, size);
+  if (!result) {
+    fprintf(stderr, "gc_snapshot: out of memory\n");
+    exit(1);
+  }
+  return result;
+}
+
+static void *grow(void *array, size_t element_size, size_t count, size_t *capacity) {
+  if (count < *capacity) {
+    return array;
+  }
+  *capacity = *capacity ? *capacity * 2 : 64;
+  return xrealloc(array, *capacity * element_size);
+}
+
+static int read_bytes(FILE *file, void *out, size_t size) {
+  return fread(out, 1, size, file) == size;
+}
+
+static int read_u8(FILE *file, unsigned *out) {
+  unsigned char byte;
+  if (!read_bytes(file, &byte, 1)) {
+    return 0;
+  }
+  *out = byte;
+  return 1;
+}
+
+static int read_u32(FILE *file, uint32_t *out) {
+  unsigned char bytes[4];
+  if (!read_bytes(file, bytes, sizeof(bytes))) {
+    return 0;
+  }
+  *out = 0;
+  for (int i = 3; i >= 0; --i) {
+    *out = (*out << 8) | bytes[i];
+  }
+  return 1;
+}
+
+static int read_u64(FILE *file, uint64_t *out) {
+  unsigned char bytes[8];
+  if (!read_bytes(file, bytes, sizeof(bytes))) {
+    return 0;
+  }
+  *out = 0;
+  for (int i = 7; i >= 0; --i) {
+    *out = (*out << 8) | bytes[i];
+  }
+  return 1;
+}
+
+static void add_edge(struct snapshot *snapshot, uint32_t from, uint32_t to) {
+  snapshot->edges =
+      grow(snapshot->edges, sizeof(struct edge), snapshot->edge_count, &snapshot->edge_capacity);
+  snapshot->edges[snapshot->edge_count].from = from;
+  snapshot->edges[snapshot->edge_count].to = to;
+  snapshot->edge_count++;
+}
+
+// Returns 0 and prints an error if the snapshot is malformed.
+static int read_snapshot(FILE *file, struct snapshot *snapshot) {
+  char magic[8];
+  uint32_t version;
+  if (!read_bytes(file, magic, sizeof(magic)) || memcmp(magic, GC_SNAPSHOT_MAGIC, 8) != 0 ||
+      !read_u32(file, &version)) {
+    fprintf(stderr, "gc_snapshot: not a heap snapshot\n");
+    return 0;
+  }
+
+  if (version != GC_SNAPSHOT_VERSION) {
+    fprintf(stderr, "gc_snapshot: unsupported snapshot version %u\n", version);
+    return 0;
+  }
+
+  uint64_t object_edges = 0;
+  int have_object = 0;
+  for (;;) {
+    unsigned tag;
+    if (!read_u8(file, &tag)) {
+      fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+      return 0;
+    }
+
+    uint32_t id;
+    uint32_t other;
+    uint64_t size;
+    unsigned space;
+    unsigned kind;
+    uint64_t object_count;
+    uint64_t edge_count;
+
+    switch (tag) {
+      case GC_SNAPSHOT_END:
+        if (!read_u64(file, &object_count) || !read_u64(file, &edge_count)) {
+          fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+          return 0;
+        }
+        if (object_count != snapshot->count || edge_count != object_edges) {
+          fprintf(stderr, "gc_snapshot: snapshot is inconsistent\n");
+          return 0;
+        }
+        return 1;
+
+      case GC_SNAPSHOT_ROOT:
+        if (!read_u32(file, &id) || !read_u8(file, &kind)) {
+          fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+          return 0;
+        }
+        snapshot->roots = grow(snapshot->roots, sizeof(uint32_t), snapshot->root_count,
+                               &snapshot->root_capacity);
+        snapshot->roots[snapshot->root_count++] = id;
+        break;
+
+      case GC_SNAPSHOT_OBJECT:
+        if (!read_u32(file, &id) || !read_u64(file, &size) || !read_u8(file, &space) ||
+            !read_u8(file, &kind)) {
+          fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+          return 0;
+        }
+        if (snapshot->count == snapshot->capacity) {
+          snapshot->capacity = snapshot->capacity ? snapshot->capacity * 2 : 64;
+          snapshot->ids = xrealloc(snapshot->ids, snapshot->capacity * sizeof(uint32_t));
+          snapshot->sizes = xrealloc(snapshot->sizes, snapshot->capacity * sizeof(uint64_t));
+          snapshot->spaces = xrealloc(snapshot->spaces, snapshot->capacity);
+        }
+        snapshot->ids[snapshot->count] = id;
+        snapshot->sizes[snapshot->count] = size;
+        snapshot->spaces[snapshot->count] = (unsigned char)space;
+        snapshot->count++;
+        have_object = 1;
+        break;
+
+      case GC_SNAPSHOT_EDGE:
+        if (!read_u32(file, &other)) {
+          fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+          return 0;
+        }
+        if (!have_object) {
+          fprintf(stderr, "gc_snapshot: edge before the first object\n");
+          return 0;
+        }
+        add_edge(snapshot, snapshot->ids[snapshot->count - 1], other);
+        object_edges++;
+        break;
+
+      case GC_SNAPSHOT_EPHEMERON:
+        if (!read_u32(file, &id) || !read_u32(file, &other)) {
+          fprintf(stderr, "gc_snapshot: snapshot is truncated\n");
+          return 0;
+        }
+        add_edge(snapshot, id, other);
+        break;
+
+      default:
+        fprintf(stderr, "gc_snapshot: unknown record %u\n", tag);
+        return 0;
+    }
+  }
+}
+
+// Builds compressed sparse rows from `count` (from, to) pairs over `nodes` nodes.
+static void build_rows(size_t nodes, const uint32_t *from, const uint32_t *to, size_t count,
+                       uint32_t **start_out, uint32_t **items_out) {
+  uint32_t *start = xcalloc(nodes + 1, sizeof(uint32_t));
+  uint32_t *items = xcalloc(count, sizeof(uint32_t));
+
+  for (size_t i = 0; i < count; ++i) {
+    start[from[i] + 1]++;
+  }
+  for (size_t i = 0; i < nodes; ++i) {
+    start[i + 1] += start[i];
+  }
+
+  uint32_t *cursor = xcalloc(nodes, sizeof(uint32_t));
+  memcpy(cursor, start, nodes * sizeof(uint32_t));
+  for (size_t i = 0; i < count; ++i) {
+    items[cursor[from[i]]++] = to[i];
+  }
+  free(cursor);
+
+  *start_out = start;
+  *items_out = items;
+}
+
+static void build_graph(struct snapshot *snapshot, struct graph *graph) {
+  size_t count = snapshot->count;
+  uint32_t root = (uint32_t)count;
+  graph->count = count;
+
+  uint32_t max_id = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (snapshot->ids[i] > max_id) {
+      max_id = snapshot->ids[i];
+    }
+  }
+
+  uint32_t *index_of = xcalloc((size_t)max_id + 1, sizeof(uint32_t));
+  for (size_t i = 0; i <= max_id; ++i) {
+    index_of[i] = UNDEFINED;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    index_of[snapshot->ids[i]] = (uint32_t)i;
+  }
+
+  size_t capacity = snapshot->edge_count + snapshot->root_count;
+  uint32_t *from = xcalloc(capacity, sizeof(uint32_t));
+  uint32_t *to = xcalloc(capacity, sizeof(uint32_t));
+  size_t edges = 0;
+
+  for (size_t i = 0; i < snapshot->root_count; ++i) {
+    uint32_t id = snapshot->roots[i];
+    if (id <= max_id && index_of[id] != UNDEFINED) {
+      from[edges] = root;
+      to[edges] = index_of[id];
+      edges++;
+    }
+  }
+
+  // References to objects that aren't in the snapshot (such as ones awaiting finalization) are
+  // dropped.
+  for (size_t i = 0; i < snapshot->edge_count; ++i) {
+    struct edge *edge = &snapshot->edges[i];
+    if (edge->from <= max_id && edge->to <= max_id && index_of[edge->from] != UNDEFINED &&
+        index_of[edge->to] != UNDEFINED) {
+      from[edges] = index_of[edge->from];
+      to[edges] = index_of[edge->to];
+      edges++;
+    }
+  }
+
+  build_rows(count + 1, from, to, edges, &graph->succ_start, &graph->succ);
+  build_rows(count + 1, to, from, edges, &graph->pred_start, &graph->pred);
+
+  free(from);
+  free(to);
+  free(index_of);
+}
+
+// Numbers the nodes reachable from the root in postorder.
+static void number_postorder(struct graph *graph) {
+  size_t nodes = graph->count + 1;
+  uint32_t root = (uint32_t)graph->count;
+
+  graph->post = xcalloc(nodes, sizeof(uint32_t));
+  graph->order = xcalloc(nodes, sizeof(uint32_t));
+  for (size_t i = 0; i < nodes; ++i) {
+    graph->post[i] = UNDEFINED;
+  }
+
+  // Each stack entry is a node and the position of the next successor to visit.
+  uint32_t *stack = xcalloc(nodes, sizeof(uint32_t));
+  uint32_t *next = xcalloc(nodes, sizeof(uint32_t));
+  unsigned char *visited = xcalloc(nodes, 1);
+  size_t depth = 0;
+  uint32_t numbered = 0;
+
+  stack[depth++] = root;
+  next[root] = graph->succ_start[root];
+  visited[root] = 1;
+
+  while (depth) {
+    uint32_t node = stack[depth - 1];
+    if (next[node] < graph->succ_start[node + 1]) {
+      uint32_t succ = graph->succ[next[node]++];
+      if (!visited[succ]) {
+        visited[succ] = 1;
+        next[succ] = graph->succ_start[succ];
+        stack[depth++] = succ;
+      }
+      continue;
+    }
+
+    graph->post[node] = numbered;
+    graph->order[numbered] = node;
+    numbered++;
+    depth--;
+  }
+
+  graph->reachable = numbered;
+
+  free(stack);
+  free(next);
+  free(visited);
+}
+
+static uint32_t intersect(struct graph *graph, uint32_t a, uint32_t b) {
+  while (a != b) {
+    while (graph->post[a] < graph->post[b]) {
+      a = graph->idom[a];
+    }
+    while (graph->post[b] < graph->post[a]) {
+      b = graph->idom[b];
+    }
+  }
+  return a;
+}
+
+static void compute_dominators(struct graph *graph) {
+  size_t nodes = graph->count + 1;
+  uint32_t root = (uint32_t)graph->count;
+
+  graph->idom = xcalloc(nodes, sizeof(uint32_t));
+  for (size_t i = 0; i < nodes; ++i) {
+    graph->idom[i] = UNDEFINED;
+  }
+  graph->idom[root] = root;
+
+  // The root is last in postorder, so walking backwards from the one before it visits nodes in
+  // reverse postorder.
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t i = graph->reachable - 1; i-- > 0;) {
+      uint32_t node = graph->order[i];
+      uint32_t idom = UNDEFINED;
+
+      for (uint32_t j = graph->pred_start[node]; j < graph->pred_start[node + 1]; ++j) {
+        uint32_t pred = graph->pred[j];
+        if (graph->idom[pred] == UNDEFINED) {
+          continue;
+        }
+        idom = idom == UNDEFINED ? pred : intersect(graph, pred, idom);
+      }
+
+      if (graph->idom[node] != idom) {
+        graph->idom[node] = idom;
+        changed = 1;
+      }
+    }
+  }
+}
+
+// A node's dominator always comes after it in postorder, so a single pass in postorder adds every
+// node's retained size to its dominator's after the node's own is complete.
+static void compute_retained(struct snapshot *snapshot, struct graph *graph) {
+  size_t nodes = graph->count + 1;
+  graph->retained = xcalloc(nodes, sizeof(uint64_t));
+
+  for (size_t i = 0; i + 1 < graph->reachable; ++i) {
+    uint32_t node = graph->order[i];
+    graph->retained[node] += snapshot->sizes[node];
+    graph->retained[graph->idom[node]] += graph->retained[node];
+  }
+}
+
+struct ranked {
+  uint64_t retained;
+  uint32_t node;
+};
+
+static int compare_ranked(const void *a, const void *b) {
+  uint64_t left = ((const struct ranked *)a)->retained;
+  uint64_t right = ((const struct ranked *)b)->retained;
+  return left < right ? 1 : left > right ? -1 : 0;
+}
+
+static const char *space_name(unsigned space) {
+  static const char *names[] = {"young", "old", "large", "custom1",
+                                "custom2", "custom3", "custom4", "custom5"};
+  return space < 8 ? names[space] : "?";
+}
+
+static void report(struct snapshot *snapshot, struct graph *graph, size_t top) {
+  uint64_t total_bytes = 0;
+  uint64_t reachable_bytes = 0;
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    total_bytes += snapshot->sizes[i];
+    if (graph->post[i] != UNDEFINED) {
+      reachable_bytes += snapshot->sizes[i];
+    }
+  }
+
+  size_t reachable = graph->reachable - 1;
+  printf("objects:     %zu (%llu bytes)\n", snapshot->count, (unsigned long long)total_bytes);
+  printf("edges:       %zu\n", snapshot->edge_count);
+  printf("roots:       %zu\n", snapshot->root_count);
+  printf("reachable:   %zu (%llu bytes)\n", reachable, (unsigned long long)reachable_bytes);
+  printf("unreachable: %zu (%llu bytes)\n", snapshot->count - reachable,
+         (unsigned long long)(total_bytes - reachable_bytes));
+
+  struct ranked *ranked = xcalloc(reachable, sizeof(struct ranked));
+  for (size_t i = 0; i < reachable; ++i) {
+    ranked[i].node = graph->order[i];
+    ranked[i].retained = graph->retained[ranked[i].node];
+  }
+  qsort(ranked, reachable, sizeof(struct ranked), compare_ranked);
+
+  if (top > reachable) {
+    top = reachable;
+  }
+
+  printf("\n%16s %12s %-8s %10s %10s\n", "retained", "size", "space", "id", "dominator");
+  for (size_t i = 0; i < top; ++i) {
+    uint32_t node = ranked[i].node;
+    uint32_t idom = graph->idom[node];
+    printf("%16llu %12llu %-8s %10u ", (unsigned long long)graph->retained[node],
+           (unsigned long long)snapshot->sizes[node], space_name(snapshot->spaces[node]),
+           snapshot->ids[node]);
+    if (idom == graph->count) {
+      printf("%10s\n", "(root)");
+    } else {
+      printf("%10u\n", snapshot->ids[idom]);
+    }
+  }
+
+  free(ranked);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: gc_snapshot [-n count] snapshot\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  size_t top = 20;
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      top = strtoul(argv[++i], NULL, 10);
+    } else if (!path && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      usage();
+    }
+  }
+
+  if (!path) {
+    usage();
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+
+  struct snapshot snapshot = {0};
+  int ok = read_snapshot(file, &snapshot);
+  fclose(file);
+  if (!ok) {
+    return 1;
+  }
+
+  struct graph graph = {0};
+  build_graph(&snapshot, &graph);
+  number_postorder(&graph);
+  compute_dominators(&graph);
+  compute_retained(&snapshot, &graph);
+  report(&snapshot, &graph, top);
+
+  free(graph.succ_start);
+  free(graph.succ);
+  free(graph.pred_start);
+  free(graph.pred);
+  free(graph.post);
+  free(graph.order);
+  free(graph.idom);
+  free(graph.retained);
+  free(snapshot.ids);
+  free(snapshot.sizes);
+  free(snapshot.spaces);
+  free(snapshot.edges);
+  free(snapshot.roots);
+  return 0;
+}